@@ -2,72 +2,17 @@
 #include "protocol.h"  // Добавляем для новых типов сообщений
 #include <string.h>
 
-// Mock функция для определения размера сообщений по типу
+// Размер сообщения по типу (protocol_schema.h); у сообщений переменной длины -
+// минимальный, с пустым списком элементов
 int buffer_protocol_expected_size(uint8_t type, uint32_t* out_size) {
     if (!out_size)
         return -1;
 
-    switch (type) {
-        /* Базовые сообщения */
-        case CLIENT_ERROR:
-        case SERVER_ERROR:
-        case CLIENT_SUCCESS:
-        case SERVER_SUCCESS:
-            // Переменная длина - минимальный размер 2 байта (тип + длина)
-            *out_size = 2;
-            return 0;
-
-        case SERVER_HANDSHAKE_START:
-            *out_size = 1 + sizeof(HandshakeStartPayload);
-            return 0;
-
-        case SERVER_HANDSHAKE_END:
-            *out_size = 1 + sizeof(HandshakeEndPayload);
-            return 0;
-
-        /* Сообщения стримов */
-        case CLIENT_STREAM_CREATE:
-            *out_size = 1 + sizeof(StreamCreatePayload);
-            return 0;
-
-        case CLIENT_STREAM_DELETE:
-        case CLIENT_STREAM_CONN_JOIN:
-        case CLIENT_STREAM_CONN_LEAVE:
-        case SERVER_STREAM_CREATED:
-        case SERVER_STREAM_DELETED:
-        case SERVER_STREAM_CONN_JOINED:
-        case SERVER_STREAM_START:
-        case SERVER_STREAM_END:
-            *out_size = 1 + sizeof(StreamIDPayload);
-            return 0;
-
-        /* Сообщения звонков */
-        case CLIENT_CALL_CREATE:
-            *out_size = 1;  // Только тип
-            return 0;
-
-        case CLIENT_CALL_CONN_JOIN:
-        case CLIENT_CALL_CONN_LEAVE:
-            *out_size = 1 + sizeof(CallJoinPayload);
-            return 0;
-
-        case SERVER_CALL_CREATED:
-        case SERVER_CALL_CONN_NEW:
-        case SERVER_CALL_CONN_LEFT:
-        case SERVER_CALL_STREAM_NEW:
-        case SERVER_CALL_STREAM_DELETED:
-            *out_size = 1 + sizeof(IDPayload);
-            return 0;
-
-        case SERVER_CALL_CONN_JOINED:
-            // Переменная длина - зависит от количества участников и стримов
-            // Минимальный размер: тип + call_id + participant_count + stream_count
-            *out_size = 1 + sizeof(uint32_t) + 1 + 1;
-            return 0;
-
-        default:
-            return -1;  // Неизвестный тип сообщения
-    }
+    const ProtocolMessageInfo* info = protocol_message_info(type);
+    if (!info)
+        return -1;  // Неизвестный тип сообщения
+    *out_size = 1 + info->header_size;
+    return 0;
 }
 
 // Добавить в начало buffer_logic.c
@@ -115,6 +60,66 @@ void buffer_protocol_consume(Buffer* buf) {
     }
 }
 
+// Размер сообщения FRAMING_LEGACY: у сообщений переменной длины - по их заголовку,
+// у остальных - по типу. 1 - размер известен, 0 - заголовок еще не пришел
+static int buffer_protocol_legacy_size(const uint8_t* data, uint32_t avail, uint32_t* out_size) {
+    const ProtocolMessageInfo* info = protocol_message_info(data[0]);
+    if (info && info->entry_size) {
+        uint32_t payload_size = 0;
+        int known = protocol_payload_size(data[0], data + 1, avail - 1, &payload_size);
+        *out_size = 1 + payload_size;
+        return known;
+    }
+    return current_resolver(data[0], out_size) == 0 ? 1 : -1;
+}
+
+int buffer_protocol_next_frame(const uint8_t* data, uint32_t avail, uint8_t framing, ProtocolFrame* frame) {
+    if (!data || !frame)
+        return -3;
+
+    uint32_t header = 0;
+    uint32_t size = 0;
+    if (framing == FRAMING_LENGTH_PREFIXED) {
+        if (avail < FRAMING_HEADER_SIZE)
+            return 0;
+        header = FRAMING_HEADER_SIZE;
+        size = ((uint32_t)data[0] << 8) | data[1];
+    } else {
+        if (avail < 1)
+            return 0;
+        int known = buffer_protocol_legacy_size(data, avail, &size);
+        if (known <= 0)
+            return known;
+    }
+
+    if (size == 0 || header + size > BUFFER_SIZE)
+        return -2;
+    if (avail < header + size)
+        return 0;
+
+    frame->type = data[header];
+    frame->payload = data + header + 1;
+    frame->payload_len = size - 1;
+    frame->frame_len = header + size;
+    return 1;
+}
+
+uint8_t buffer_protocol_framing_negotiate(uint8_t requested) {
+    return requested < FRAMING_VERSION_MAX ? requested : FRAMING_VERSION_MAX;
+}
+
+void buffer_protocol_discard(Buffer* buf, uint32_t consumed) {
+    if (!buf)
+        return;
+    if (consumed >= buf->position) {
+        buf->position = 0;
+    } else if (consumed > 0) {
+        memmove(buf->data, buf->data + consumed, buf->position - consumed);
+        buf->position -= consumed;
+    }
+    buf->expected_size = 0;
+}
+
 // Добавьте в конец buffer_logic.c
 size_t buffer_get_data_size(Buffer* buf) {
     if (!buf) return 0;
@@ -2,6 +2,34 @@
 
 #include "buffer.h"
 
+// Формат TCP-сообщений (кадрирование). По умолчанию FRAMING_LEGACY: [type][payload],
+// размер выводится из типа. Клиент может запросить другой формат сообщением
+// CLIENT_FRAMING; после него входящие, а после ответа SERVER_FRAMING - исходящие
+// сообщения идут в согласованном формате.
+#define FRAMING_LEGACY           0
+#define FRAMING_LENGTH_PREFIXED  1  // [uint16_t length][type][payload], length = 1 + payload, сетевой порядок
+#define FRAMING_VERSION_MAX      FRAMING_LENGTH_PREFIXED
+#define FRAMING_HEADER_SIZE      2
+
+// Очередное сообщение потока: тип, полезная нагрузка и сколько байт оно занимает в потоке
+typedef struct {
+    uint8_t type;
+    const uint8_t* payload;
+    uint32_t payload_len;
+    uint32_t frame_len;
+} ProtocolFrame;
+
+// Ищет границу сообщения в data[0..avail). Возвращает 1 - сообщение целиком,
+// 0 - нужно больше данных, <0 - поток не разобрать (неизвестный тип в FRAMING_LEGACY,
+// пустой или больше BUFFER_SIZE кадр)
+int buffer_protocol_next_frame(const uint8_t* data, uint32_t avail, uint8_t framing, ProtocolFrame* frame);
+
+// Формат, на который сервер соглашается в ответ на запрошенную версию
+uint8_t buffer_protocol_framing_negotiate(uint8_t requested);
+
+// Снимает consumed обработанных байт с начала буфера одним сдвигом
+void buffer_protocol_discard(Buffer* buf, uint32_t consumed);
+
 // Функция для определения ожидаемого размера сообщения по его типу
 int buffer_protocol_expected_size(uint8_t type, uint32_t* out_size);
 
@@ -0,0 +1,81 @@
+#include "bwe.h"
+#include <string.h>
+
+void rate_meter_update(RateMeter* meter, size_t bytes, uint64_t now_ms) {
+    if (!meter) return;
+
+    if (meter->window_start_ms == 0) {
+        meter->window_start_ms = now_ms;
+    }
+
+    uint64_t elapsed = now_ms - meter->window_start_ms;
+    if (elapsed >= RATE_METER_WINDOW_MS) {
+        uint32_t window_bps = (uint32_t)(meter->window_bytes * 8000ull / elapsed);
+        // Первое окно берем как есть, дальше - скользящее среднее с весом 1/2
+        meter->bitrate_bps = meter->bitrate_bps ? (meter->bitrate_bps + window_bps) / 2 : window_bps;
+        meter->window_start_ms = now_ms;
+        meter->window_bytes = 0;
+    }
+
+    meter->window_bytes += bytes;
+}
+
+uint32_t rate_meter_bps(const RateMeter* meter, uint64_t now_ms) {
+    if (!meter || meter->window_start_ms == 0) return 0;
+
+    // Поток остановился - старое значение больше не верно
+    if (now_ms - meter->window_start_ms > 4 * RATE_METER_WINDOW_MS) return 0;
+    return meter->bitrate_bps;
+}
+
+void bwe_init(BandwidthEstimator* bwe) {
+    if (!bwe) return;
+    memset(bwe, 0, sizeof(*bwe));
+}
+
+void bwe_on_report(BandwidthEstimator* bwe, uint32_t packets_expected, uint32_t packets_received,
+                   uint32_t bytes_received, uint32_t interval_ms, uint64_t now_ms) {
+    if (!bwe || interval_ms == 0) return;
+
+    // Пакеты, которые сервер сам не отправил, получатель видит пропусками номеров
+    uint32_t gaps = packets_expected > packets_received ? packets_expected - packets_received : 0;
+    packets_expected -= gaps < bwe->dropped_since_report ? gaps : bwe->dropped_since_report;
+    bwe->dropped_since_report = 0;
+
+    if (packets_received > packets_expected) {
+        packets_expected = packets_received;
+    }
+    uint32_t lost = packets_expected - packets_received;
+    uint16_t loss = packets_expected ? (uint16_t)((uint64_t)lost * 1000 / packets_expected) : 0;
+    uint32_t receive_rate = (uint32_t)((uint64_t)bytes_received * 8000ull / interval_ms);
+
+    // Потери выше порога - канал не тянет: опускаемся ниже фактической скорости приема.
+    // Почти без потерь - осторожно растем, но не ниже того, что получатель уже принял.
+    uint64_t estimate = bwe->estimate_bps ? bwe->estimate_bps : receive_rate;
+    if (loss > BWE_LOSS_DECREASE_PERMILLE) {
+        if (estimate > receive_rate) estimate = receive_rate;
+        estimate = estimate * (2000 - loss) / 2000;
+    } else if (loss < BWE_LOSS_INCREASE_PERMILLE) {
+        estimate = estimate * 105 / 100;
+        if (estimate < receive_rate) estimate = receive_rate;
+    }
+
+    bwe->estimate_bps = estimate > UINT32_MAX ? UINT32_MAX : (uint32_t)estimate;
+    bwe->receive_rate_bps = receive_rate;
+    bwe->loss_permille = loss;
+    bwe->last_report_ms = now_ms;
+    bwe->reports++;
+}
+
+bool bwe_update_congestion(BandwidthEstimator* bwe, uint32_t demand_bps) {
+    if (!bwe) return false;
+
+    bwe->demand_bps = demand_bps;
+
+    // Запас 10%, чтобы шум измерений на границе не переключал режим
+    bool congested = bwe->reports > 0 &&
+                     (uint64_t)bwe->estimate_bps + bwe->estimate_bps / 10 < demand_bps;
+    bool changed = congested != bwe->congested;
+    bwe->congested = congested;
+    return changed;
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Окно измерения входящего битрейта стрима
+#ifndef RATE_METER_WINDOW_MS
+#define RATE_METER_WINDOW_MS 500
+#endif
+
+// Оценка считается устаревшей, если отчетов нет дольше этого времени
+#ifndef BWE_REPORT_TIMEOUT_MS
+#define BWE_REPORT_TIMEOUT_MS 3000
+#endif
+
+// Пороги потерь (в промилле): выше - снижаем оценку, ниже - растим
+#define BWE_LOSS_DECREASE_PERMILLE 100
+#define BWE_LOSS_INCREASE_PERMILLE 20
+
+// Битрейт по окнам фиксированной длины со сглаживанием
+typedef struct {
+    uint64_t window_start_ms;
+    uint64_t window_bytes;
+    uint32_t bitrate_bps;
+} RateMeter;
+
+void rate_meter_update(RateMeter* meter, size_t bytes, uint64_t now_ms);
+uint32_t rate_meter_bps(const RateMeter* meter, uint64_t now_ms);
+
+// Оценка пропускной способности канала до получателя по его отчетам
+typedef struct {
+    uint32_t estimate_bps;       // 0 - отчетов еще не было
+    uint32_t receive_rate_bps;   // скорость приема из последнего отчета
+    uint32_t demand_bps;         // суммарный битрейт стримов, которые смотрит получатель
+    uint16_t loss_permille;      // потери из последнего отчета
+    bool congested;              // оценка ниже потребности - отбрасываем droppable пакеты
+    uint64_t last_report_ms;
+    uint64_t reports;
+    uint64_t dropped_packets;    // отброшено droppable пакетов для этого получателя
+    uint32_t dropped_since_report; // они дают пропуски номеров - это не потери канала
+} BandwidthEstimator;
+
+void bwe_init(BandwidthEstimator* bwe);
+
+// Отчет получателя за интервал: ожидалось/получено пакетов, байт, длительность
+void bwe_on_report(BandwidthEstimator* bwe, uint32_t packets_expected, uint32_t packets_received,
+                   uint32_t bytes_received, uint32_t interval_ms, uint64_t now_ms);
+
+// Сравнение оценки с потребностью; возвращает true, если состояние перегрузки изменилось
+bool bwe_update_congestion(BandwidthEstimator* bwe, uint32_t demand_bps);
+
+// Отбрасывать ли droppable пакеты сейчас (без свежих отчетов - никогда)
+static inline bool bwe_should_drop(const BandwidthEstimator* bwe, uint64_t now_ms) {
+    return bwe->congested && now_ms - bwe->last_report_ms <= BWE_REPORT_TIMEOUT_MS;
+}
+
+static inline void bwe_count_drop(BandwidthEstimator* bwe) {
+    bwe->dropped_packets++;
+    bwe->dropped_since_report++;
+}
@@ -1,10 +1,12 @@
 #include "call.h"
 #include "id_utils.h"
+#include "cluster.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 
 Call* calls = NULL;
+int call_mixing_count = 0;
 
 /* Внутренние функции */
 static Call* call_alloc(uint32_t call_id) {
@@ -14,6 +16,15 @@ static Call* call_alloc(uint32_t call_id) {
     call->call_id = call_id;
     DENSE_ARRAY_INIT(call->participants, MAX_CALL_PARTICIPANTS);
     DENSE_ARRAY_INIT(call->streams, MAX_CALL_STREAMS);
+    DENSE_ARRAY_INIT(call->active_speakers, CALL_ACTIVE_SPEAKERS);
+    call->speakers_updated_ms = 0;
+    call->mixing = false;
+    call->mix_stream_id = 0;
+    call->mix_sequence = 0;
+    call->mix_next_ms = 0;
+    // Случайное начало: клиент, знавший прежний звонок с тем же ID, не примет чужой журнал за свой
+    call->version = generate_id();
+    call->change_count = 0;
     
     return call;
 }
@@ -23,8 +34,13 @@ static void call_free(Call* call) {
     free(call);
 }
 
+// В кластере ID выбирается из части кольца этого узла: звонок остается у создателя
 static uint32_t call_generate_id(void) {
-    return generate_id();
+    uint32_t call_id;
+    do {
+        call_id = generate_id();
+    } while (!cluster_owns_call(call_id));
+    return call_id;
 }
 
 static int call_add_to_registry(Call* call) {
@@ -48,7 +64,9 @@ static void call_remove_from_registry(Call* call) {
 
 static int call_add_participant_to_array(Call* call, Connection* participant) {
     if (!call || !participant) return -1;
-    return DENSE_ARRAY_ADD(call->participants, MAX_CALL_PARTICIPANTS, participant);
+    int index = DENSE_ARRAY_ADD(call->participants, MAX_CALL_PARTICIPANTS, participant);
+    if (index >= 0) call->subscribed[index] = false;  // флаг мог остаться от прежнего участника
+    return index;
 }
 
 static int call_remove_participant_from_array(Call* call, Connection* participant) {
@@ -83,6 +101,7 @@ int call_remove_participant_safe(Call* call, Connection* participant) {
     int index = DENSE_ARRAY_INDEX_OF(call->participants, MAX_CALL_PARTICIPANTS, participant);
     if (index >= 0) {
         call->participants[index] = NULL;
+        call_log_change(call, CALL_CHANGE_CONN_LEFT, (uint32_t)participant->fd);
         return 0;
     }
     return -1;
@@ -144,11 +163,27 @@ void call_delete(Call* call) {
         }
     }
 
+    call_set_mixing(call, false);
+
     // 3. Удаляем из реестра и освобождаем память
     call_remove_from_registry(call);
     call_free(call);
 }
 
+int call_set_subscribed(Call* call, const Connection* participant, bool subscribed) {
+    if (!call || !participant) return -1;
+    int index = DENSE_ARRAY_INDEX_OF(call->participants, MAX_CALL_PARTICIPANTS, participant);
+    if (index < 0) return -2;
+    call->subscribed[index] = subscribed;
+    return 0;
+}
+
+bool call_is_subscribed(const Call* call, const Connection* participant) {
+    if (!call || !participant) return false;
+    int index = DENSE_ARRAY_INDEX_OF(call->participants, MAX_CALL_PARTICIPANTS, participant);
+    return index >= 0 && call->subscribed[index];
+}
+
 int call_add_participant(Call* call, Connection* participant) {
     if (!call || !participant) return -1;
     
@@ -171,17 +206,18 @@ int call_add_participant(Call* call, Connection* participant) {
     }
     
     // Добавляем в массив участников звонка
-    if (call_add_participant_to_array(call, participant) != 0) {
+    if (call_add_participant_to_array(call, participant) < 0) {
         return -3;
     }
     
     // Добавляем звонок в calls участника
-    if (connection_add_call(participant, call) != 0) {
+    if (connection_add_call(participant, call) < 0) {
         // Откатываем добавление в массив участников
         call_remove_participant_from_array(call, participant);
         return -4;
     }
     
+    call_log_change(call, CALL_CHANGE_CONN_NEW, (uint32_t)participant->fd);
     printf("Added participant fd=%d to call %u\n", participant->fd, call->call_id);
     
     return 0;
@@ -228,13 +264,14 @@ int call_add_stream(Call* call, Stream* stream) {
     }
     
     // Добавляем в массив стримов звонка
-    if (call_add_stream_to_array(call, stream) != 0) {
+    if (call_add_stream_to_array(call, stream) < 0) {
         printf("Failed to add stream %u to call %u array\n", stream->stream_id, call->call_id);
         return -4;
     }
     
     // Устанавливаем call для стрима
     stream->call = call;
+    call_log_change(call, CALL_CHANGE_STREAM_NEW, stream->stream_id);
     
     printf("Added stream %u to call %u\n", stream->stream_id, call->call_id);
     
@@ -250,7 +287,10 @@ int call_remove_stream(Call* call, Stream* stream) {
     }
     
     // Снимаем call со стрима
+    DENSE_ARRAY_REMOVE(call->active_speakers, CALL_ACTIVE_SPEAKERS, stream);
     stream->call = NULL;
+    stream->speaker_rank = 0;
+    call_log_change(call, CALL_CHANGE_STREAM_DELETED, stream->stream_id);
     
     printf("Removed stream %u from call %u\n", stream->stream_id, call->call_id);
     
@@ -266,6 +306,60 @@ int call_get_stream_count(const Call* call) {
     return (int)DENSE_ARRAY_COUNT(call->streams, MAX_CALL_STREAMS);
 }
 
+void call_log_change(Call* call, CallChangeType type, uint32_t id) {
+    if (!call) return;
+    call->version++;
+    CallChange* change = &call->changes[call->version % CALL_CHANGE_LOG];
+    change->version = call->version;
+    change->type = (uint8_t)type;
+    change->id = id;
+    if (call->change_count < CALL_CHANGE_LOG) call->change_count++;
+}
+
+static bool call_change_is_stream(uint8_t type) {
+    return type == CALL_CHANGE_STREAM_NEW || type == CALL_CHANGE_STREAM_DELETED;
+}
+
+// Пара, в которой второе изменение отменяет первое
+static bool call_change_cancels(const CallChange* earlier, const CallChange* later) {
+    return earlier->id == later->id &&
+           ((earlier->type == CALL_CHANGE_CONN_NEW && later->type == CALL_CHANGE_CONN_LEFT) ||
+            (earlier->type == CALL_CHANGE_STREAM_NEW && later->type == CALL_CHANGE_STREAM_DELETED));
+}
+
+int call_changes_since(const Call* call, uint32_t known, CallChange* out, int max) {
+    if (!call || !out) return -1;
+    // Разность по модулю 2^32: переполнение версии журналу не мешает
+    uint32_t behind = call->version - known;
+    if (behind > call->change_count) return -1;
+
+    int count = 0;
+    for (uint32_t version = known + 1; version != call->version + 1; version++) {
+        const CallChange* change = &call->changes[version % CALL_CHANGE_LOG];
+        int cancelled = -1;
+        for (int i = count - 1; i >= 0; i--) {
+            if (out[i].id != change->id || call_change_is_stream(out[i].type) != call_change_is_stream(change->type))
+                continue;
+            if (call_change_cancels(&out[i], change)) cancelled = i;
+            break;  // решает последнее изменение того же участника или стрима
+        }
+        if (cancelled >= 0) {
+            memmove(&out[cancelled], &out[cancelled + 1], (count - cancelled - 1) * sizeof(CallChange));
+            count--;
+            continue;
+        }
+        if (count == max) return -1;
+        out[count++] = *change;
+    }
+    return count;
+}
+
+void call_reset_changes(Call* call, uint32_t version) {
+    if (!call) return;
+    call->version = version;
+    call->change_count = 0;
+}
+
 Call* call_find_by_id(uint32_t call_id) {
     Call* call = NULL;
     HASH_FIND_INT(calls, &call_id, call);
@@ -331,4 +425,80 @@ bool call_can_add_stream(const Call* call) {
         }
     }
     return false;
-}
\ No newline at end of file
+}
+
+bool call_update_active_speakers(Call* call, uint64_t now_ms) {
+    if (!call) return false;
+
+    Stream* audio[MAX_CALL_STREAMS];
+    uint16_t levels[MAX_CALL_STREAMS];
+    uint8_t prev_rank[MAX_CALL_STREAMS];
+    uint8_t rank[MAX_CALL_STREAMS];
+    int count = 0;
+
+    for (int i = 0; i < MAX_CALL_STREAMS; i++) {
+        Stream* stream = call->streams[i];
+        if (!stream || !stream->is_audio) continue;
+        audio[count] = stream;
+        levels[count] = audio_level_current(&stream->audio_level, now_ms);
+        prev_rank[count] = stream->speaker_rank;
+        count++;
+    }
+
+    speaker_rank(levels, prev_rank, count, CALL_ACTIVE_SPEAKERS, rank);
+
+    Stream* speakers[CALL_ACTIVE_SPEAKERS];
+    DENSE_ARRAY_INIT(speakers, CALL_ACTIVE_SPEAKERS);
+    for (int i = 0; i < count; i++) {
+        audio[i]->speaker_rank = rank[i];
+        if (rank[i] <= CALL_ACTIVE_SPEAKERS) {
+            speakers[rank[i] - 1] = audio[i];
+        }
+    }
+    call->speakers_updated_ms = now_ms;
+
+    // Сравниваем наборы, а не порядок: перестановка внутри набора не уведомляется
+    bool changed = DENSE_ARRAY_COUNT(speakers, CALL_ACTIVE_SPEAKERS) !=
+                   DENSE_ARRAY_COUNT(call->active_speakers, CALL_ACTIVE_SPEAKERS);
+    for (int i = 0; i < CALL_ACTIVE_SPEAKERS && !changed; i++) {
+        if (speakers[i] && !DENSE_ARRAY_CONTAINS(call->active_speakers, CALL_ACTIVE_SPEAKERS, speakers[i])) {
+            changed = true;
+        }
+    }
+
+    memcpy(call->active_speakers, speakers, sizeof(speakers));
+    return changed;
+}
+
+bool call_should_forward_audio(const Stream* stream, const Connection* recipient) {
+    if (!stream || !stream->call || !stream->is_audio) return true;
+
+    // Ранги еще не считались - пересылаем всем
+    if (stream->speaker_rank == 0 || stream->speaker_rank <= CALL_ACTIVE_SPEAKERS) return true;
+    if (stream->speaker_rank > CALL_ACTIVE_SPEAKERS + 1) return false;
+
+    // Следующий за набором стрим нужен тем, чей собственный голос в наборе:
+    // себя они не слышат, и им остается только CALL_ACTIVE_SPEAKERS - 1 чужих
+    for (int i = 0; i < MAX_OUTPUT; i++) {
+        const Stream* own = recipient->own_streams[i];
+        if (own && own->call == stream->call && own->is_audio &&
+            own->speaker_rank != 0 && own->speaker_rank <= CALL_ACTIVE_SPEAKERS) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void call_set_mixing(Call* call, bool enabled) {
+    if (!call || call->mixing == enabled) return;
+
+    call->mixing = enabled;
+    if (enabled) {
+        call->mix_stream_id = generate_id();
+        call->mix_next_ms = 0;
+        call_mixing_count++;
+    } else {
+        call_mixing_count--;
+    }
+    printf("Call %u audio mixing %s\n", call->call_id, enabled ? "enabled" : "disabled");
+}
@@ -6,18 +6,56 @@
 #include "dense_array.h"
 #include "connection.h"
 #include "stream.h"
+#include "speaker.h"
 
-#define MAX_CALL_PARTICIPANTS 4
-#define MAX_CALL_STREAMS 4
+// Аудио пересылается только активным говорящим (CALL_ACTIVE_SPEAKERS),
+// поэтому исходящий трафик растет линейно, а не квадратично с размером звонка
+#ifndef MAX_CALL_PARTICIPANTS
+#define MAX_CALL_PARTICIPANTS 16
+#endif
+#ifndef MAX_CALL_STREAMS
+#define MAX_CALL_STREAMS 32
+#endif
+
+// Журнал изменений состава звонка (CLIENT_CALL_SYNC): каждое изменение участников
+// и стримов увеличивает версию звонка, последние CALL_CHANGE_LOG изменений хранятся.
+// Клиент с версией из журнала получает только изменения после нее, иначе - все состояние
+#ifndef CALL_CHANGE_LOG
+#define CALL_CHANGE_LOG 64
+#endif
+
+typedef enum {
+    CALL_CHANGE_CONN_NEW = 0,
+    CALL_CHANGE_CONN_LEFT,
+    CALL_CHANGE_STREAM_NEW,
+    CALL_CHANGE_STREAM_DELETED,
+} CallChangeType;
+
+typedef struct {
+    uint32_t version;   // версия звонка после изменения
+    uint8_t type;       // CallChangeType
+    uint32_t id;        // connection_id или stream_id
+} CallChange;
 
 typedef struct Call {
     uint32_t call_id;
     Connection* participants[MAX_CALL_PARTICIPANTS];
+    bool subscribed[MAX_CALL_PARTICIPANTS];  // участник на том же месте получает все стримы звонка, включая будущие
     Stream* streams[MAX_CALL_STREAMS];
+    Stream* active_speakers[CALL_ACTIVE_SPEAKERS];  // от самого громкого
+    uint64_t speakers_updated_ms;
+    bool mixing;                  // аудио участников смешивается сервером (MCU)
+    uint32_t mix_stream_id;       // stream_id, с которым участникам приходит микс
+    uint32_t mix_sequence;
+    uint64_t mix_next_ms;         // время следующего кадра микшера
+    uint32_t version;             // растет с каждым изменением участников и стримов
+    uint32_t change_count;        // изменений в журнале (не больше CALL_CHANGE_LOG)
+    CallChange changes[CALL_CHANGE_LOG];  // кольцо: изменение с версией v - в changes[v % CALL_CHANGE_LOG]
     UT_hash_handle hh;
 } Call;
 
 extern Call* calls;
+extern int call_mixing_count;  // звонков в режиме микширования
 
 /* Основные операции жизненного цикла */
 Call* call_new(uint32_t call_id);
@@ -29,12 +67,24 @@ int call_remove_participant(Call* call, Connection* participant);
 bool call_has_participant(const Call* call, const Connection* participant);
 int call_get_participant_count(const Call* call);
 
+/* Подписка участника на все стримы звонка (CLIENT_CALL_SUBSCRIBE) */
+int call_set_subscribed(Call* call, const Connection* participant, bool subscribed);
+bool call_is_subscribed(const Call* call, const Connection* participant);
+
 /* Управление стримами */
 int call_add_stream(Call* call, Stream* stream);
 int call_remove_stream(Call* call, Stream* stream);
 bool call_has_stream(const Call* call, const Stream* stream);
 int call_get_stream_count(const Call* call);
 
+/* Версия состава и журнал изменений */
+void call_log_change(Call* call, CallChangeType type, uint32_t id);
+// Изменения после версии known, взаимно отмененные (вход и выход, создание и удаление)
+// выброшены. -1 - журнал не покрывает known (усечен или версия чужая): нужно все состояние
+int call_changes_since(const Call* call, uint32_t known, CallChange* out, int max);
+// Журнал с чистого листа на версии version (восстановление из снимка)
+void call_reset_changes(Call* call, uint32_t version);
+
 /* Поиск */
 Call* call_find_by_id(uint32_t call_id);
 int call_find_by_participant(const Connection* participant, Call** result, int max_results);
@@ -45,4 +95,11 @@ Stream* call_find_stream_by_id(const Call* call, uint32_t stream_id);
 
 bool call_can_add_participant(const Call* call);
 bool call_can_add_stream(const Call* call);
+
+/* Активные говорящие */
+bool call_update_active_speakers(Call* call, uint64_t now_ms);
+bool call_should_forward_audio(const Stream* stream, const Connection* recipient);
+
+/* Микширование аудио на сервере */
+void call_set_mixing(Call* call, bool enabled);
 int call_remove_participant_safe(Call* call, Connection* participant);
\ No newline at end of file
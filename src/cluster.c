@@ -0,0 +1,144 @@
+#include "cluster.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+static ClusterNode nodes[CLUSTER_MAX_NODES];
+static uint32_t node_count = 0;
+static uint32_t self_index = 0;
+
+static ClusterRingPoint* ring = NULL;
+static uint32_t ring_size = 0;
+
+static uint64_t redirects = 0;
+
+// fmix64 из MurmurHash3: и точки узлов, и соседние call_id расходятся по кольцу
+static uint64_t cluster_hash(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdull;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ull;
+    key ^= key >> 33;
+    return key;
+}
+
+static int compare_points(const void* a, const void* b) {
+    uint64_t x = ((const ClusterRingPoint*)a)->point, y = ((const ClusterRingPoint*)b)->point;
+    return (x > y) - (x < y);
+}
+
+int cluster_parse_node(const char* text, ClusterNode* out) {
+    char host[64];
+    unsigned tcp_port = 0, udp_port = 0, weight = 1;
+
+    int fields = sscanf(text, "%63[^:]:%u:%u:%u", host, &tcp_port, &udp_port, &weight);
+    if (fields < 3 || tcp_port == 0 || tcp_port > 65535 || udp_port == 0 || udp_port > 65535 ||
+        weight == 0 || weight > CLUSTER_MAX_WEIGHT) {
+        return -1;
+    }
+
+    memset(out, 0, sizeof(*out));
+    out->tcp_addr.sin_family = AF_INET;
+    out->tcp_addr.sin_port = htons((uint16_t)tcp_port);
+    if (inet_pton(AF_INET, host, &out->tcp_addr.sin_addr) != 1) return -1;
+    out->udp_port = (uint16_t)udp_port;
+    out->weight = weight;
+    return 0;
+}
+
+int cluster_init(const ClusterNode* list, uint32_t count, uint32_t self) {
+    cluster_shutdown();
+    if (count == 0) return 0;
+    if (count > CLUSTER_MAX_NODES || self >= count) return -1;
+
+    uint32_t total = 0;
+    for (uint32_t n = 0; n < count; n++) total += list[n].weight * CLUSTER_VNODES;
+
+    ring = malloc(sizeof(ClusterRingPoint) * total);
+    if (!ring) return -2;
+
+    // Точки узла зависят только от его номера в списке - кольцо одинаково на всех узлах
+    for (uint32_t n = 0; n < count; n++) {
+        nodes[n] = list[n];
+        for (uint32_t v = 0; v < list[n].weight * CLUSTER_VNODES; v++) {
+            ring[ring_size].point = cluster_hash(((uint64_t)(n + 1) << 32) | v);
+            ring[ring_size].node = (uint8_t)n;
+            ring_size++;
+        }
+    }
+    qsort(ring, ring_size, sizeof(ClusterRingPoint), compare_points);
+
+    node_count = count;
+    self_index = self;
+    return 0;
+}
+
+void cluster_shutdown(void) {
+    free(ring);
+    ring = NULL;
+    ring_size = 0;
+    node_count = 0;
+    self_index = 0;
+    redirects = 0;
+}
+
+bool cluster_enabled(void) {
+    return node_count > 1;
+}
+
+uint32_t cluster_node_count(void) {
+    return node_count;
+}
+
+uint32_t cluster_self(void) {
+    return self_index;
+}
+
+const ClusterNode* cluster_node(uint32_t index) {
+    return index < node_count ? &nodes[index] : NULL;
+}
+
+// Первая точка не меньше хеша (за последней - снова первая)
+static uint32_t cluster_ring_successor(uint64_t hash) {
+    uint32_t low = 0, high = ring_size;
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        if (ring[mid].point < hash) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low == ring_size ? 0 : low;
+}
+
+uint32_t cluster_owner_of(uint32_t call_id) {
+    if (ring_size == 0) return self_index;
+    return ring[cluster_ring_successor(cluster_hash(call_id))].node;
+}
+
+bool cluster_owns_call(uint32_t call_id) {
+    return !cluster_enabled() || cluster_owner_of(call_id) == self_index;
+}
+
+uint32_t cluster_ring_share(uint32_t node) {
+    if (ring_size == 0 || node >= node_count) return 0;
+
+    // Узлу принадлежит дуга от предыдущей точки до каждой его точки
+    uint64_t owned = 0;
+    for (uint32_t i = 0; i < ring_size; i++) {
+        if (ring[i].node != node) continue;
+        uint64_t previous = ring[i == 0 ? ring_size - 1 : i - 1].point;
+        owned += (ring[i].point - previous) >> 10;  // беззнаковое вычитание замыкает кольцо
+    }
+    return (uint32_t)(owned / ((UINT64_MAX >> 10) / 1000));
+}
+
+void cluster_count_redirect(void) {
+    redirects++;
+}
+
+uint64_t cluster_redirects(void) {
+    return redirects;
+}
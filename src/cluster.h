@@ -0,0 +1,53 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <netinet/in.h>
+
+// Кластер узлов со статическим списком участников (одинаковым на всех узлах).
+// Звонок принадлежит узлу по согласованному хешированию call_id: у каждого узла
+// CLUSTER_VNODES точек на кольце на единицу веса, владелец - первая точка по часовой
+// после хеша call_id. Новый звонок создается на узле создателя (ID выбирается из его
+// части кольца), вход в чужой звонок отвечается SERVER_CALL_REDIRECT на владельца.
+
+#ifndef CLUSTER_MAX_NODES
+#define CLUSTER_MAX_NODES 16
+#endif
+
+#ifndef CLUSTER_VNODES
+#define CLUSTER_VNODES 128
+#endif
+
+#ifndef CLUSTER_MAX_WEIGHT
+#define CLUSTER_MAX_WEIGHT 16
+#endif
+
+typedef struct {
+    struct sockaddr_in tcp_addr;
+    uint16_t udp_port;
+    uint32_t weight;         // доля кольца пропорциональна весу (емкости узла)
+} ClusterNode;
+
+typedef struct {
+    uint64_t point;
+    uint8_t node;
+} ClusterRingPoint;
+
+// HOST:TCP_PORT:UDP_PORT[:WEIGHT]
+int cluster_parse_node(const char* text, ClusterNode* out);
+
+int cluster_init(const ClusterNode* nodes, uint32_t count, uint32_t self);
+void cluster_shutdown(void);
+bool cluster_enabled(void);
+uint32_t cluster_node_count(void);
+uint32_t cluster_self(void);
+const ClusterNode* cluster_node(uint32_t index);
+
+/* Владение звонками */
+uint32_t cluster_owner_of(uint32_t call_id);
+bool cluster_owns_call(uint32_t call_id);  // без кластера - всегда true
+
+// Доля кольца узла, промилле
+uint32_t cluster_ring_share(uint32_t node);
+
+void cluster_count_redirect(void);
+uint64_t cluster_redirects(void);
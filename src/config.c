@@ -0,0 +1,306 @@
+#include "config.h"
+#include "network.h"
+#include "fanout.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <arpa/inet.h>
+
+ServerConfig g_config;
+
+// Длинные опции без коротких синонимов
+enum {
+    OPT_PACING_RATE = 256,
+    OPT_PACING_BURST,
+    OPT_METRICS_INTERVAL,
+    OPT_NO_GSO,
+    OPT_UDP_GRO,
+    OPT_BUNDLE_WINDOW,
+    OPT_STREAM_STATS_INTERVAL,
+    OPT_EGRESS_QUEUE,
+    OPT_EGRESS_DROP,
+    OPT_UDP_RCVBUF,
+    OPT_UDP_SNDBUF,
+    OPT_TCP_SNDBUF,
+    OPT_NO_DSCP,
+    OPT_AUDIO_DSCP,
+    OPT_VIDEO_DSCP,
+    OPT_NO_CONTROL_THREAD,
+    OPT_FANOUT_THREADS,
+    OPT_TRUNK,
+    OPT_CLUSTER,
+    OPT_CLUSTER_SELF,
+    OPT_HANDOFF_SOCKET,
+    OPT_TAKEOVER,
+    OPT_SNAPSHOT_FILE,
+    OPT_SNAPSHOT_INTERVAL,
+    OPT_NO_EVENT_COALESCING,
+    OPT_HELP,
+};
+
+static const struct option long_options[] = {
+    {"pacing-rate",      required_argument, 0, OPT_PACING_RATE},
+    {"pacing-burst",     required_argument, 0, OPT_PACING_BURST},
+    {"metrics-interval", required_argument, 0, OPT_METRICS_INTERVAL},
+    {"no-gso",           no_argument,       0, OPT_NO_GSO},
+    {"udp-gro",          no_argument,       0, OPT_UDP_GRO},
+    {"bundle-window",    required_argument, 0, OPT_BUNDLE_WINDOW},
+    {"stream-stats-interval", required_argument, 0, OPT_STREAM_STATS_INTERVAL},
+    {"egress-queue",     required_argument, 0, OPT_EGRESS_QUEUE},
+    {"egress-drop",      required_argument, 0, OPT_EGRESS_DROP},
+    {"udp-rcvbuf",       required_argument, 0, OPT_UDP_RCVBUF},
+    {"udp-sndbuf",       required_argument, 0, OPT_UDP_SNDBUF},
+    {"tcp-sndbuf",       required_argument, 0, OPT_TCP_SNDBUF},
+    {"no-dscp",          no_argument,       0, OPT_NO_DSCP},
+    {"audio-dscp",       required_argument, 0, OPT_AUDIO_DSCP},
+    {"video-dscp",       required_argument, 0, OPT_VIDEO_DSCP},
+    {"no-control-thread", no_argument,      0, OPT_NO_CONTROL_THREAD},
+    {"fanout-threads",   required_argument, 0, OPT_FANOUT_THREADS},
+    {"trunk",            required_argument, 0, OPT_TRUNK},
+    {"cluster",          required_argument, 0, OPT_CLUSTER},
+    {"cluster-self",     required_argument, 0, OPT_CLUSTER_SELF},
+    {"handoff-socket",   required_argument, 0, OPT_HANDOFF_SOCKET},
+    {"takeover",         required_argument, 0, OPT_TAKEOVER},
+    {"snapshot-file",    required_argument, 0, OPT_SNAPSHOT_FILE},
+    {"snapshot-interval", required_argument, 0, OPT_SNAPSHOT_INTERVAL},
+    {"no-event-coalescing", no_argument,    0, OPT_NO_EVENT_COALESCING},
+    {"help",             no_argument,       0, OPT_HELP},
+    {0, 0, 0, 0}
+};
+
+static int parse_u32(const char* text, uint32_t* out) {
+    char* end = NULL;
+    unsigned long value = strtoul(text, &end, 10);
+    if (!text[0] || *end != '\0' || value > UINT32_MAX) return -1;
+    *out = (uint32_t)value;
+    return 0;
+}
+
+// HOST:TCP_PORT:UDP_PORT узла-источника
+static int parse_trunk(const char* text, ServerConfig* config) {
+    char host[sizeof(config->trunk_host)];
+    unsigned tcp_port = 0, udp_port = 0;
+    struct in_addr addr;
+
+    if (sscanf(text, "%63[^:]:%u:%u", host, &tcp_port, &udp_port) != 3 ||
+        tcp_port == 0 || tcp_port > 65535 || udp_port == 0 || udp_port > 65535 ||
+        inet_pton(AF_INET, host, &addr) != 1) {
+        return -1;
+    }
+    memcpy(config->trunk_host, host, sizeof(host));
+    config->trunk_tcp_port = (uint16_t)tcp_port;
+    config->trunk_udp_port = (uint16_t)udp_port;
+    return 0;
+}
+
+// Узлы через запятую, каждый HOST:TCP_PORT:UDP_PORT[:WEIGHT]
+static int parse_cluster(const char* text, ServerConfig* config) {
+    char list[1024];
+    if (strlen(text) >= sizeof(list)) return -1;
+    strcpy(list, text);
+
+    config->cluster_node_count = 0;
+    char* saveptr = NULL;
+    for (char* item = strtok_r(list, ",", &saveptr); item; item = strtok_r(NULL, ",", &saveptr)) {
+        if (config->cluster_node_count >= CLUSTER_MAX_NODES ||
+            cluster_parse_node(item, &config->cluster_nodes[config->cluster_node_count]) != 0) {
+            return -1;
+        }
+        config->cluster_node_count++;
+    }
+    return config->cluster_node_count > 0 ? 0 : -1;
+}
+
+void config_init_defaults(ServerConfig* config) {
+    memset(config, 0, sizeof(*config));
+    config->tcp_port = 23230;
+    config->udp_port = 23231;
+    config->pacing_rate_kbps = 0;
+    config->pacing_burst_bytes = 16 * 1200;
+    config->metrics_interval_sec = 10;
+    config->udp_gso = true;
+    config->udp_gro = false;
+    config->bundle_window_us = 0;
+    config->stream_stats_interval_ms = 0;
+    config->egress_queue_packets = PACER_QUEUE_PACKETS;
+    config->egress_drop_policy = PACER_DROP_TAIL;
+    config->dscp_marking = true;
+    config->audio_dscp = 46;  // EF
+    config->video_dscp = 34;  // AF41
+    config->control_thread = true;
+    config->event_coalescing = true;
+}
+
+int config_parse_args(ServerConfig* config, int argc, char* argv[]) {
+    optind = 1;
+
+    int ch;
+    while ((ch = getopt_long(argc, argv, "", long_options, NULL)) != -1) {
+        uint32_t value = 0;
+        switch (ch) {
+            case OPT_PACING_RATE:
+                if (parse_u32(optarg, &value) != 0) goto bad_value;
+                config->pacing_rate_kbps = value;
+                break;
+            case OPT_PACING_BURST:
+                if (parse_u32(optarg, &value) != 0) goto bad_value;
+                config->pacing_burst_bytes = value;
+                break;
+            case OPT_METRICS_INTERVAL:
+                if (parse_u32(optarg, &value) != 0) goto bad_value;
+                config->metrics_interval_sec = value;
+                break;
+            case OPT_NO_GSO:
+                config->udp_gso = false;
+                break;
+            case OPT_UDP_GRO:
+                config->udp_gro = true;
+                break;
+            case OPT_BUNDLE_WINDOW:
+                if (parse_u32(optarg, &value) != 0) goto bad_value;
+                config->bundle_window_us = value;
+                break;
+            case OPT_STREAM_STATS_INTERVAL:
+                if (parse_u32(optarg, &value) != 0) goto bad_value;
+                config->stream_stats_interval_ms = value;
+                break;
+            case OPT_EGRESS_QUEUE:
+                if (parse_u32(optarg, &value) != 0 || value == 0 || value > PACER_QUEUE_PACKETS) goto bad_value;
+                config->egress_queue_packets = value;
+                break;
+            case OPT_EGRESS_DROP:
+                if (pacer_parse_drop_policy(optarg, &config->egress_drop_policy) != 0) goto bad_value;
+                break;
+            case OPT_UDP_RCVBUF:
+            case OPT_UDP_SNDBUF:
+            case OPT_TCP_SNDBUF:
+                if (parse_u32(optarg, &value) != 0 || value > INT32_MAX / 2) goto bad_value;
+                if (ch == OPT_UDP_RCVBUF) config->udp_rcvbuf_bytes = value;
+                if (ch == OPT_UDP_SNDBUF) config->udp_sndbuf_bytes = value;
+                if (ch == OPT_TCP_SNDBUF) config->tcp_sndbuf_bytes = value;
+                break;
+            case OPT_NO_DSCP:
+                config->dscp_marking = false;
+                break;
+            case OPT_AUDIO_DSCP:
+            case OPT_VIDEO_DSCP:
+                if (parse_u32(optarg, &value) != 0 || value > 63) goto bad_value;
+                if (ch == OPT_AUDIO_DSCP) config->audio_dscp = (uint8_t)value;
+                if (ch == OPT_VIDEO_DSCP) config->video_dscp = (uint8_t)value;
+                break;
+            case OPT_NO_CONTROL_THREAD:
+                config->control_thread = false;
+                break;
+            case OPT_FANOUT_THREADS:
+                if (parse_u32(optarg, &value) != 0 || value > FANOUT_MAX_THREADS) goto bad_value;
+                config->fanout_threads = value;
+                break;
+            case OPT_TRUNK:
+                if (parse_trunk(optarg, config) != 0) goto bad_value;
+                break;
+            case OPT_CLUSTER:
+                if (parse_cluster(optarg, config) != 0) goto bad_value;
+                break;
+            case OPT_CLUSTER_SELF:
+                if (parse_u32(optarg, &value) != 0 || value >= CLUSTER_MAX_NODES) goto bad_value;
+                config->cluster_self = value;
+                break;
+            case OPT_HANDOFF_SOCKET:
+            case OPT_TAKEOVER:
+                if (strlen(optarg) == 0 || strlen(optarg) >= sizeof(config->handoff_path)) goto bad_value;
+                strcpy(ch == OPT_HANDOFF_SOCKET ? config->handoff_path : config->takeover_path, optarg);
+                break;
+            case OPT_SNAPSHOT_FILE:
+                if (strlen(optarg) == 0 || strlen(optarg) >= sizeof(config->snapshot_path)) goto bad_value;
+                strcpy(config->snapshot_path, optarg);
+                break;
+            case OPT_SNAPSHOT_INTERVAL:
+                if (parse_u32(optarg, &value) != 0) goto bad_value;
+                config->snapshot_interval_sec = value;
+                break;
+            case OPT_NO_EVENT_COALESCING:
+                config->event_coalescing = false;
+                break;
+            case OPT_HELP:
+                config_print_usage(argv[0]);
+                return 1;
+            default:
+                config_print_usage(argv[0]);
+                return -1;
+        }
+    }
+
+    // Позиционные аргументы: порты TCP и UDP (как раньше)
+    if (optind < argc) config->tcp_port = atoi(argv[optind++]);
+    if (optind < argc) config->udp_port = atoi(argv[optind++]);
+
+    if (config->cluster_node_count > 0 && config->cluster_self >= config->cluster_node_count) {
+        fprintf(stderr, "--cluster-self %u is out of the --cluster list (%u nodes)\n",
+                config->cluster_self, config->cluster_node_count);
+        return -1;
+    }
+
+    return 0;
+
+bad_value:
+    fprintf(stderr, "Invalid value for --%s: %s\n", long_options[ch - OPT_PACING_RATE].name, optarg);
+    return -1;
+}
+
+void config_print_usage(const char* program) {
+    printf("Usage: %s [tcp_port] [udp_port] [options]\n", program);
+    printf("  --pacing-rate KBPS       per-recipient UDP pacing rate, 0 = unlimited (default 0)\n");
+    printf("  --pacing-burst BYTES     token bucket size per recipient (default 19200)\n");
+    printf("  --metrics-interval SEC   metrics report period, 0 = SIGUSR1 only (default 10)\n");
+    printf("  --no-gso                 send every UDP packet separately instead of GSO batches\n");
+    printf("  --udp-gro                receive coalesced UDP bursts (UDP_GRO) and split them\n");
+    printf("  --bundle-window US       pack small packets to one recipient into one datagram\n");
+    printf("                           within this window, 0 = off (default 0, e.g. 2000)\n");
+    printf("  --stream-stats-interval MS  ingress quality report to length-prefixed stream owners (default 0 = off)\n");
+    printf("  --egress-queue N         per-recipient send queue limit, packets (default and max %d)\n",
+           PACER_QUEUE_PACKETS);
+    printf("  --egress-drop POLICY     full queue: tail (drop new), oldest, audio (evict video first)\n");
+    printf("  --udp-rcvbuf BYTES       UDP receive buffer, 0 = auto: start at %d, grow on kernel drops\n",
+           UDP_AUTO_BUFFER_BYTES);
+    printf("  --udp-sndbuf BYTES       UDP send buffer, 0 = auto: grow on EAGAIN (default 0)\n");
+    printf("  --tcp-sndbuf BYTES       TCP send buffer of client connections, 0 = kernel autotuning\n");
+    printf("  --audio-dscp N           DSCP of audio packets (default 46, EF)\n");
+    printf("  --video-dscp N           DSCP of video packets (default 34, AF41)\n");
+    printf("  --no-dscp                send without DSCP and SO_PRIORITY marking\n");
+    printf("  --no-control-thread      handle TCP control messages in the media loop\n");
+    printf("  --fanout-threads K       send streams with %d+ viewers from K threads, each owning\n",
+           FANOUT_MIN_RECIPIENTS);
+    printf("                           a share of the viewers (default 0 = off, max %d)\n", FANOUT_MAX_THREADS);
+    printf("  --trunk HOST:TCP:UDP     relay streams of another node: unknown stream ids are\n");
+    printf("                           subscribed once from that origin and fanned out here\n");
+    printf("  --cluster LIST           cluster nodes HOST:TCP:UDP[:WEIGHT],... (same list on every node);\n");
+    printf("                           calls are owned by consistent hashing of call_id, joins\n");
+    printf("                           elsewhere get SERVER_CALL_REDIRECT (up to %d nodes)\n", CLUSTER_MAX_NODES);
+    printf("  --cluster-self N         index of this node in --cluster (default 0)\n");
+    printf("  --handoff-socket PATH    wait for a successor on this Unix socket (hot restart)\n");
+    printf("  --takeover PATH          take listeners, client sockets and state from the server\n");
+    printf("                           listening on PATH instead of binding the ports\n");
+    printf("  --snapshot-file PATH     restore calls, streams and memberships from PATH at start\n");
+    printf("                           (clients resume with CLIENT_CONN_RESUME) and save state there\n");
+    printf("                           on SIGUSR2, at shutdown and every --snapshot-interval\n");
+    printf("  --snapshot-interval SEC  background snapshot period, 0 = off (default 0)\n");
+    printf("  --no-event-coalescing    send call and stream notifications at once instead of\n");
+    printf("                           collecting them per loop iteration into one write\n");
+}
+
+void config_print(const ServerConfig* config) {
+    printf("Config: tcp_port=%d udp_port=%d pacing_rate=%u kbps pacing_burst=%u bytes metrics_interval=%u s gso=%s gro=%s bundle_window=%u us stream_stats_interval=%u ms egress_queue=%u egress_drop=%s udp_rcvbuf=%u udp_sndbuf=%u tcp_sndbuf=%u dscp=%s control_thread=%s fanout_threads=%u trunk=%s:%u:%u cluster=%u/%u handoff=%s takeover=%s snapshot=%s/%us event_coalescing=%s\n",
+           config->tcp_port, config->udp_port, config->pacing_rate_kbps,
+           config->pacing_burst_bytes, config->metrics_interval_sec, config->udp_gso ? "on" : "off",
+           config->udp_gro ? "on" : "off", config->bundle_window_us,
+           config->stream_stats_interval_ms, config->egress_queue_packets,
+           pacer_drop_policy_name(config->egress_drop_policy), config->udp_rcvbuf_bytes,
+           config->udp_sndbuf_bytes, config->tcp_sndbuf_bytes, config->dscp_marking ? "on" : "off",
+           config->control_thread ? "on" : "off",
+           config->fanout_threads, config->trunk_tcp_port ? config->trunk_host : "off",
+           config->trunk_tcp_port, config->trunk_udp_port, config->cluster_self, config->cluster_node_count,
+           config->handoff_path[0] ? config->handoff_path : "off", config->takeover_path[0] ? config->takeover_path : "off",
+           config->snapshot_path[0] ? config->snapshot_path : "off", config->snapshot_interval_sec,
+           config->event_coalescing ? "on" : "off");
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "pacer.h"
+#include "cluster.h"
+
+// Настройки сервера из командной строки:
+//   server [tcp_port] [udp_port] [--опции]
+typedef struct {
+    int tcp_port;
+    int udp_port;
+
+    // Пейсинг UDP на получателя (0 - отправка без ограничения скорости)
+    uint32_t pacing_rate_kbps;
+    uint32_t pacing_burst_bytes;
+
+    // Отправка серий пакетов одному получателю через UDP GSO (UDP_SEGMENT)
+    bool udp_gso;
+
+    // Прием склеенных серий датаграмм через UDP GRO (по умолчанию выключен)
+    bool udp_gro;
+
+    // Окно сборки связок мелких пакетов одному получателю, мкс (0 - выключено)
+    uint32_t bundle_window_us;
+
+    // Буферы сокетов, байт: для UDP 0 - авто (рост при потерях в ядре и EAGAIN),
+    // для TCP 0 - автоподстройка ядра (принятые соединения наследуют от слушающего)
+    uint32_t udp_rcvbuf_bytes;
+    uint32_t udp_sndbuf_bytes;
+    uint32_t tcp_sndbuf_bytes;
+
+    // Разметка исходящих пакетов по классу медиа: DSCP и SO_PRIORITY
+    bool dscp_marking;
+    uint8_t audio_dscp;
+    uint8_t video_dscp;
+
+    // Очередь отправки получателя: предел глубины (пакетов) и что выбрасывать при переполнении
+    uint32_t egress_queue_packets;
+    PacerDropPolicy egress_drop_policy;
+
+    // Потоки рассылки стримов с большой аудиторией (0 - выключены)
+    uint32_t fanout_threads;
+
+    // Магистраль к узлу-источнику стримов (trunk_tcp_port 0 - выключена)
+    char trunk_host[64];
+    uint16_t trunk_tcp_port;
+    uint16_t trunk_udp_port;
+
+    // Кластер: список узлов (одинаковый на всех) и номер этого узла в нем
+    ClusterNode cluster_nodes[CLUSTER_MAX_NODES];
+    uint32_t cluster_node_count;
+    uint32_t cluster_self;
+
+    // Горячий перезапуск: Unix-сокет, на котором ждем преемника, и сокет
+    // работающего сервера, у которого забираем сокеты и состояние (пусто - выключено)
+    char handoff_path[108];
+    char takeover_path[108];
+
+    // Снимок состояния в файл: восстанавливается при запуске, пишется в фоне
+    // каждые snapshot_interval_sec (0 - только по SIGUSR2 и при остановке)
+    char snapshot_path[256];
+    uint32_t snapshot_interval_sec;
+
+    // TCP (прием, чтение, разбор сообщений) в отдельном потоке управления
+    bool control_thread;
+
+    // Уведомления о звонках и стримах собираются за итерацию цикла в одну запись получателю
+    bool event_coalescing;
+
+    // Период отчетов SERVER_STREAM_STATS владельцам стримов, мс (0 - выключены, по умолчанию)
+    uint32_t stream_stats_interval_ms;
+
+    // Период печати метрик в секундах (0 - только по SIGUSR1)
+    uint32_t metrics_interval_sec;
+} ServerConfig;
+
+extern ServerConfig g_config;
+
+void config_init_defaults(ServerConfig* config);
+int config_parse_args(ServerConfig* config, int argc, char* argv[]);
+void config_print_usage(const char* program);
+void config_print(const ServerConfig* config);
+
+// Скорость пейсинга в байтах в секунду
+static inline uint64_t config_pacing_rate_bytes(const ServerConfig* config) {
+    return (uint64_t)config->pacing_rate_kbps * 1000ull / 8ull;
+}
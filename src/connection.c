@@ -3,6 +3,10 @@
 #include "call.h"
 #include "buffer_logic.h"
 #include "network.h"
+#include "pacer.h"
+#include "notify.h"
+#include "config.h"
+#include "control.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -13,6 +17,9 @@
 extern int g_epoll_fd;
 Connection* connections = NULL;
 
+// Кто закрывает сокет удаленного соединения (NULL - close здесь же)
+static void (*close_fd_fn)(int fd) = NULL;
+
 /* Внутренние функции */
 static Connection* connection_alloc(int fd, const struct sockaddr_in* addr) {
     Connection* conn = malloc(sizeof(Connection));
@@ -28,6 +35,13 @@ static Connection* connection_alloc(int fd, const struct sockaddr_in* addr) {
     }
 
     conn->udp_handshake_complete = false;
+    conn->framing = FRAMING_LEGACY;
+    conn->pacer = NULL;
+    conn->notify = NULL;
+    conn->event_batch = false;
+    conn->write_overflow = false;
+    conn->resume_token = 0;
+    bwe_init(&conn->bwe);
     
     DENSE_ARRAY_INIT(conn->watch_streams, MAX_INPUT);
     DENSE_ARRAY_INIT(conn->own_streams, MAX_OUTPUT);
@@ -50,13 +64,19 @@ int connection_remove_call_safe(Connection* conn, Call* call) {
 
 static void connection_free(Connection* conn) {
     if (!conn) return;
+    pacer_queue_delete(conn->pacer);
+    notify_forget(conn);
     free(conn);
 }
 
 static void connection_close(Connection* conn) {
     if (!conn) return;
     if (conn->fd >= 0) {
-        close(conn->fd);
+        if (close_fd_fn) {
+            close_fd_fn(conn->fd);
+        } else {
+            close(conn->fd);
+        }
     }
 }
 
@@ -178,13 +198,11 @@ void connection_delete(Connection* conn) {
         }
     }
 
-    // 4. Удаляем из глобальной хеш-таблицы
-    if (conn->fd >= 0) {
-        Connection* found = NULL;
-        HASH_FIND_INT(connections, &conn->fd, found);
-        if (found == conn) {
-            HASH_DEL(connections, conn);
-        }
+    // 4. Удаляем из глобальной хеш-таблицы (отсоединенные после снимка - под отрицательным ключом)
+    Connection* found = NULL;
+    HASH_FIND_INT(connections, &conn->fd, found);
+    if (found == conn) {
+        HASH_DEL(connections, conn);
     }
 
     // 5. Закрываем сокет и освобождаем память
@@ -192,6 +210,10 @@ void connection_delete(Connection* conn) {
     connection_free(conn);
 }
 
+void connection_set_close_fn(void (*close_fn)(int fd)) {
+    close_fd_fn = close_fn;
+}
+
 Connection* connection_find(int fd) {
     Connection* result = NULL;
     HASH_FIND_INT(connections, &fd, result);
@@ -213,16 +235,17 @@ void connection_close_all(void) {
 int connection_read_data(Connection* conn) {
     if (!conn) return -1;
 
-    uint8_t temp[512];
-    ssize_t n = read(conn->fd, temp, sizeof(temp));
+    // Читаем сразу в хвост буфера: за одно чтение приходит столько сообщений, сколько влезет
+    Buffer* buf = &conn->read_buffer;
+    if (buf->position >= BUFFER_SIZE) {
+        fprintf(stderr, "connection_read_data: buffer overflow\n");
+        buffer_clear(buf);
+        return -1;
+    }
+    ssize_t n = read(conn->fd, buf->data + buf->position, BUFFER_SIZE - buf->position);
 
     if (n > 0) {
-        BufferResult res = buffer_write(&conn->read_buffer, temp, (uint32_t)n);
-        if (res == BUFFER_OVERFLOW) {
-            fprintf(stderr, "connection_read_data: buffer overflow\n");
-            buffer_clear(&conn->read_buffer);
-            return -1;
-        }
+        buf->position += (uint32_t)n;
         return (int)n;
     } else if (n == 0) {
         return 0; // соединение закрыто
@@ -264,28 +287,59 @@ int connection_write_data(Connection* conn) {
     }
 }
 
-int connection_send_message(Connection* conn, const void* data, size_t len) {
+int connection_queue_message(Connection* conn, const void* data, size_t len) {
     if (!conn || !data || len == 0)
         return -1;
-    if (len > BUFFER_SIZE)
+    uint32_t header = conn->framing == FRAMING_LENGTH_PREFIXED ? FRAMING_HEADER_SIZE : 0;
+    if (conn->fd < 0)
+        return -1;  // восстановлено из снимка и ждет CLIENT_CONN_RESUME: сокета нет
+    if (conn->write_overflow)
+        return -1;
+    // Недописанный хвост прошлых сообщений остается впереди: поток не рвется посреди сообщения
+    if (conn->write_buffer.position + len + header > BUFFER_SIZE) {
+        printf("Connection %d: write buffer full (%u bytes unsent), closing\n", conn->fd,
+               conn->write_buffer.position);
+        conn->write_overflow = true;
+        shutdown(conn->fd, SHUT_RDWR);
         return -1;
+    }
 
-    buffer_clear(&conn->write_buffer);
-    buffer_reserve(&conn->write_buffer, (uint32_t)len);
+    conn->write_buffer.expected_size = 0;
+    if (header > 0) {
+        uint8_t prefix[FRAMING_HEADER_SIZE] = { (uint8_t)(len >> 8), (uint8_t)len };
+        buffer_write(&conn->write_buffer, prefix, header);
+    }
     buffer_write(&conn->write_buffer, data, (uint32_t)len);
+    return 0;
+}
 
+int connection_flush(Connection* conn) {
     int result = connection_write_data(conn);
     
     if (result == -2) { // EAGAIN/EWOULDBLOCK
-        epoll_modify(g_epoll_fd, conn->fd, EPOLLIN | EPOLLOUT | EPOLLET);
+        // С потоком управления сокет читает он: основному циклу нужен только EPOLLOUT
+        uint32_t events = (control_plane_running() ? 0 : EPOLLIN) | EPOLLOUT | EPOLLET;
+        epoll_modify(g_epoll_fd, conn->fd, events);
     }
     
     return result;
 }
 
+int connection_send_message(Connection* conn, const void* data, size_t len) {
+    // Накопленные за итерацию уведомления уходят раньше: клиент видит события в прежнем порядке
+    if (conn && conn->notify)
+        notify_flush_connection(conn);
+    if (connection_queue_message(conn, data, len) != 0)
+        return -1;
+    return connection_flush(conn);
+}
+
 void connection_set_udp_addr(Connection* conn, const struct sockaddr_in* udp_addr) {
     if (!conn || !udp_addr) return;
     memcpy(&conn->udp_addr, udp_addr, sizeof(struct sockaddr_in));
+    if (conn->pacer) {
+        memcpy(&conn->pacer->addr, udp_addr, sizeof(struct sockaddr_in));
+    }
 }
 
 bool connection_has_udp(const Connection* conn) {
@@ -302,6 +356,37 @@ void connection_set_udp_handshake_complete(Connection* conn) {
     }
 }
 
+int connection_send_udp(Connection* conn, PacketBuf* buf) {
+    if (!conn || !buf) return -1;
+    if (!connection_has_udp(conn) || !connection_is_udp_handshake_complete(conn)) return -1;
+
+    PacerQueue* pacer = connection_pacer(conn);
+    if (!pacer) return -1;
+
+    return pacer_enqueue(pacer, buf);
+}
+
+PacerQueue* connection_pacer(Connection* conn) {
+    if (!conn->pacer) {
+        conn->pacer = pacer_queue_new(&conn->udp_addr, config_pacing_rate_bytes(&g_config),
+                                      g_config.pacing_burst_bytes);
+    }
+    return conn->pacer;
+}
+
+// Суммарный битрейт стримов (выбранных слоев), которые смотрит клиент
+uint32_t connection_watch_bitrate(const Connection* conn, uint64_t now_ms) {
+    if (!conn) return 0;
+
+    uint64_t total = 0;
+    for (int i = 0; i < MAX_INPUT; i++) {
+        if (conn->watch_streams[i] != NULL) {
+            total += stream_recipient_bitrate(conn->watch_streams[i], conn, now_ms);
+        }
+    }
+    return total > UINT32_MAX ? UINT32_MAX : (uint32_t)total;
+}
+
 int connection_add_watch_stream(Connection* conn, Stream* stream) {
     if (!conn || !stream) return -1;
     if (connection_is_watching_stream(conn, stream)) return -2;
@@ -355,6 +440,43 @@ int connection_get_call_count(const Connection* conn) {
     return (int)DENSE_ARRAY_COUNT(conn->calls, MAX_CONNECTION_CALLS);
 }
 
+int connection_transfer(Connection* from, Connection* to) {
+    if (!from || !to || from == to) return -1;
+    if (DENSE_ARRAY_COUNT(to->calls, MAX_CONNECTION_CALLS) > 0 ||
+        DENSE_ARRAY_COUNT(to->own_streams, MAX_OUTPUT) > 0 ||
+        DENSE_ARRAY_COUNT(to->watch_streams, MAX_INPUT) > 0) {
+        return -2;
+    }
+
+    for (int i = 0; i < MAX_CONNECTION_CALLS; i++) {
+        Call* call = from->calls[i];
+        if (!call) continue;
+        int index = DENSE_ARRAY_INDEX_OF(call->participants, MAX_CALL_PARTICIPANTS, from);
+        if (index >= 0) call->participants[index] = to;
+        to->calls[i] = call;
+        from->calls[i] = NULL;
+    }
+
+    for (int i = 0; i < MAX_OUTPUT; i++) {
+        Stream* stream = from->own_streams[i];
+        if (!stream) continue;
+        stream->owner = to;
+        to->own_streams[i] = stream;
+        from->own_streams[i] = NULL;
+    }
+
+    for (int i = 0; i < MAX_INPUT; i++) {
+        Stream* stream = from->watch_streams[i];
+        if (!stream) continue;
+        int index = DENSE_ARRAY_INDEX_OF(stream->recipients, STREAM_MAX_RECIPIENTS, from);
+        if (index >= 0) stream->recipients[index] = to;
+        to->watch_streams[i] = stream;
+        from->watch_streams[i] = NULL;
+    }
+
+    return 0;
+}
+
 Stream* connection_find_stream_by_id(const Connection* conn, uint32_t stream_id) {
     if (!conn) return NULL;
     
@@ -6,13 +6,17 @@
 #include "buffer.h"  
 #include "uthash.h"
 #include "dense_array.h"
+#include "bwe.h"
 
-#define MAX_INPUT 4
+#define MAX_INPUT 32  // звонок MAX_CALL_PARTICIPANTS с аудио и видео от каждого
 #define MAX_OUTPUT 4
 #define MAX_CONNECTION_CALLS 4
 
 typedef struct Stream Stream;
 typedef struct Call Call;
+typedef struct PacerQueue PacerQueue;
+typedef struct PacketBuf PacketBuf;
+typedef struct NotifyQueue NotifyQueue;
 
 typedef struct Connection {
     int fd;
@@ -23,6 +27,13 @@ typedef struct Connection {
     struct sockaddr_in tcp_addr;
     struct sockaddr_in udp_addr;
     bool udp_handshake_complete;
+    uint8_t framing;        // формат TCP-сообщений в обе стороны (FRAMING_*), меняет CLIENT_FRAMING
+    PacerQueue* pacer;      // очередь UDP отправки, создается при первой отправке
+    NotifyQueue* notify;    // уведомления этой итерации цикла, ждущие записи (NULL - нет)
+    bool event_batch;       // уведомления пачкой SERVER_EVENT_BATCH, включает CLIENT_EVENT_BATCH
+    uint64_t resume_token;  // секрет CLIENT_CONN_RESUME, 0 - клиент его не запрашивал
+    bool write_overflow;    // клиент не читал, сообщение не влезло: сокет закрыт, ждет удаления
+    BandwidthEstimator bwe; // оценка канала до клиента по его отчетам о приеме
 
     Stream* watch_streams[MAX_INPUT];
     Stream* own_streams[MAX_OUTPUT];
@@ -40,16 +51,27 @@ void connection_delete(Connection* conn);
 Connection* connection_find(int fd);
 void connection_close_all(void);
 
+// Сокеты читает поток управления: закрывать их должен он (NULL - закрывать сразу)
+void connection_set_close_fn(void (*close_fn)(int fd));
+
 /* Сетевые операции */
 int connection_read_data(Connection* conn);
 int connection_write_data(Connection* conn);
 int connection_send_message(Connection* conn, const void* data, size_t len);
+// Дописывает сообщение в буфер отправки, не отправляя: несколько сообщений - одна запись
+// Сообщение, не влезающее в буфер записи, не теряется молча: соединение закрывается
+// (shutdown, удаление - обычным путем из цикла), иначе картина звонков у клиента разойдется
+int connection_queue_message(Connection* conn, const void* data, size_t len);
+int connection_flush(Connection* conn);
 
 /* UDP */
 void connection_set_udp_addr(Connection* conn, const struct sockaddr_in* udp_addr);
 bool connection_has_udp(const Connection* conn);
 bool connection_is_udp_handshake_complete(const Connection* conn);
 void connection_set_udp_handshake_complete(Connection* conn);
+int connection_send_udp(Connection* conn, PacketBuf* buf);
+PacerQueue* connection_pacer(Connection* conn);  // очередь пейсинга, создается при первом обращении
+uint32_t connection_watch_bitrate(const Connection* conn, uint64_t now_ms);
 
 /* Управление стримами */
 int connection_add_watch_stream(Connection* conn, Stream* stream);
@@ -66,6 +88,10 @@ int connection_remove_call(Connection* conn, Call* call);
 bool connection_is_in_call(const Connection* conn, const Call* call);
 int connection_get_call_count(const Connection* conn);
 
+// Переносит звонки, свои и просматриваемые стримы на пустое соединение to:
+// указатели меняются на месте, поэтому состояние получателя в стриме сохраняется
+int connection_transfer(Connection* from, Connection* to);
+
 /* Поиск */
 Stream* connection_find_stream_by_id(const Connection* conn, uint32_t stream_id);
 Call* connection_find_call_by_id(const Connection* conn, uint32_t call_id);
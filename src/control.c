@@ -0,0 +1,491 @@
+#include "control.h"
+#include "spsc.h"
+#include "connection.h"
+#include "protocol.h"
+#include "buffer_logic.h"
+#include "network.h"
+#include "uthash.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+extern int g_epoll_fd;
+
+// Клиентский сокет на стороне потока управления: только буфер разбора сообщений
+typedef struct {
+    int fd;
+    Buffer read_buffer;
+    uint8_t framing;  // формат чтения: поток отслеживает CLIENT_FRAMING сам, не дожидаясь основного цикла
+    UT_hash_handle hh;
+} ControlPeer;
+
+static pthread_t control_thread;
+static atomic_bool running = false;
+
+static int listen_fd = -1;
+static int control_epoll_fd = -1;
+static int wake_fd = -1;       // основной цикл -> поток: освобожденные сокеты, остановка
+static int command_fd = -1;    // поток -> основной цикл: есть команды
+
+static SpscQueue command_queue;   // поток управления -> основной цикл
+static SpscQueue release_queue;   // основной цикл -> поток управления
+
+static ControlPeer* peers = NULL;  // только поток управления
+
+// Счетчики: у каждого один писатель, читает их отчет метрик
+static struct {
+    _Atomic uint64_t accepted;
+    _Atomic uint64_t messages;
+    _Atomic uint64_t closed;
+    _Atomic uint64_t applied;
+    _Atomic uint64_t queue_full_waits;
+    _Atomic uint32_t max_backlog;
+} stats;
+
+static void control_notify(int fd) {
+    uint64_t one = 1;
+    if (write(fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        perror("control_notify");
+    }
+}
+
+// epoll_remove с печатью - для редких событий; здесь сокеты уходят на каждом закрытии
+static void control_epoll_forget(int epoll_fd, int fd) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+static void control_reset_event(int fd) {
+    uint64_t value;
+    while (read(fd, &value, sizeof(value)) > 0) {}
+}
+
+// ==================== ПОТОК УПРАВЛЕНИЯ ====================
+
+static ControlCommand* control_command_new(uint8_t type, int fd, size_t payload_len) {
+    ControlCommand* cmd = malloc(sizeof(ControlCommand) + payload_len);
+    if (!cmd) return NULL;
+    memset(cmd, 0, sizeof(*cmd));
+    cmd->type = type;
+    cmd->fd = fd;
+    cmd->payload_len = (uint32_t)payload_len;
+    return cmd;
+}
+
+// Очередь полна - основной цикл не успевает: ждем его, а клиенты ждут в буферах TCP
+static void control_push(ControlCommand* cmd) {
+    while (!spsc_push(&command_queue, cmd)) {
+        atomic_fetch_add_explicit(&stats.queue_full_waits, 1, memory_order_relaxed);
+        control_notify(command_fd);
+        if (!atomic_load(&running)) {
+            if (cmd->type == CONTROL_CMD_ACCEPT) close(cmd->fd);
+            free(cmd);
+            return;
+        }
+        usleep(100);
+    }
+
+    uint32_t backlog = spsc_count(&command_queue);
+    if (backlog > atomic_load_explicit(&stats.max_backlog, memory_order_relaxed)) {
+        atomic_store_explicit(&stats.max_backlog, backlog, memory_order_relaxed);
+    }
+}
+
+static bool control_accept_all(void) {
+    bool pushed = false;
+
+    for (;;) {
+        struct sockaddr_in addr;
+        int fd = accept_connection(listen_fd, &addr);
+        if (fd < 0) break;
+
+        ControlPeer* peer = malloc(sizeof(ControlPeer));
+        ControlCommand* cmd = control_command_new(CONTROL_CMD_ACCEPT, fd, 0);
+        if (!peer || !cmd || epoll_add(control_epoll_fd, fd, EPOLLIN | EPOLLET) != 0) {
+            fprintf(stderr, "Control plane: failed to register connection fd=%d\n", fd);
+            free(peer);
+            free(cmd);
+            close(fd);
+            continue;
+        }
+
+        peer->fd = fd;
+        buffer_init(&peer->read_buffer);
+        peer->framing = FRAMING_LEGACY;
+        HASH_ADD_INT(peers, fd, peer);
+
+        cmd->addr = addr;
+        control_push(cmd);
+        atomic_fetch_add_explicit(&stats.accepted, 1, memory_order_relaxed);
+        pushed = true;
+    }
+
+    return pushed;
+}
+
+// Режет буфер на полные сообщения (как handle_tcp_client) и отдает их основному циклу
+static bool control_frame_messages(ControlPeer* peer) {
+    Buffer* read_buf = &peer->read_buffer;
+    uint32_t offset = 0;
+    ProtocolFrame frame;
+    bool pushed = false;
+    int result;
+
+    while ((result = buffer_protocol_next_frame(read_buf->data + offset, read_buf->position - offset,
+                                                peer->framing, &frame)) == 1) {
+        ControlCommand* cmd = control_command_new(CONTROL_CMD_MESSAGE, peer->fd, frame.payload_len);
+        if (!cmd) break;
+        cmd->message_type = frame.type;
+        memcpy(cmd->payload, frame.payload, frame.payload_len);
+        control_push(cmd);
+        atomic_fetch_add_explicit(&stats.messages, 1, memory_order_relaxed);
+        pushed = true;
+        offset += frame.frame_len;
+
+        // Следующие байты уже в новом формате - тем же выбором, что сделает handle_framing
+        if (frame.type == CLIENT_FRAMING && frame.payload_len >= sizeof(FramingPayload)) {
+            peer->framing = buffer_protocol_framing_negotiate(frame.payload[0]);
+        }
+    }
+
+    if (result < 0) {
+        fprintf(stderr, "Cannot determine message size, clearing buffer\n");
+        buffer_clear(read_buf);
+        return pushed;
+    }
+    buffer_protocol_discard(read_buf, offset);
+    return pushed;
+}
+
+// Сокет закрывает не поток, а освобождение из основного цикла: до этого номер fd не переиспользуется
+static void control_peer_closed(ControlPeer* peer) {
+    ControlCommand* cmd = control_command_new(CONTROL_CMD_CLOSED, peer->fd, 0);
+    if (cmd) control_push(cmd);
+    atomic_fetch_add_explicit(&stats.closed, 1, memory_order_relaxed);
+
+    control_epoll_forget(control_epoll_fd, peer->fd);
+    HASH_DEL(peers, peer);
+    free(peer);
+}
+
+static bool control_read_peer(ControlPeer* peer) {
+    bool pushed = false;
+
+    // Edge-triggered: читаем до EAGAIN
+    for (;;) {
+        Buffer* read_buf = &peer->read_buffer;
+        uint32_t space = BUFFER_SIZE - read_buf->position;
+        if (space == 0) {
+            fprintf(stderr, "connection_read_data: buffer overflow\n");
+            buffer_clear(read_buf);
+            space = BUFFER_SIZE;
+        }
+
+        ssize_t n = read(peer->fd, read_buf->data + read_buf->position, space);
+        if (n > 0) {
+            read_buf->position += (uint32_t)n;
+            pushed = control_frame_messages(peer) || pushed;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+
+        control_peer_closed(peer);
+        return true;
+    }
+
+    return pushed;
+}
+
+static void control_release_pending(void) {
+    void* item;
+    while ((item = spsc_pop(&release_queue)) != NULL) {
+        int fd = (int)(intptr_t)item;
+
+        ControlPeer* peer = NULL;
+        HASH_FIND_INT(peers, &fd, peer);
+        if (peer) {
+            control_epoll_forget(control_epoll_fd, fd);
+            HASH_DEL(peers, peer);
+            free(peer);
+        }
+        close(fd);
+    }
+}
+
+static void* control_thread_main(void* arg) {
+    (void)arg;
+    struct epoll_event events[64];
+
+    while (atomic_load(&running)) {
+        int nfds = epoll_wait(control_epoll_fd, events, 64, -1);
+        if (nfds < 0) {
+            if (errno == EINTR) continue;
+            perror("control plane epoll_wait");
+            break;
+        }
+
+        bool pushed = false;
+        for (int i = 0; i < nfds; i++) {
+            int fd = events[i].data.fd;
+
+            if (fd == listen_fd) {
+                pushed = control_accept_all() || pushed;
+            } else if (fd == wake_fd) {
+                control_reset_event(wake_fd);
+                control_release_pending();
+            } else {
+                ControlPeer* peer = NULL;
+                HASH_FIND_INT(peers, &fd, peer);
+                if (peer) {
+                    pushed = control_read_peer(peer) || pushed;
+                }
+            }
+        }
+
+        // Одно пробуждение основного цикла на пачку событий
+        if (pushed) {
+            control_notify(command_fd);
+        }
+    }
+
+    return NULL;
+}
+
+int control_plane_start(int server_fd) {
+    if (atomic_load(&running)) return -1;
+
+    if (spsc_init(&command_queue, CONTROL_QUEUE_CAPACITY) != 0 ||
+        spsc_init(&release_queue, CONTROL_QUEUE_CAPACITY) != 0) {
+        spsc_destroy(&command_queue);
+        return -2;
+    }
+
+    listen_fd = server_fd;
+    control_epoll_fd = create_epoll_fd();
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    command_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (control_epoll_fd < 0 || wake_fd < 0 || command_fd < 0 ||
+        epoll_add(control_epoll_fd, listen_fd, EPOLLIN) != 0 ||
+        epoll_add(control_epoll_fd, wake_fd, EPOLLIN) != 0) {
+        perror("control plane setup");
+        control_plane_stop();
+        return -3;
+    }
+
+    // Сокеты, принятые от предшественника: данные, пришедшие за время передачи, epoll отдаст сразу
+    ControlPeer* peer, *tmp;
+    HASH_ITER(hh, peers, peer, tmp) {
+        if (epoll_add(control_epoll_fd, peer->fd, EPOLLIN | EPOLLET) != 0) {
+            fprintf(stderr, "Control plane: failed to register adopted fd=%d\n", peer->fd);
+        }
+    }
+
+    memset(&stats, 0, sizeof(stats));
+    atomic_store(&running, true);
+
+    // Сигналы обрабатывает основной поток: их обработчики только выставляют флаги
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    int result = pthread_create(&control_thread, NULL, control_thread_main, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    if (result != 0) {
+        fprintf(stderr, "Control plane: pthread_create failed: %s\n", strerror(result));
+        atomic_store(&running, false);
+        control_plane_stop();
+        return -4;
+    }
+
+    connection_set_close_fn(control_plane_release_fd);
+    return 0;
+}
+
+void control_plane_stop(void) {
+    if (atomic_exchange(&running, false)) {
+        control_notify(wake_fd);
+        pthread_join(control_thread, NULL);
+    }
+    connection_set_close_fn(NULL);
+
+    // Непримененные команды: у несостоявшихся соединений закрываем сокет
+    if (command_queue.slots) {
+        ControlCommand* cmd;
+        while ((cmd = spsc_pop(&command_queue)) != NULL) {
+            if (cmd->type == CONTROL_CMD_ACCEPT) close(cmd->fd);
+            free(cmd);
+        }
+    }
+    if (release_queue.slots) {
+        control_release_pending();
+    }
+
+    // Сокеты пиров закроют их соединения в основном цикле
+    ControlPeer* peer, *tmp;
+    HASH_ITER(hh, peers, peer, tmp) {
+        HASH_DEL(peers, peer);
+        free(peer);
+    }
+
+    spsc_destroy(&command_queue);
+    spsc_destroy(&release_queue);
+    if (control_epoll_fd >= 0) close(control_epoll_fd);
+    if (wake_fd >= 0) close(wake_fd);
+    if (command_fd >= 0) close(command_fd);
+    control_epoll_fd = wake_fd = command_fd = -1;
+    listen_fd = -1;
+}
+
+bool control_plane_running(void) {
+    return atomic_load(&running);
+}
+
+void control_plane_drain(void) {
+    if (atomic_exchange(&running, false)) {
+        control_notify(wake_fd);
+        pthread_join(control_thread, NULL);
+    }
+
+    // Поток стоит: очередь и буферы пиров можно трогать отсюда
+    if (command_queue.slots) {
+        control_plane_apply(UINT32_MAX);
+    }
+
+    ControlPeer* peer, *tmp;
+    HASH_ITER(hh, peers, peer, tmp) {
+        Connection* conn = connection_find(peer->fd);
+        if (conn) {
+            conn->read_buffer = peer->read_buffer;
+        }
+    }
+
+    control_plane_stop();
+}
+
+int control_plane_adopt(int fd, const Buffer* pending, uint8_t framing) {
+    if (atomic_load(&running) || fd < 0) return -1;
+
+    ControlPeer* peer = malloc(sizeof(ControlPeer));
+    if (!peer) return -2;
+    peer->fd = fd;
+    if (pending) {
+        peer->read_buffer = *pending;
+    } else {
+        buffer_init(&peer->read_buffer);
+    }
+    peer->framing = framing;
+    HASH_ADD_INT(peers, fd, peer);
+    return 0;
+}
+
+// ==================== ОСНОВНОЙ ЦИКЛ ====================
+
+int control_plane_event_fd(void) {
+    return command_fd;
+}
+
+static void control_apply_accept(const ControlCommand* cmd) {
+    Connection* conn = connection_new(cmd->fd, &cmd->addr);
+    if (!conn) {
+        control_plane_release_fd(cmd->fd);
+        return;
+    }
+
+    // Читает сокет поток управления; основному циклу он нужен только для EPOLLOUT
+    if (g_epoll_fd >= 0 && epoll_add(g_epoll_fd, cmd->fd, EPOLLET) != 0) {
+        fprintf(stderr, "Failed to add client to epoll\n");
+        connection_delete(conn);
+        return;
+    }
+
+    send_server_handshake_start(conn);
+
+    printf("New connection accepted: fd=%d, %s\n", cmd->fd, connection_get_address_string(conn));
+}
+
+static void control_apply_command(const ControlCommand* cmd) {
+    Connection* conn = NULL;
+
+    switch (cmd->type) {
+        case CONTROL_CMD_ACCEPT:
+            control_apply_accept(cmd);
+            break;
+
+        case CONTROL_CMD_MESSAGE:
+            // Соединение уже удалено - сообщение опоздало
+            conn = connection_find(cmd->fd);
+            if (conn) {
+                handle_client_message(conn, cmd->message_type, cmd->payload, cmd->payload_len);
+            }
+            break;
+
+        case CONTROL_CMD_CLOSED:
+            conn = connection_find(cmd->fd);
+            if (conn) {
+                printf("Connection closed by client: %s\n", connection_get_address_string(conn));
+                handle_connection_closed(conn);
+            }
+            break;
+    }
+}
+
+uint32_t control_plane_apply(uint32_t budget) {
+    if (!command_queue.slots) return 0;
+
+    control_reset_event(command_fd);
+
+    uint32_t applied = 0;
+    ControlCommand* cmd;
+    while (applied < budget && (cmd = spsc_pop(&command_queue)) != NULL) {
+        control_apply_command(cmd);
+        free(cmd);
+        applied++;
+    }
+
+    atomic_fetch_add_explicit(&stats.applied, applied, memory_order_relaxed);
+    return applied;
+}
+
+uint32_t control_plane_backlog(void) {
+    if (!command_queue.slots) return 0;
+    return spsc_count(&command_queue);
+}
+
+void control_plane_release_fd(int fd) {
+    if (fd < 0) return;
+
+    // Ждать EPOLLOUT по этому номеру основному циклу больше незачем
+    if (g_epoll_fd >= 0) {
+        control_epoll_forget(g_epoll_fd, fd);
+    }
+
+    if (!atomic_load(&running)) {
+        close(fd);
+        return;
+    }
+
+    while (!spsc_push(&release_queue, (void*)(intptr_t)fd)) {
+        control_notify(wake_fd);
+        sched_yield();
+    }
+    control_notify(wake_fd);
+}
+
+ControlStats control_plane_stats(void) {
+    ControlStats result = {
+        .accepted = atomic_load_explicit(&stats.accepted, memory_order_relaxed),
+        .messages = atomic_load_explicit(&stats.messages, memory_order_relaxed),
+        .closed = atomic_load_explicit(&stats.closed, memory_order_relaxed),
+        .applied = atomic_load_explicit(&stats.applied, memory_order_relaxed),
+        .queue_full_waits = atomic_load_explicit(&stats.queue_full_waits, memory_order_relaxed),
+        .max_backlog = atomic_load_explicit(&stats.max_backlog, memory_order_relaxed),
+    };
+    return result;
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <netinet/in.h>
+#include "buffer.h"
+
+// Поток управляющего канала: принимает TCP соединения, читает сокеты клиентов
+// и режет поток на сообщения. Объекты (connections, streams, calls) он не трогает:
+// готовые команды уходят основному циклу через очередь SPSC, и тот применяет их
+// порциями между пачками UDP, чтобы всплеск входов в звонки не задерживал медиа.
+//
+// Обработчики сообщений (handle_client_message с его логом, send_call_joined, рассылки
+// участникам) и запись ответов остаются в основном цикле: пересылка читает connections,
+// streams и calls на каждом пакете, и владей ими этот поток, понадобились бы блокировки
+// на горячем пути или снимок маршрутов. От всплеска команд медиа защищает только
+// предел CONTROL_COMMANDS_PER_TICK на итерацию.
+
+// Емкость очередей команд и освобождаемых сокетов (степень двойки)
+#ifndef CONTROL_QUEUE_CAPACITY
+#define CONTROL_QUEUE_CAPACITY 4096
+#endif
+
+// Сколько команд основной цикл применяет за одну итерацию
+#ifndef CONTROL_COMMANDS_PER_TICK
+#define CONTROL_COMMANDS_PER_TICK 64
+#endif
+
+typedef enum {
+    CONTROL_CMD_ACCEPT,     // новое соединение: fd и адрес
+    CONTROL_CMD_MESSAGE,    // полное сообщение клиента
+    CONTROL_CMD_CLOSED,     // клиент закрыл соединение или ошибка чтения
+} ControlCommandType;
+
+typedef struct {
+    uint8_t type;
+    uint8_t message_type;
+    int fd;
+    struct sockaddr_in addr;
+    uint32_t payload_len;
+    uint8_t payload[];
+} ControlCommand;
+
+typedef struct {
+    uint64_t accepted;
+    uint64_t messages;
+    uint64_t closed;
+    uint64_t applied;           // применено основным циклом
+    uint64_t queue_full_waits;  // поток ждал места в очереди команд
+    uint32_t max_backlog;
+} ControlStats;
+
+/* Поток управления */
+int control_plane_start(int listen_fd);
+void control_plane_stop(void);
+bool control_plane_running(void);
+
+/* Горячий перезапуск */
+// Останавливает поток, применяет накопленные команды и возвращает недочитанные
+// части сообщений в read_buffer соединений (затем как control_plane_stop)
+void control_plane_drain(void);
+// Сокет клиента, полученный от предшественника, с недочитанной частью сообщения
+// и согласованным форматом (до control_plane_start: поток начнет читать его вместе с остальными)
+int control_plane_adopt(int fd, const Buffer* pending, uint8_t framing);
+
+/* Основной цикл */
+int control_plane_event_fd(void);           // читаемо, когда есть команды
+uint32_t control_plane_apply(uint32_t budget);
+uint32_t control_plane_backlog(void);
+
+// Сокет больше не нужен основному циклу: закроет поток управления
+// (после закрытия номер fd может сразу достаться новому соединению)
+void control_plane_release_fd(int fd);
+
+ControlStats control_plane_stats(void);
@@ -0,0 +1,367 @@
+#include "fanout.h"
+#include "spsc.h"
+#include "packet_pool.h"
+#include "pacer.h"
+#include "network.h"
+#include "connection.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sched.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+
+typedef struct FanoutJob {
+    PacketBuf* buf;
+    uint64_t seq;
+    uint16_t count;
+    struct FanoutJob* next_free;
+    struct sockaddr_in dests[STREAM_MAX_RECIPIENTS];
+} FanoutJob;
+
+typedef struct {
+    pthread_t thread;
+    SpscQueue jobs;          // поток приема -> поток отправки
+    SpscQueue done;          // обратно: отправленные задания
+    int wake_fd;
+    uint32_t outstanding;    // заданий не вернулось (только поток приема)
+    bool wake_pending;       // есть задания с прошлого fanout_flush (только поток приема)
+    uint32_t index;
+
+    // Последнее отправленное задание: до него очереди пейсинга получателей ждут
+    _Atomic uint64_t completed;
+
+    // Счетчики пишет поток отправки, кроме jobs_pushed и queue_full
+    _Atomic uint64_t sends;
+    _Atomic uint64_t syscalls;
+    _Atomic uint64_t eagain_waits;
+    _Atomic uint64_t dropped_eagain;
+    _Atomic uint64_t errors;
+    uint64_t jobs_pushed;
+    uint64_t queue_full;
+} FanoutThread;
+
+static FanoutThread threads[FANOUT_MAX_THREADS];
+static uint32_t thread_count = 0;
+static int fanout_fd = -1;
+static atomic_bool running = false;
+static FanoutJob* free_jobs = NULL;  // только поток приема
+static uint64_t next_seq = 1;        // номера заданий, сквозные по потокам (только поток приема)
+
+// ==================== ПОТОКИ ОТПРАВКИ ====================
+
+// Ждет, пока сокет снова примет датаграммы; false - потоки останавливаются
+static bool fanout_wait_writable(void) {
+    struct pollfd pfd = {.fd = fanout_fd, .events = POLLOUT};
+    while (atomic_load(&running)) {
+        if (poll(&pfd, 1, FANOUT_WRITABLE_POLL_MS) > 0) return true;
+    }
+    return false;
+}
+
+static void fanout_send_job(FanoutThread* self, const FanoutJob* job) {
+    const PacketBuf* buf = job->buf;
+    const UdpMarking* marking = pacer_class_marking(buf->media_class);
+
+    int offset = 0;
+    while (offset < job->count) {
+        int sent = udp_send_many(fanout_fd, buf->data, buf->len, job->dests + offset, job->count - offset, marking);
+        atomic_fetch_add_explicit(&self->syscalls, 1, memory_order_relaxed);
+
+        if (sent > 0) {
+            atomic_fetch_add_explicit(&self->sends, (uint64_t)sent, memory_order_relaxed);
+            offset += sent;
+            continue;
+        }
+        // Буфер сокета полон: держим задание, как пейсинг держит очередь до EPOLLOUT
+        if (sent == -2) {
+            atomic_fetch_add_explicit(&self->eagain_waits, 1, memory_order_relaxed);
+            if (fanout_wait_writable()) continue;
+            atomic_fetch_add_explicit(&self->dropped_eagain, (uint64_t)(job->count - offset), memory_order_relaxed);
+        } else {
+            atomic_fetch_add_explicit(&self->errors, (uint64_t)(job->count - offset), memory_order_relaxed);
+        }
+        break;
+    }
+}
+
+static void* fanout_thread_main(void* arg) {
+    FanoutThread* self = arg;
+
+    while (atomic_load(&running)) {
+        FanoutJob* job = spsc_pop(&self->jobs);
+        if (!job) {
+            // Ждем fanout_flush (счетчик eventfd не теряет пробуждение между pop и read)
+            uint64_t value;
+            if (read(self->wake_fd, &value, sizeof(value)) < 0 && errno != EINTR) break;
+            continue;
+        }
+
+        fanout_send_job(self, job);
+        atomic_store_explicit(&self->completed, job->seq, memory_order_release);
+
+        // Кольцо возврата не переполняется: заданий в работе не больше его емкости
+        while (!spsc_push(&self->done, job)) {
+            sched_yield();
+        }
+    }
+
+    return NULL;
+}
+
+int fanout_start(uint32_t count, int udp_fd) {
+    if (thread_count > 0 || count == 0) return -1;
+    if (count > FANOUT_MAX_THREADS) count = FANOUT_MAX_THREADS;
+
+    fanout_fd = udp_fd;
+    atomic_store(&running, true);
+
+    // Сигналы обрабатывает основной поток
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+
+    int result = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        FanoutThread* t = &threads[i];
+        memset(t, 0, sizeof(*t));
+        t->index = i;
+        atomic_store(&t->completed, next_seq - 1);
+        t->wake_fd = eventfd(0, EFD_CLOEXEC);
+        if (t->wake_fd < 0 || spsc_init(&t->jobs, FANOUT_QUEUE_CAPACITY) != 0 ||
+            spsc_init(&t->done, FANOUT_QUEUE_CAPACITY) != 0) {
+            result = -2;
+            break;
+        }
+        if (pthread_create(&t->thread, NULL, fanout_thread_main, t) != 0) {
+            result = -3;
+            break;
+        }
+        thread_count = i + 1;
+    }
+
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    if (result != 0) {
+        fprintf(stderr, "Fan-out: failed to start thread %u\n", thread_count);
+        fanout_stop();
+        return result;
+    }
+    return 0;
+}
+
+static void fanout_release_job(FanoutThread* t, FanoutJob* job) {
+    packet_buf_release(job->buf);
+    job->buf = NULL;
+    job->next_free = free_jobs;
+    free_jobs = job;
+    t->outstanding--;
+}
+
+void fanout_stop(void) {
+    atomic_store(&running, false);
+
+    for (uint32_t i = 0; i < FANOUT_MAX_THREADS; i++) {
+        FanoutThread* t = &threads[i];
+        if (i < thread_count) {
+            uint64_t one = 1;
+            if (write(t->wake_fd, &one, sizeof(one)) < 0) perror("fanout wake");
+            pthread_join(t->thread, NULL);
+            // Неотправленные задания не придут: очереди пейсинга их больше не ждут
+            atomic_store(&t->completed, UINT64_MAX);
+        }
+
+        // Неотправленные и отправленные задания отдают ссылки на буферы
+        FanoutJob* job;
+        if (t->jobs.slots) {
+            while ((job = spsc_pop(&t->jobs)) != NULL) fanout_release_job(t, job);
+        }
+        if (t->done.slots) {
+            while ((job = spsc_pop(&t->done)) != NULL) fanout_release_job(t, job);
+        }
+        spsc_destroy(&t->jobs);
+        spsc_destroy(&t->done);
+        if (t->wake_fd > 0) close(t->wake_fd);
+        t->wake_fd = -1;
+    }
+
+    while (free_jobs) {
+        FanoutJob* next = free_jobs->next_free;
+        free(free_jobs);
+        free_jobs = next;
+    }
+    thread_count = 0;
+    fanout_fd = -1;
+}
+
+bool fanout_enabled(void) {
+    return thread_count > 0;
+}
+
+uint32_t fanout_thread_count(void) {
+    return thread_count;
+}
+
+// ==================== ЧАСТИ ПОЛУЧАТЕЛЕЙ ====================
+
+void fanout_rebalance_stream(Stream* stream) {
+    if (!stream || thread_count == 0) return;
+
+    uint32_t sizes[FANOUT_MAX_THREADS] = {0};
+    for (int i = 0; i < STREAM_MAX_RECIPIENTS; i++) {
+        uint8_t part = stream->recipient_state[i].fanout_thread;
+        if (stream->recipients[i] && part < thread_count) sizes[part]++;
+    }
+
+    // Новые зрители - в самую маленькую часть
+    for (int i = 0; i < STREAM_MAX_RECIPIENTS; i++) {
+        StreamRecipientState* state = &stream->recipient_state[i];
+        if (!stream->recipients[i] || state->fanout_thread < thread_count) continue;
+
+        uint8_t smallest = 0;
+        for (uint32_t p = 1; p < thread_count; p++) {
+            if (sizes[p] < sizes[smallest]) smallest = (uint8_t)p;
+        }
+        state->fanout_thread = smallest;
+        sizes[smallest]++;
+    }
+
+    // После выходов: переносим по одному зрителю, пока части не сравняются с точностью до одного
+    for (;;) {
+        uint8_t largest = 0, smallest = 0;
+        for (uint32_t p = 1; p < thread_count; p++) {
+            if (sizes[p] > sizes[largest]) largest = (uint8_t)p;
+            if (sizes[p] < sizes[smallest]) smallest = (uint8_t)p;
+        }
+        if (sizes[largest] <= sizes[smallest] + 1) break;
+
+        for (int i = 0; i < STREAM_MAX_RECIPIENTS; i++) {
+            if (stream->recipients[i] && stream->recipient_state[i].fanout_thread == largest) {
+                stream->recipient_state[i].fanout_thread = smallest;
+                break;
+            }
+        }
+        sizes[largest]--;
+        sizes[smallest]++;
+    }
+}
+
+// ==================== ПУТЬ ПЕРЕСЫЛКИ ====================
+
+bool fanout_stream_eligible(const Stream* stream) {
+    return thread_count > 0 && stream_get_recipient_count(stream) >= FANOUT_MIN_RECIPIENTS;
+}
+
+// Пакет len байт получателю можно отдать потоку thread: в пейсинге пусто, токены списаны.
+// Пока прежние пакеты получателя у другого потока (части перераспределились), новые
+// идут через пейсинг и ждут их там.
+bool fanout_recipient_ready(Connection* recipient, uint8_t thread, uint32_t len, uint64_t now_us) {
+    if (thread >= thread_count) thread = 0;
+    FanoutThread* t = &threads[thread];
+    if (t->outstanding >= FANOUT_QUEUE_CAPACITY) {
+        t->queue_full++;
+        return false;
+    }
+
+    PacerQueue* pacer = connection_pacer(recipient);
+    if (!pacer) return false;
+    if (pacer_queue_held(pacer) && pacer->hold_done != &t->completed) return false;
+    return pacer_queue_charge(pacer, len, now_us);
+}
+
+void fanout_batch_init(FanoutBatch* batch) {
+    memset(batch->count, 0, sizeof(batch->count));
+}
+
+void fanout_batch_add(FanoutBatch* batch, uint8_t thread, Connection* recipient) {
+    if (thread >= thread_count) thread = 0;
+    batch->recipients[thread][batch->count[thread]++] = recipient;
+}
+
+bool fanout_batch_empty(const FanoutBatch* batch) {
+    for (uint32_t t = 0; t < thread_count; t++) {
+        if (batch->count[t] > 0) return false;
+    }
+    return true;
+}
+
+static FanoutJob* fanout_job_alloc(void) {
+    FanoutJob* job = free_jobs;
+    if (job) {
+        free_jobs = job->next_free;
+        return job;
+    }
+    return malloc(sizeof(FanoutJob));
+}
+
+void fanout_submit(FanoutBatch* batch, PacketBuf* buf) {
+    for (uint32_t t = 0; t < thread_count; t++) {
+        uint8_t count = batch->count[t];
+        if (count == 0) continue;
+
+        FanoutThread* thread = &threads[t];
+        FanoutJob* job = fanout_job_alloc();
+        if (!job) {
+            // Нет памяти под задание - часть потока идет обычным путем
+            for (uint8_t i = 0; i < count; i++) {
+                connection_send_udp(batch->recipients[t][i], buf);
+            }
+            continue;
+        }
+
+        packet_buf_retain(buf);
+        job->buf = buf;
+        job->seq = next_seq++;
+        job->count = count;
+        for (uint8_t i = 0; i < count; i++) {
+            Connection* recipient = batch->recipients[t][i];
+            job->dests[i] = recipient->udp_addr;
+            pacer_queue_hold(recipient->pacer, &thread->completed, job->seq);
+        }
+
+        spsc_push(&thread->jobs, job);
+        thread->outstanding++;
+        thread->jobs_pushed++;
+        thread->wake_pending = true;
+    }
+}
+
+void fanout_flush(void) {
+    for (uint32_t t = 0; t < thread_count; t++) {
+        FanoutThread* thread = &threads[t];
+        if (!thread->wake_pending) continue;
+
+        uint64_t one = 1;
+        if (write(thread->wake_fd, &one, sizeof(one)) < 0) perror("fanout wake");
+        thread->wake_pending = false;
+    }
+}
+
+void fanout_collect(void) {
+    for (uint32_t t = 0; t < thread_count; t++) {
+        FanoutJob* job;
+        while ((job = spsc_pop(&threads[t].done)) != NULL) {
+            fanout_release_job(&threads[t], job);
+        }
+    }
+}
+
+FanoutStats fanout_thread_stats(uint32_t index) {
+    FanoutStats stats;
+    memset(&stats, 0, sizeof(stats));
+    if (index >= thread_count) return stats;
+
+    FanoutThread* t = &threads[index];
+    stats.jobs = t->jobs_pushed;
+    stats.sends = atomic_load_explicit(&t->sends, memory_order_relaxed);
+    stats.syscalls = atomic_load_explicit(&t->syscalls, memory_order_relaxed);
+    stats.eagain_waits = atomic_load_explicit(&t->eagain_waits, memory_order_relaxed);
+    stats.dropped_eagain = atomic_load_explicit(&t->dropped_eagain, memory_order_relaxed);
+    stats.errors = atomic_load_explicit(&t->errors, memory_order_relaxed);
+    stats.queue_full = t->queue_full;
+    return stats;
+}
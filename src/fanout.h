@@ -0,0 +1,80 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <netinet/in.h>
+#include "stream.h"
+
+// Дерево рассылки для больших аудиторий: поток приема раздает каждый пакет (одна копия
+// со ссылками) K потокам отправки. Каждый поток владеет своей частью получателей стрима
+// и шлет им пакет одним sendmmsg. Части выравниваются при входе и выходе зрителей.
+// Пул буферов остается однопоточным: отправленное задание возвращается по второй
+// очереди, и ссылку снимает поток приема.
+//
+// Пакет уходит потоку мимо очереди пейсинга получателя, только если та пуста и его
+// token bucket оплачивает пакет (pacer_queue_charge). Все, что после этого идет
+// получателю через пейсинг, ждет, пока поток не отправит задание (pacer_queue_hold),
+// так что пакеты получателя не переставляются. На EAGAIN поток, как и пейсинг, держит
+// задание до освобождения сокета; его очередь тем временем заполняется, и новые пакеты
+// идут через пейсинг с его политикой отбрасывания.
+
+#ifndef FANOUT_MAX_THREADS
+#define FANOUT_MAX_THREADS 8
+#endif
+
+// Стримы с меньшим числом получателей идут только через очереди пейсинга
+#ifndef FANOUT_MIN_RECIPIENTS
+#define FANOUT_MIN_RECIPIENTS 8
+#endif
+
+// Заданий в работе на поток (степень двойки)
+#ifndef FANOUT_QUEUE_CAPACITY
+#define FANOUT_QUEUE_CAPACITY 1024
+#endif
+
+// Период проверки остановки, пока поток ждет освобождения сокета после EAGAIN
+#ifndef FANOUT_WRITABLE_POLL_MS
+#define FANOUT_WRITABLE_POLL_MS 100
+#endif
+
+#define FANOUT_UNASSIGNED 0xFF
+
+typedef struct PacketBuf PacketBuf;
+
+// Получатели одного пакета, разложенные по потокам (собирается на стеке пути пересылки)
+typedef struct {
+    uint8_t count[FANOUT_MAX_THREADS];
+    Connection* recipients[FANOUT_MAX_THREADS][STREAM_MAX_RECIPIENTS];
+} FanoutBatch;
+
+typedef struct {
+    uint64_t jobs;           // пакетов, розданных потоку
+    uint64_t sends;          // датаграмм отправлено
+    uint64_t syscalls;       // вызовов sendmmsg
+    uint64_t eagain_waits;   // буфер сокета полон - поток ждал освобождения
+    uint64_t dropped_eagain; // остановка во время ожидания - получатели пакета пропущены
+    uint64_t errors;
+    uint64_t queue_full;     // очередь потока полна - получатель пошел через пейсинг
+} FanoutStats;
+
+/* Потоки рассылки */
+int fanout_start(uint32_t thread_count, int udp_fd);
+void fanout_stop(void);
+bool fanout_enabled(void);
+uint32_t fanout_thread_count(void);
+
+/* Части получателей стрима (вход/выход зрителя) */
+void fanout_rebalance_stream(Stream* stream);
+
+/* Путь пересылки (поток приема) */
+bool fanout_stream_eligible(const Stream* stream);
+bool fanout_recipient_ready(Connection* recipient, uint8_t thread, uint32_t len, uint64_t now_us);
+void fanout_batch_init(FanoutBatch* batch);
+void fanout_batch_add(FanoutBatch* batch, uint8_t thread, Connection* recipient);
+bool fanout_batch_empty(const FanoutBatch* batch);
+void fanout_submit(FanoutBatch* batch, PacketBuf* buf);
+
+// Конец итерации: разбудить потоки с новыми заданиями, забрать отправленные
+void fanout_flush(void);
+void fanout_collect(void);
+
+FanoutStats fanout_thread_stats(uint32_t thread);
@@ -0,0 +1,304 @@
+#include "handoff.h"
+#include "snapshot.h"
+#include "network.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+
+#define HANDOFF_ACK 'K'
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    int32_t tcp_fd;
+    int32_t udp_fd;
+    uint32_t fd_count;
+    uint64_t snapshot_len;
+} HandoffHeader;
+
+static int listen_fd = -1;
+static char listen_path[sizeof(((struct sockaddr_un*)0)->sun_path)];
+static bool completed = false;
+
+static int handoff_address(const char* path, struct sockaddr_un* addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (!path || strlen(path) >= sizeof(addr->sun_path)) return -1;
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+static void handoff_set_timeouts(int fd) {
+    struct timeval timeout = { HANDOFF_TIMEOUT_MS / 1000, (HANDOFF_TIMEOUT_MS % 1000) * 1000 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+// ==================== СТАРЫЙ ПРОЦЕСС ====================
+
+int handoff_listen(const char* path, int epoll_fd) {
+    struct sockaddr_un addr;
+    if (handoff_address(path, &addr) != 0) return -1;
+
+    listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) return -2;
+
+    // Файл сокета остается от предшественника (он его не удаляет) или от падения
+    unlink(path);
+    if (bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(listen_fd, 1) != 0 ||
+        epoll_add(epoll_fd, listen_fd, EPOLLIN) != 0) {
+        perror("handoff_listen");
+        close(listen_fd);
+        listen_fd = -1;
+        return -3;
+    }
+
+    strcpy(listen_path, path);
+    completed = false;
+    return 0;
+}
+
+int handoff_fd(void) {
+    return listen_fd;
+}
+
+int handoff_accept(void) {
+    if (listen_fd < 0) return -1;
+    int channel = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (channel < 0) return -1;
+    handoff_set_timeouts(channel);
+    return channel;
+}
+
+static int handoff_send_fds(int channel, const int* fds, uint32_t count) {
+    int32_t numbers[HANDOFF_FDS_PER_MESSAGE];
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * HANDOFF_FDS_PER_MESSAGE)];
+        struct cmsghdr align;
+    } control;
+
+    // Номер каждого сокета у нас - номер, под которым он нужен преемнику
+    for (uint32_t i = 0; i < count; i++) numbers[i] = fds[i];
+
+    struct iovec iov = { .iov_base = numbers, .iov_len = count * sizeof(int32_t) };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    memset(&control, 0, sizeof(control));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * count);
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * count);
+
+    return sendmsg(channel, &msg, MSG_NOSIGNAL) == (ssize_t)iov.iov_len ? 0 : -1;
+}
+
+int handoff_send(int channel, const int* fds, uint32_t fd_count, const uint8_t* snapshot, size_t len) {
+    if (channel < 0 || !fds || fd_count < 2) return -1;
+
+    HandoffHeader header = {
+        .magic = HANDOFF_MAGIC,
+        .version = SNAPSHOT_VERSION,
+        .tcp_fd = fds[0],
+        .udp_fd = fds[1],
+        .fd_count = fd_count,
+        .snapshot_len = len,
+    };
+    if (send(channel, &header, sizeof(header), MSG_NOSIGNAL) != (ssize_t)sizeof(header)) return -2;
+
+    for (uint32_t sent = 0; sent < fd_count; sent += HANDOFF_FDS_PER_MESSAGE) {
+        uint32_t count = fd_count - sent;
+        if (count > HANDOFF_FDS_PER_MESSAGE) count = HANDOFF_FDS_PER_MESSAGE;
+        if (handoff_send_fds(channel, fds + sent, count) != 0) return -3;
+    }
+
+    for (size_t offset = 0; offset < len; offset += HANDOFF_CHUNK_BYTES) {
+        size_t chunk = len - offset < HANDOFF_CHUNK_BYTES ? len - offset : HANDOFF_CHUNK_BYTES;
+        if (send(channel, snapshot + offset, chunk, MSG_NOSIGNAL) != (ssize_t)chunk) return -4;
+    }
+
+    // Подтверждение приходит, когда преемник восстановил реестры и готов к циклу
+    char ack = 0;
+    if (recv(channel, &ack, 1, 0) != 1 || ack != HANDOFF_ACK) return -5;
+
+    completed = true;
+    return 0;
+}
+
+bool handoff_completed(void) {
+    return completed;
+}
+
+void handoff_stop(void) {
+    if (listen_fd < 0) return;
+    close(listen_fd);
+    listen_fd = -1;
+
+    // После передачи путь уже занял преемник
+    if (!completed) unlink(listen_path);
+}
+
+// ==================== НОВЫЙ ПРОЦЕСС ====================
+
+// Принимает одну запись с сокетами; received[i] придет под номером targets[i]
+static int handoff_receive_fds(int channel, int* received, int* targets, uint32_t max_count) {
+    int32_t numbers[HANDOFF_FDS_PER_MESSAGE];
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * HANDOFF_FDS_PER_MESSAGE)];
+        struct cmsghdr align;
+    } control;
+    memset(&control, 0, sizeof(control));
+
+    struct iovec iov = { .iov_base = numbers, .iov_len = sizeof(numbers) };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    ssize_t n = recvmsg(channel, &msg, MSG_CMSG_CLOEXEC);
+    // При ошибке (в том числе тайм-ауте SO_RCVTIMEO) ядро не заполняет control,
+    // а на EOF сокетов нет: в обоих случаях закрывать нечего
+    if (n <= 0) return -1;
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) return -1;
+
+    // Сокеты уже в процессе: что бы ни было не так с записью, все они закрываются
+    const uint8_t* fds = CMSG_DATA(cmsg);
+    uint32_t count = (uint32_t)((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+    if ((msg.msg_flags & MSG_CTRUNC) || count > max_count || (size_t)n != count * sizeof(int32_t)) {
+        for (uint32_t i = 0; i < count; i++) {
+            int fd;
+            memcpy(&fd, fds + i * sizeof(int), sizeof(fd));
+            close(fd);
+        }
+        return -1;
+    }
+    memcpy(received, fds, sizeof(int) * count);
+    for (uint32_t i = 0; i < count; i++) targets[i] = numbers[i];
+    return (int)count;
+}
+
+// Раскладывает сокеты по прежним номерам: сначала все уводятся выше самого
+// большого нужного номера, потом по одному ставятся на место
+static int handoff_place_fds(int* received, const int* targets, uint32_t count, int* channel) {
+    int highest = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (targets[i] > highest) highest = targets[i];
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        int moved = fcntl(received[i], F_DUPFD_CLOEXEC, highest + 1);
+        if (moved < 0) return -1;
+        close(received[i]);
+        received[i] = moved;
+    }
+    int moved = fcntl(*channel, F_DUPFD_CLOEXEC, highest + 1);
+    if (moved < 0) return -1;
+    close(*channel);
+    *channel = moved;
+
+    for (uint32_t i = 0; i < count; i++) {
+        // Номер занят чем-то своим (например, унаследованным дескриптором) - не затираем
+        if (fcntl(targets[i], F_GETFD) >= 0) {
+            fprintf(stderr, "Handoff: fd %d is already in use in this process\n", targets[i]);
+            return -2;
+        }
+        if (dup2(received[i], targets[i]) < 0) return -1;
+        close(received[i]);
+        received[i] = targets[i];
+    }
+    return 0;
+}
+
+int handoff_receive(const char* path, HandoffTakeover* out) {
+    struct sockaddr_un addr;
+    if (!out || handoff_address(path, &addr) != 0) return -1;
+    memset(out, 0, sizeof(*out));
+    out->tcp_fd = out->udp_fd = out->channel = -1;
+
+    int channel = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (channel < 0) return -2;
+    handoff_set_timeouts(channel);
+    if (connect(channel, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        perror("handoff connect");
+        close(channel);
+        return -2;
+    }
+
+    HandoffHeader header;
+    if (recv(channel, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+        header.magic != HANDOFF_MAGIC || header.version != SNAPSHOT_VERSION || header.fd_count < 2) {
+        fprintf(stderr, "Handoff: bad header from the running server\n");
+        close(channel);
+        return -3;
+    }
+
+    int* received = calloc(header.fd_count, sizeof(int));
+    int* targets = calloc(header.fd_count, sizeof(int));
+    uint8_t* snapshot = malloc(header.snapshot_len ? header.snapshot_len : 1);
+    uint32_t got = 0;
+    int result = received && targets && snapshot ? 0 : -4;
+
+    while (result == 0 && got < header.fd_count) {
+        int count = handoff_receive_fds(channel, received + got, targets + got, header.fd_count - got);
+        if (count <= 0) result = -5;
+        else got += (uint32_t)count;
+    }
+
+    size_t offset = 0;
+    while (result == 0 && offset < header.snapshot_len) {
+        ssize_t n = recv(channel, snapshot + offset, header.snapshot_len - offset, 0);
+        if (n <= 0) result = -6;
+        else offset += (size_t)n;
+    }
+
+    if (result == 0) {
+        result = handoff_place_fds(received, targets, got, &channel) == 0 ? 0 : -7;
+    }
+
+    if (result != 0) {
+        for (uint32_t i = 0; i < got; i++) close(received[i]);
+        close(channel);
+        free(snapshot);
+    } else {
+        out->tcp_fd = header.tcp_fd;
+        out->udp_fd = header.udp_fd;
+        out->snapshot = snapshot;
+        out->snapshot_len = header.snapshot_len;
+        out->channel = channel;
+    }
+    free(received);
+    free(targets);
+    return result;
+}
+
+int handoff_confirm(HandoffTakeover* takeover) {
+    if (!takeover || takeover->channel < 0) return -1;
+    char ack = HANDOFF_ACK;
+    int result = send(takeover->channel, &ack, 1, MSG_NOSIGNAL) == 1 ? 0 : -2;
+    close(takeover->channel);
+    takeover->channel = -1;
+    return result;
+}
+
+void handoff_takeover_free(HandoffTakeover* takeover) {
+    if (!takeover) return;
+    if (takeover->channel >= 0) close(takeover->channel);
+    takeover->channel = -1;
+    free(takeover->snapshot);
+    takeover->snapshot = NULL;
+    takeover->snapshot_len = 0;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Горячий перезапуск: работающий сервер слушает Unix-сокет (SOCK_SEQPACKET),
+// новый процесс подключается к нему и получает слушающие сокеты, сокеты клиентов
+// (SCM_RIGHTS) и снимок реестров. Сокеты приходят под прежними номерами:
+// номер fd - это connection_id, который клиенты уже знают. Пока новый процесс
+// поднимается, старый стоит и не читает UDP - датаграммы ждут в буфере общего
+// сокета. После подтверждения старый процесс завершается, не закрывая соединения;
+// без подтверждения он продолжает работу сам.
+
+#ifndef HANDOFF_TIMEOUT_MS
+#define HANDOFF_TIMEOUT_MS 5000
+#endif
+
+// Сокетов в одном сообщении SCM_RIGHTS (ядро допускает до 253)
+#ifndef HANDOFF_FDS_PER_MESSAGE
+#define HANDOFF_FDS_PER_MESSAGE 64
+#endif
+
+// Снимок идет записями этого размера
+#ifndef HANDOFF_CHUNK_BYTES
+#define HANDOFF_CHUNK_BYTES 32768
+#endif
+
+#define HANDOFF_MAGIC 0x48414e44u  // "HAND"
+
+typedef struct {
+    int tcp_fd;
+    int udp_fd;
+    uint8_t* snapshot;
+    size_t snapshot_len;
+    int channel;  // сокет к предшественнику: ждет подтверждения
+} HandoffTakeover;
+
+/* Старый процесс */
+int handoff_listen(const char* path, int epoll_fd);
+int handoff_fd(void);
+int handoff_accept(void);  // сокет преемника или -1
+// Передает сокеты (первые два - TCP и UDP сервера) и снимок, ждет подтверждения
+int handoff_send(int channel, const int* fds, uint32_t fd_count, const uint8_t* snapshot, size_t len);
+bool handoff_completed(void);
+void handoff_stop(void);
+
+/* Новый процесс */
+int handoff_receive(const char* path, HandoffTakeover* out);
+int handoff_confirm(HandoffTakeover* takeover);
+void handoff_takeover_free(HandoffTakeover* takeover);
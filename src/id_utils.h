@@ -3,6 +3,7 @@
 #include <time.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <sys/random.h>
 
 static inline uint32_t generate_id(void) {
     static bool was_called = false;
@@ -13,6 +14,13 @@ static inline uint32_t generate_id(void) {
     return (uint32_t)(rand() % 308915776);  // 26^6 = 308915776
 }
 
+// Секрет, который нельзя угадать (в отличие от generate_id): из getrandom. 0 - получить не удалось
+static inline uint64_t generate_token(void) {
+    uint64_t token = 0;
+    if (getrandom(&token, sizeof(token), 0) != (ssize_t)sizeof(token)) return 0;
+    return token;
+}
+
 static inline void id_to_string(uint32_t id, char str[6]) {
     for (int i = 0; i < 6; ++i) {
         str[i] = (char)(id % 26 + 'A');
@@ -248,6 +248,8 @@ inline static bool check_all_integrity(void) {
                        stream->stream_id, stream->owner->fd);
                 all_ok = false;
             }
+        } else if (stream->relayed) {
+            printf("  OK: Stream %u is relayed from another node\n", stream->stream_id);
         } else {
             printf("  ERROR: Stream %u has no owner\n", stream->stream_id);
             all_ok = false;
@@ -0,0 +1,66 @@
+#include "keyframe_cache.h"
+#include <stdlib.h>
+#include <string.h>
+
+KeyframeCache* keyframe_cache_new(void) {
+    KeyframeCache* cache = malloc(sizeof(KeyframeCache));
+    if (!cache) return NULL;
+
+    cache->count = 0;
+    cache->generation = 0;
+    cache->valid = false;
+
+    return cache;
+}
+
+void keyframe_cache_delete(KeyframeCache* cache) {
+    if (!cache) return;
+    free(cache);
+}
+
+void keyframe_cache_reset(KeyframeCache* cache) {
+    if (!cache) return;
+    cache->count = 0;
+    cache->valid = false;
+    cache->generation++;
+}
+
+void keyframe_cache_push(KeyframeCache* cache, const void* data, size_t len, bool is_keyframe) {
+    if (!cache || !data || len == 0 || len > UDP_PACKET_SIZE) return;
+
+    if (is_keyframe) {
+        // Новый ключевой кадр - старая серия больше не нужна
+        cache->count = 0;
+        cache->valid = true;
+        cache->generation++;
+    }
+
+    // Пока не видели ключевой кадр, хранить нечего
+    if (!cache->valid) return;
+
+    if (cache->count >= KEYFRAME_CACHE_MAX_PACKETS) {
+        // Неполная серия бесполезна для декодера - ждем следующий ключевой кадр
+        cache->count = 0;
+        cache->valid = false;
+        cache->generation++;
+        return;
+    }
+
+    CachedPacket* slot = &cache->packets[cache->count++];
+    slot->len = (uint16_t)len;
+    memcpy(slot->data, data, len);
+}
+
+bool keyframe_cache_is_valid(const KeyframeCache* cache) {
+    return cache && cache->valid && cache->count > 0;
+}
+
+uint32_t keyframe_cache_count(const KeyframeCache* cache) {
+    if (!cache || !cache->valid) return 0;
+    return cache->count;
+}
+
+const CachedPacket* keyframe_cache_get(const KeyframeCache* cache, uint32_t index) {
+    if (!cache || !cache->valid || index >= cache->count) return NULL;
+    return &cache->packets[index];
+}
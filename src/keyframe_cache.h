@@ -0,0 +1,36 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "protocol.h"
+
+// Сколько пакетов с последнего ключевого кадра хранится для одного стрима.
+// Если серия длиннее, кеш инвалидируется до следующего ключевого кадра.
+#ifndef KEYFRAME_CACHE_MAX_PACKETS
+#define KEYFRAME_CACHE_MAX_PACKETS 256
+#endif
+
+typedef struct {
+    uint16_t len;
+    uint8_t data[UDP_PACKET_SIZE];
+} CachedPacket;
+
+typedef struct KeyframeCache {
+    uint32_t count;
+    uint32_t generation;   // увеличивается на каждом новом ключевом кадре
+    bool valid;            // серия начата с ключевого кадра и не переполнена
+    CachedPacket packets[KEYFRAME_CACHE_MAX_PACKETS];
+} KeyframeCache;
+
+/* Основные операции жизненного цикла */
+KeyframeCache* keyframe_cache_new(void);
+void keyframe_cache_delete(KeyframeCache* cache);
+
+/* Добавление пакета: ключевой кадр начинает новую серию */
+void keyframe_cache_push(KeyframeCache* cache, const void* data, size_t len, bool is_keyframe);
+void keyframe_cache_reset(KeyframeCache* cache);
+
+/* Чтение серии */
+bool keyframe_cache_is_valid(const KeyframeCache* cache);
+uint32_t keyframe_cache_count(const KeyframeCache* cache);
+const CachedPacket* keyframe_cache_get(const KeyframeCache* cache, uint32_t index);
@@ -9,25 +9,55 @@
 
 #include "network.h"
 #include "connection.h"
+#include "stream.h"
 #include "protocol.h"
 #include "buffer_logic.h"
 #include "integrity_check.h"
+#include "config.h"
+#include "pacer.h"
+#include "metrics.h"
+#include "mixer.h"
+#include "control.h"
+#include "fanout.h"
+#include "trunk.h"
+#include "cluster.h"
+#include "handoff.h"
+#include "snapshot.h"
+#include "notify.h"
+#include "time_utils.h"
+#include <arpa/inet.h>
 
 int g_epoll_fd = -1;
 int g_tcp_fd = -1;
 int g_udp_fd = -1;
 
 volatile sig_atomic_t keep_running = 1;
+volatile sig_atomic_t metrics_requested = 0;
+volatile sig_atomic_t snapshot_requested = 0;
+
+static bool udp_gro_enabled = false;
 
 void handle_signal(int sig) {
     printf("Received signal %d, shutting down...\n", sig);
     keep_running = 0;
 }
 
+void handle_metrics_signal(int sig) {
+    (void)sig;
+    metrics_requested = 1;
+}
+
+void handle_snapshot_signal(int sig) {
+    (void)sig;
+    snapshot_requested = 1;
+}
+
 void setup_signal_handlers(void) {
     // Используем signal вместо sigaction для простоты
     signal(SIGINT, handle_signal);
     signal(SIGTERM, handle_signal);
+    signal(SIGUSR1, handle_metrics_signal);
+    signal(SIGUSR2, handle_snapshot_signal);
     
     // Игнорируем SIGPIPE чтобы не падать при записи в закрытый сокет
     signal(SIGPIPE, SIG_IGN);
@@ -68,64 +98,90 @@ int handle_tcp_accept(void) {
     return 0;
 }
 
+// Обрабатывает все полные сообщения в буфере чтения: границы находятся за один проход,
+// обработанные байты снимаются одним сдвигом в конце
+static void handle_tcp_messages(Connection* conn) {
+    Buffer* read_buf = &conn->read_buffer;
+    uint32_t offset = 0;
+    ProtocolFrame frame;
+    int result;
+
+    // Формат читается заново на каждом сообщении: CLIENT_FRAMING меняет его посреди буфера
+    while ((result = buffer_protocol_next_frame(read_buf->data + offset, read_buf->position - offset,
+                                                conn->framing, &frame)) == 1) {
+        handle_client_message(conn, frame.type, frame.payload, frame.payload_len);
+        offset += frame.frame_len;
+    }
+
+    if (result < 0) {
+        // Не можем определить размер сообщения - очищаем буфер
+        fprintf(stderr, "Cannot determine message size, clearing buffer\n");
+        buffer_clear(read_buf);
+        return;
+    }
+    buffer_protocol_discard(read_buf, offset);
+}
+
 int handle_tcp_client(Connection* conn) {
     if (!conn) return -1;
     
-    int result = connection_read_data(conn);
-    
-    if (result == 0) {
-        // Соединение закрыто клиентом
-        printf("Connection closed by client: %s\n", connection_get_address_string(conn));
-        handle_connection_closed(conn);
-        return 0;
-    } else if (result < 0) {
-        if (result != -2) { // -2 означает EAGAIN/EWOULDBLOCK
-            // Ошибка чтения
-            fprintf(stderr, "Read error from %s, closing connection\n", 
-                    connection_get_address_string(conn));
+    // Edge-triggered: читаем до EAGAIN, разбирая сообщения после каждого чтения
+    for (;;) {
+        int result = connection_read_data(conn);
+        
+        if (result == 0) {
+            // Соединение закрыто клиентом
+            printf("Connection closed by client: %s\n", connection_get_address_string(conn));
             handle_connection_closed(conn);
-            return -1;
+            return 0;
+        } else if (result < 0) {
+            if (result != -2) { // -2 означает EAGAIN/EWOULDBLOCK
+                // Ошибка чтения
+                fprintf(stderr, "Read error from %s, closing connection\n", 
+                        connection_get_address_string(conn));
+                handle_connection_closed(conn);
+                return -1;
+            }
+            // EAGAIN/EWOULDBLOCK - нормально для неблокирующего сокета
+            return 0;
         }
-        // EAGAIN/EWOULDBLOCK - нормально для неблокирующего сокета
-        return 0;
+        
+        handle_tcp_messages(conn);
     }
+}
+
+// Режим UDP GRO: один recvmsg приносит серию датаграмм, режем ее по размеру сегмента
+static int handle_udp_data_gro(void) {
+    static uint8_t buffer[UDP_GRO_BUFFER_SIZE];
+    struct sockaddr_in src_addr;
     
-    // Обрабатываем все полные сообщения в буфере
-    Buffer* read_buf = &conn->read_buffer;
-    
-    while (read_buf->position > 0) {
-        // Если expected_size еще не установлен, пытаемся установить
-        if (read_buf->expected_size == 0) {
-            if (buffer_protocol_set_expected(read_buf) != 0) {
-                // Не можем определить размер сообщения - очищаем буфер
-                fprintf(stderr, "Cannot determine message size, clearing buffer\n");
-                buffer_clear(read_buf);
-                break;
+    for (int i = 0; i < UDP_RX_BATCH; i++) {
+        uint16_t segment_size = 0;
+        int received = udp_receive_gro(g_udp_fd, buffer, sizeof(buffer), &src_addr, &segment_size);
+        
+        if (received <= 0) {
+            if (received < 0 && received != -2) {
+                perror("udp_receive_gro failed");
             }
+            break;
         }
         
-        // Проверяем, есть ли полное сообщение
-        BufferResult state = buffer_protocol_state(read_buf);
+        if (segment_size < received) {
+            g_udp_rx_stats.gro_buffers++;
+        }
         
-        if (state == BUFFER_IS_COMPLETE) {
-            // Извлекаем тип сообщения
-            uint8_t message_type = read_buf->data[0];
-            size_t payload_len = read_buf->expected_size - 1;
-            const uint8_t* payload = read_buf->data + 1;
-            
-            // Обрабатываем сообщение
-            handle_client_message(conn, message_type, payload, payload_len);
-            
-            // Удаляем обработанное сообщение из буфера
-            buffer_protocol_consume(read_buf);
-            
-        } else if (state == BUFFER_OVERFLOW) {
-            fprintf(stderr, "Buffer overflow, clearing\n");
-            buffer_clear(read_buf);
-            break;
-        } else {
-            // BUFFER_IS_INCOMPLETE - ждем больше данных
-            break;
+        for (int offset = 0; offset < received; offset += segment_size) {
+            int remaining = received - offset;
+            size_t len = remaining < segment_size ? (size_t)remaining : segment_size;
+            if (segment_size < received) {
+                g_udp_rx_stats.gro_segments++;
+            }
+            if (len > UDP_PACKET_SIZE) {
+                g_udp_rx_stats.oversized++;
+                continue;
+            }
+            g_udp_rx_stats.datagrams++;
+            handle_udp_packet(buffer + offset, len, &src_addr);
         }
     }
     
@@ -133,28 +189,143 @@ int handle_tcp_client(Connection* conn) {
 }
 
 int handle_udp_data(void) {
+    if (udp_gro_enabled) {
+        return handle_udp_data_gro();
+    }
+    
     uint8_t buffer[UDP_PACKET_SIZE];
     struct sockaddr_in src_addr;
     
-    int received = udp_receive_packet(g_udp_fd, buffer, sizeof(buffer), &src_addr);
-    
-    if (received > 0) {
-        handle_udp_packet(buffer, (size_t)received, &src_addr);
-    } else if (received < 0 && received != -2) {
-        perror("udp_receive_packet failed");
+    // Вычитываем пачку датаграмм: их пересылка уйдет сериями в pacer_flush
+    for (int i = 0; i < UDP_RX_BATCH; i++) {
+        int received = udp_receive_packet(g_udp_fd, buffer, sizeof(buffer), &src_addr);
+        
+        if (received > 0) {
+            g_udp_rx_stats.datagrams++;
+            handle_udp_packet(buffer, (size_t)received, &src_addr);
+        } else {
+            if (received < 0 && received != -2) {
+                perror("udp_receive_packet failed");
+            }
+            break;
+        }
     }
     
     return 0;
 }
 
+// TCP сервера и клиентов читает либо поток управления, либо основной цикл
+static int start_tcp_handling(void) {
+    if (!g_config.control_thread) {
+        if (epoll_add(g_epoll_fd, g_tcp_fd, EPOLLIN) != 0) {
+            fprintf(stderr, "Failed to add TCP server to epoll\n");
+            return -1;
+        }
+        return 0;
+    }
+
+    // Уже открытые соединения (от предшественника) поток дочитывает с их недочитанного места
+    Connection* conn, *tmp;
+    HASH_ITER(hh, connections, conn, tmp) {
+        if (conn->fd < 0) continue;
+        control_plane_adopt(conn->fd, &conn->read_buffer, conn->framing);
+        buffer_clear(&conn->read_buffer);
+    }
+    if (control_plane_start(g_tcp_fd) != 0 ||
+        epoll_add(g_epoll_fd, control_plane_event_fd(), EPOLLIN) != 0) {
+        fprintf(stderr, "Failed to start control plane thread\n");
+        return -1;
+    }
+    printf("Control plane thread started\n");
+    return 0;
+}
+
+// Реестры предшественника поверх полученных от него сокетов
+static int restore_takeover(const HandoffTakeover* takeover) {
+    SnapshotCounts counts;
+    int result = snapshot_restore(takeover->snapshot, takeover->snapshot_len, false, &counts);
+    if (result != 0) {
+        fprintf(stderr, "Failed to restore snapshot from the running server (%d)\n", result);
+        return -1;
+    }
+
+    Connection* conn, *tmp;
+    HASH_ITER(hh, connections, conn, tmp) {
+        if (conn->fd < 0) continue;  // ждет CLIENT_CONN_RESUME, сокета нет
+        uint32_t events = (g_config.control_thread ? 0 : EPOLLIN) | EPOLLET;
+        if (conn->write_buffer.position > 0) events |= EPOLLOUT;
+        if (epoll_add(g_epoll_fd, conn->fd, events) != 0) {
+            fprintf(stderr, "Failed to add client to epoll\n");
+            return -1;
+        }
+    }
+
+    printf("Hot restart: restored %u connections, %u calls, %u streams, %u memberships (%u skipped)\n",
+           counts.connections, counts.calls, counts.streams, counts.memberships, counts.skipped);
+    return 0;
+}
+
+// Преемник подключился к сокету горячего перезапуска: отдаем ему сокеты и реестры.
+// true - он их принял и этот процесс завершается, не трогая соединения
+static bool serve_successor(void) {
+    int channel = handoff_accept();
+    if (channel < 0) return false;
+    printf("Hot restart: successor connected, handing over %u connections\n", HASH_COUNT(connections));
+
+    // Прочитанные потоком управления команды применяются здесь, недочитанное уходит в снимок
+    bool control_was_running = control_plane_running();
+    if (control_was_running) {
+        control_plane_drain();
+    }
+    notify_flush();
+    pacer_flush(monotonic_us());
+
+    SnapshotBlob blob = {0};
+    uint32_t fd_count = 0;
+    int* fds = malloc((HASH_COUNT(connections) + 2) * sizeof(int));
+    int result = fds ? snapshot_encode(&blob) : -1;
+    if (result == 0) {
+        fds[fd_count++] = g_tcp_fd;
+        fds[fd_count++] = g_udp_fd;
+        Connection* conn, *tmp;
+        HASH_ITER(hh, connections, conn, tmp) {
+            if (conn->fd >= 0) fds[fd_count++] = conn->fd;
+        }
+        result = handoff_send(channel, fds, fd_count, blob.data, blob.len);
+    }
+    close(channel);
+    free(fds);
+
+    if (result == 0) {
+        printf("Hot restart: successor took over %u sockets (%zu byte snapshot)\n", fd_count, blob.len);
+        snapshot_blob_free(&blob);
+        return true;
+    }
+    snapshot_blob_free(&blob);
+
+    fprintf(stderr, "Hot restart: handoff failed (%d), continuing to serve\n", result);
+    if (control_was_running && start_tcp_handling() != 0) {
+        keep_running = 0;
+    }
+    return false;
+}
+
 void cleanup(void) {
     printf("Cleaning up...\n");
     
     // Проверяем целостность перед завершением
     check_all_integrity();
     
+    // Сначала останавливаем поток управления: дальше сокеты закрываются здесь
+    control_plane_stop();
+    handoff_stop();
+    fanout_stop();
+    trunk_stop();
+
     // Закрываем все соединения
     connection_close_all();
+    pacer_shutdown();
+    cluster_shutdown();
     
     // Закрываем серверные сокеты
     if (g_tcp_fd >= 0) {
@@ -177,9 +348,29 @@ void cleanup(void) {
 
 int main(int argc, char* argv[]) {
     printf("Starting Video Conference Server...\n");
+
+    config_init_defaults(&g_config);
+    int parse_result = config_parse_args(&g_config, argc, argv);
+    if (parse_result != 0) {
+        return parse_result > 0 ? 0 : 1;
+    }
+    config_print(&g_config);
     
     setup_signal_handlers();
     
+    // Горячий перезапуск: сокеты забираем у работающего сервера раньше, чем открываем
+    // свои дескрипторы - они встают под прежние номера
+    HandoffTakeover takeover = { .tcp_fd = -1, .udp_fd = -1, .channel = -1 };
+    bool taking_over = g_config.takeover_path[0] != '\0';
+    if (taking_over) {
+        int result = handoff_receive(g_config.takeover_path, &takeover);
+        if (result != 0) {
+            fprintf(stderr, "Failed to take over from %s (%d)\n", g_config.takeover_path, result);
+            return 1;
+        }
+        printf("Hot restart: received listeners and client sockets, %zu byte snapshot\n", takeover.snapshot_len);
+    }
+    
     // Создаем epoll
     g_epoll_fd = create_epoll_fd();
     if (g_epoll_fd < 0) {
@@ -188,44 +379,154 @@ int main(int argc, char* argv[]) {
     }
     
     // Создаем TCP сервер
-    int tcp_port = 23230;
-    if (argc > 1) {
-        tcp_port = atoi(argv[1]);
-    }
+    int tcp_port = g_config.tcp_port;
     
-    g_tcp_fd = create_tcp_server(tcp_port);
+    g_tcp_fd = taking_over ? takeover.tcp_fd : create_tcp_server(tcp_port);
     if (g_tcp_fd < 0) {
         fprintf(stderr, "Failed to create TCP server\n");
         cleanup();
         return 1;
     }
+    if (g_config.tcp_sndbuf_bytes > 0) {
+        printf("TCP sndbuf: %d bytes\n", socket_set_buffer(g_tcp_fd, false, (int)g_config.tcp_sndbuf_bytes));
+    }
     
     // Создаем UDP сервер
-    int udp_port = 23231;
-    if (argc > 2) {
-        udp_port = atoi(argv[2]);
-    }
+    int udp_port = g_config.udp_port;
     
-    g_udp_fd = create_udp_server(udp_port);
+    g_udp_fd = taking_over ? takeover.udp_fd : create_udp_server(udp_port);
     if (g_udp_fd < 0) {
         fprintf(stderr, "Failed to create UDP server\n");
         cleanup();
         return 1;
     }
+    // Большие буферы переживают всплески; потери в ядре видны через SO_RXQ_OVFL
+    udp_setup_buffers(g_udp_fd, (int)g_config.udp_rcvbuf_bytes, (int)g_config.udp_sndbuf_bytes);
+    udp_enable_rxq_ovfl(g_udp_fd);
     
-    // Добавляем серверные сокеты в epoll
-    if (epoll_add(g_epoll_fd, g_tcp_fd, EPOLLIN) != 0) {
-        fprintf(stderr, "Failed to add TCP server to epoll\n");
+    // Добавляем UDP сервер в epoll (TCP - после восстановления состояния)
+    if (epoll_add(g_epoll_fd, g_udp_fd, EPOLLIN) != 0) {
+        fprintf(stderr, "Failed to add UDP server to epoll\n");
         cleanup();
         return 1;
     }
     
-    if (epoll_add(g_epoll_fd, g_udp_fd, EPOLLIN) != 0) {
-        fprintf(stderr, "Failed to add UDP server to epoll\n");
+    // Таймер планировщика пейсинга
+    if (pacer_init(g_epoll_fd) != 0) {
+        fprintf(stderr, "Failed to initialize pacer\n");
+        cleanup();
+        return 1;
+    }
+    if (g_config.udp_gso) {
+        pacer_enable_gso(g_udp_fd);
+    }
+    pacer_set_bundle_window(g_config.bundle_window_us);
+    pacer_set_queue_limit(g_config.egress_queue_packets);
+    pacer_set_drop_policy(g_config.egress_drop_policy);
+    if (g_config.dscp_marking) {
+        pacer_set_class_marking(MEDIA_CLASS_AUDIO, g_config.audio_dscp, PACER_AUDIO_SO_PRIORITY);
+        pacer_set_class_marking(MEDIA_CLASS_VIDEO, g_config.video_dscp, PACER_VIDEO_SO_PRIORITY);
+    }
+    // Склеенная на приеме серия уходит получателям тоже серией (GSO) в pacer_flush
+    if (g_config.udp_gro) {
+        udp_gro_enabled = udp_enable_gro(g_udp_fd) == 0;
+        printf("UDP GRO %s\n", udp_gro_enabled ? "enabled" : "is not available, receiving datagrams one by one");
+    }
+    
+    // Потоки рассылки для стримов с большой аудиторией
+    if (g_config.fanout_threads > 0) {
+        if (fanout_start(g_config.fanout_threads, g_udp_fd) != 0) {
+            fprintf(stderr, "Failed to start fan-out threads\n");
+            cleanup();
+            return 1;
+        }
+        printf("Fan-out: %u threads for streams with %d+ recipients\n", fanout_thread_count(), FANOUT_MIN_RECIPIENTS);
+    }
+    
+    // Кластер: звонки распределены по узлам согласованным хешированием
+    if (g_config.cluster_node_count > 1) {
+        if (cluster_init(g_config.cluster_nodes, g_config.cluster_node_count, g_config.cluster_self) != 0) {
+            fprintf(stderr, "Failed to initialize cluster\n");
+            cleanup();
+            return 1;
+        }
+        const ClusterNode* self = cluster_node(cluster_self());
+        if (ntohs(self->tcp_addr.sin_port) != tcp_port || self->udp_port != udp_port) {
+            fprintf(stderr, "Warning: cluster node %u is %u/%u, but this server listens on %d/%d\n",
+                    cluster_self(), ntohs(self->tcp_addr.sin_port), self->udp_port, tcp_port, udp_port);
+        }
+        printf("Cluster: node %u of %u, owns %u.%u%% of the call ring\n", cluster_self(), cluster_node_count(),
+               cluster_ring_share(cluster_self()) / 10, cluster_ring_share(cluster_self()) % 10);
+    }
+    
+    // Магистраль к узлу-источнику: чужие стримы принимаются на наш UDP-сокет
+    if (g_config.trunk_tcp_port > 0) {
+        struct sockaddr_in origin_tcp, origin_udp;
+        memset(&origin_tcp, 0, sizeof(origin_tcp));
+        origin_tcp.sin_family = AF_INET;
+        origin_tcp.sin_port = htons(g_config.trunk_tcp_port);
+        inet_pton(AF_INET, g_config.trunk_host, &origin_tcp.sin_addr);
+        origin_udp = origin_tcp;
+        origin_udp.sin_port = htons(g_config.trunk_udp_port);
+
+        if (trunk_start(&origin_tcp, &origin_udp, g_epoll_fd, g_udp_fd) != 0) {
+            fprintf(stderr, "Failed to start trunk\n");
+            cleanup();
+            return 1;
+        }
+        printf("Trunk to origin %s:%u (UDP %u)\n", g_config.trunk_host, g_config.trunk_tcp_port,
+               g_config.trunk_udp_port);
+    }
+    
+    // Ядро микшера звонков под текущий процессор
+    mixer_init();
+    printf("Audio mixer kernel: %s\n", mixer_kernel_name());
+    
+    // Реестры предшественника восстанавливаются, когда подсистемы уже запущены
+    if (taking_over && restore_takeover(&takeover) != 0) {
+        handoff_takeover_free(&takeover);
+        cleanup();
+        return 1;
+    }
+    
+    // Иначе - снимок из файла (после падения или остановки): клиенты вернутся с CLIENT_CONN_RESUME
+    if (!taking_over && g_config.snapshot_path[0] != '\0') {
+        SnapshotCounts counts;
+        int result = snapshot_load(g_config.snapshot_path, &counts);
+        if (result == 0) {
+            printf("Snapshot: restored %u calls, %u streams, %u memberships from %s; "
+                   "%u connections wait %d s for CLIENT_CONN_RESUME\n",
+                   counts.calls, counts.streams, counts.memberships, g_config.snapshot_path, counts.detached,
+                   SNAPSHOT_RESUME_GRACE_MS / 1000);
+        } else if (result < 0) {
+            fprintf(stderr, "Snapshot: %s is damaged (%d), restored %u connections of it\n",
+                    g_config.snapshot_path, result, counts.connections);
+        }
+    }
+    
+    if (start_tcp_handling() != 0) {
+        handoff_takeover_free(&takeover);
         cleanup();
         return 1;
     }
     
+    // Все готово: предшественник может завершаться
+    if (taking_over) {
+        if (handoff_confirm(&takeover) != 0) {
+            fprintf(stderr, "Hot restart: the running server did not get the confirmation\n");
+        }
+        handoff_takeover_free(&takeover);
+    }
+    
+    if (g_config.handoff_path[0] != '\0') {
+        if (handoff_listen(g_config.handoff_path, g_epoll_fd) != 0) {
+            fprintf(stderr, "Failed to listen for hot restart on %s\n", g_config.handoff_path);
+            cleanup();
+            return 1;
+        }
+        printf("Hot restart: waiting for a successor on %s\n", g_config.handoff_path);
+    }
+    
     printf("Server started successfully\n");
     printf("TCP port: %d, UDP port: %d\n", tcp_port, udp_port);
     printf("Press Ctrl+C to stop the server\n");
@@ -234,7 +535,11 @@ int main(int argc, char* argv[]) {
     struct epoll_event events[100];
     
     while (keep_running) {
-        int nfds = epoll_wait(g_epoll_fd, events, 100, 1000); // 1 second timeout
+        // Пока идет досылка кеша ключевых кадров или микширование звонков, просыпаемся каждую миллисекунду;
+        // остались команды управления сверх бюджета итерации - не ждем вовсе
+        int timeout = stream_active_replays > 0 || call_mixing_count > 0 ? 1 : 1000;
+        if (control_plane_backlog() > 0) timeout = 0;
+        int nfds = epoll_wait(g_epoll_fd, events, 100, timeout);
         
         if (nfds < 0) {
             if (errno == EINTR) {
@@ -244,6 +549,9 @@ int main(int argc, char* argv[]) {
             break;
         }
         
+        // Уведомления о звонках и стримах копятся до конца итерации
+        if (g_config.event_coalescing) notify_begin();
+        
         for (int i = 0; i < nfds; i++) {
             int fd = events[i].data.fd;
             
@@ -251,33 +559,113 @@ int main(int argc, char* argv[]) {
                 // Новое TCP соединение
                 handle_tcp_accept();
             } else if (fd == g_udp_fd) {
+                // Буфер отправки освободился - досылаем очереди, упершиеся в EAGAIN
+                if (events[i].events & EPOLLOUT) {
+                    pacer_on_writable();
+                }
                 // UDP данные
-                handle_udp_data();
+                if (events[i].events & EPOLLIN) {
+                    handle_udp_data();
+                }
+            } else if (fd == pacer_get_timer_fd()) {
+                // Тик колеса таймеров пейсинга
+                pacer_on_timer();
+            } else if (fd == handoff_fd()) {
+                // Новый процесс забирает сокеты и состояние
+                if (serve_successor()) break;
+            } else if (fd == trunk_fd()) {
+                // Сокет магистрали к узлу-источнику
+                trunk_on_event(events[i].events);
+            } else if (fd == control_plane_event_fd()) {
+                // Команды управления применяются после UDP этой итерации
+                continue;
             } else {
                 // TCP клиент
                 Connection* conn = connection_find(fd);
                 if (conn) {
-                    if (events[i].events & EPOLLIN) {
+                    // С потоком управления сокет клиента читает он, здесь - только досылка
+                    if ((events[i].events & EPOLLIN) && !control_plane_running()) {
                         handle_tcp_client(conn);
                     }
                     if (events[i].events & EPOLLOUT) {
                         connection_write_data(conn);
                     }
                 } else {
-                    // Соединение не найдено - удаляем из epoll
+                    // Соединение не найдено - удаляем из epoll (сокет потока управления закроет он сам)
                     epoll_remove(g_epoll_fd, fd);
-                    close(fd);
+                    if (!control_plane_running()) {
+                        close(fd);
+                    }
                 }
             }
         }
         
+        // Соединения уже у преемника: больше ничего не читаем и не шлем
+        if (handoff_completed()) break;
+        
+        // Управляющие команды порцией: всплеск входов в звонки растягивается на несколько итераций
+        control_plane_apply(CONTROL_COMMANDS_PER_TICK);
+        
+        process_keyframe_replays();
+        process_call_mixing();
+        process_stream_stats();
+        notify_flush();
+        
+        // Отправляем все, что накопилось за итерацию (серии одному получателю - через GSO).
+        // Потоки рассылки будим первыми: очереди, ждущие их заданий, дождутся быстрее
+        uint64_t now_us = monotonic_us();
+        fanout_flush();
+        pacer_flush(now_us);
+        fanout_collect();
+        trunk_tick(now_us / 1000ull);
+        
         // Периодическая проверка целостности (каждые 60 секунд)
         static time_t last_check = 0;
         time_t now = time(NULL);
+
+        // Раз в секунду: буферы UDP растут, если ядро теряло пакеты или отправка упиралась в EAGAIN
+        static time_t last_autotune = 0;
+        if (now != last_autotune) {
+            udp_autotune_buffers(g_udp_fd, pacer_eagain_stalls());
+            last_autotune = now;
+        }
         if (now - last_check >= 60) {
             check_all_integrity();
             last_check = now;
         }
+
+        // Метрики: периодически и по SIGUSR1
+        static time_t last_metrics = 0;
+        if (last_metrics == 0) last_metrics = now;
+        if (metrics_requested ||
+            (g_config.metrics_interval_sec > 0 && now - last_metrics >= (time_t)g_config.metrics_interval_sec)) {
+            metrics_print_report(stdout);
+            metrics_requested = 0;
+            last_metrics = now;
+        }
+
+        // Снимок состояния: периодически и по SIGUSR2, пишет дочерний процесс
+        if (g_config.snapshot_path[0] != '\0') {
+            static time_t last_snapshot = 0;
+            if (last_snapshot == 0) last_snapshot = now;
+            if (snapshot_requested ||
+                (g_config.snapshot_interval_sec > 0 && now - last_snapshot >= (time_t)g_config.snapshot_interval_sec)) {
+                snapshot_save_async(g_config.snapshot_path);
+                snapshot_requested = 0;
+                last_snapshot = now;
+            }
+            snapshot_reap(false);
+        }
+        snapshot_expire_detached(now_us / 1000ull);
+    }
+    
+    // Остановка без преемника: последний снимок, чтобы клиенты возобновились на следующем запуске
+    if (g_config.snapshot_path[0] != '\0' && !handoff_completed()) {
+        snapshot_reap(true);
+        int bytes = snapshot_save(g_config.snapshot_path);
+        if (bytes >= 0) {
+            printf("Snapshot: saved %d bytes to %s\n", bytes, g_config.snapshot_path);
+        }
     }
     
     cleanup();
@@ -0,0 +1,159 @@
+#include "metrics.h"
+#include "connection.h"
+#include "pacer.h"
+#include "packet_pool.h"
+#include "network.h"
+#include "stream.h"
+#include "control.h"
+#include "fanout.h"
+#include "trunk.h"
+#include "cluster.h"
+#include "snapshot.h"
+#include "notify.h"
+#include "config.h"
+
+static void metrics_print_recipients(FILE* out) {
+    fprintf(out, "  %-6s %-21s %6s %6s %10s %10s %10s %10s %10s %7s %8s %8s %8s %8s %8s %8s %10s %8s %10s\n",
+            "fd", "udp", "depth", "max", "enqueued", "sent", "sent_aud", "sent_vid", "fanout", "starve", "full",
+            "oldest", "video", "eagain", "error", "gso", "gso_pkts", "bundles", "bndl_pkts");
+
+    Connection* conn, *tmp;
+    HASH_ITER(hh, connections, conn, tmp) {
+        PacerQueue* queue = conn->pacer;
+        if (!queue) continue;
+
+        char addr[32];
+        sockaddr_to_string(&conn->udp_addr, addr, sizeof(addr));
+        fprintf(out, "  %-6d %-21s %6u %6u %10lu %10lu %10lu %10lu %10lu %7lu %8lu %8lu %8lu %8lu %8lu %8lu %10lu %8lu %10lu\n",
+                conn->fd, addr, pacer_queue_depth(queue), queue->stats.max_depth,
+                (unsigned long)queue->stats.enqueued, (unsigned long)queue->stats.sent,
+                (unsigned long)queue->stats.sent_class[MEDIA_CLASS_AUDIO],
+                (unsigned long)queue->stats.sent_class[MEDIA_CLASS_VIDEO],
+                (unsigned long)queue->stats.sent_direct, (unsigned long)queue->stats.starvation_turns,
+                (unsigned long)queue->stats.dropped_full, (unsigned long)queue->stats.dropped_oldest,
+                (unsigned long)queue->stats.dropped_video, (unsigned long)queue->stats.eagain_stalls,
+                (unsigned long)queue->stats.dropped_error, (unsigned long)queue->stats.gso_batches,
+                (unsigned long)queue->stats.gso_packets, (unsigned long)queue->stats.bundles,
+                (unsigned long)queue->stats.bundled_packets);
+    }
+}
+
+static void metrics_print_bandwidth(FILE* out) {
+    fprintf(out, "  %-6s %10s %10s %10s %7s %9s %8s %10s\n",
+            "fd", "est_kbps", "rx_kbps", "need_kbps", "loss%", "congested", "reports", "dropped");
+
+    Connection* conn, *tmp;
+    HASH_ITER(hh, connections, conn, tmp) {
+        const BandwidthEstimator* bwe = &conn->bwe;
+        if (bwe->reports == 0) continue;
+
+        fprintf(out, "  %-6d %10u %10u %10u %5u.%u %9s %8lu %10lu\n",
+                conn->fd, bwe->estimate_bps / 1000, bwe->receive_rate_bps / 1000, bwe->demand_bps / 1000,
+                bwe->loss_permille / 10, bwe->loss_permille % 10, bwe->congested ? "yes" : "no",
+                (unsigned long)bwe->reports, (unsigned long)bwe->dropped_packets);
+    }
+}
+
+static void metrics_print_ingress(FILE* out) {
+    fprintf(out, "  %-10s %-6s %10s %10s %8s %7s %8s %8s %8s %10s\n",
+            "stream", "owner", "received", "expected", "lost", "loss%", "reorder", "dup", "late", "jitter_us");
+
+    Stream* stream, *tmp;
+    HASH_ITER(hh, streams, stream, tmp) {
+        StreamIngressTotals totals;
+        stream_ingress_totals(stream, &totals);
+        if (totals.expected == 0) continue;
+
+        uint64_t late = 0;
+        for (int layer = 0; layer < SIMULCAST_MAX_LAYERS; layer++) {
+            late += stream->ingress[layer].late;
+        }
+        uint64_t loss_permille = totals.lost * 1000 / totals.expected;
+        fprintf(out, "  %-10u %-6d %10lu %10lu %8lu %5lu.%lu %8lu %8lu %8lu %10u\n",
+                stream->stream_id, stream->owner ? stream->owner->fd : -1,
+                (unsigned long)totals.received, (unsigned long)totals.expected, (unsigned long)totals.lost,
+                (unsigned long)(loss_permille / 10), (unsigned long)(loss_permille % 10),
+                (unsigned long)totals.reordered, (unsigned long)totals.duplicates, (unsigned long)late,
+                totals.jitter_us);
+    }
+}
+
+static void metrics_print_fanout(FILE* out) {
+    fprintf(out, "  %-6s %10s %12s %10s %8s %8s %8s %10s\n",
+            "thread", "jobs", "sends", "sendmmsg", "eagain", "dropped", "error", "queue_full");
+
+    for (uint32_t t = 0; t < fanout_thread_count(); t++) {
+        FanoutStats stats = fanout_thread_stats(t);
+        fprintf(out, "  %-6u %10lu %12lu %10lu %8lu %8lu %8lu %10lu\n",
+                t, (unsigned long)stats.jobs, (unsigned long)stats.sends, (unsigned long)stats.syscalls,
+                (unsigned long)stats.eagain_waits, (unsigned long)stats.dropped_eagain, (unsigned long)stats.errors,
+                (unsigned long)stats.queue_full);
+    }
+}
+
+void metrics_print_report(FILE* out) {
+    if (!out) return;
+
+    PacketPoolStats pool = packet_pool_stats();
+
+    fprintf(out, "=== Metrics ===\n");
+    fprintf(out, "Connections: %u, packet buffers: %lu in use / %lu allocated, paced queues waiting: %u\n",
+            HASH_COUNT(connections), (unsigned long)pool.in_use, (unsigned long)pool.allocated,
+            pacer_scheduled_count());
+    fprintf(out, "UDP ingress: %lu datagrams, %lu GRO buffers carrying %lu datagrams, %lu oversized dropped\n",
+            (unsigned long)g_udp_rx_stats.datagrams, (unsigned long)g_udp_rx_stats.gro_buffers,
+            (unsigned long)g_udp_rx_stats.gro_segments, (unsigned long)g_udp_rx_stats.oversized);
+    fprintf(out, "UDP socket: %lu dropped by kernel (receive queue overflow), rcvbuf %d%s, sndbuf %d%s, "
+            "%lu EAGAIN stalls, %u buffer grows\n",
+            (unsigned long)g_udp_rx_stats.kernel_drops, g_udp_buffers.rcvbuf,
+            g_udp_buffers.auto_rcvbuf ? " (auto)" : "", g_udp_buffers.sndbuf,
+            g_udp_buffers.auto_sndbuf ? " (auto)" : "", (unsigned long)pacer_eagain_stalls(), g_udp_buffers.grows);
+    if (control_plane_running()) {
+        ControlStats control = control_plane_stats();
+        fprintf(out, "Control plane thread: %lu accepted, %lu messages, %lu closed, %lu applied, "
+                "backlog %u (max %u), %lu full-queue waits\n",
+                (unsigned long)control.accepted, (unsigned long)control.messages, (unsigned long)control.closed,
+                (unsigned long)control.applied, control_plane_backlog(), control.max_backlog,
+                (unsigned long)control.queue_full_waits);
+    }
+    fprintf(out, "UDP egress per recipient (GSO %s, bundle window %u us, queue limit %u, drop %s, waiting EPOLLOUT: %u):\n",
+            pacer_gso_enabled() ? "on" : "off", pacer_bundle_window(), pacer_queue_limit(),
+            pacer_drop_policy_name(pacer_drop_policy()), pacer_blocked_count());
+    metrics_print_recipients(out);
+    fprintf(out, "Downlink estimates (receiver reports):\n");
+    metrics_print_bandwidth(out);
+    fprintf(out, "Ingress per stream (packet_number):\n");
+    metrics_print_ingress(out);
+    if (cluster_enabled()) {
+        uint32_t share = cluster_ring_share(cluster_self());
+        fprintf(out, "Cluster: node %u of %u, ring share %u.%u%%, %u calls here, %lu joins redirected\n",
+                cluster_self(), cluster_node_count(), share / 10, share % 10, HASH_COUNT(calls),
+                (unsigned long)cluster_redirects());
+    }
+    if (g_config.event_coalescing) {
+        NotifyStats notify = notify_stats();
+        fprintf(out, "Notifications: %lu events queued, %lu superseded, %lu writes (%lu SERVER_EVENT_BATCH)\n",
+                (unsigned long)notify.events, (unsigned long)notify.superseded, (unsigned long)notify.writes,
+                (unsigned long)notify.batches);
+    }
+    if (g_config.snapshot_path[0] != '\0') {
+        SnapshotStats snapshot = snapshot_stats();
+        fprintf(out, "State snapshots: %lu written (%lu failed), last %lu bytes in %lu ms, "
+                "%u connections awaiting resume\n",
+                (unsigned long)snapshot.written, (unsigned long)snapshot.failed, (unsigned long)snapshot.last_bytes,
+                (unsigned long)snapshot.last_ms, snapshot.detached);
+    }
+    if (trunk_enabled()) {
+        TrunkStats trunk = trunk_stats();
+        fprintf(out, "Trunk to origin: %s, %u subscriptions (%u active), %lu joins (%lu refused), %lu leaves, "
+                "%lu disconnects, %lu packets in -> %lu local copies\n",
+                trunk_state_name(trunk.state), trunk.subscriptions, trunk.active, (unsigned long)trunk.joins,
+                (unsigned long)trunk.join_failures, (unsigned long)trunk.leaves, (unsigned long)trunk.disconnects,
+                (unsigned long)trunk.packets, (unsigned long)trunk.sends);
+    }
+    if (fanout_enabled()) {
+        fprintf(out, "Fan-out threads (streams with %d+ recipients):\n", FANOUT_MIN_RECIPIENTS);
+        metrics_print_fanout(out);
+    }
+    fflush(out);
+}
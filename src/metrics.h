@@ -0,0 +1,5 @@
+#pragma once
+#include <stdio.h>
+
+// Отчет о состоянии сервера: очереди отправки и счетчики потерь по получателям
+void metrics_print_report(FILE* out);
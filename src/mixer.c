@@ -0,0 +1,121 @@
+#include "mixer.h"
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// ==================== ОЧЕРЕДЬ КАДРОВ ====================
+
+void audio_jitter_init(AudioJitterQueue* queue) {
+    if (!queue) return;
+    memset(queue, 0, sizeof(*queue));
+}
+
+void audio_jitter_push(AudioJitterQueue* queue, const void* pcm) {
+    if (!queue || !pcm) return;
+
+    // Издатель обгоняет микшер - выбрасываем самый старый кадр, задержка не растет
+    if (queue->count == MIX_JITTER_FRAMES) {
+        queue->head = (uint8_t)((queue->head + 1) % MIX_JITTER_FRAMES);
+        queue->count--;
+        queue->overruns++;
+    }
+
+    int tail = (queue->head + queue->count) % MIX_JITTER_FRAMES;
+    memcpy(queue->frames[tail].samples, pcm, MIX_FRAME_BYTES);
+    queue->count++;
+}
+
+const AudioFrame* audio_jitter_pop(AudioJitterQueue* queue) {
+    if (!queue) return NULL;
+    if (queue->count == 0) {
+        queue->underruns++;
+        return NULL;
+    }
+
+    const AudioFrame* frame = &queue->frames[queue->head];
+    queue->head = (uint8_t)((queue->head + 1) % MIX_JITTER_FRAMES);
+    queue->count--;
+    return frame;  // действителен до следующего push
+}
+
+// ==================== ЯДРА СЛОЖЕНИЯ С НАСЫЩЕНИЕМ ====================
+
+void mix_add_s16_scalar(int16_t* acc, const int16_t* src, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        int32_t sum = (int32_t)acc[i] + src[i];
+        if (sum > INT16_MAX) sum = INT16_MAX;
+        if (sum < INT16_MIN) sum = INT16_MIN;
+        acc[i] = (int16_t)sum;
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2")))
+void mix_add_s16_sse2(int16_t* acc, const int16_t* src, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(acc + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(src + i));
+        _mm_storeu_si128((__m128i*)(acc + i), _mm_adds_epi16(a, b));
+    }
+    mix_add_s16_scalar(acc + i, src + i, count - i);
+}
+
+__attribute__((target("avx2")))
+void mix_add_s16_avx2(int16_t* acc, const int16_t* src, size_t count) {
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(acc + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(src + i));
+        _mm256_storeu_si256((__m256i*)(acc + i), _mm256_adds_epi16(a, b));
+    }
+    mix_add_s16_sse2(acc + i, src + i, count - i);
+}
+#endif
+
+MixAddFn mix_add_s16 = mix_add_s16_scalar;
+static const char* mix_kernel_name = "scalar";
+
+void mixer_init(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        mix_add_s16 = mix_add_s16_avx2;
+        mix_kernel_name = "avx2";
+        return;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        mix_add_s16 = mix_add_s16_sse2;
+        mix_kernel_name = "sse2";
+        return;
+    }
+#endif
+    mix_add_s16 = mix_add_s16_scalar;
+    mix_kernel_name = "scalar";
+}
+
+const char* mixer_kernel_name(void) {
+    return mix_kernel_name;
+}
+
+// ==================== МИКШИРОВАНИЕ ====================
+
+void mixer_mix_minus(const AudioFrame* const* sources, int count, AudioFrame* everyone, AudioFrame* minus) {
+    memset(everyone->samples, 0, sizeof(everyone->samples));
+    if (count <= 0) return;
+
+    // Суффиксные суммы: minus[i] = sources[i+1] + ... + sources[count-1]
+    memset(minus[count - 1].samples, 0, sizeof(minus[count - 1].samples));
+    for (int i = count - 2; i >= 0; i--) {
+        memcpy(minus[i].samples, minus[i + 1].samples, sizeof(minus[i].samples));
+        mix_add_s16(minus[i].samples, sources[i + 1]->samples, MIX_FRAME_SAMPLES);
+    }
+
+    // Префиксная сумма копится в everyone: к minus[i] добавляется все, что до i.
+    // Итого 3*count сложений кадров вместо count^2 при сумме "всех, кроме себя" в лоб.
+    for (int i = 0; i < count; i++) {
+        mix_add_s16(minus[i].samples, everyone->samples, MIX_FRAME_SAMPLES);
+        mix_add_s16(everyone->samples, sources[i]->samples, MIX_FRAME_SAMPLES);
+    }
+}
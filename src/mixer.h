@@ -0,0 +1,61 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Формат PCM в режиме микширования: 16 бит со знаком, little-endian, моно.
+// Кадр 10 мс при 48 кГц - 960 байт, помещается в UDPStreamPacket.data вместе с расширением.
+#ifndef MIX_SAMPLE_RATE
+#define MIX_SAMPLE_RATE 48000
+#endif
+#ifndef MIX_FRAME_MS
+#define MIX_FRAME_MS 10
+#endif
+#define MIX_FRAME_SAMPLES (MIX_SAMPLE_RATE / 1000 * MIX_FRAME_MS)
+#define MIX_FRAME_BYTES   (MIX_FRAME_SAMPLES * (int)sizeof(int16_t))
+
+// Сколько кадров издателя может ждать очередного тика микшера
+#ifndef MIX_JITTER_FRAMES
+#define MIX_JITTER_FRAMES 4
+#endif
+
+// Не больше стольких источников смешивается в одном кадре
+#ifndef MIX_MAX_SOURCES
+#define MIX_MAX_SOURCES 8
+#endif
+
+typedef struct {
+    _Alignas(32) int16_t samples[MIX_FRAME_SAMPLES];
+} AudioFrame;
+
+// Очередь кадров одного аудиострима: издатель пишет когда придется,
+// микшер забирает по одному кадру на тик
+typedef struct AudioJitterQueue {
+    AudioFrame frames[MIX_JITTER_FRAMES];
+    uint8_t head;
+    uint8_t count;
+    uint64_t overruns;   // кадр пришел в полную очередь - самый старый выброшен
+    uint64_t underruns;  // на тике кадра не было
+} AudioJitterQueue;
+
+void audio_jitter_init(AudioJitterQueue* queue);
+void audio_jitter_push(AudioJitterQueue* queue, const void* pcm);  // MIX_FRAME_BYTES байт
+const AudioFrame* audio_jitter_pop(AudioJitterQueue* queue);       // NULL - кадра нет
+
+// Ядро: acc[i] = saturate(acc[i] + src[i])
+typedef void (*MixAddFn)(int16_t* acc, const int16_t* src, size_t count);
+
+void mix_add_s16_scalar(int16_t* acc, const int16_t* src, size_t count);
+#if defined(__x86_64__) || defined(__i386__)
+void mix_add_s16_sse2(int16_t* acc, const int16_t* src, size_t count);
+void mix_add_s16_avx2(int16_t* acc, const int16_t* src, size_t count);
+#endif
+
+// Выбор лучшего ядра для текущего процессора (до этого используется скалярное)
+void mixer_init(void);
+const char* mixer_kernel_name(void);
+extern MixAddFn mix_add_s16;
+
+// Микширование кадра: everyone - сумма всех источников,
+// minus[i] - сумма всех, кроме sources[i] (его владелец не слышит себя)
+void mixer_mix_minus(const AudioFrame* const* sources, int count, AudioFrame* everyone, AudioFrame* minus);
@@ -5,9 +5,28 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <stdatomic.h>
 #include <arpa/inet.h>
 #include <sys/epoll.h>
 #include <netinet/tcp.h>
+#include <netinet/udp.h>
+
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+
+#ifndef SO_RXQ_OVFL
+#define SO_RXQ_OVFL 40
+#endif
+
+UdpRxStats g_udp_rx_stats;
+SocketBufferState g_udp_buffers;
 
 // Изменяем на объявления (extern) вместо определений
 extern int g_udp_fd;
@@ -122,6 +141,116 @@ int create_udp_server(int port) {
     return server_fd;
 }
 
+int socket_get_buffer(int fd, bool receive) {
+    int value = 0;
+    socklen_t len = sizeof(value);
+    if (getsockopt(fd, SOL_SOCKET, receive ? SO_RCVBUF : SO_SNDBUF, &value, &len) == -1) {
+        return -1;
+    }
+    return value;
+}
+
+int socket_set_buffer(int fd, bool receive, int bytes) {
+    if (bytes <= 0) return socket_get_buffer(fd, receive);
+
+    int force = receive ? SO_RCVBUFFORCE : SO_SNDBUFFORCE;
+    int plain = receive ? SO_RCVBUF : SO_SNDBUF;
+    if (setsockopt(fd, SOL_SOCKET, force, &bytes, sizeof(bytes)) == -1 &&
+        setsockopt(fd, SOL_SOCKET, plain, &bytes, sizeof(bytes)) == -1) {
+        perror(receive ? "setsockopt SO_RCVBUF" : "setsockopt SO_SNDBUF");
+        return -1;
+    }
+    return socket_get_buffer(fd, receive);
+}
+
+// Ядро хранит удвоенный размер: меньше запрошенного - уперлись в [rw]mem_max
+static void udp_report_buffer(const char* name, int requested, int actual) {
+    if (actual >= 0 && actual < requested) {
+        printf("UDP %s: %d bytes (requested %d, limited by net.core.%s_max without CAP_NET_ADMIN)\n",
+               name, actual, requested, name[0] == 'r' ? "rmem" : "wmem");
+    } else {
+        printf("UDP %s: %d bytes\n", name, actual);
+    }
+}
+
+void udp_setup_buffers(int udp_fd, int rcvbuf, int sndbuf) {
+    memset(&g_udp_buffers, 0, sizeof(g_udp_buffers));
+    g_udp_buffers.auto_rcvbuf = rcvbuf == 0;
+    g_udp_buffers.auto_sndbuf = sndbuf == 0;
+
+    int rcv_target = rcvbuf ? rcvbuf : UDP_AUTO_BUFFER_BYTES;
+    int snd_target = sndbuf ? sndbuf : UDP_AUTO_BUFFER_BYTES;
+    g_udp_buffers.rcvbuf = socket_set_buffer(udp_fd, true, rcv_target);
+    g_udp_buffers.sndbuf = socket_set_buffer(udp_fd, false, snd_target);
+    udp_report_buffer("rcvbuf", rcv_target, g_udp_buffers.rcvbuf);
+    udp_report_buffer("sndbuf", snd_target, g_udp_buffers.sndbuf);
+}
+
+// Удваивает буфер (ядро само удваивает переданный размер); уперлись в лимит - авто выключается
+static void udp_grow_buffer(int udp_fd, bool receive, int* size, bool* auto_mode) {
+    const char* name = receive ? "rcvbuf" : "sndbuf";
+    if (*size <= 0 || *size >= UDP_AUTO_BUFFER_MAX) {
+        *auto_mode = false;
+        return;
+    }
+
+    int before = *size;
+    int after = socket_set_buffer(udp_fd, receive, before);
+    if (after <= before) {
+        printf("UDP %s stays at %d bytes: raise net.core.%s_max or run with CAP_NET_ADMIN\n",
+               name, before, receive ? "rmem" : "wmem");
+        *auto_mode = false;
+        return;
+    }
+
+    *size = after;
+    g_udp_buffers.grows++;
+    printf("UDP %s grown after %s: %d -> %d bytes\n", name, receive ? "kernel drops" : "EAGAIN", before, after);
+}
+
+void udp_autotune_buffers(int udp_fd, uint64_t eagain_stalls) {
+    bool kernel_dropped = g_udp_rx_stats.kernel_drops > g_udp_buffers.seen_kernel_drops;
+    bool send_stalled = eagain_stalls > g_udp_buffers.seen_eagain_stalls;
+    g_udp_buffers.seen_kernel_drops = g_udp_rx_stats.kernel_drops;
+    g_udp_buffers.seen_eagain_stalls = eagain_stalls;
+
+    if (kernel_dropped && g_udp_buffers.auto_rcvbuf) {
+        udp_grow_buffer(udp_fd, true, &g_udp_buffers.rcvbuf, &g_udp_buffers.auto_rcvbuf);
+    }
+    if (send_stalled && g_udp_buffers.auto_sndbuf) {
+        udp_grow_buffer(udp_fd, false, &g_udp_buffers.sndbuf, &g_udp_buffers.auto_sndbuf);
+    }
+}
+
+int udp_enable_rxq_ovfl(int udp_fd) {
+    int on = 1;
+    if (setsockopt(udp_fd, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on)) == -1) {
+        perror("setsockopt SO_RXQ_OVFL");
+        return -1;
+    }
+    return 0;
+}
+
+// Служебные данные приема: размер сегмента GRO и счетчик потерь сокета
+static void udp_parse_cmsgs(struct msghdr* msg, ssize_t received, uint16_t* segment_size) {
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO && segment_size) {
+            int gso_size = 0;
+            memcpy(&gso_size, CMSG_DATA(cmsg), sizeof(gso_size));
+            if (gso_size > 0 && gso_size < received) {
+                *segment_size = (uint16_t)gso_size;
+            }
+        } else if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL) {
+            // Накопительный счетчик сокета на момент постановки датаграммы в очередь
+            uint32_t drops = 0;
+            memcpy(&drops, CMSG_DATA(cmsg), sizeof(drops));
+            if (drops > g_udp_rx_stats.kernel_drops) {
+                g_udp_rx_stats.kernel_drops = drops;
+            }
+        }
+    }
+}
+
 int create_epoll_fd(void) {
     int epoll_fd = epoll_create1(0);
     if (epoll_fd == -1) {
@@ -228,13 +357,202 @@ int udp_send_packet(int udp_fd, const void* data, size_t len,
     return (int)sent;
 }
 
+// Служебные данные отправки: размер сегмента GSO и разметка класса
+typedef union {
+    char buf[CMSG_SPACE(sizeof(uint16_t)) + 2 * CMSG_SPACE(sizeof(int))];
+    struct cmsghdr align;
+} UdpSendControl;
+
+// Ядро может не знать cmsg разметки (SO_PRIORITY - с 6.x): тогда выключаем ее.
+// Флаги общие с потоками рассылки (fanout.c)
+static _Atomic bool udp_tos_cmsg = true;
+static _Atomic bool udp_priority_cmsg = true;
+
+static struct cmsghdr* udp_put_cmsg(UdpSendControl* control, size_t* used, int level, int type,
+                                    const void* data, size_t len) {
+    struct cmsghdr* cmsg = (struct cmsghdr*)(control->buf + *used);
+    cmsg->cmsg_level = level;
+    cmsg->cmsg_type = type;
+    cmsg->cmsg_len = CMSG_LEN(len);
+    memcpy(CMSG_DATA(cmsg), data, len);
+    *used += CMSG_SPACE(len);
+    return cmsg;
+}
+
+static bool udp_marking_active(const UdpMarking* marking) {
+    return marking && ((marking->tos >= 0 && udp_tos_cmsg) || (marking->priority >= 0 && udp_priority_cmsg));
+}
+
+static size_t udp_fill_control(UdpSendControl* control, uint16_t segment_size, const UdpMarking* marking) {
+    memset(control, 0, sizeof(*control));
+    size_t used = 0;
+
+    if (segment_size > 0) {
+        udp_put_cmsg(control, &used, SOL_UDP, UDP_SEGMENT, &segment_size, sizeof(segment_size));
+    }
+    if (marking && marking->tos >= 0 && udp_tos_cmsg) {
+        udp_put_cmsg(control, &used, IPPROTO_IP, IP_TOS, &marking->tos, sizeof(int));
+    }
+    if (marking && marking->priority >= 0 && udp_priority_cmsg) {
+        udp_put_cmsg(control, &used, SOL_SOCKET, SO_PRIORITY, &marking->priority, sizeof(int));
+    }
+    return used;
+}
+
+// Разметку не приняли (EINVAL): выключаем сначала SO_PRIORITY, затем TOS; true - есть что повторить
+static bool udp_drop_marking(const UdpMarking* marking) {
+    if (!udp_marking_active(marking)) return false;
+
+    // Выключает тот поток, что первым получил EINVAL; он же пишет в лог
+    if (marking->priority >= 0 && udp_priority_cmsg) {
+        if (atomic_exchange(&udp_priority_cmsg, false)) {
+            printf("SO_PRIORITY cmsg is not supported by the kernel, sending without it\n");
+        }
+    } else if (atomic_exchange(&udp_tos_cmsg, false)) {
+        printf("IP_TOS cmsg is not supported by the kernel, sending without DSCP\n");
+    }
+    return true;
+}
+
+// sendmsg с GSO (segment_size > 0) и разметкой; -1 с errno при ошибке
+static ssize_t udp_sendmsg(int udp_fd, const struct iovec* iov, int count, uint16_t segment_size,
+                           const struct sockaddr_in* dest_addr, const UdpMarking* marking) {
+    UdpSendControl control;
+    size_t used = udp_fill_control(&control, segment_size, marking);
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = (void*)dest_addr;
+    msg.msg_namelen = sizeof(*dest_addr);
+    msg.msg_iov = (struct iovec*)iov;
+    msg.msg_iovlen = (size_t)count;
+    msg.msg_control = used > 0 ? control.buf : NULL;
+    msg.msg_controllen = used;
+
+    ssize_t sent = sendmsg(udp_fd, &msg, MSG_DONTWAIT);
+
+    // Разметку не приняли - повторяем без нее
+    if (sent == -1 && errno == EINVAL && udp_drop_marking(marking)) {
+        return udp_sendmsg(udp_fd, iov, count, segment_size, dest_addr, marking);
+    }
+    return sent;
+}
+
+int udp_send_many(int udp_fd, const void* data, size_t len, const struct sockaddr_in* dests, int count,
+                  const UdpMarking* marking) {
+    if (!data || !dests || count <= 0) return -1;
+    if (count > UDP_SEND_MANY_MAX) count = UDP_SEND_MANY_MAX;
+
+    // Одни и те же данные и служебная часть на все адреса
+    struct iovec iov = {.iov_base = (void*)data, .iov_len = len};
+    UdpSendControl control;
+    size_t used = udp_fill_control(&control, 0, marking);
+
+    struct mmsghdr msgs[UDP_SEND_MANY_MAX];
+    memset(msgs, 0, sizeof(struct mmsghdr) * (size_t)count);
+    for (int i = 0; i < count; i++) {
+        msgs[i].msg_hdr.msg_name = (void*)&dests[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(dests[i]);
+        msgs[i].msg_hdr.msg_iov = &iov;
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_control = used > 0 ? control.buf : NULL;
+        msgs[i].msg_hdr.msg_controllen = used;
+    }
+
+    int sent = sendmmsg(udp_fd, msgs, (unsigned int)count, MSG_DONTWAIT);
+    if (sent == -1) {
+        if (errno == EINVAL && udp_drop_marking(marking)) {
+            return udp_send_many(udp_fd, data, len, dests, count, marking);
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return -2;
+        }
+        perror("sendmmsg");
+        return -1;
+    }
+    return sent;
+}
+
+int udp_send_marked(int udp_fd, const void* data, size_t len,
+                    const struct sockaddr_in* dest_addr, const UdpMarking* marking) {
+    if (!udp_marking_active(marking)) {
+        return udp_send_packet(udp_fd, data, len, dest_addr);
+    }
+
+    struct iovec iov = {.iov_base = (void*)data, .iov_len = len};
+    ssize_t sent = udp_sendmsg(udp_fd, &iov, 1, 0, dest_addr, marking);
+    if (sent == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return -2;
+        }
+        perror("sendmsg");
+        return -1;
+    }
+
+    if ((size_t)sent != len) {
+        fprintf(stderr, "Partial UDP send: %zd of %zu bytes\n", sent, len);
+        return -1;
+    }
+
+    return (int)sent;
+}
+
+int udp_send_segments(int udp_fd, const struct iovec* iov, int count, uint16_t segment_size,
+                      const struct sockaddr_in* dest_addr, const UdpMarking* marking) {
+    if (!iov || count <= 0 || count > UDP_GSO_MAX_SEGMENTS || segment_size == 0) return -1;
+
+    size_t total = 0;
+    for (int i = 0; i < count; i++) {
+        total += iov[i].iov_len;
+    }
+
+    ssize_t sent = udp_sendmsg(udp_fd, iov, count, segment_size, dest_addr, marking);
+    if (sent == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return -2;
+        }
+        // EIO - устройство без checksum offload, EINVAL/EOPNOTSUPP - ядро без GSO
+        if (errno == EIO || errno == EINVAL || errno == EOPNOTSUPP || errno == ENOPROTOOPT) {
+            return -3;
+        }
+        perror("sendmsg UDP_SEGMENT");
+        return -1;
+    }
+
+    if ((size_t)sent != total) {
+        fprintf(stderr, "Partial UDP GSO send: %zd of %zu bytes\n", sent, total);
+        return -1;
+    }
+
+    return (int)sent;
+}
+
+bool udp_gso_supported(int udp_fd) {
+    int value = 0;
+    socklen_t len = sizeof(value);
+    return getsockopt(udp_fd, SOL_UDP, UDP_SEGMENT, &value, &len) == 0;
+}
+
 int udp_receive_packet(int udp_fd, void* buffer, size_t buffer_len,
                       struct sockaddr_in* src_addr) {
-    socklen_t addr_len = sizeof(struct sockaddr_in);
-    
+    struct iovec iov = {.iov_base = buffer, .iov_len = buffer_len};
+
+    union {
+        char buf[CMSG_SPACE(sizeof(uint32_t))];
+        struct cmsghdr align;
+    } control;
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = src_addr;
+    msg.msg_namelen = sizeof(struct sockaddr_in);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
     // Используем MSG_DONTWAIT для неблокирующего приема
-    ssize_t received = recvfrom(udp_fd, buffer, buffer_len, MSG_DONTWAIT,
-                               (struct sockaddr*)src_addr, &addr_len);
+    ssize_t received = recvmsg(udp_fd, &msg, MSG_DONTWAIT);
     
     if (received == -1) {
         if (errno == EAGAIN || errno == EWOULDBLOCK) {
@@ -250,6 +568,52 @@ int udp_receive_packet(int udp_fd, void* buffer, size_t buffer_len,
         return 0;
     }
 
+    if (msg.msg_controllen > 0) {
+        udp_parse_cmsgs(&msg, received, NULL);
+    }
+
+    return (int)received;
+}
+
+int udp_enable_gro(int udp_fd) {
+    int on = 1;
+    if (setsockopt(udp_fd, SOL_UDP, UDP_GRO, &on, sizeof(on)) == -1) {
+        perror("setsockopt UDP_GRO");
+        return -1;
+    }
+    return 0;
+}
+
+int udp_receive_gro(int udp_fd, void* buffer, size_t buffer_len,
+                    struct sockaddr_in* src_addr, uint16_t* segment_size) {
+    struct iovec iov = {.iov_base = buffer, .iov_len = buffer_len};
+
+    union {
+        char buf[CMSG_SPACE(sizeof(int)) + CMSG_SPACE(sizeof(uint32_t))];
+        struct cmsghdr align;
+    } control;
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = src_addr;
+    msg.msg_namelen = sizeof(struct sockaddr_in);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    ssize_t received = recvmsg(udp_fd, &msg, MSG_DONTWAIT);
+    if (received == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return -2;
+        }
+        perror("recvmsg");
+        return -1;
+    }
+
+    *segment_size = (uint16_t)received;
+    udp_parse_cmsgs(&msg, received, segment_size);
+
     return (int)received;
 }
 
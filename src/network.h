@@ -2,6 +2,56 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <sys/epoll.h>
+#include <sys/uio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Лимиты UDP GSO: ядро принимает не больше 64 сегментов и 64 КБ на один вызов
+#define UDP_GSO_MAX_SEGMENTS 64
+#define UDP_GSO_MAX_BYTES 65000
+
+// Адресов на один sendmmsg (udp_send_many)
+#define UDP_SEND_MANY_MAX 64
+
+// Сколько датаграмм читаем за одно пробуждение epoll, прежде чем отправлять накопленное
+#ifndef UDP_RX_BATCH
+#define UDP_RX_BATCH 64
+#endif
+
+// Буфер приема UDP GRO: ядро склеивает серию датаграмм одного потока до 64 КБ
+#define UDP_GRO_BUFFER_SIZE 65536
+
+// Счетчики приема UDP (для метрик)
+typedef struct {
+    uint64_t datagrams;       // датаграмм передано обработчику
+    uint64_t gro_buffers;     // склеенных буферов, пришедших одним recvmsg
+    uint64_t gro_segments;    // датаграмм в составе склеенных буферов
+    uint64_t oversized;       // отброшено: сегмент длиннее UDP_PACKET_SIZE
+    uint64_t kernel_drops;    // отброшено ядром до нас (SO_RXQ_OVFL, счетчик сокета)
+} UdpRxStats;
+
+extern UdpRxStats g_udp_rx_stats;
+
+// Буферы UDP сокета в авто-режиме: начальный размер и потолок автоподстройки
+#ifndef UDP_AUTO_BUFFER_BYTES
+#define UDP_AUTO_BUFFER_BYTES (4 * 1024 * 1024)
+#endif
+#ifndef UDP_AUTO_BUFFER_MAX
+#define UDP_AUTO_BUFFER_MAX (64 * 1024 * 1024)
+#endif
+
+// Фактические буферы UDP сокета (как их видит getsockopt - ядро удваивает запрошенное)
+typedef struct {
+    int rcvbuf;
+    int sndbuf;
+    bool auto_rcvbuf;         // растить при потерях в ядре
+    bool auto_sndbuf;         // растить при EAGAIN на отправке
+    uint32_t grows;
+    uint64_t seen_kernel_drops;
+    uint64_t seen_eagain_stalls;
+} SocketBufferState;
+
+extern SocketBufferState g_udp_buffers;
 
 extern int g_epoll_fd;
 extern int g_tcp_fd;
@@ -14,6 +64,19 @@ int set_nonblocking(int fd);
 int create_tcp_server(int port);
 int create_udp_server(int port);
 
+// Размер буфера приема/отправки: сначала SO_*BUFFORCE (CAP_NET_ADMIN, мимо
+// net.core.[rw]mem_max), затем обычный SO_*BUF. Возвращает фактический размер или -1
+int socket_set_buffer(int fd, bool receive, int bytes);
+int socket_get_buffer(int fd, bool receive);
+
+// Начальная настройка буферов UDP сокета: 0 - авто-режим (UDP_AUTO_BUFFER_BYTES и рост)
+void udp_setup_buffers(int udp_fd, int rcvbuf, int sndbuf);
+// Раз в период: удвоить буфер авто-режима, если с прошлого раза были потери в ядре / EAGAIN
+void udp_autotune_buffers(int udp_fd, uint64_t eagain_stalls);
+
+// Счетчик потерь сокета в cmsg каждого приема (SO_RXQ_OVFL)
+int udp_enable_rxq_ovfl(int udp_fd);
+
 // Функции для epoll
 int create_epoll_fd(void);
 int epoll_add(int epoll_fd, int fd, uint32_t events);
@@ -23,12 +86,38 @@ int epoll_remove(int epoll_fd, int fd);
 // Принятие нового соединения (неблокирующее)
 int accept_connection(int server_fd, struct sockaddr_in* client_addr);
 
+// Разметка датаграммы для сети и qdisc (через cmsg на каждую отправку)
+typedef struct {
+    int tos;       // байт TOS: DSCP << 2; -1 - не задавать
+    int priority;  // SO_PRIORITY; -1 - не задавать
+} UdpMarking;
+
 // Отправка/прием UDP пакетов
 int udp_send_packet(int udp_fd, const void* data, size_t len,
                    const struct sockaddr_in* dest_addr);
+// То же с разметкой (NULL - как udp_send_packet). Если ядро не принимает cmsg
+// разметки, она выключается до конца работы, а пакет уходит без нее
+int udp_send_marked(int udp_fd, const void* data, size_t len,
+                    const struct sockaddr_in* dest_addr, const UdpMarking* marking);
+// Отправка серии датаграмм одному адресу одним sendmsg с UDP_SEGMENT (GSO).
+// Все датаграммы, кроме последней, длиной segment_size, последняя - не длиннее.
+// Возвращает число байт, -2 при EAGAIN, -3 если GSO недоступен на этом маршруте
+int udp_send_segments(int udp_fd, const struct iovec* iov, int count, uint16_t segment_size,
+                      const struct sockaddr_in* dest_addr, const UdpMarking* marking);
+bool udp_gso_supported(int udp_fd);
+// Одна датаграмма многим адресам одним sendmmsg (не больше UDP_SEND_MANY_MAX за вызов).
+// Возвращает число отправленных (может быть меньше count), -2 при EAGAIN на первой
+int udp_send_many(int udp_fd, const void* data, size_t len, const struct sockaddr_in* dests, int count,
+                  const UdpMarking* marking);
 int udp_receive_packet(int udp_fd, void* buffer, size_t buffer_len,
                       struct sockaddr_in* src_addr);
 
+// Прием с UDP_GRO: в буфер может прийти несколько датаграмм подряд, каждая длиной
+// *segment_size (последняя - короче). Без склейки *segment_size равен длине датаграммы
+int udp_enable_gro(int udp_fd);
+int udp_receive_gro(int udp_fd, void* buffer, size_t buffer_len,
+                    struct sockaddr_in* src_addr, uint16_t* segment_size);
+
 // Асинхронные операции ввода-вывода
 int async_read(int fd, void* buffer, size_t buffer_len);
 int async_write(int fd, const void* data, size_t len);
@@ -0,0 +1,204 @@
+#include "notify.h"
+#include "protocol.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+static bool notify_open = false;
+static NotifyQueue* notify_pending = NULL;  // очереди с событиями, двусвязный список
+static NotifyStats notify_totals;
+
+void notify_begin(void) {
+    notify_open = true;
+}
+
+bool notify_active(void) {
+    return notify_open;
+}
+
+// Событие, которое отменяет это (вход - выход, создание - удаление, START - END)
+static int notify_opposite(uint8_t type) {
+    switch (type) {
+        case SERVER_CALL_CONN_NEW:       return SERVER_CALL_CONN_LEFT;
+        case SERVER_CALL_CONN_LEFT:      return SERVER_CALL_CONN_NEW;
+        case SERVER_CALL_STREAM_NEW:     return SERVER_CALL_STREAM_DELETED;
+        case SERVER_CALL_STREAM_DELETED: return SERVER_CALL_STREAM_NEW;
+        case SERVER_STREAM_START:        return SERVER_STREAM_END;
+        case SERVER_STREAM_END:          return SERVER_STREAM_START;
+        default:                         return -1;
+    }
+}
+
+static bool notify_opens(uint8_t type) {
+    return type == SERVER_CALL_CONN_NEW || type == SERVER_CALL_STREAM_NEW || type == SERVER_STREAM_START;
+}
+
+// Отдельное сообщение события через схему (protocol_encode): CallConnPayload/CallStreamPayload
+// или StreamIDPayload для START/END. Возвращает длину или -1
+static int notify_encode(const NotifyEvent* event, uint8_t* message, size_t size) {
+    if (event->type == SERVER_STREAM_START || event->type == SERVER_STREAM_END) {
+        StreamIDPayload payload = { .stream_id = htonl(event->id) };
+        return protocol_encode(message, size, event->type, &payload, sizeof(payload));
+    }
+    // CallStreamPayload того же вида: call_id и id
+    CallConnPayload payload = { .call_id = htonl(event->call_id), .connection_id = htonl(event->id) };
+    return protocol_encode(message, size, event->type, &payload, sizeof(payload));
+}
+
+static void notify_send(Connection* conn, const NotifyEvent* event, bool queue_only) {
+    uint8_t message[1 + sizeof(CallConnPayload)];
+    int len = notify_encode(event, message, sizeof(message));
+    if (len < 0) {
+        printf("ERROR: Malformed notification 0x%02x not sent\n", event->type);
+        return;
+    }
+    if (queue_only) {
+        connection_queue_message(conn, message, (size_t)len);
+    } else {
+        connection_send_message(conn, message, (size_t)len);
+    }
+}
+
+static void notify_write(Connection* conn, const NotifyEvent* events, uint32_t count) {
+    if (conn->event_batch && count > 1) {
+        uint8_t payload[sizeof(EventBatchPayload) + NOTIFY_MAX_EVENTS * sizeof(EventBatchEntry)];
+        uint8_t message[1 + sizeof(payload)];
+        EventBatchPayload header;
+        header.event_count = (uint8_t)count;
+        memcpy(payload, &header, sizeof(header));
+
+        EventBatchEntry* entries = (EventBatchEntry*)(payload + sizeof(header));
+        for (uint32_t i = 0; i < count; i++) {
+            entries[i].type = events[i].type;
+            entries[i].call_id = htonl(events[i].call_id);
+            entries[i].id = htonl(events[i].id);
+        }
+        int len = protocol_encode(message, sizeof(message), SERVER_EVENT_BATCH, payload,
+                                  sizeof(header) + count * sizeof(EventBatchEntry));
+        if (len > 0) {
+            connection_queue_message(conn, message, (size_t)len);
+            notify_totals.batches++;
+        } else {
+            printf("ERROR: Malformed SERVER_EVENT_BATCH (%u events) not sent\n", count);
+        }
+    } else {
+        for (uint32_t i = 0; i < count; i++) {
+            notify_send(conn, &events[i], true);
+        }
+    }
+    connection_flush(conn);
+}
+
+static void notify_unlink(NotifyQueue* queue) {
+    if (queue->prev) {
+        queue->prev->next = queue->next;
+    } else {
+        notify_pending = queue->next;
+    }
+    if (queue->next) {
+        queue->next->prev = queue->prev;
+    }
+    queue->conn->notify = NULL;
+}
+
+void notify_flush_connection(Connection* conn) {
+    if (!conn || !conn->notify) return;
+
+    // Отцепляем до записи: connection_send_message внутри не должен выталкивать ее снова
+    NotifyQueue* queue = conn->notify;
+    notify_unlink(queue);
+
+    if (queue->count > 0) {
+        if (queue->count > 1) {
+            printf("notify_flush: connection %d, %u events in one write%s\n", conn->fd, queue->count,
+                   conn->event_batch ? " (SERVER_EVENT_BATCH)" : "");
+        }
+        notify_write(conn, queue->events, queue->count);
+        notify_totals.writes++;
+    }
+    free(queue);
+}
+
+void notify_flush(void) {
+    while (notify_pending) {
+        notify_flush_connection(notify_pending->conn);
+    }
+    notify_open = false;
+}
+
+void notify_forget(Connection* conn) {
+    if (!conn || !conn->notify) return;
+    NotifyQueue* queue = conn->notify;
+    notify_unlink(queue);
+    free(queue);
+}
+
+void notify_event(Connection* conn, uint8_t type, uint32_t call_id, uint32_t id) {
+    if (!conn || conn->fd < 0) return;  // отсоединенное после снимка: сокета нет
+
+    NotifyEvent event = { .type = type, .call_id = call_id, .id = id };
+    if (!notify_open) {
+        notify_send(conn, &event, false);
+        return;
+    }
+    notify_totals.events++;
+
+    NotifyQueue* queue = conn->notify;
+    if (queue) {
+        // Последнее ожидающее событие о том же участнике или стриме решает судьбу нового
+        int opposite = notify_opposite(type);
+        for (int32_t i = (int32_t)queue->count - 1; i >= 0; i--) {
+            const NotifyEvent* pending = &queue->events[i];
+            if (pending->call_id != call_id || pending->id != id) continue;
+            if (pending->type == type) {
+                notify_totals.superseded++;
+                return;
+            }
+            if (pending->type != opposite) continue;
+            if (notify_opens(pending->type)) {
+                // Появился и исчез за одну итерацию: клиенту незачем знать ни о том, ни о другом
+                memmove(&queue->events[i], &queue->events[i + 1], (queue->count - i - 1) * sizeof(NotifyEvent));
+                queue->count--;
+                notify_totals.superseded += 2;
+                return;
+            }
+            break;  // выход и новый вход: клиент должен увидеть оба
+        }
+
+        if (queue->count == NOTIFY_MAX_EVENTS) {
+            notify_flush_connection(conn);
+            queue = NULL;
+        }
+    }
+
+    if (!queue) {
+        queue = malloc(sizeof(NotifyQueue));
+        if (!queue) {
+            notify_send(conn, &event, false);
+            return;
+        }
+        queue->conn = conn;
+        queue->count = 0;
+        queue->prev = NULL;
+        queue->next = notify_pending;
+        if (notify_pending) notify_pending->prev = queue;
+        notify_pending = queue;
+        conn->notify = queue;
+    }
+    queue->events[queue->count++] = event;
+}
+
+void notify_call_event(Call* call, uint8_t type, uint32_t id, Connection* exclude) {
+    if (!call) return;
+    for (int i = 0; i < MAX_CALL_PARTICIPANTS; i++) {
+        Connection* participant = call->participants[i];
+        if (participant && participant != exclude) {
+            notify_event(participant, type, call->call_id, id);
+        }
+    }
+}
+
+NotifyStats notify_stats(void) {
+    return notify_totals;
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "connection.h"
+
+// Сборка уведомлений за итерацию основного цикла. Между notify_begin и notify_flush
+// события о составе звонков и о стримах (SERVER_CALL_CONN_NEW/LEFT,
+// SERVER_CALL_STREAM_NEW/DELETED, SERVER_STREAM_START/END) не пишутся в сокет сразу,
+// а копятся в очереди получателя. Отмененные события выбрасываются: вход и выход
+// того же участника, создание и удаление стрима, START и END одного стрима, повторы.
+// В конце итерации у получателя одна запись в сокет: SERVER_EVENT_BATCH, если клиент
+// включил его CLIENT_EVENT_BATCH, иначе уцелевшие сообщения подряд в прежнем виде.
+// Любое другое сообщение соединению сначала выталкивает его очередь - порядок
+// событий и ответов не меняется. Вне итерации уведомления уходят сразу.
+
+// Переполненная очередь выталкивается не дожидаясь конца итерации
+#ifndef NOTIFY_MAX_EVENTS
+#define NOTIFY_MAX_EVENTS 64
+#endif
+
+typedef struct {
+    uint8_t type;       // тип сообщения, которым событие ушло бы отдельно
+    uint32_t call_id;   // 0 для SERVER_STREAM_START/END
+    uint32_t id;        // connection_id или stream_id
+} NotifyEvent;
+
+typedef struct NotifyQueue {
+    Connection* conn;
+    uint32_t count;
+    NotifyEvent events[NOTIFY_MAX_EVENTS];
+    struct NotifyQueue* prev;
+    struct NotifyQueue* next;
+} NotifyQueue;
+
+typedef struct {
+    uint64_t events;      // поставлено в очереди
+    uint64_t superseded;  // выброшено: отменили друг друга или повторяют ожидающее
+    uint64_t batches;     // отправлено SERVER_EVENT_BATCH
+    uint64_t writes;      // записей в сокеты при выталкивании очередей
+} NotifyStats;
+
+/* Итерация основного цикла */
+void notify_begin(void);
+void notify_flush(void);
+bool notify_active(void);
+
+/* События */
+void notify_event(Connection* conn, uint8_t type, uint32_t call_id, uint32_t id);
+// Всем участникам звонка кроме exclude
+void notify_call_event(Call* call, uint8_t type, uint32_t id, Connection* exclude);
+
+/* Очередь соединения */
+void notify_flush_connection(Connection* conn);
+void notify_forget(Connection* conn);
+
+NotifyStats notify_stats(void);
@@ -0,0 +1,772 @@
+#include "pacer.h"
+#include "network.h"
+#include "time_utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/timerfd.h>
+
+extern int g_udp_fd;
+
+static int pacer_timer_fd = -1;
+static bool pacer_timer_armed = false;
+
+static PacerQueue* wheel[PACER_WHEEL_SLOTS];
+static uint64_t wheel_tick = 0;          // текущий тик колеса (мс монотонного времени)
+static uint32_t wheel_scheduled = 0;
+
+// Разметка по классам (по умолчанию выключена) и порядок обслуживания классов
+static UdpMarking class_marking[MEDIA_CLASS_COUNT] = {{-1, -1}, {-1, -1}};
+static const uint8_t class_priority[MEDIA_CLASS_COUNT] = {MEDIA_CLASS_AUDIO, MEDIA_CLASS_VIDEO};
+
+static int pacer_default_send(const void* data, size_t len, const struct sockaddr_in* dest_addr,
+                              uint8_t media_class) {
+    return udp_send_marked(g_udp_fd, data, len, dest_addr, &class_marking[media_class]);
+}
+
+static int pacer_default_batch_send(const struct iovec* iov, int count, uint16_t segment_size,
+                                    const struct sockaddr_in* dest_addr, uint8_t media_class) {
+    return udp_send_segments(g_udp_fd, iov, count, segment_size, dest_addr, &class_marking[media_class]);
+}
+
+static PacerSendFn pacer_send = pacer_default_send;
+static PacerBatchSendFn pacer_batch_send = NULL;
+
+static PacerQueue* flush_head = NULL;
+static uint32_t bundle_window_us = 0;
+
+static uint32_t queue_limit = PACER_QUEUE_PACKETS;
+static PacerDropPolicy drop_policy = PACER_DROP_TAIL;
+
+// Очереди, упершиеся в EAGAIN, в порядке блокировки (досылаются по EPOLLOUT)
+static int pacer_epoll_fd = -1;
+static PacerQueue* blocked_head = NULL;
+static PacerQueue* blocked_tail = NULL;
+static uint32_t blocked_count = 0;
+static bool wait_writable = false;
+static uint64_t total_eagain_stalls = 0;
+
+static const char* drop_policy_names[] = {"tail", "oldest", "audio"};
+
+/* Внутренние функции */
+
+static void pacer_arm_timer(bool enable) {
+    if (pacer_timer_fd < 0 || pacer_timer_armed == enable) return;
+
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    if (enable) {
+        spec.it_value.tv_nsec = PACER_TICK_US * 1000;
+        spec.it_interval.tv_nsec = PACER_TICK_US * 1000;
+    }
+
+    if (timerfd_settime(pacer_timer_fd, 0, &spec, NULL) == 0) {
+        pacer_timer_armed = enable;
+    } else {
+        perror("timerfd_settime");
+    }
+}
+
+static void pacer_refill(PacerQueue* queue, uint64_t now_us) {
+    if (queue->rate_bytes_per_sec == 0) return;
+
+    if (now_us > queue->last_refill_us) {
+        uint64_t elapsed = now_us - queue->last_refill_us;
+        queue->tokens += (int64_t)(elapsed * queue->rate_bytes_per_sec / 1000000ull);
+        if (queue->tokens > queue->burst_bytes) {
+            queue->tokens = queue->burst_bytes;
+        }
+    }
+    queue->last_refill_us = now_us;
+}
+
+static bool pacer_can_send(const PacerQueue* queue) {
+    return queue->rate_bytes_per_sec == 0 || queue->tokens > 0;
+}
+
+// Время (мкс), через которое накопится положительный баланс токенов
+static uint64_t pacer_wait_us(const PacerQueue* queue) {
+    if (pacer_can_send(queue)) return 0;
+    uint64_t deficit = (uint64_t)(-queue->tokens) + 1;
+    return deficit * 1000000ull / queue->rate_bytes_per_sec + 1;
+}
+
+static void pacer_unschedule(PacerQueue* queue) {
+    if (queue->wheel_slot < 0) return;
+
+    if (queue->wheel_prev) {
+        queue->wheel_prev->wheel_next = queue->wheel_next;
+    } else {
+        wheel[queue->wheel_slot] = queue->wheel_next;
+    }
+    if (queue->wheel_next) {
+        queue->wheel_next->wheel_prev = queue->wheel_prev;
+    }
+
+    queue->wheel_next = NULL;
+    queue->wheel_prev = NULL;
+    queue->wheel_slot = -1;
+    wheel_scheduled--;
+
+    if (wheel_scheduled == 0) pacer_arm_timer(false);
+}
+
+static void pacer_schedule(PacerQueue* queue, uint64_t now_us, uint64_t wait_us) {
+    if (queue->wheel_slot >= 0) return;
+
+    uint64_t now_tick = now_us / PACER_TICK_US;
+    if (wheel_scheduled == 0 || wheel_tick > now_tick) {
+        wheel_tick = now_tick;
+    }
+
+    // Минимум через один тик; дальше горизонта - в последний слот, там перепланируемся
+    uint64_t ticks = (wait_us + PACER_TICK_US - 1) / PACER_TICK_US;
+    if (ticks < 1) ticks = 1;
+    if (ticks >= PACER_WHEEL_SLOTS) ticks = PACER_WHEEL_SLOTS - 1;
+
+    int slot = (int)((now_tick + ticks) % PACER_WHEEL_SLOTS);
+    queue->wheel_slot = slot;
+    queue->wheel_prev = NULL;
+    queue->wheel_next = wheel[slot];
+    if (wheel[slot]) wheel[slot]->wheel_prev = queue;
+    wheel[slot] = queue;
+    wheel_scheduled++;
+
+    pacer_arm_timer(true);
+}
+
+static void pacer_flush_remove(PacerQueue* queue) {
+    if (!queue->flush_pending) return;
+
+    PacerQueue** link = &flush_head;
+    while (*link && *link != queue) {
+        link = &(*link)->flush_next;
+    }
+    if (*link) *link = queue->flush_next;
+
+    queue->flush_next = NULL;
+    queue->flush_pending = false;
+}
+
+static uint8_t pacer_buf_class(const PacketBuf* buf) {
+    return buf->media_class < MEDIA_CLASS_COUNT ? buf->media_class : MEDIA_CLASS_VIDEO;
+}
+
+static void pacer_pop(PacerQueue* queue, PacerRing* ring) {
+    packet_buf_release(ring->ring[ring->head]);
+    ring->ring[ring->head] = NULL;
+    ring->head = (ring->head + 1) % PACER_QUEUE_PACKETS;
+    ring->count--;
+    queue->count--;
+}
+
+static PacketBuf* pacer_peek(const PacerRing* ring, uint32_t index) {
+    return ring->ring[(ring->head + index) % PACER_QUEUE_PACKETS];
+}
+
+// Строгий приоритет классов: первым - старший непустой. Если младший ждет, а старший
+// ушел PACER_STARVATION_LIMIT раз подряд, младшему достается один ход
+static int pacer_next_class(PacerQueue* queue) {
+    int first = -1, last = -1;
+    for (int i = 0; i < MEDIA_CLASS_COUNT; i++) {
+        uint8_t media_class = class_priority[i];
+        if (queue->rings[media_class].count == 0) continue;
+        if (first < 0) first = media_class;
+        last = media_class;
+    }
+    if (first < 0) return -1;
+
+    if (first == last) {
+        queue->starve_streak = 0;
+        return first;
+    }
+    if (queue->starve_streak >= PACER_STARVATION_LIMIT) {
+        queue->starve_streak = 0;
+        queue->stats.starvation_turns++;
+        return last;
+    }
+    queue->starve_streak++;
+    return first;
+}
+
+// Освобождает место в полной очереди по политике; false - отбросить новый пакет
+static bool pacer_make_room(PacerQueue* queue, const PacketBuf* incoming) {
+    PacerRing* own = &queue->rings[pacer_buf_class(incoming)];
+    PacerRing* video = &queue->rings[MEDIA_CLASS_VIDEO];
+
+    switch (drop_policy) {
+        case PACER_DROP_OLDEST: {
+            // Самый старый своего класса, а если своих нет - младшего из занятых
+            PacerRing* victim = own;
+            for (int i = 0; i < MEDIA_CLASS_COUNT && victim->count == 0; i++) {
+                victim = &queue->rings[class_priority[MEDIA_CLASS_COUNT - 1 - i]];
+            }
+            pacer_pop(queue, victim);
+            queue->stats.dropped_oldest++;
+            return true;
+        }
+
+        case PACER_DROP_VIDEO_FIRST:
+            if (video->count > 0) {
+                pacer_pop(queue, video);
+                queue->stats.dropped_video++;
+                return true;
+            }
+            // В очереди одно аудио: новое аудио вытесняет самое старое, видео не берем
+            if (pacer_buf_class(incoming) == MEDIA_CLASS_AUDIO) {
+                pacer_pop(queue, own);
+                queue->stats.dropped_oldest++;
+                return true;
+            }
+            return false;
+
+        case PACER_DROP_TAIL:
+        default:
+            return false;
+    }
+}
+
+static void pacer_set_wait_writable(bool enable) {
+    if (wait_writable == enable) return;
+    wait_writable = enable;
+
+    if (pacer_epoll_fd < 0 || g_udp_fd < 0) return;
+    if (epoll_modify(pacer_epoll_fd, g_udp_fd, EPOLLIN | (enable ? EPOLLOUT : 0)) != 0) {
+        perror("epoll_modify (UDP EPOLLOUT)");
+    }
+}
+
+// Очередь ждет, пока у UDP сокета освободится буфер отправки
+static void pacer_block(PacerQueue* queue) {
+    if (queue->blocked) return;
+
+    queue->blocked = true;
+    queue->blocked_next = NULL;
+    if (blocked_tail) {
+        blocked_tail->blocked_next = queue;
+    } else {
+        blocked_head = queue;
+    }
+    blocked_tail = queue;
+    blocked_count++;
+
+    pacer_set_wait_writable(true);
+}
+
+static void pacer_blocked_remove(PacerQueue* queue) {
+    if (!queue->blocked) return;
+
+    PacerQueue* prev = NULL;
+    PacerQueue* item = blocked_head;
+    while (item && item != queue) {
+        prev = item;
+        item = item->blocked_next;
+    }
+    if (item) {
+        if (prev) {
+            prev->blocked_next = queue->blocked_next;
+        } else {
+            blocked_head = queue->blocked_next;
+        }
+        if (blocked_tail == queue) blocked_tail = prev;
+        blocked_count--;
+    }
+
+    queue->blocked_next = NULL;
+    queue->blocked = false;
+    if (!blocked_head) pacer_set_wait_writable(false);
+}
+
+// Собирает с головы очереди серию для GSO: пакеты одной длины (последний может
+// быть короче), пока хватает токенов и не превышены лимиты ядра
+static int pacer_collect_batch(const PacerQueue* queue, const PacerRing* ring, struct iovec* iov,
+                               uint16_t* segment_size) {
+    uint16_t first_len = pacer_peek(ring, 0)->len;
+    if (first_len == 0) return 1;
+
+    int limit = UDP_GSO_MAX_BYTES / first_len;
+    if (limit > UDP_GSO_MAX_SEGMENTS) limit = UDP_GSO_MAX_SEGMENTS;
+
+    int64_t tokens = queue->tokens;
+    int count = 0;
+    while (count < (int)ring->count && count < limit) {
+        if (queue->rate_bytes_per_sec > 0 && tokens <= 0) break;
+
+        PacketBuf* buf = pacer_peek(ring, (uint32_t)count);
+        if (buf->len > first_len) break;
+
+        iov[count].iov_base = buf->data;
+        iov[count].iov_len = buf->len;
+        tokens -= buf->len;
+        count++;
+
+        if (buf->len < first_len) break;
+    }
+
+    *segment_size = first_len;
+    return count;
+}
+
+// Сколько пакетов с головы очереди помещается в одну связку (и ее длина)
+static int pacer_collect_bundle(const PacerQueue* queue, const PacerRing* ring, bool check_tokens,
+                                size_t* bundle_len) {
+    size_t len = UDP_BUNDLE_HEADER_SIZE;
+    int64_t tokens = queue->tokens;
+    int count = 0;
+
+    while (count < (int)ring->count) {
+        if (check_tokens && queue->rate_bytes_per_sec > 0 && tokens <= 0) break;
+
+        size_t entry = UDP_BUNDLE_ENTRY_HEADER + pacer_peek(ring, (uint32_t)count)->len;
+        if (len + entry > UDP_PACKET_SIZE) break;
+        len += entry;
+        tokens -= (int64_t)entry;
+        count++;
+    }
+
+    *bundle_len = len;
+    return count;
+}
+
+// Собирает связку в буфер пула: копия мелких пакетов дешевле лишних sendto
+static int pacer_send_bundle(const PacerQueue* queue, const PacerRing* ring, int count, uint8_t media_class) {
+    PacketBuf* bundle = packet_buf_alloc();
+    if (!bundle) return -1;
+
+    uint32_t marker = htonl(UDP_BUNDLE_MARKER);
+    memcpy(bundle->data, &marker, sizeof(marker));
+    size_t offset = UDP_BUNDLE_HEADER_SIZE;
+
+    for (int i = 0; i < count; i++) {
+        const PacketBuf* buf = pacer_peek(ring, (uint32_t)i);
+        uint16_t len = htons(buf->len);
+        memcpy(bundle->data + offset, &len, sizeof(len));
+        memcpy(bundle->data + offset + UDP_BUNDLE_ENTRY_HEADER, buf->data, buf->len);
+        offset += UDP_BUNDLE_ENTRY_HEADER + buf->len;
+    }
+    bundle->len = (uint16_t)offset;
+
+    int result = pacer_send(bundle->data, bundle->len, &queue->addr, media_class);
+    packet_buf_release(bundle);
+    return result;
+}
+
+// Копить ли очередь дальше ради связки: все, что лежит в каждом классе, мелкое,
+// влезает в одну датаграмму, и окно с первого пакета еще не истекло
+static bool pacer_bundle_hold(PacerQueue* queue, uint64_t now_us) {
+    if (bundle_window_us == 0 || queue->count == 0) return false;
+
+    for (int media_class = 0; media_class < MEDIA_CLASS_COUNT; media_class++) {
+        const PacerRing* ring = &queue->rings[media_class];
+        if (ring->count == 0) continue;
+        if (pacer_peek(ring, 0)->len > PACER_BUNDLE_MAX_PACKET) return false;
+
+        size_t bundle_len = 0;
+        if (pacer_collect_bundle(queue, ring, false, &bundle_len) < (int)ring->count) return false;
+    }
+
+    if (queue->bundle_since_us == 0) queue->bundle_since_us = now_us;
+    uint64_t waited = now_us - queue->bundle_since_us;
+    if (waited >= bundle_window_us) return false;
+
+    pacer_schedule(queue, now_us, bundle_window_us - waited);
+    return true;
+}
+
+// Отправляет пакеты, пока позволяет token bucket
+static void pacer_drain(PacerQueue* queue, uint64_t now_us) {
+    // Буфер сокета общий: пока кто-то ждет EPOLLOUT, остальные встают за ним
+    if (blocked_head) {
+        pacer_block(queue);
+        return;
+    }
+
+    // Поток рассылки еще не отправил более ранние пакеты получателя
+    if (pacer_queue_held(queue)) {
+        pacer_schedule(queue, now_us, PACER_TICK_US);
+        return;
+    }
+
+    pacer_refill(queue, now_us);
+    queue->bundle_since_us = 0;
+
+    while (queue->count > 0 && pacer_can_send(queue)) {
+        int media_class = pacer_next_class(queue);
+        PacerRing* ring = &queue->rings[media_class];
+
+        struct iovec iov[UDP_GSO_MAX_SEGMENTS];
+        uint16_t segment_size = 0;
+        size_t bundle_len = 0;
+        int count = bundle_window_us > 0 ? pacer_collect_bundle(queue, ring, true, &bundle_len) : 1;
+        bool bundled = count > 1;
+        int result;
+
+        if (!bundled) {
+            bundle_len = 0;
+            count = pacer_batch_send ? pacer_collect_batch(queue, ring, iov, &segment_size) : 1;
+        }
+
+        if (bundled) {
+            result = pacer_send_bundle(queue, ring, count, (uint8_t)media_class);
+            if (result >= 0) {
+                queue->stats.bundles++;
+                queue->stats.bundled_packets += (uint64_t)count;
+            }
+        } else if (count > 1) {
+            result = pacer_batch_send(iov, count, segment_size, &queue->addr, (uint8_t)media_class);
+            if (result == -3) {
+                printf("UDP GSO is not available, falling back to per-packet sends\n");
+                pacer_batch_send = NULL;
+                continue;
+            }
+            if (result >= 0) {
+                queue->stats.gso_batches++;
+                queue->stats.gso_packets += (uint64_t)count;
+            }
+        } else {
+            count = 1;
+            PacketBuf* buf = pacer_peek(ring, 0);
+            result = pacer_send(buf->data, buf->len, &queue->addr, (uint8_t)media_class);
+        }
+
+        // Буфер сокета полон: пакеты остаются в очереди до EPOLLOUT
+        if (result == -2) {
+            queue->stats.eagain_stalls++;
+            total_eagain_stalls++;
+            pacer_block(queue);
+            return;
+        }
+
+        uint64_t bytes = bundle_len;
+        for (int i = 0; i < count && !bundled; i++) {
+            bytes += pacer_peek(ring, (uint32_t)i)->len;
+        }
+
+        if (result >= 0) {
+            queue->stats.sent += (uint64_t)count;
+            queue->stats.sent_class[media_class] += (uint64_t)count;
+            queue->stats.sent_bytes += bytes;
+        } else {
+            queue->stats.dropped_error += (uint64_t)count;
+        }
+
+        if (queue->rate_bytes_per_sec > 0) {
+            queue->tokens -= (int64_t)bytes;
+        }
+        for (int i = 0; i < count; i++) {
+            pacer_pop(queue, ring);
+        }
+    }
+
+    if (queue->count > 0) {
+        pacer_schedule(queue, now_us, pacer_wait_us(queue));
+    }
+}
+
+/* Публичные функции */
+
+int pacer_init(int epoll_fd) {
+    memset(wheel, 0, sizeof(wheel));
+    wheel_tick = 0;
+    wheel_scheduled = 0;
+    flush_head = NULL;
+    pacer_batch_send = NULL;
+    bundle_window_us = 0;
+    queue_limit = PACER_QUEUE_PACKETS;
+    drop_policy = PACER_DROP_TAIL;
+    for (int media_class = 0; media_class < MEDIA_CLASS_COUNT; media_class++) {
+        pacer_set_class_marking((uint8_t)media_class, -1, -1);
+    }
+    blocked_head = NULL;
+    blocked_tail = NULL;
+    blocked_count = 0;
+    wait_writable = false;
+    pacer_epoll_fd = epoll_fd;
+
+    if (epoll_fd < 0) return 0;
+
+    pacer_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (pacer_timer_fd < 0) {
+        perror("timerfd_create");
+        return -1;
+    }
+
+    if (epoll_add(epoll_fd, pacer_timer_fd, EPOLLIN) != 0) {
+        close(pacer_timer_fd);
+        pacer_timer_fd = -1;
+        return -1;
+    }
+
+    printf("Pacer initialized: timer fd %d, tick %d us, %d wheel slots\n",
+           pacer_timer_fd, PACER_TICK_US, PACER_WHEEL_SLOTS);
+    return 0;
+}
+
+void pacer_shutdown(void) {
+    if (pacer_timer_fd >= 0) {
+        close(pacer_timer_fd);
+        pacer_timer_fd = -1;
+    }
+    pacer_timer_armed = false;
+}
+
+int pacer_get_timer_fd(void) {
+    return pacer_timer_fd;
+}
+
+void pacer_set_send_fn(PacerSendFn fn) {
+    pacer_send = fn ? fn : pacer_default_send;
+}
+
+void pacer_set_batch_send_fn(PacerBatchSendFn fn) {
+    pacer_batch_send = fn;
+}
+
+int pacer_enable_gso(int udp_fd) {
+    if (!udp_gso_supported(udp_fd)) {
+        printf("UDP GSO is not supported by the kernel, using per-packet sends\n");
+        return -1;
+    }
+
+    pacer_batch_send = pacer_default_batch_send;
+    printf("UDP GSO enabled: up to %d segments per send\n", UDP_GSO_MAX_SEGMENTS);
+    return 0;
+}
+
+bool pacer_gso_enabled(void) {
+    return pacer_batch_send != NULL;
+}
+
+void pacer_set_bundle_window(uint32_t window_us) {
+    bundle_window_us = window_us;
+}
+
+uint32_t pacer_bundle_window(void) {
+    return bundle_window_us;
+}
+
+void pacer_set_class_marking(uint8_t media_class, int dscp, int priority) {
+    if (media_class >= MEDIA_CLASS_COUNT) return;
+    class_marking[media_class].tos = dscp >= 0 ? (dscp & 0x3F) << 2 : -1;
+    class_marking[media_class].priority = priority;
+}
+
+const UdpMarking* pacer_class_marking(uint8_t media_class) {
+    return media_class < MEDIA_CLASS_COUNT ? &class_marking[media_class] : NULL;
+}
+
+void pacer_set_queue_limit(uint32_t packets) {
+    if (packets == 0 || packets > PACER_QUEUE_PACKETS) packets = PACER_QUEUE_PACKETS;
+    queue_limit = packets;
+}
+
+uint32_t pacer_queue_limit(void) {
+    return queue_limit;
+}
+
+void pacer_set_drop_policy(PacerDropPolicy policy) {
+    drop_policy = policy;
+}
+
+PacerDropPolicy pacer_drop_policy(void) {
+    return drop_policy;
+}
+
+const char* pacer_drop_policy_name(PacerDropPolicy policy) {
+    if ((unsigned)policy >= sizeof(drop_policy_names) / sizeof(drop_policy_names[0])) return "?";
+    return drop_policy_names[policy];
+}
+
+int pacer_parse_drop_policy(const char* name, PacerDropPolicy* out) {
+    if (!name || !out) return -1;
+    for (unsigned i = 0; i < sizeof(drop_policy_names) / sizeof(drop_policy_names[0]); i++) {
+        if (strcmp(name, drop_policy_names[i]) == 0) {
+            *out = (PacerDropPolicy)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+PacerQueue* pacer_queue_new(const struct sockaddr_in* addr, uint64_t rate_bytes_per_sec, uint32_t burst_bytes) {
+    PacerQueue* queue = calloc(1, sizeof(PacerQueue));
+    if (!queue) return NULL;
+
+    if (addr) {
+        memcpy(&queue->addr, addr, sizeof(struct sockaddr_in));
+    }
+    queue->wheel_slot = -1;
+    pacer_queue_set_rate(queue, rate_bytes_per_sec, burst_bytes);
+    queue->tokens = queue->burst_bytes;
+
+    return queue;
+}
+
+void pacer_queue_delete(PacerQueue* queue) {
+    if (!queue) return;
+
+    pacer_unschedule(queue);
+    pacer_flush_remove(queue);
+    pacer_blocked_remove(queue);
+    for (int media_class = 0; media_class < MEDIA_CLASS_COUNT; media_class++) {
+        while (queue->rings[media_class].count > 0) {
+            pacer_pop(queue, &queue->rings[media_class]);
+        }
+    }
+    free(queue);
+}
+
+void pacer_queue_set_rate(PacerQueue* queue, uint64_t rate_bytes_per_sec, uint32_t burst_bytes) {
+    if (!queue) return;
+
+    queue->rate_bytes_per_sec = rate_bytes_per_sec;
+    // Корзина не меньше одного пакета, иначе большие пакеты не уйдут никогда
+    queue->burst_bytes = burst_bytes < UDP_PACKET_SIZE ? UDP_PACKET_SIZE : burst_bytes;
+    if (queue->tokens > queue->burst_bytes) {
+        queue->tokens = queue->burst_bytes;
+    }
+}
+
+uint32_t pacer_queue_depth(const PacerQueue* queue) {
+    return queue ? queue->count : 0;
+}
+
+bool pacer_queue_charge(PacerQueue* queue, uint32_t len, uint64_t now_us) {
+    if (!queue || queue->count > 0 || queue->blocked || blocked_head) return false;
+    if (bundle_window_us > 0 && len <= PACER_BUNDLE_MAX_PACKET) return false;
+
+    pacer_refill(queue, now_us);
+    if (queue->rate_bytes_per_sec > 0) {
+        if (queue->tokens < (int64_t)len) return false;
+        queue->tokens -= (int64_t)len;
+    }
+    queue->stats.sent_direct++;
+    return true;
+}
+
+void pacer_queue_hold(PacerQueue* queue, const _Atomic uint64_t* done, uint64_t seq) {
+    if (!queue) return;
+    queue->hold_done = done;
+    queue->hold_seq = seq;
+}
+
+bool pacer_queue_held(PacerQueue* queue) {
+    if (!queue || !queue->hold_done) return false;
+    if (atomic_load_explicit(queue->hold_done, memory_order_acquire) < queue->hold_seq) return true;
+    queue->hold_done = NULL;
+    return false;
+}
+
+int pacer_enqueue(PacerQueue* queue, PacketBuf* buf) {
+    if (!queue || !buf) return -1;
+
+    queue->stats.enqueued++;
+
+    if (queue->count >= queue_limit && !pacer_make_room(queue, buf)) {
+        queue->stats.dropped_full++;
+        return -2;
+    }
+
+    PacerRing* ring = &queue->rings[pacer_buf_class(buf)];
+    packet_buf_retain(buf);
+    ring->ring[(ring->head + ring->count) % PACER_QUEUE_PACKETS] = buf;
+    ring->count++;
+    queue->count++;
+    if (queue->count > queue->stats.max_depth) {
+        queue->stats.max_depth = queue->count;
+    }
+
+    // Уже ждем токены или EPOLLOUT - пакет уйдет в порядке очереди
+    if (queue->wheel_slot >= 0 || queue->flush_pending || queue->blocked) return 0;
+
+    queue->flush_pending = true;
+    queue->flush_next = flush_head;
+    flush_head = queue;
+    return 0;
+}
+
+void pacer_flush(uint64_t now_us) {
+    while (flush_head) {
+        PacerQueue* queue = flush_head;
+        flush_head = queue->flush_next;
+        queue->flush_next = NULL;
+        queue->flush_pending = false;
+
+        if (queue->wheel_slot < 0 && !pacer_bundle_hold(queue, now_us)) {
+            pacer_drain(queue, now_us);
+        }
+    }
+}
+
+void pacer_run(uint64_t now_us) {
+    if (wheel_scheduled == 0) return;
+
+    uint64_t now_tick = now_us / PACER_TICK_US;
+    uint32_t steps = 0;
+
+    // Проходим все слоты от прошлого тика до текущего (не больше одного оборота)
+    while (wheel_tick <= now_tick && steps < PACER_WHEEL_SLOTS && wheel_scheduled > 0) {
+        int slot = (int)(wheel_tick % PACER_WHEEL_SLOTS);
+
+        PacerQueue* queue = wheel[slot];
+        wheel[slot] = NULL;
+        while (queue) {
+            PacerQueue* next = queue->wheel_next;
+            queue->wheel_next = NULL;
+            queue->wheel_prev = NULL;
+            queue->wheel_slot = -1;
+            wheel_scheduled--;
+
+            pacer_drain(queue, now_us);
+            queue = next;
+        }
+
+        wheel_tick++;
+        steps++;
+    }
+
+    if (wheel_tick <= now_tick) {
+        wheel_tick = now_tick;
+    }
+    if (wheel_scheduled == 0) pacer_arm_timer(false);
+}
+
+void pacer_on_timer(void) {
+    if (pacer_timer_fd >= 0) {
+        uint64_t expirations;
+        while (read(pacer_timer_fd, &expirations, sizeof(expirations)) > 0) {}
+    }
+    pacer_run(monotonic_us());
+}
+
+uint32_t pacer_scheduled_count(void) {
+    return wheel_scheduled;
+}
+
+void pacer_on_writable(void) {
+    PacerQueue* queue = blocked_head;
+    blocked_head = NULL;
+    blocked_tail = NULL;
+    blocked_count = 0;
+    pacer_set_wait_writable(false);
+
+    // Снова упершиеся в EAGAIN встанут в список заново, в том же порядке
+    uint64_t now_us = monotonic_us();
+    while (queue) {
+        PacerQueue* next = queue->blocked_next;
+        queue->blocked_next = NULL;
+        queue->blocked = false;
+        pacer_drain(queue, now_us);
+        queue = next;
+    }
+}
+
+uint32_t pacer_blocked_count(void) {
+    return blocked_count;
+}
+
+uint64_t pacer_eagain_stalls(void) {
+    return total_eagain_stalls;
+}
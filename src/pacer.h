@@ -0,0 +1,167 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <netinet/in.h>
+#include <sys/uio.h>
+#include "packet_pool.h"
+#include "network.h"
+
+// Емкость очереди одного получателя (пакетов)
+#ifndef PACER_QUEUE_PACKETS
+#define PACER_QUEUE_PACKETS 256
+#endif
+
+// Колесо таймеров: слот = 1 мс, горизонт планирования = PACER_WHEEL_SLOTS мс
+#ifndef PACER_WHEEL_SLOTS
+#define PACER_WHEEL_SLOTS 256
+#endif
+#define PACER_TICK_US 1000
+
+// Сколько отправок подряд старший класс делает, пока младший ждет (защита от голодания)
+#ifndef PACER_STARVATION_LIMIT
+#define PACER_STARVATION_LIMIT 8
+#endif
+
+// SO_PRIORITY классов при включенной разметке (0..6 доступны без CAP_NET_ADMIN)
+#define PACER_AUDIO_SO_PRIORITY 6
+#define PACER_VIDEO_SO_PRIORITY 4
+
+// Пакеты длиннее этого не задерживаются ради связки (видео уходит сразу)
+#ifndef PACER_BUNDLE_MAX_PACKET
+#define PACER_BUNDLE_MAX_PACKET (UDP_PACKET_SIZE / 2)
+#endif
+
+// Что выбрасывать, когда очередь получателя заполнена
+typedef enum {
+    PACER_DROP_TAIL = 0,     // новый пакет
+    PACER_DROP_OLDEST,       // самый старый пакет своего класса (живой поток важнее задержавшегося)
+    PACER_DROP_VIDEO_FIRST,  // самый старый видеопакет; аудио выбрасывается последним
+} PacerDropPolicy;
+
+typedef struct {
+    uint64_t enqueued;
+    uint64_t sent;
+    uint64_t sent_bytes;
+    uint64_t dropped_full;    // очередь переполнена, отброшен новый пакет
+    uint64_t dropped_oldest;  // очередь переполнена, вытеснен самый старый
+    uint64_t dropped_video;   // очередь переполнена, вытеснено видео ради аудио
+    uint64_t eagain_stalls;   // сокет вернул EAGAIN: очередь ждет EPOLLOUT, пакеты не теряются
+    uint64_t dropped_error;   // прочие ошибки sendto
+    uint64_t gso_batches;     // отправок UDP_SEGMENT (одна на серию пакетов)
+    uint64_t gso_packets;     // пакетов, ушедших в составе таких серий
+    uint64_t bundles;         // датаграмм-связок (UDP_BUNDLE_MARKER)
+    uint64_t bundled_packets; // пакетов, ушедших внутри связок
+    uint64_t sent_class[MEDIA_CLASS_COUNT];
+    uint64_t starvation_turns; // ходов, отданных младшему классу защитой от голодания
+    uint64_t sent_direct;     // отдано потоку рассылки мимо очереди (токены списаны)
+    uint32_t max_depth;
+} PacerStats;
+
+// Кольцевой буфер пакетов одного класса медиа
+typedef struct {
+    PacketBuf* ring[PACER_QUEUE_PACKETS];
+    uint32_t head;
+    uint32_t count;
+} PacerRing;
+
+// Очередь отправки одного получателя с token bucket. Классы медиа лежат в
+// отдельных кольцах и обслуживаются в строгом приоритете: аудио, затем видео
+typedef struct PacerQueue {
+    struct sockaddr_in addr;
+
+    PacerRing rings[MEDIA_CLASS_COUNT];
+    uint32_t count;               // всего пакетов во всех классах
+    uint32_t starve_streak;       // отправок старшего класса подряд, пока младший ждет
+
+    uint64_t rate_bytes_per_sec;  // 0 - без ограничения
+    int64_t burst_bytes;
+    int64_t tokens;
+    uint64_t last_refill_us;
+
+    // Колесо таймеров (интрузивный двусвязный список слота)
+    struct PacerQueue* wheel_next;
+    struct PacerQueue* wheel_prev;
+    int wheel_slot;               // -1, если не запланирована
+
+    // Список очередей, ожидающих pacer_flush в конце итерации цикла
+    struct PacerQueue* flush_next;
+    bool flush_pending;
+    uint64_t bundle_since_us;     // с какого момента очередь копит связку (0 - не копит)
+
+    // Список очередей, ожидающих EPOLLOUT на UDP сокете после EAGAIN
+    struct PacerQueue* blocked_next;
+    bool blocked;
+
+    // Пакеты, отданные мимо очереди потоку рассылки: пока он не закончил задание
+    // hold_seq (*hold_done < hold_seq), очередь не шлет ничего, чтобы их не обогнать
+    const _Atomic uint64_t* hold_done;
+    uint64_t hold_seq;
+
+    PacerStats stats;
+} PacerQueue;
+
+typedef int (*PacerSendFn)(const void* data, size_t len, const struct sockaddr_in* dest_addr,
+                           uint8_t media_class);
+// Отправка серии пакетов одного размера одним вызовом (UDP GSO), -3 - GSO недоступен
+typedef int (*PacerBatchSendFn)(const struct iovec* iov, int count, uint16_t segment_size,
+                                const struct sockaddr_in* dest_addr, uint8_t media_class);
+
+/* Инициализация планировщика: timerfd добавляется в epoll, если epoll_fd >= 0 */
+int pacer_init(int epoll_fd);
+void pacer_shutdown(void);
+int pacer_get_timer_fd(void);
+void pacer_set_send_fn(PacerSendFn fn);
+
+/* UDP GSO: серии пакетов одного размера уходят одним sendmsg. NULL - выключено */
+void pacer_set_batch_send_fn(PacerBatchSendFn fn);
+int pacer_enable_gso(int udp_fd);
+bool pacer_gso_enabled(void);
+
+/* Связки: мелкие пакеты одному получателю до window_us копятся и уходят
+   одной датаграммой (формат - UDP_BUNDLE_MARKER в protocol.h). 0 - выключено */
+void pacer_set_bundle_window(uint32_t window_us);
+uint32_t pacer_bundle_window(void);
+
+/* Разметка исходящих пакетов класса: DSCP (0..63) и SO_PRIORITY, -1 - не размечать */
+void pacer_set_class_marking(uint8_t media_class, int dscp, int priority);
+const UdpMarking* pacer_class_marking(uint8_t media_class);
+
+/* Переполнение очереди: предел глубины (не больше PACER_QUEUE_PACKETS) и политика */
+void pacer_set_queue_limit(uint32_t packets);
+uint32_t pacer_queue_limit(void);
+void pacer_set_drop_policy(PacerDropPolicy policy);
+PacerDropPolicy pacer_drop_policy(void);
+const char* pacer_drop_policy_name(PacerDropPolicy policy);
+int pacer_parse_drop_policy(const char* name, PacerDropPolicy* out);
+
+/* Очереди получателей */
+PacerQueue* pacer_queue_new(const struct sockaddr_in* addr, uint64_t rate_bytes_per_sec, uint32_t burst_bytes);
+void pacer_queue_delete(PacerQueue* queue);
+void pacer_queue_set_rate(PacerQueue* queue, uint64_t rate_bytes_per_sec, uint32_t burst_bytes);
+uint32_t pacer_queue_depth(const PacerQueue* queue);
+
+/* Отправка мимо очереди (потоки рассылки, fanout.h): можно, только если очередь пуста,
+   сокет не ждет EPOLLOUT, пакет не копится в связку и токенов хватает на len байт.
+   Тогда токены списываются и возвращается true */
+bool pacer_queue_charge(PacerQueue* queue, uint32_t len, uint64_t now_us);
+
+/* Очередь ждет, пока *done не дойдет до seq; held - ожидание еще не кончилось */
+void pacer_queue_hold(PacerQueue* queue, const _Atomic uint64_t* done, uint64_t seq);
+bool pacer_queue_held(PacerQueue* queue);
+
+/* Постановка пакета в очередь. Отправка откладывается до pacer_flush, чтобы
+   пакеты, пришедшие за одну итерацию цикла, ушли сериями */
+int pacer_enqueue(PacerQueue* queue, PacketBuf* buf);
+void pacer_flush(uint64_t now_us);
+
+/* Обработка колеса таймеров (по срабатыванию timerfd или вручную в тестах) */
+void pacer_on_timer(void);
+void pacer_run(uint64_t now_us);
+uint32_t pacer_scheduled_count(void);
+
+/* UDP сокет снова доступен для записи (EPOLLOUT): дослать очереди, упершиеся в EAGAIN */
+void pacer_on_writable(void);
+uint32_t pacer_blocked_count(void);
+uint64_t pacer_eagain_stalls(void);  // по всем очередям, включая удаленные
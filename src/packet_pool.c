@@ -0,0 +1,61 @@
+#include "packet_pool.h"
+#include <stdlib.h>
+#include <string.h>
+
+static PacketBuf* free_list = NULL;
+static PacketPoolStats pool_stats = {0};
+
+PacketBuf* packet_buf_alloc(void) {
+    PacketBuf* buf = free_list;
+    if (buf) {
+        free_list = buf->next_free;
+    } else {
+        buf = malloc(sizeof(PacketBuf));
+        if (!buf) return NULL;
+        pool_stats.allocated++;
+    }
+
+    buf->refcount = 1;
+    buf->len = 0;
+    buf->media_class = MEDIA_CLASS_VIDEO;
+    buf->next_free = NULL;
+    pool_stats.in_use++;
+    return buf;
+}
+
+PacketBuf* packet_buf_from(const void* data, size_t len) {
+    if (!data || len == 0 || len > UDP_PACKET_SIZE) return NULL;
+
+    PacketBuf* buf = packet_buf_alloc();
+    if (!buf) return NULL;
+
+    memcpy(buf->data, data, len);
+    buf->len = (uint16_t)len;
+    return buf;
+}
+
+void packet_buf_retain(PacketBuf* buf) {
+    if (buf) buf->refcount++;
+}
+
+void packet_buf_release(PacketBuf* buf) {
+    if (!buf || buf->refcount == 0) return;
+    if (--buf->refcount > 0) return;
+
+    buf->next_free = free_list;
+    free_list = buf;
+    pool_stats.in_use--;
+}
+
+PacketPoolStats packet_pool_stats(void) {
+    return pool_stats;
+}
+
+void packet_pool_trim(void) {
+    while (free_list) {
+        PacketBuf* next = free_list->next_free;
+        free(free_list);
+        free_list = next;
+        pool_stats.allocated--;
+    }
+}
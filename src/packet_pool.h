@@ -0,0 +1,28 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "protocol.h"
+
+// Буфер UDP пакета с подсчетом ссылок: при рассылке одна копия на всех получателей
+typedef struct PacketBuf {
+    uint32_t refcount;
+    uint16_t len;
+    uint8_t media_class;     // MEDIA_CLASS_*: очередь и разметка при отправке
+    struct PacketBuf* next_free;
+    uint8_t data[UDP_PACKET_SIZE];
+} PacketBuf;
+
+typedef struct {
+    uint64_t allocated;    // всего буферов создано через malloc
+    uint64_t in_use;
+} PacketPoolStats;
+
+/* Выделение и освобождение (буферы переиспользуются через free-list) */
+PacketBuf* packet_buf_alloc(void);
+PacketBuf* packet_buf_from(const void* data, size_t len);
+void packet_buf_retain(PacketBuf* buf);
+void packet_buf_release(PacketBuf* buf);
+
+/* Статистика и очистка пула */
+PacketPoolStats packet_pool_stats(void);
+void packet_pool_trim(void);
@@ -10,6 +10,21 @@
 #include "call.h"
 #include "network.h"
 #include "id_utils.h"
+#include "keyframe_cache.h"
+#include "packet_pool.h"
+#include "pacer.h"
+#include "bwe.h"
+#include "simulcast.h"
+#include "mixer.h"
+#include "config.h"
+#include "fanout.h"
+#include "trunk.h"
+#include "cluster.h"
+#include "snapshot.h"
+#include "notify.h"
+#include "buffer_logic.h"
+#include <stddef.h>
+#include "time_utils.h"
 #include <unistd.h>
 
 // Глобальные переменные
@@ -36,53 +51,47 @@ static void print_connection_id(const Connection* conn) {
     printf("Connection %d", conn->fd);
 }
 
+// Сообщение [type][payload]; размер нагрузки сверяется со схемой (protocol_schema.h)
+static void send_message(Connection* conn, uint8_t type, const void* payload, size_t payload_len) {
+    uint8_t message[BUFFER_SIZE];
+    int len = protocol_encode(message, sizeof(message), type, payload, payload_len);
+    if (len < 0) {
+        printf("ERROR: Malformed message 0x%02x (%zu bytes) not sent\n", type, payload_len);
+        return;
+    }
+    connection_send_message(conn, message, (size_t)len);
+}
+
+// SERVER_ERROR / SERVER_SUCCESS с текстом
+static void send_text(Connection* conn, uint8_t type, uint8_t original_message, const char* text) {
+    uint8_t payload[sizeof(ErrorSuccessPayload) + UINT8_MAX];
+    size_t text_len = strlen(text);
+    if (text_len > UINT8_MAX) text_len = UINT8_MAX;
+
+    ErrorSuccessPayload header;
+    header.original_message_type = original_message;
+    header.message_length = (uint8_t)text_len;
+    memcpy(payload, &header, sizeof(header));
+    memcpy(payload + sizeof(header), text, text_len);
+
+    send_message(conn, type, payload, sizeof(header) + text_len);
+}
+
 // Функция для отправки сообщений об ошибке
 static void send_error(Connection* conn, uint8_t original_message, const char* error_msg) {
     printf("Sending error: %s\n", error_msg);
-    
-    size_t msg_len = strlen(error_msg);
-    ErrorSuccessPayload payload;
-    payload.original_message_type = original_message;
-    payload.message_length = (uint8_t)msg_len;
-    
-    // Выделяем память для полного сообщения
-    size_t total_len = 1 + sizeof(ErrorSuccessPayload) + msg_len;
-    uint8_t* message = malloc(total_len);
-    if (!message) return;
-    
-    message[0] = SERVER_ERROR;
-    memcpy(message + 1, &payload, sizeof(payload));
-    memcpy(message + 1 + sizeof(payload), error_msg, msg_len);
-    
-    connection_send_message(conn, message, total_len);
-    free(message);
+    send_text(conn, SERVER_ERROR, original_message, error_msg);
 }
 
 // Функция для отправки сообщений об успехе
 static void send_success(Connection* conn, uint8_t original_message, const char* success_msg) {
     printf("Sending success: %s\n", success_msg);
-    
-    size_t msg_len = strlen(success_msg);
-    ErrorSuccessPayload payload;
-    payload.original_message_type = original_message;
-    payload.message_length = (uint8_t)msg_len;
-    
-    size_t total_len = 1 + sizeof(ErrorSuccessPayload) + msg_len;
-    uint8_t* message = malloc(total_len);
-    if (!message) return;
-    
-    message[0] = SERVER_SUCCESS;
-    memcpy(message + 1, &payload, sizeof(payload));
-    memcpy(message + 1 + sizeof(payload), success_msg, msg_len);
-    
-    connection_send_message(conn, message, total_len);
-    free(message);
+    send_text(conn, SERVER_SUCCESS, original_message, success_msg);
 }
 
 // ==================== ОБРАБОТЧИКИ БАЗОВЫХ СООБЩЕНИЙ ====================
 
-// ИЗМЕНИТЬ: убрать неиспользуемый параметр conn
-void handle_client_error(const ErrorSuccessPayload* payload) {
+void handle_client_error(Connection* conn, const ErrorSuccessPayload* payload) {
     char message[256];
     if (payload->message_length > 0) {
         size_t copy_len = payload->message_length;
@@ -91,13 +100,12 @@ void handle_client_error(const ErrorSuccessPayload* payload) {
         }
         memcpy(message, (const uint8_t*)payload + sizeof(ErrorSuccessPayload), copy_len);
         message[copy_len] = '\0';
-        printf("Client error (original msg 0x%02x): %s\n", 
-               payload->original_message_type, message);
+        printf("Client error from connection %d (original msg 0x%02x): %s\n",
+               conn->fd, payload->original_message_type, message);
     }
 }
 
-// ИЗМЕНИТЬ: убрать неиспользуемый параметр conn
-void handle_client_success(const ErrorSuccessPayload* payload) {
+void handle_client_success(Connection* conn, const ErrorSuccessPayload* payload) {
     char message[256];
     if (payload->message_length > 0) {
         size_t copy_len = payload->message_length;
@@ -106,29 +114,84 @@ void handle_client_success(const ErrorSuccessPayload* payload) {
         }
         memcpy(message, (const uint8_t*)payload + sizeof(ErrorSuccessPayload), copy_len);
         message[copy_len] = '\0';
-        printf("Client success (original msg 0x%02x): %s\n", 
-               payload->original_message_type, message);
+        printf("Client success from connection %d (original msg 0x%02x): %s\n",
+               conn->fd, payload->original_message_type, message);
     }
 }
 
 
 // ==================== ОБРАБОТЧИКИ СТРИМОВ ====================
 
-void handle_stream_create(Connection* conn, const StreamCreatePayload* payload) {
+// Новый зритель стрима: первый будит владельца, остальным - быстрый старт с ключевого кадра
+static void stream_join_start_media(Connection* conn, Stream* stream) {
+    if (stream_get_recipient_count(stream) == 1) {
+        send_stream_start(stream);
+    }
+    if (connection_is_udp_handshake_complete(conn) && stream_start_replay(stream, conn) == 0) {
+        int index = DENSE_ARRAY_INDEX_OF(stream->recipients, STREAM_MAX_RECIPIENTS, conn);
+        uint8_t layer = stream->recipient_state[index].replay_layer;
+        printf("Started keyframe replay for connection %d on stream %u layer %u (%u packets cached)\n",
+               conn->fd, stream->stream_id, layer, keyframe_cache_count(stream->keyframe_cache[layer]));
+    }
+}
+
+// Подписка из пакетной операции: те же проверки, что в handle_stream_join, но вместо
+// ответа на каждый стрим - статус для общего SERVER_STREAM_BATCH_RESULT
+static uint8_t stream_batch_join_one(Connection* conn, Stream* stream) {
+    if (stream->call && !call_has_participant(stream->call, conn)) {
+        return BATCH_STATUS_NOT_IN_CALL;
+    }
+
+    int result = stream_add_recipient(stream, conn);
+    if (result == -2) return BATCH_STATUS_ALREADY;
+    if (result != 0) return BATCH_STATUS_FAILED;
+
+    stream_join_start_media(conn, stream);
+    return BATCH_STATUS_OK;
+}
+
+static uint8_t stream_batch_leave_one(Connection* conn, Stream* stream) {
+    if (stream_remove_recipient(stream, conn) != 0) return BATCH_STATUS_ALREADY;
+
+    if (stream_get_recipient_count(stream) == 0) {
+        send_stream_end(stream);
+    }
+    return BATCH_STATUS_OK;
+}
+
+// Участники, подписанные на весь звонок, получают его новый стрим сразу
+static void call_subscribers_join(Call* call, Stream* stream) {
+    for (int i = 0; i < MAX_CALL_PARTICIPANTS; i++) {
+        Connection* participant = call->participants[i];
+        if (!participant || !call->subscribed[i] || participant == stream->owner) continue;
+
+        StreamBatchResult result;
+        result.stream_id = htonl(stream->stream_id);
+        result.status = stream_batch_join_one(participant, stream);
+        send_stream_batch_result(participant, CLIENT_CALL_SUBSCRIBE, &result, 1);
+    }
+}
+
+// Общая часть CLIENT_STREAM_CREATE и CLIENT_STREAM_CREATE_MEDIA; ошибки - с типом запроса
+static void stream_create(Connection* conn, uint8_t request, uint32_t call_id, uint8_t media_class) {
     printf("handle_stream_create: ");
     print_connection_id(conn);
-    printf(", call_id=%u\n", ntohl(payload->call_id));
+    printf(", call_id=%u, media_class=%u\n", call_id, media_class);
     
-    uint32_t call_id = ntohl(payload->call_id);
     Call* call = NULL;
     
+    if (media_class >= MEDIA_CLASS_COUNT) {
+        send_error(conn, request, "ERROR: INVALID MEDIA CLASS");
+        return;
+    }
+    
     // Проверяем, приватный ли это стрим
     if (call_id != 0) {
         call = call_find_by_id(call_id);
         if (!call) {
             char error_msg[64];
             snprintf(error_msg, sizeof(error_msg), "ERROR: COULDN'T FIND CALL WITH ID %u", call_id);
-            send_error(conn, CLIENT_STREAM_CREATE, error_msg);
+            send_error(conn, request, error_msg);
             return;
         }
         
@@ -137,7 +200,7 @@ void handle_stream_create(Connection* conn, const StreamCreatePayload* payload)
             char error_msg[64];
             snprintf(error_msg, sizeof(error_msg), "ERROR: %u ISN'T A PARTICIPANT OF THE CALL %u", 
                      conn->fd, call_id);
-            send_error(conn, CLIENT_STREAM_CREATE, error_msg);
+            send_error(conn, request, error_msg);
             return;
         }
     }
@@ -146,9 +209,10 @@ void handle_stream_create(Connection* conn, const StreamCreatePayload* payload)
     Stream* stream = stream_new(0, conn, call);
     if (!stream) {
         fprintf(stderr, "Failed to create stream in handle_stream_create\n");
-        send_error(conn, CLIENT_STREAM_CREATE, "ERROR: FAILED TO CREATE STREAM");
+        send_error(conn, request, "ERROR: FAILED TO CREATE STREAM");
         return;
     }
+    stream->media_class = media_class;
     
     // Отправляем ответ
     send_stream_created(conn, stream);
@@ -156,9 +220,18 @@ void handle_stream_create(Connection* conn, const StreamCreatePayload* payload)
     // Если стрим приватный, уведомляем участников звонка
     if (call) {
         send_call_stream_new(call, stream);
+        call_subscribers_join(call, stream);
     }
 }
 
+void handle_stream_create(Connection* conn, const StreamCreatePayload* payload) {
+    stream_create(conn, CLIENT_STREAM_CREATE, ntohl(payload->call_id), MEDIA_CLASS_VIDEO);
+}
+
+void handle_stream_create_media(Connection* conn, const StreamCreateMediaPayload* payload) {
+    stream_create(conn, CLIENT_STREAM_CREATE_MEDIA, ntohl(payload->call_id), payload->media_class);
+}
+
 
 void handle_stream_delete(Connection* conn, const StreamIDPayload* payload) {
     uint32_t stream_id = ntohl(payload->stream_id);
@@ -213,6 +286,10 @@ void handle_stream_join(Connection* conn, const StreamIDPayload* payload) {
     printf("\n");
     
     Stream* stream = stream_find_by_id(stream_id);
+    if (!stream && trunk_enabled()) {
+        // Стрим другого узла: подписываемся на него по магистрали (отказ источника придет как удаление)
+        stream = trunk_subscribe(stream_id);
+    }
     if (!stream) {
         char error_msg[64];
         snprintf(error_msg, sizeof(error_msg), "ERROR: COULDN'T FIND STREAM WITH ID %u", stream_id);
@@ -242,29 +319,8 @@ void handle_stream_join(Connection* conn, const StreamIDPayload* payload) {
     // Отправляем подтверждение
     send_stream_joined(conn, stream);
     
-    // Если это первый зритель, уведомляем владельца
-    if (stream_get_recipient_count(stream) == 1) {
-        send_stream_start(stream);
-    }
-
-    if (connection_has_udp(conn) && connection_is_udp_handshake_complete(conn)) {
-        UDPStreamPacket test_packet;
-        memset(&test_packet, 0, sizeof(test_packet));
-        test_packet.call_id = htonl(0);  // public stream
-        test_packet.stream_id = htonl(stream_id);
-        test_packet.packet_number = htonl(9999);  // специальный номер для тестового пакета
-        const char* test_data = "TEST UDP PACKET AFTER JOIN";
-        memcpy(test_packet.data, test_data, strlen(test_data));
-        
-        // Отправляем на сохраненный адрес клиента
-        udp_send_packet(g_udp_fd, &test_packet, sizeof(test_packet), &conn->udp_addr);
-        
-        printf("🔥 Sent test UDP packet to connection %d after joining stream %u\n", 
-            conn->fd, stream_id);
-        printf("🔥 Destination: %s:%d\n", 
-            inet_ntoa(conn->udp_addr.sin_addr), ntohs(conn->udp_addr.sin_port));
-    }
-
+    // Первый зритель будит владельца; быстрый старт с ключевого кадра
+    stream_join_start_media(conn, stream);
 
     printf("🔍 After stream_join - recipient count: %d\n", stream_get_recipient_count(stream));
     for (int i = 0; i < STREAM_MAX_RECIPIENTS; i++) {
@@ -312,6 +368,92 @@ void handle_stream_leave(Connection* conn, const StreamIDPayload* payload) {
     send_success(conn, CLIENT_STREAM_CONN_LEAVE, success_msg);
 }
 
+void handle_stream_batch_join(Connection* conn, const StreamBatchPayload* payload) {
+    const uint8_t* ids = (const uint8_t*)(payload + 1);
+    printf("handle_stream_batch_join: ");
+    print_connection_id(conn);
+    printf(", %u streams\n", payload->stream_count);
+
+    StreamBatchResult results[UINT8_MAX];
+    for (uint8_t i = 0; i < payload->stream_count; i++) {
+        memcpy(&results[i].stream_id, ids + i * sizeof(uint32_t), sizeof(uint32_t));
+        uint32_t stream_id = ntohl(results[i].stream_id);
+
+        Stream* stream = stream_find_by_id(stream_id);
+        if (!stream && trunk_enabled()) {
+            stream = trunk_subscribe(stream_id);
+        }
+        results[i].status = stream ? stream_batch_join_one(conn, stream) : BATCH_STATUS_NOT_FOUND;
+    }
+
+    send_stream_batch_result(conn, CLIENT_STREAM_BATCH_JOIN, results, payload->stream_count);
+}
+
+void handle_stream_batch_leave(Connection* conn, const StreamBatchPayload* payload) {
+    const uint8_t* ids = (const uint8_t*)(payload + 1);
+    printf("handle_stream_batch_leave: ");
+    print_connection_id(conn);
+    printf(", %u streams\n", payload->stream_count);
+
+    StreamBatchResult results[UINT8_MAX];
+    for (uint8_t i = 0; i < payload->stream_count; i++) {
+        memcpy(&results[i].stream_id, ids + i * sizeof(uint32_t), sizeof(uint32_t));
+        Stream* stream = stream_find_by_id(ntohl(results[i].stream_id));
+        results[i].status = stream ? stream_batch_leave_one(conn, stream) : BATCH_STATUS_NOT_FOUND;
+    }
+
+    send_stream_batch_result(conn, CLIENT_STREAM_BATCH_LEAVE, results, payload->stream_count);
+}
+
+void handle_receiver_report(Connection* conn, const ReceiverReportPayload* payload) {
+    uint64_t now_ms = monotonic_ms();
+    
+    // Отчет приходит часто - подтверждение не отправляем
+    bwe_on_report(&conn->bwe, ntohl(payload->packets_expected), ntohl(payload->packets_received),
+                  ntohl(payload->bytes_received), ntohl(payload->interval_ms), now_ms);
+    
+    // Оценка канала делится поровну между стримами зрителя; под нее выбираем слои
+    int watched = (int)DENSE_ARRAY_COUNT(conn->watch_streams, MAX_INPUT);
+    for (int i = 0; i < MAX_INPUT && watched > 0; i++) {
+        Stream* stream = conn->watch_streams[i];
+        if (!stream) continue;
+        int index = DENSE_ARRAY_INDEX_OF(stream->recipients, STREAM_MAX_RECIPIENTS, conn);
+        stream_select_layer(stream, index, conn->bwe.estimate_bps / (uint32_t)watched, now_ms);
+    }
+    
+    if (bwe_update_congestion(&conn->bwe, connection_watch_bitrate(conn, now_ms))) {
+        printf("Connection %d downlink %s: estimate %u kbps, demand %u kbps, loss %u.%u%%\n",
+               conn->fd, conn->bwe.congested ? "congested, dropping droppable packets" : "recovered",
+               conn->bwe.estimate_bps / 1000, conn->bwe.demand_bps / 1000,
+               conn->bwe.loss_permille / 10, conn->bwe.loss_permille % 10);
+    }
+}
+
+void handle_stream_set_layer(Connection* conn, const StreamLayerPayload* payload) {
+    uint32_t stream_id = ntohl(payload->stream_id);
+    printf("handle_stream_set_layer: Connection %d, Stream %u, max layer %u\n",
+           conn->fd, stream_id, payload->max_layer);
+    
+    Stream* stream = stream_find_by_id(stream_id);
+    if (!stream) {
+        send_error(conn, CLIENT_STREAM_SET_LAYER, "ERROR: stream not found");
+        return;
+    }
+    
+    int result = stream_set_max_layer(stream, conn, payload->max_layer);
+    if (result == -2) {
+        send_error(conn, CLIENT_STREAM_SET_LAYER, "ERROR: not a recipient of this stream");
+        return;
+    } else if (result != 0) {
+        send_error(conn, CLIENT_STREAM_SET_LAYER, "ERROR: invalid layer");
+        return;
+    }
+    
+    char success_msg[64];
+    snprintf(success_msg, sizeof(success_msg), "SUCCESS: stream %u max layer %u", stream_id, payload->max_layer);
+    send_success(conn, CLIENT_STREAM_SET_LAYER, success_msg);
+}
+
 // ==================== ОБРАБОТЧИКИ ЗВОНКОВ ====================
 
 void handle_call_create(Connection* conn) {
@@ -336,38 +478,79 @@ void handle_call_create(Connection* conn) {
     send_call_created(conn, call);
 }
 
-void handle_call_join(Connection* conn, const CallJoinPayload* payload) {
-    uint32_t call_id = ntohl(payload->call_id);
-    printf("handle_call_join: ");
-    print_connection_id(conn);
-    printf(", ");
-    print_call_id(call_id);
-    printf("\n");
-    
+// Звонок для входа; NULL - клиенту уже ушел SERVER_CALL_REDIRECT или ошибка
+static Call* call_find_for_join(Connection* conn, uint32_t call_id, uint8_t original_message) {
     Call* call = call_find_by_id(call_id);
+    if (!call && !cluster_owns_call(call_id)) {
+        // Звонок живет на другом узле кластера - отправляем клиента туда
+        send_call_redirect(conn, call_id, cluster_owner_of(call_id));
+        return NULL;
+    }
     if (!call) {
         char error_msg[64];
         snprintf(error_msg, sizeof(error_msg), "ERROR: COULDN'T FIND CALL WITH ID %u", call_id);
-        send_error(conn, CLIENT_CALL_CONN_JOIN, error_msg);
-        return;
+        send_error(conn, original_message, error_msg);
     }
-    
-    // Добавляем участника
+    return call;
+}
+
+static bool call_join_participant(Connection* conn, Call* call, uint8_t original_message) {
     int result = call_add_participant(call, conn);
     if (result != 0) {
         char error_msg[64];
-        snprintf(error_msg, sizeof(error_msg), "ERROR: FAILED TO JOIN CALL %u (code %d)", call_id, result);
-        send_error(conn, CLIENT_CALL_CONN_JOIN, error_msg);
-        return;
+        snprintf(error_msg, sizeof(error_msg), "ERROR: FAILED TO JOIN CALL %u (code %d)", call->call_id, result);
+        send_error(conn, original_message, error_msg);
+        return false;
     }
+    return true;
+}
+
+void handle_call_join(Connection* conn, const CallJoinPayload* payload) {
+    uint32_t call_id = ntohl(payload->call_id);
+    printf("handle_call_join: ");
+    print_connection_id(conn);
+    printf(", ");
+    print_call_id(call_id);
+    printf("\n");
+    
+    Call* call = call_find_for_join(conn, call_id, CLIENT_CALL_CONN_JOIN);
+    if (!call || !call_join_participant(conn, call, CLIENT_CALL_CONN_JOIN)) return;
     
     // Отправляем ответ новому участнику
     send_call_joined(conn, call);
+    if (call->mixing) {
+        send_call_mixing(call, conn);
+    }
     
     // Уведомляем других участников о новом участнике
     send_call_conn_new(call, conn);
 }
 
+void handle_call_sync(Connection* conn, const CallSyncPayload* payload) {
+    uint32_t call_id = ntohl(payload->call_id);
+    uint32_t known = ntohl(payload->version);
+    printf("handle_call_sync: ");
+    print_connection_id(conn);
+    printf(", ");
+    print_call_id(call_id);
+    printf(", known version %u\n", known);
+    
+    Call* call = call_find_for_join(conn, call_id, CLIENT_CALL_SYNC);
+    if (!call) return;
+    
+    // Участник только уточняет версию; новый входит, как по CLIENT_CALL_CONN_JOIN
+    bool joined = !call_has_participant(call, conn);
+    if (joined && !call_join_participant(conn, call, CLIENT_CALL_SYNC)) return;
+    
+    send_call_delta(conn, call, known);
+    if (joined) {
+        if (call->mixing) {
+            send_call_mixing(call, conn);
+        }
+        send_call_conn_new(call, conn);
+    }
+}
+
 void handle_call_leave(Connection* conn, const CallJoinPayload* payload) {
     uint32_t call_id = ntohl(payload->call_id);
     printf("handle_call_leave: ");
@@ -429,70 +612,222 @@ void handle_call_leave(Connection* conn, const CallJoinPayload* payload) {
     send_success(conn, CLIENT_CALL_CONN_LEAVE, success_msg);
 }
 
+void handle_call_subscribe(Connection* conn, const CallSubscribePayload* payload) {
+    uint32_t call_id = ntohl(payload->call_id);
+    printf("handle_call_subscribe: ");
+    print_connection_id(conn);
+    printf(", ");
+    print_call_id(call_id);
+    printf(", enabled=%u\n", payload->enabled);
+
+    Call* call = call_find_by_id(call_id);
+    if (!call) {
+        char error_msg[64];
+        snprintf(error_msg, sizeof(error_msg), "ERROR: COULDN'T FIND CALL WITH ID %u", call_id);
+        send_error(conn, CLIENT_CALL_SUBSCRIBE, error_msg);
+        return;
+    }
+
+    if (call_set_subscribed(call, conn, payload->enabled != 0) != 0) {
+        char error_msg[64];
+        snprintf(error_msg, sizeof(error_msg), "ERROR: %u ISN'T A PARTICIPANT OF THE CALL %u",
+                 conn->fd, call_id);
+        send_error(conn, CLIENT_CALL_SUBSCRIBE, error_msg);
+        return;
+    }
+
+    // Уже существующие стримы - за один проход и одним ответом (при отписке ответ пустой)
+    StreamBatchResult results[MAX_CALL_STREAMS];
+    uint8_t count = 0;
+    for (int i = 0; i < MAX_CALL_STREAMS && payload->enabled; i++) {
+        Stream* stream = call->streams[i];
+        if (!stream || stream->owner == conn) continue;
+        results[count].stream_id = htonl(stream->stream_id);
+        results[count].status = stream_batch_join_one(conn, stream);
+        count++;
+    }
+
+    send_stream_batch_result(conn, CLIENT_CALL_SUBSCRIBE, results, count);
+}
+
+void handle_call_set_mixing(Connection* conn, const CallMixingPayload* payload) {
+    uint32_t call_id = ntohl(payload->call_id);
+    printf("handle_call_set_mixing: ");
+    print_connection_id(conn);
+    printf(", ");
+    print_call_id(call_id);
+    printf(", enabled=%u\n", payload->enabled);
+    
+    Call* call = call_find_by_id(call_id);
+    if (!call) {
+        char error_msg[64];
+        snprintf(error_msg, sizeof(error_msg), "ERROR: COULDN'T FIND CALL WITH ID %u", call_id);
+        send_error(conn, CLIENT_CALL_SET_MIXING, error_msg);
+        return;
+    }
+    
+    if (!call_has_participant(call, conn)) {
+        char error_msg[64];
+        snprintf(error_msg, sizeof(error_msg), "ERROR: %u ISN'T A PARTICIPANT OF THE CALL %u", 
+                 conn->fd, call_id);
+        send_error(conn, CLIENT_CALL_SET_MIXING, error_msg);
+        return;
+    }
+    
+    // Уведомление получают все участники, включая инициатора - оно же и подтверждение
+    call_set_mixing(call, payload->enabled != 0);
+    send_call_mixing(call, NULL);
+}
+
+void handle_resume_token(Connection* conn) {
+    printf("handle_resume_token: ");
+    print_connection_id(conn);
+    printf("\n");
+
+    if (conn->resume_token == 0) {
+        conn->resume_token = generate_token();
+    }
+    if (conn->resume_token == 0) {
+        send_error(conn, CLIENT_RESUME_TOKEN, "ERROR: NO RANDOMNESS FOR TOKEN");
+        return;
+    }
+    ResumeTokenPayload payload = { .connection_id = htonl((uint32_t)conn->fd), .token = conn->resume_token };
+    send_message(conn, SERVER_RESUME_TOKEN, &payload, sizeof(payload));
+}
+
+void handle_conn_resume(Connection* conn, const ConnResumePayload* payload) {
+    uint32_t previous_id = ntohl(payload->connection_id);
+    printf("handle_conn_resume: ");
+    print_connection_id(conn);
+    printf(", previous_id=%u\n", previous_id);
+
+    Connection* detached = previous_id < INT32_MAX ? connection_find(SNAPSHOT_DETACHED_FD(previous_id)) : NULL;
+    // Чужой или не выданный токен неотличим от отсутствующей сессии
+    if (!detached || detached->resume_token == 0 || detached->resume_token != payload->token) {
+        send_error(conn, CLIENT_CONN_RESUME, "ERROR: NOTHING TO RESUME");
+        return;
+    }
+    // Как и UDP handshake: состояние отдается только клиенту с того же адреса
+    if (detached->tcp_addr.sin_addr.s_addr != conn->tcp_addr.sin_addr.s_addr) {
+        send_error(conn, CLIENT_CONN_RESUME, "ERROR: ADDRESS MISMATCH");
+        return;
+    }
+    if (connection_transfer(detached, conn) != 0) {
+        send_error(conn, CLIENT_CONN_RESUME, "ERROR: CONNECTION ALREADY HAS STATE");
+        return;
+    }
+
+    // UDP-сокет клиента обычно переживает обрыв TCP: медиа идет дальше без нового handshake
+    if (!connection_is_udp_handshake_complete(conn) && detached->udp_handshake_complete) {
+        connection_set_udp_addr(conn, &detached->udp_addr);
+        connection_set_udp_handshake_complete(conn);
+    }
+
+    for (int i = 0; i < MAX_CONNECTION_CALLS; i++) {
+        Call* call = conn->calls[i];
+        if (!call) continue;
+        notify_call_event(call, SERVER_CALL_CONN_LEFT, previous_id, conn);
+        // Место участника перешло к новому соединению на месте: в журнале это выход и вход
+        call_log_change(call, CALL_CHANGE_CONN_LEFT, previous_id);
+        call_log_change(call, CALL_CHANGE_CONN_NEW, (uint32_t)conn->fd);
+        send_call_conn_new(call, conn);
+        send_call_joined(conn, call);
+    }
+
+    conn->resume_token = detached->resume_token;
+    connection_delete(detached);
+    send_success(conn, CLIENT_CONN_RESUME, "SUCCESS: RESUMED");
+}
+
+void handle_framing(Connection* conn, const FramingPayload* payload) {
+    uint8_t version = buffer_protocol_framing_negotiate(payload->version);
+    printf("handle_framing: ");
+    print_connection_id(conn);
+    printf(", requested=%u, using=%u\n", payload->version, version);
+
+    // Ответ уходит еще в прежнем формате: получив его, клиент переключает чтение
+    FramingPayload reply = { .version = version };
+    send_message(conn, SERVER_FRAMING, &reply, sizeof(reply));
+    conn->framing = version;
+}
+
+void handle_event_batch(Connection* conn, const EventBatchModePayload* payload) {
+    printf("handle_event_batch: ");
+    print_connection_id(conn);
+    printf(", enabled=%u\n", payload->enabled);
+
+    // Ответ выталкивает накопленное еще в прежнем виде
+    send_success(conn, CLIENT_EVENT_BATCH, payload->enabled ? "SUCCESS: EVENT BATCH ON" : "SUCCESS: EVENT BATCH OFF");
+    conn->event_batch = payload->enabled != 0;
+}
+
 // ==================== ГЛАВНЫЙ ДИСПЕТЧЕР СООБЩЕНИЙ ====================
 
+// Обработчики по схеме: переходник на каждый тип клиента и таблица по байту типа
+typedef void (*ProtocolHandler)(Connection* conn, const uint8_t* payload);
+
+#define DISPATCH_BARE(type, handler) \
+    static void dispatch_##type(Connection* conn, const uint8_t* payload) { \
+        (void)payload; \
+        handler(conn); \
+    }
+#define DISPATCH_FIXED(type, Payload, handler) \
+    static void dispatch_##type(Connection* conn, const uint8_t* payload) { \
+        handler(conn, (const Payload*)payload); \
+    }
+#define DISPATCH_VARIABLE(type, Header, Entry, count, handler) \
+    static void dispatch_##type(Connection* conn, const uint8_t* payload) { \
+        handler(conn, (const Header*)payload); \
+    }
+PROTOCOL_CLIENT_MESSAGES(DISPATCH_BARE, DISPATCH_FIXED, DISPATCH_VARIABLE)
+
+#define DISPATCH_ENTRY(type, ...) [type] = dispatch_##type,
+static const ProtocolHandler client_handlers[256] = {
+    PROTOCOL_CLIENT_MESSAGES(DISPATCH_ENTRY, DISPATCH_ENTRY, DISPATCH_ENTRY)
+};
+
 void handle_client_message(Connection* conn, uint8_t message_type, const uint8_t* payload, size_t payload_len) {
     printf("handle_client_message: conn_fd=%d, type=0x%02x, payload_len=%zu\n", 
            conn->fd, message_type, payload_len);
     
-    switch (message_type) {
-        // Базовые сообщения
-        case CLIENT_ERROR:
-            if (payload_len >= sizeof(ErrorSuccessPayload)) {
-                handle_client_error((const ErrorSuccessPayload*)payload);
-            }
-            break;
-        case CLIENT_SUCCESS:
-            if (payload_len >= sizeof(ErrorSuccessPayload)) {
-                handle_client_success((const ErrorSuccessPayload*)payload);
-            }
-            break;
-            
-        // Сообщения стримов
-        case CLIENT_STREAM_CREATE:
-            if (payload_len >= sizeof(StreamCreatePayload)) {
-                handle_stream_create(conn, (const StreamCreatePayload*)payload);
-            }
-            break;
-        case CLIENT_STREAM_DELETE:
-            if (payload_len >= sizeof(StreamIDPayload)) {
-                handle_stream_delete(conn, (const StreamIDPayload*)payload);
-            }
-            break;
-        case CLIENT_STREAM_CONN_JOIN:
-            if (payload_len >= sizeof(StreamIDPayload)) {
-                handle_stream_join(conn, (const StreamIDPayload*)payload);
-            }
-            break;
-        case CLIENT_STREAM_CONN_LEAVE:
-            if (payload_len >= sizeof(StreamIDPayload)) {
-                handle_stream_leave(conn, (const StreamIDPayload*)payload);
-            }
-            break;
-            
-        // Сообщения звонков
-        case CLIENT_CALL_CREATE:
-            handle_call_create(conn);
-            break;
-        case CLIENT_CALL_CONN_JOIN:
-            if (payload_len >= sizeof(CallJoinPayload)) {
-                handle_call_join(conn, (const CallJoinPayload*)payload);
-            }
-            break;
-        case CLIENT_CALL_CONN_LEAVE:
-            if (payload_len >= sizeof(CallJoinPayload)) {
-                handle_call_leave(conn, (const CallJoinPayload*)payload);
-            }
-            break;
-            
-        default:
-            printf("ERROR: Unknown message type 0x%02x from connection %d\n", message_type, conn->fd);
-            break;
+    ProtocolHandler handler = client_handlers[message_type];
+    if (!handler) {
+        printf("ERROR: Unknown message type 0x%02x from connection %d\n", message_type, conn->fd);
+        return;
+    }
+
+    // Нагрузка не короче, чем требует схема, вместе со всеми заявленными элементами
+    uint32_t size = 0;
+    if (protocol_payload_size(message_type, payload, (uint32_t)payload_len, &size) != 1 || payload_len < size) {
+        printf("ERROR: Truncated message 0x%02x from connection %d (%zu of %u bytes)\n", message_type, conn->fd,
+               payload_len, size);
+        return;
     }
+    handler(conn, payload);
 }
 
 // ==================== ОБРАБОТЧИКИ UDP ПАКЕТОВ ====================
 
+// Связка пакетов: так пишет магистрали узел-источник с --bundle-window (зритель для него -
+// этот узел). Записи разбираются по одной; обрезанная запись заканчивает разбор.
+static void handle_udp_bundle(const uint8_t* data, size_t len, const struct sockaddr_in* src_addr) {
+    UDPStreamPacket packet;  // записи идут без выравнивания
+    size_t offset = UDP_BUNDLE_HEADER_SIZE;
+    while (offset + UDP_BUNDLE_ENTRY_HEADER <= len) {
+        uint16_t entry_len;
+        memcpy(&entry_len, data + offset, sizeof(entry_len));
+        entry_len = ntohs(entry_len);
+        offset += UDP_BUNDLE_ENTRY_HEADER;
+        if (entry_len < UDP_HEADER_SIZE || entry_len > sizeof(packet) || offset + entry_len > len) {
+            printf("UDP bundle: bad entry of %u bytes at offset %zu\n", entry_len, offset);
+            return;
+        }
+        memcpy(&packet, data + offset, entry_len);
+        handle_udp_stream_packet(&packet, entry_len, src_addr);
+        offset += entry_len;
+    }
+}
+
 void handle_udp_packet(const uint8_t* data, size_t len, const struct sockaddr_in* src_addr) {
     if (len < UDP_HEADER_SIZE) {
         printf("UDP packet too small: %zu bytes\n", len);
@@ -500,10 +835,14 @@ void handle_udp_packet(const uint8_t* data, size_t len, const struct sockaddr_in
     }
     
     // Определяем тип пакета по первым байтам
+    uint32_t marker;
+    memcpy(&marker, data, sizeof(marker));
     if (len >= sizeof(UDPHandshakePacket) && memcmp(data, "\0\0\0\0\0\0\0\0", 8) == 0) {
         handle_udp_handshake((const UDPHandshakePacket*)data, src_addr);
+    } else if (ntohl(marker) == UDP_BUNDLE_MARKER) {
+        handle_udp_bundle(data, len, src_addr);
     } else {
-        handle_udp_stream_packet((const UDPStreamPacket*)data, src_addr);
+        handle_udp_stream_packet((const UDPStreamPacket*)data, len, src_addr);
     }
 }
 
@@ -547,11 +886,27 @@ void handle_udp_handshake(const UDPHandshakePacket* packet, const struct sockadd
     printf("UDP handshake completed for connection %u\n", connection_id);
 }
 
-void handle_udp_stream_packet(const UDPStreamPacket* packet, const struct sockaddr_in* src_addr) {
+// Копия пакета с другим packet_number (для получателя, сменившего слой simulcast)
+static PacketBuf* packet_buf_renumbered(const void* packet, size_t len, uint32_t number) {
+    PacketBuf* buf = packet_buf_from(packet, len);
+    if (buf) {
+        uint32_t net_number = htonl(number);
+        memcpy(buf->data + offsetof(UDPStreamPacket, packet_number), &net_number, sizeof(net_number));
+    }
+    return buf;
+}
+
+// Класс пакетов стрима: заявленный при создании или аудио по флагам расширения
+static uint8_t stream_packet_class(const Stream* stream) {
+    return stream->media_class == MEDIA_CLASS_AUDIO || stream->is_audio ? MEDIA_CLASS_AUDIO : MEDIA_CLASS_VIDEO;
+}
+
+void handle_udp_stream_packet(const UDPStreamPacket* packet, size_t len, const struct sockaddr_in* src_addr) {
 
     
     uint32_t call_id = ntohl(packet->call_id);
-    uint32_t stream_id = ntohl(packet->stream_id);
+    uint32_t raw_stream_id = ntohl(packet->stream_id);
+    uint32_t stream_id = raw_stream_id & UDP_STREAM_ID_MASK;
 
     //printf("sent: %ld; udp_fd=%d, len=%zu, dest_addr={family=%d, addr=%s, port=%d}\n", 
     //   sent, udp_fd, len, 
@@ -567,6 +922,19 @@ void handle_udp_stream_packet(const UDPStreamPacket* packet, const struct sockad
       , number
     );
 
+    // Разбираем расширение заголовка, если оно есть
+    const UDPStreamExtHeader* ext = NULL;
+    if ((raw_stream_id & UDP_STREAM_EXT_BIT) && len >= UDP_HEADER_SIZE + sizeof(UDPStreamExtHeader)) {
+        ext = (const UDPStreamExtHeader*)packet->data;
+    }
+    bool is_keyframe = ext && (ext->flags & UDP_EXT_FLAG_KEYFRAME);
+    bool is_droppable = ext && (ext->flags & UDP_EXT_FLAG_DROPPABLE);
+    uint8_t layer = ext ? ext->layer : 0;
+    if (layer >= SIMULCAST_MAX_LAYERS) {
+        printf("UDP stream packet: invalid layer %u for stream %u\n", layer, stream_id);
+        return;
+    }
+
 
     // Находим стрим
     Stream* stream = stream_find_by_id(stream_id);
@@ -584,6 +952,49 @@ void handle_udp_stream_packet(const UDPStreamPacket* packet, const struct sockad
         printf("UDP stream packet: call_id mismatch for stream %u\n", stream_id);
         return;
     }
+
+    // Запоминаем серию с последнего ключевого кадра для новых зрителей.
+    // Ключевой кадр отменяет незаконченные replay - дальше все идут живым потоком.
+    stream_cache_packet(stream, layer, packet, len, is_keyframe);
+
+    uint64_t now_us = monotonic_us();
+    uint64_t now_ms = now_us / 1000ull;
+    rate_meter_update(&stream->layer_rate[layer], len, now_ms);
+    seq_stats_update(&stream->ingress[layer], number, now_us);
+
+    // Громкость аудиостримов звонка: участникам уходят только самые громкие
+    if (ext && (ext->flags & UDP_EXT_FLAG_AUDIO)) {
+        stream->is_audio = true;
+        audio_level_update(&stream->audio_level, ext->audio_level, now_ms);
+        Call* call = stream->call;
+        if (call && now_ms - call->speakers_updated_ms >= SPEAKER_UPDATE_INTERVAL_MS &&
+            call_update_active_speakers(call, now_ms)) {
+            send_call_active_speakers(call);
+        }
+
+        // Звонок микшируется сервером: аудио не пересылается, кадр ждет тика микшера
+        if (call && call->mixing) {
+            size_t pcm_len = len - UDP_HEADER_SIZE - sizeof(UDPStreamExtHeader);
+            if (pcm_len != MIX_FRAME_BYTES) {
+                printf("UDP stream packet: mixing call %u expects %d PCM bytes, got %zu\n",
+                       call->call_id, MIX_FRAME_BYTES, pcm_len);
+                return;
+            }
+            stream_push_audio_frame(stream, ext + 1);
+            return;
+        }
+    }
+
+    // Одна копия пакета на всех получателей, очереди пейсинга держат ссылки
+    PacketBuf* buf = NULL;
+    uint32_t sends = 0;
+
+    // Большая аудитория: получателей раздаем потокам рассылки по их частям
+    bool use_fanout = fanout_stream_eligible(stream);
+    FanoutBatch fanout_batch;
+    if (use_fanout) {
+        fanout_batch_init(&fanout_batch);
+    }
     
     // Пересылаем пакет всем получателям по UDP
     for (int i = 0; i < STREAM_MAX_RECIPIENTS; i++) {
@@ -594,16 +1005,267 @@ void handle_udp_stream_packet(const UDPStreamPacket* packet, const struct sockad
           //      recipient->fd, 
           //      connection_has_udp(recipient),
           //      connection_is_udp_handshake_complete(recipient));
+
+            // Получатель догоняет кеш - этот пакет уже лежит в кеше и придет по очереди
+            if (stream_is_replaying_to(stream, i)) {
+                continue;
+            }
+
+            // Тихий участник звонка - его аудио этому получателю не нужно
+            if (!call_should_forward_audio(stream, recipient)) {
+                continue;
+            }
+
+            // Слой получателя: чужие слои пропускаем, на ключевом кадре целевого - переключаемся
+            uint32_t out_number = number;
+            if (!simulcast_route(&stream->recipient_state[i].simulcast, layer, is_keyframe, number, &out_number)) {
+                continue;
+            }
+
+            // Канал получателя не тянет битрейт - не опорные кадры ему не шлем
+            if (is_droppable && bwe_should_drop(&recipient->bwe, now_ms)) {
+                bwe_count_drop(&recipient->bwe);
+                continue;
+            }
+
             // Проверяем, что для получателя завершен UDP handshake
             if (connection_has_udp(recipient) && connection_is_udp_handshake_complete(recipient)) {
-                // Отправляем исходный UDP пакет (не меняя его состав)
-                udp_send_packet(g_udp_fd, packet, sizeof(UDPStreamPacket), &recipient->udp_addr);
+                // Получателю после смены слоя - своя копия с перенумерацией
+                if (out_number != number) {
+                    PacketBuf* renumbered = packet_buf_renumbered(packet, len, out_number);
+                    if (renumbered) {
+                        renumbered->media_class = stream_packet_class(stream);
+                        connection_send_udp(recipient, renumbered);
+                        packet_buf_release(renumbered);
+                        sends++;
+                    }
+                    continue;
+                }
+                if (use_fanout && fanout_recipient_ready(recipient, stream->recipient_state[i].fanout_thread,
+                                                         (uint32_t)len, now_us)) {
+                    fanout_batch_add(&fanout_batch, stream->recipient_state[i].fanout_thread, recipient);
+                    sends++;
+                    continue;
+                }
+                if (!buf) {
+                    buf = packet_buf_from(packet, len);
+                    if (!buf) return;
+                    buf->media_class = stream_packet_class(stream);
+                }
+                // Отправляем исходный UDP пакет (не меняя его состав) через очередь пейсинга
+                connection_send_udp(recipient, buf);
+                sends++;
             }
         }
     }
+
+    if (use_fanout && !fanout_batch_empty(&fanout_batch)) {
+        if (!buf) {
+            buf = packet_buf_from(packet, len);
+            if (!buf) return;
+            buf->media_class = stream_packet_class(stream);
+        }
+        fanout_submit(&fanout_batch, buf);
+    }
+
+    packet_buf_release(buf);
+    if (stream->relayed) {
+        trunk_account(stream, sends);
+    }
     
     (void)src_addr; // Помечаем параметр как использованный
 }
+
+void process_keyframe_replays(void) {
+    static uint64_t last_tick_ms = 0;
+
+    if (stream_active_replays == 0) {
+        last_tick_ms = 0;
+        return;
+    }
+
+    // Бюджет пропорционален прошедшему времени, но не больше 10 мс за раз,
+    // чтобы после долгого epoll_wait не выдать весь кеш одной пачкой
+    uint64_t now_ms = monotonic_ms();
+    uint64_t elapsed = last_tick_ms ? now_ms - last_tick_ms : 1;
+    if (elapsed == 0) return;
+    if (elapsed > 10) elapsed = 10;
+    last_tick_ms = now_ms;
+    uint32_t budget = (uint32_t)(elapsed * KEYFRAME_REPLAY_PACKETS_PER_MS);
+
+    Stream* stream, *tmp;
+    HASH_ITER(hh, streams, stream, tmp) {
+        if (stream->active_replays == 0) continue;
+
+        for (int i = 0; i < STREAM_MAX_RECIPIENTS; i++) {
+            StreamRecipientState* state = &stream->recipient_state[i];
+            Connection* recipient = stream->recipients[i];
+            if (!state->replay_active || !recipient) continue;
+
+            KeyframeCache* cache = stream->keyframe_cache[state->replay_layer];
+            if (!keyframe_cache_is_valid(cache) || cache->generation != state->replay_generation) {
+                stream_stop_replay(stream, i);
+                continue;
+            }
+
+            // Половину очереди пейсинга оставляем под живой поток других стримов
+            uint32_t sent = 0;
+            while (sent < budget && state->replay_cursor < keyframe_cache_count(cache) &&
+                   pacer_queue_depth(recipient->pacer) < pacer_queue_limit() / 2) {
+                const CachedPacket* cached = keyframe_cache_get(cache, state->replay_cursor);
+                const UDPStreamPacket* original = (const UDPStreamPacket*)cached->data;
+                uint32_t out_number = simulcast_rewrite(&state->simulcast, ntohl(original->packet_number));
+                PacketBuf* buf = packet_buf_renumbered(cached->data, cached->len, out_number);
+                if (!buf) break;
+                buf->media_class = stream_packet_class(stream);
+                int result = connection_send_udp(recipient, buf);
+                packet_buf_release(buf);
+                if (result == -2) break;  // очередь заполнена - продолжим на следующем тике
+                state->replay_cursor++;
+                sent++;
+            }
+
+            // Догнали живой поток - дальше пакеты идут напрямую
+            if (state->replay_cursor >= keyframe_cache_count(cache)) {
+                printf("Keyframe replay finished for connection %d on stream %u\n",
+                       recipient->fd, stream->stream_id);
+                stream_stop_replay(stream, i);
+            }
+        }
+    }
+}
+
+// UDP пакет микса для участников звонка (PCM сразу пишется в буфер пула)
+static PacketBuf* mix_packet(const Call* call, const AudioFrame* frame) {
+    PacketBuf* buf = packet_buf_alloc();
+    if (!buf) return NULL;
+    buf->media_class = MEDIA_CLASS_AUDIO;
+    
+    UDPStreamPacket* packet = (UDPStreamPacket*)buf->data;
+    packet->call_id = htonl(call->call_id);
+    packet->stream_id = htonl(call->mix_stream_id | UDP_STREAM_EXT_BIT);
+    packet->packet_number = htonl(call->mix_sequence);
+    
+    UDPStreamExtHeader ext;
+    memset(&ext, 0, sizeof(ext));
+    ext.flags = UDP_EXT_FLAG_AUDIO;
+    ext.audio_level = AUDIO_LEVEL_SILENCE;
+    memcpy(packet->data, &ext, sizeof(ext));
+    memcpy(packet->data + sizeof(ext), frame->samples, MIX_FRAME_BYTES);
+    
+    buf->len = (uint16_t)(UDP_HEADER_SIZE + sizeof(ext) + MIX_FRAME_BYTES);
+    return buf;
+}
+
+static void mix_call_frame(Call* call) {
+    static AudioFrame everyone;
+    static AudioFrame minus[MIX_MAX_SOURCES];
+    const AudioFrame* sources[MIX_MAX_SOURCES];
+    Connection* source_owners[MIX_MAX_SOURCES];
+    int count = 0;
+    
+    // По кадру из каждой очереди на тик, даже если стрим не попадает в микс,
+    // чтобы очереди не копили задержку
+    for (int i = 0; i < MAX_CALL_STREAMS; i++) {
+        Stream* stream = call->streams[i];
+        if (!stream || !stream->mix_queue) continue;
+        
+        const AudioFrame* frame = audio_jitter_pop(stream->mix_queue);
+        if (!frame || count == MIX_MAX_SOURCES) continue;
+        
+        // Смешиваем самых громких (ранги считает выбор активных говорящих)
+        if (stream->speaker_rank > MIX_MAX_SOURCES) continue;
+        sources[count] = frame;
+        source_owners[count] = stream->owner;
+        count++;
+    }
+    if (count == 0) return;  // все молчат (DTX) - участникам тоже нечего слать
+    
+    mixer_mix_minus(sources, count, &everyone, minus);
+    
+    // Слушатели, которых нет в миксе, получают одну общую копию
+    PacketBuf* everyone_buf = NULL;
+    for (int i = 0; i < MAX_CALL_PARTICIPANTS; i++) {
+        Connection* participant = call->participants[i];
+        if (!participant || !connection_has_udp(participant) ||
+            !connection_is_udp_handshake_complete(participant)) {
+            continue;
+        }
+        
+        int own = -1;
+        for (int s = 0; s < count; s++) {
+            if (source_owners[s] == participant) {
+                own = s;
+                break;
+            }
+        }
+        
+        if (own >= 0) {
+            PacketBuf* buf = mix_packet(call, &minus[own]);
+            if (!buf) continue;
+            connection_send_udp(participant, buf);
+            packet_buf_release(buf);
+        } else {
+            if (!everyone_buf) {
+                everyone_buf = mix_packet(call, &everyone);
+                if (!everyone_buf) continue;
+            }
+            connection_send_udp(participant, everyone_buf);
+        }
+    }
+    
+    packet_buf_release(everyone_buf);
+    call->mix_sequence++;
+}
+
+void process_call_mixing(void) {
+    if (call_mixing_count == 0) return;
+    
+    uint64_t now_ms = monotonic_ms();
+    Call* call, *tmp;
+    HASH_ITER(hh, calls, call, tmp) {
+        if (!call->mixing) continue;
+        
+        // После долгой паузы главного цикла не догоняем пропущенные кадры пачкой
+        if (call->mix_next_ms == 0 || now_ms - call->mix_next_ms > 4 * MIX_FRAME_MS) {
+            call->mix_next_ms = now_ms;
+        }
+        while (now_ms >= call->mix_next_ms) {
+            mix_call_frame(call);
+            call->mix_next_ms += MIX_FRAME_MS;
+        }
+    }
+}
+
+void process_stream_stats(void) {
+    if (g_config.stream_stats_interval_ms == 0) return;
+
+    static uint64_t last_run_ms = 0;
+    uint64_t now_ms = monotonic_ms();
+    if (now_ms - last_run_ms < g_config.stream_stats_interval_ms) return;
+    last_run_ms = now_ms;
+
+    Stream* stream, *tmp;
+    HASH_ITER(hh, streams, stream, tmp) {
+        if (!stream->owner) continue;
+        // Клиент с legacy-фреймингом не знает длины 0x95 и собьется с потока
+        if (stream->owner->framing != FRAMING_LENGTH_PREFIXED) continue;
+        if (stream->ingress_reported_ms == 0) {
+            // Первый интервал отсчитываем от появления стрима в обходе
+            stream->ingress_reported_ms = now_ms;
+            continue;
+        }
+        // Без новых пакетов отчет ничего не скажет издателю
+        StreamIngressTotals totals;
+        stream_ingress_totals(stream, &totals);
+        if (totals.received == stream->ingress_reported.received &&
+            totals.duplicates == stream->ingress_reported.duplicates) {
+            continue;
+        }
+        send_stream_stats(stream, now_ms);
+    }
+}
+
 // ==================== ФУНКЦИИ ОТПРАВКИ СЕРВЕРА ====================
 
 void send_server_handshake_start(Connection* conn) {
@@ -614,11 +1276,7 @@ void send_server_handshake_start(Connection* conn) {
     HandshakeStartPayload payload;
     payload.connection_id = htonl(conn->fd);
     
-    uint8_t message[1 + sizeof(HandshakeStartPayload)];
-    message[0] = SERVER_HANDSHAKE_START;
-    memcpy(message + 1, &payload, sizeof(payload));
-    
-    connection_send_message(conn, message, sizeof(message));
+    send_message(conn, SERVER_HANDSHAKE_START, &payload, sizeof(payload));
 }
 
 void send_server_handshake_end(Connection* conn) {
@@ -629,11 +1287,7 @@ void send_server_handshake_end(Connection* conn) {
     HandshakeStartPayload payload;  // Используем ту же структуру, что и для START
     payload.connection_id = htonl(conn->fd);
     
-    uint8_t message[1 + sizeof(HandshakeStartPayload)];
-    message[0] = SERVER_HANDSHAKE_END;
-    memcpy(message + 1, &payload, sizeof(payload));
-    
-    connection_send_message(conn, message, sizeof(message));
+    send_message(conn, SERVER_HANDSHAKE_END, &payload, sizeof(payload));
 }
 
 void send_stream_created(Connection* conn, Stream* stream) {
@@ -646,11 +1300,7 @@ void send_stream_created(Connection* conn, Stream* stream) {
     StreamIDPayload payload;
     payload.stream_id = htonl(stream->stream_id);
     
-    uint8_t message[1 + sizeof(StreamIDPayload)];
-    message[0] = SERVER_STREAM_CREATED;
-    memcpy(message + 1, &payload, sizeof(payload));
-    
-    connection_send_message(conn, message, sizeof(message));
+    send_message(conn, SERVER_STREAM_CREATED, &payload, sizeof(payload));
 }
 
 void send_stream_deleted(Stream* stream) {
@@ -674,11 +1324,7 @@ void send_stream_joined(Connection* conn, Stream* stream) {
     StreamIDPayload payload;
     payload.stream_id = htonl(stream->stream_id);
     
-    uint8_t message[1 + sizeof(StreamIDPayload)];
-    message[0] = SERVER_STREAM_CONN_JOINED;
-    memcpy(message + 1, &payload, sizeof(payload));
-    
-    connection_send_message(conn, message, sizeof(message));
+    send_message(conn, SERVER_STREAM_CONN_JOINED, &payload, sizeof(payload));
 }
 
 void send_stream_start(Stream* stream) {
@@ -686,15 +1332,55 @@ void send_stream_start(Stream* stream) {
     print_stream_id(stream->stream_id);
     printf("\n");
     
-    StreamIDPayload payload;
+    notify_event(stream->owner, SERVER_STREAM_START, 0, stream->stream_id);
+}
+
+void send_stream_batch_result(Connection* conn, uint8_t original_message, const StreamBatchResult* results,
+                              uint8_t count) {
+    uint8_t joined = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        if (results[i].status == BATCH_STATUS_OK) joined++;
+    }
+    printf("send_stream_batch_result: ");
+    print_connection_id(conn);
+    printf(", type=0x%02x, %u of %u streams done\n", original_message, joined, count);
+
+    StreamBatchResultPayload payload;
+    payload.original_message_type = original_message;
+    payload.result_count = count;
+
+    uint8_t message[sizeof(StreamBatchResultPayload) + UINT8_MAX * sizeof(StreamBatchResult)];
+    memcpy(message, &payload, sizeof(payload));
+    memcpy(message + sizeof(payload), results, count * sizeof(StreamBatchResult));
+
+    send_message(conn, SERVER_STREAM_BATCH_RESULT, message, sizeof(payload) + count * sizeof(StreamBatchResult));
+}
+
+void send_stream_stats(Stream* stream, uint64_t now_ms) {
+    StreamIngressTotals totals;
+    stream_ingress_totals(stream, &totals);
+    const StreamIngressTotals* last = &stream->ingress_reported;
+
+    printf("send_stream_stats: ");
+    print_stream_id(stream->stream_id);
+    printf(", received %lu/%lu, lost %lu, jitter %u us\n",
+           (unsigned long)(totals.received - last->received), (unsigned long)(totals.expected - last->expected),
+           (unsigned long)(totals.lost - last->lost), totals.jitter_us);
+
+    StreamStatsPayload payload;
     payload.stream_id = htonl(stream->stream_id);
-    
-    uint8_t message[1 + sizeof(StreamIDPayload)];
-    message[0] = SERVER_STREAM_START;
-    memcpy(message + 1, &payload, sizeof(payload));
-    
-    // Приводим тип для устранения предупреждения
-    connection_send_message((Connection*)stream->owner, message, sizeof(message));
+    payload.packets_expected = htonl((uint32_t)(totals.expected - last->expected));
+    payload.packets_received = htonl((uint32_t)(totals.received - last->received));
+    payload.packets_lost = htonl((uint32_t)(totals.lost - last->lost));
+    payload.packets_reordered = htonl((uint32_t)(totals.reordered - last->reordered));
+    payload.packets_duplicate = htonl((uint32_t)(totals.duplicates - last->duplicates));
+    payload.jitter_us = htonl(totals.jitter_us);
+    payload.interval_ms = htonl((uint32_t)(now_ms - stream->ingress_reported_ms));
+
+    send_message(stream->owner, SERVER_STREAM_STATS, &payload, sizeof(payload));
+
+    stream->ingress_reported = totals;
+    stream->ingress_reported_ms = now_ms;
 }
 
 void send_stream_end(Stream* stream) {
@@ -702,15 +1388,7 @@ void send_stream_end(Stream* stream) {
     print_stream_id(stream->stream_id);
     printf("\n");
     
-    StreamIDPayload payload;
-    payload.stream_id = htonl(stream->stream_id);
-    
-    uint8_t message[1 + sizeof(StreamIDPayload)];
-    message[0] = SERVER_STREAM_END;
-    memcpy(message + 1, &payload, sizeof(payload));
-    
-    // Приводим тип для устранения предупреждения
-    connection_send_message((Connection*)stream->owner, message, sizeof(message));
+    notify_event(stream->owner, SERVER_STREAM_END, 0, stream->stream_id);
 }
 
 void send_call_created(Connection* conn, Call* call) {
@@ -723,11 +1401,7 @@ void send_call_created(Connection* conn, Call* call) {
     IDPayload payload;
     payload.id = htonl(call->call_id);
     
-    uint8_t message[1 + sizeof(IDPayload)];
-    message[0] = SERVER_CALL_CREATED;
-    memcpy(message + 1, &payload, sizeof(payload));
-    
-    connection_send_message(conn, message, sizeof(message));
+    send_message(conn, SERVER_CALL_CREATED, &payload, sizeof(payload));
 }
 
 void send_call_joined(Connection* conn, Call* call) {
@@ -747,18 +1421,17 @@ void send_call_joined(Connection* conn, Call* call) {
     header.stream_count = (uint8_t)stream_count;
     
     // Вычисляем общий размер
-    size_t total_size = 1 + sizeof(CallJoinedPayload) + 
+    size_t total_size = sizeof(CallJoinedPayload) + 
                        participant_count * sizeof(uint32_t) + 
                        stream_count * sizeof(uint32_t);
     
     uint8_t* message = malloc(total_size);
     if (!message) return;
     
-    message[0] = SERVER_CALL_CONN_JOINED;
-    memcpy(message + 1, &header, sizeof(header));
+    memcpy(message, &header, sizeof(header));
     
     // Копируем участников
-    uint32_t* participants_ptr = (uint32_t*)(message + 1 + sizeof(header));
+    uint32_t* participants_ptr = (uint32_t*)(message + sizeof(header));
     for (int i = 0; i < MAX_CALL_PARTICIPANTS; i++) {
         if (call->participants[i]) {
             *participants_ptr++ = htonl(call->participants[i]->fd);
@@ -773,7 +1446,7 @@ void send_call_joined(Connection* conn, Call* call) {
         }
     }
     
-    connection_send_message(conn, message, total_size);
+    send_message(conn, SERVER_CALL_CONN_JOINED, message, total_size);
     free(message);
 }
 
@@ -782,11 +1455,7 @@ void send_call_conn_new(Call* call, Connection* new_conn) {
     print_call_id(call->call_id);
     printf(", new_conn=%d\n", new_conn->fd);
     
-    CallConnPayload payload;
-    payload.call_id = htonl(call->call_id);
-    payload.connection_id = htonl(new_conn->fd);
-    
-    broadcast_to_call_participants(call, SERVER_CALL_CONN_NEW, &payload, sizeof(payload), new_conn);
+    notify_call_event(call, SERVER_CALL_CONN_NEW, (uint32_t)new_conn->fd, new_conn);
 }
 
 void send_call_conn_left(Call* call, Connection* left_conn) {
@@ -794,11 +1463,7 @@ void send_call_conn_left(Call* call, Connection* left_conn) {
     print_call_id(call->call_id);
     printf(", left_conn=%d\n", left_conn->fd);
     
-    CallConnPayload payload;
-    payload.call_id = htonl(call->call_id);
-    payload.connection_id = htonl(left_conn->fd);
-    
-    broadcast_to_call_participants(call, SERVER_CALL_CONN_LEFT, &payload, sizeof(payload), left_conn);
+    notify_call_event(call, SERVER_CALL_CONN_LEFT, (uint32_t)left_conn->fd, left_conn);
 }
 
 void send_call_stream_new(Call* call, Stream* stream) {
@@ -808,11 +1473,7 @@ void send_call_stream_new(Call* call, Stream* stream) {
     print_stream_id(stream->stream_id);
     printf("\n");
     
-    CallStreamPayload payload;
-    payload.call_id = htonl(call->call_id);
-    payload.stream_id = htonl(stream->stream_id);
-    
-    broadcast_to_call_participants(call, SERVER_CALL_STREAM_NEW, &payload, sizeof(payload), NULL);
+    notify_call_event(call, SERVER_CALL_STREAM_NEW, stream->stream_id, NULL);
 }
 
 void send_call_stream_deleted(Call* call, Stream* stream) {
@@ -822,11 +1483,112 @@ void send_call_stream_deleted(Call* call, Stream* stream) {
     print_stream_id(stream->stream_id);
     printf("\n");
     
-    CallStreamPayload payload;
+    notify_call_event(call, SERVER_CALL_STREAM_DELETED, stream->stream_id, NULL);
+}
+
+void send_call_active_speakers(Call* call) {
+    printf("send_call_active_speakers: ");
+    print_call_id(call->call_id);
+    
+    CallSpeakersPayload header;
+    header.call_id = htonl(call->call_id);
+    header.stream_count = 0;
+    
+    uint32_t stream_ids[CALL_ACTIVE_SPEAKERS];
+    for (int i = 0; i < CALL_ACTIVE_SPEAKERS; i++) {
+        if (call->active_speakers[i]) {
+            printf(", %u", call->active_speakers[i]->stream_id);
+            stream_ids[header.stream_count++] = htonl(call->active_speakers[i]->stream_id);
+        }
+    }
+    printf("\n");
+    
+    uint8_t payload[sizeof(CallSpeakersPayload) + sizeof(stream_ids)];
+    memcpy(payload, &header, sizeof(header));
+    memcpy(payload + sizeof(header), stream_ids, header.stream_count * sizeof(uint32_t));
+    
+    broadcast_to_call_participants(call, SERVER_CALL_ACTIVE_SPEAKERS, payload,
+                                   sizeof(header) + header.stream_count * sizeof(uint32_t), NULL);
+}
+
+void send_call_mixing(Call* call, Connection* conn) {
+    printf("send_call_mixing: ");
+    print_call_id(call->call_id);
+    printf(", enabled=%d, mix stream %u\n", call->mixing, call->mixing ? call->mix_stream_id : 0);
+    
+    CallMixingStatePayload payload;
     payload.call_id = htonl(call->call_id);
-    payload.stream_id = htonl(stream->stream_id);
+    payload.mix_stream_id = htonl(call->mixing ? call->mix_stream_id : 0);
+    payload.enabled = call->mixing ? 1 : 0;
+    
+    if (conn) {
+        send_message(conn, SERVER_CALL_MIXING, &payload, sizeof(payload));
+    } else {
+        broadcast_to_call_participants(call, SERVER_CALL_MIXING, &payload, sizeof(payload), NULL);
+    }
+}
+
+void send_call_delta(Connection* conn, Call* call, uint32_t known_version) {
+    static const uint8_t change_messages[] = {
+        [CALL_CHANGE_CONN_NEW] = SERVER_CALL_CONN_NEW,
+        [CALL_CHANGE_CONN_LEFT] = SERVER_CALL_CONN_LEFT,
+        [CALL_CHANGE_STREAM_NEW] = SERVER_CALL_STREAM_NEW,
+        [CALL_CHANGE_STREAM_DELETED] = SERVER_CALL_STREAM_DELETED,
+    };
+
+    CallChange changes[CALL_CHANGE_LOG];
+    int count = known_version != 0 ? call_changes_since(call, known_version, changes, CALL_CHANGE_LOG) : -1;
+    // Изменений больше, чем весь состав - проще отдать состав
+    if (count > call_get_participant_count(call) + call_get_stream_count(call)) count = -1;
+
+    printf("send_call_delta: ");
+    print_connection_id(conn);
+    printf(", ");
+    print_call_id(call->call_id);
+    if (count < 0) {
+        printf(", version %u -> %u: full state\n", known_version, call->version);
+    } else {
+        printf(", version %u -> %u: %d changes\n", known_version, call->version, count);
+    }
+
+    CallDeltaPayload header;
+    header.call_id = htonl(call->call_id);
+    header.from_version = htonl(count < 0 ? 0 : known_version);
+    header.version = htonl(call->version);
+    header.change_count = count < 0 ? 0 : (uint8_t)count;
+
+    if (count < 0) {
+        send_call_joined(conn, call);
+    }
+
+    uint8_t message[sizeof(CallDeltaPayload) + CALL_CHANGE_LOG * sizeof(CallDeltaEntry)];
+    memcpy(message, &header, sizeof(header));
+    CallDeltaEntry* entries = (CallDeltaEntry*)(message + sizeof(header));
+    for (int i = 0; i < header.change_count; i++) {
+        entries[i].type = change_messages[changes[i].type];
+        entries[i].id = htonl(changes[i].id);
+    }
+    send_message(conn, SERVER_CALL_DELTA, message, sizeof(header) + header.change_count * sizeof(CallDeltaEntry));
+}
+
+void send_call_redirect(Connection* conn, uint32_t call_id, uint32_t node) {
+    const ClusterNode* owner = cluster_node(node);
+    if (!owner) return;
+
+    printf("send_call_redirect: ");
+    print_connection_id(conn);
+    printf(", ");
+    print_call_id(call_id);
+    printf(" -> node %u %s:%u\n", node, inet_ntoa(owner->tcp_addr.sin_addr), ntohs(owner->tcp_addr.sin_port));
+    
+    CallRedirectPayload payload;
+    payload.call_id = htonl(call_id);
+    payload.node_addr = owner->tcp_addr.sin_addr.s_addr;
+    payload.tcp_port = owner->tcp_addr.sin_port;
+    payload.udp_port = htons(owner->udp_port);
     
-    broadcast_to_call_participants(call, SERVER_CALL_STREAM_DELETED, &payload, sizeof(payload), NULL);
+    send_message(conn, SERVER_CALL_REDIRECT, &payload, sizeof(payload));
+    cluster_count_redirect();
 }
 
 // ==================== СЛУЖЕБНЫЕ ФУНКЦИИ ====================
@@ -842,45 +1604,39 @@ void handle_connection_closed(Connection* conn) {
 void broadcast_to_stream_recipients(Stream* stream, uint8_t message_type, const void* payload, size_t payload_len, Connection* exclude) {
     if (!stream) return;
     
-    // Создаем полное сообщение
-    uint8_t* message = malloc(1 + payload_len);
-    if (!message) return;
-    
-    message[0] = message_type;
-    if (payload_len > 0) {
-        memcpy(message + 1, payload, payload_len);
+    // Создаем полное сообщение (размер по схеме)
+    uint8_t message[BUFFER_SIZE];
+    int len = protocol_encode(message, sizeof(message), message_type, payload, payload_len);
+    if (len < 0) {
+        printf("ERROR: Malformed message 0x%02x (%zu bytes) not sent\n", message_type, payload_len);
+        return;
     }
     
     // Отправляем всем получателям кроме исключенного
     for (int i = 0; i < STREAM_MAX_RECIPIENTS; i++) {
         Connection* recipient = stream->recipients[i];
         if (recipient && recipient != exclude) {
-            connection_send_message(recipient, message, 1 + payload_len);
+            connection_send_message(recipient, message, (size_t)len);
         }
     }
-    
-    free(message);
 }
 
 void broadcast_to_call_participants(Call* call, uint8_t message_type, const void* payload, size_t payload_len, Connection* exclude) {
     if (!call) return;
     
-    // Создаем полное сообщение
-    uint8_t* message = malloc(1 + payload_len);
-    if (!message) return;
-    
-    message[0] = message_type;
-    if (payload_len > 0) {
-        memcpy(message + 1, payload, payload_len);
+    // Создаем полное сообщение (размер по схеме)
+    uint8_t message[BUFFER_SIZE];
+    int len = protocol_encode(message, sizeof(message), message_type, payload, payload_len);
+    if (len < 0) {
+        printf("ERROR: Malformed message 0x%02x (%zu bytes) not sent\n", message_type, payload_len);
+        return;
     }
     
     // Отправляем всем участникам кроме исключенного
     for (int i = 0; i < MAX_CALL_PARTICIPANTS; i++) {
         Connection* participant = call->participants[i];
         if (participant && participant != exclude) {
-            connection_send_message(participant, message, 1 + payload_len);
+            connection_send_message(participant, message, (size_t)len);
         }
     }
-    
-    free(message);
 }
\ No newline at end of file
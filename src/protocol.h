@@ -16,6 +16,34 @@
 #define UDP_HEADER_SIZE          (sizeof(uint32_t) * 3)  // call_id + stream_id + packet_number
 #define UDP_DATA_SIZE            (UDP_PACKET_SIZE - UDP_HEADER_SIZE)
 
+// ==================== РАСШИРЕНИЕ ЗАГОЛОВКА UDP ====================
+// ID генерируются в диапазоне [0, 26^6), поэтому старший бит stream_id всегда свободен.
+// Если он установлен, data начинается с UDPStreamExtHeader.
+#define UDP_STREAM_EXT_BIT        0x80000000u
+#define UDP_STREAM_ID_MASK        0x7FFFFFFFu
+
+// Флаги UDPStreamExtHeader.flags
+#define UDP_EXT_FLAG_KEYFRAME     0x01  // пакет открывает ключевой кадр
+#define UDP_EXT_FLAG_DROPPABLE    0x02  // не опорный кадр: можно не пересылать перегруженному получателю
+#define UDP_EXT_FLAG_AUDIO        0x04  // аудиопакет, audio_level заполнен
+
+// ==================== КЛАССЫ МЕДИА ====================
+// Класс стрима задается в CLIENT_STREAM_CREATE_MEDIA (CLIENT_STREAM_CREATE создает видео). Аудио отправляется раньше видео
+// (отдельная очередь у каждого получателя) и размечается своим DSCP/SO_PRIORITY.
+#define MEDIA_CLASS_VIDEO         0
+#define MEDIA_CLASS_AUDIO         1
+#define MEDIA_CLASS_COUNT         2
+
+// ==================== СВЯЗКИ ПАКЕТОВ ====================
+// При включенном бандлинге сервер может упаковать несколько пакетов одному получателю
+// в одну датаграмму: UDP_BUNDLE_MARKER на месте call_id (ID всегда меньше 26^6),
+// затем записи {uint16_t length; uint8_t packet[length]} до конца датаграммы.
+// packet - обычный UDPStreamPacket, length в сетевом порядке байт. Узел каскада
+// принимает связки от источника и разбирает их (handle_udp_packet).
+#define UDP_BUNDLE_MARKER         0xFFFFFFFFu
+#define UDP_BUNDLE_HEADER_SIZE    sizeof(uint32_t)
+#define UDP_BUNDLE_ENTRY_HEADER   sizeof(uint16_t)
+
 // ==================== БАЗОВЫЕ ТИПЫ СООБЩЕНИЙ ====================
 #define CLIENT_ERROR              0x01
 #define SERVER_ERROR              0x02
@@ -23,23 +51,40 @@
 #define SERVER_SUCCESS            0x04
 #define SERVER_HANDSHAKE_START    0x05
 #define SERVER_HANDSHAKE_END      0x06
+#define CLIENT_CONN_RESUME        0x07
+#define CLIENT_FRAMING            0x08
+#define SERVER_FRAMING            0x09
+#define CLIENT_EVENT_BATCH        0x0A
+#define SERVER_EVENT_BATCH        0x0B
+#define CLIENT_RESUME_TOKEN       0x0C
+#define SERVER_RESUME_TOKEN       0x0D
 
 // ==================== СООБЩЕНИЯ ДЛЯ СТРИМОВ ====================
 #define CLIENT_STREAM_CREATE      0x10
 #define CLIENT_STREAM_DELETE      0x11
 #define CLIENT_STREAM_CONN_JOIN   0x12
 #define CLIENT_STREAM_CONN_LEAVE  0x13
+#define CLIENT_RECEIVER_REPORT    0x14
+#define CLIENT_STREAM_SET_LAYER   0x15
+#define CLIENT_STREAM_BATCH_JOIN  0x16
+#define CLIENT_STREAM_BATCH_LEAVE 0x17
+#define CLIENT_STREAM_CREATE_MEDIA 0x18
 
 #define SERVER_STREAM_CREATED     0x90
 #define SERVER_STREAM_DELETED     0x91
 #define SERVER_STREAM_CONN_JOINED 0x92
 #define SERVER_STREAM_START       0x93
 #define SERVER_STREAM_END         0x94
+#define SERVER_STREAM_STATS       0x95
+#define SERVER_STREAM_BATCH_RESULT 0x96
 
 // ==================== СООБЩЕНИЯ ДЛЯ ЗВОНКОВ ====================
 #define CLIENT_CALL_CREATE        0x20
 #define CLIENT_CALL_CONN_JOIN     0x21
 #define CLIENT_CALL_CONN_LEAVE    0x22
+#define CLIENT_CALL_SET_MIXING    0x23
+#define CLIENT_CALL_SUBSCRIBE     0x24
+#define CLIENT_CALL_SYNC          0x25
 
 #define SERVER_CALL_CREATED       0xA0
 #define SERVER_CALL_CONN_JOINED   0xA1
@@ -47,6 +92,17 @@
 #define SERVER_CALL_CONN_LEFT     0xA3
 #define SERVER_CALL_STREAM_NEW    0xA4
 #define SERVER_CALL_STREAM_DELETED 0xA5
+#define SERVER_CALL_ACTIVE_SPEAKERS 0xA6
+#define SERVER_CALL_MIXING        0xA7
+#define SERVER_CALL_REDIRECT      0xA8
+#define SERVER_CALL_DELTA         0xA9
+
+// ==================== СТАТУСЫ ПАКЕТНЫХ ОПЕРАЦИЙ ====================
+#define BATCH_STATUS_OK           0
+#define BATCH_STATUS_NOT_FOUND    1
+#define BATCH_STATUS_NOT_IN_CALL  2  // приватный стрим чужого звонка
+#define BATCH_STATUS_ALREADY      3  // уже подписан (JOIN) или не был подписан (LEAVE)
+#define BATCH_STATUS_FAILED       4  // нет места у стрима или получателя, нет UDP-адреса
 
 #pragma pack(push, 1)
 
@@ -67,20 +123,124 @@ typedef struct {
     uint16_t port;
 } HandshakeEndPayload;
 
+// CLIENT_RESUME_TOKEN (без нагрузки) - клиент, который хочет пережить перезапуск сервера,
+// запрашивает секрет своей сессии. Ответ SERVER_RESUME_TOKEN; повторный запрос вернет тот же
+// токен. Отдельным запросом, а не полем SERVER_HANDSHAKE_START: в FRAMING_LEGACY размер
+// сообщения выводится из типа, и прежние клиенты не разобрали бы удлиненный handshake
+typedef struct {
+    uint32_t connection_id;
+    uint64_t token;          // непрозрачные 8 байт, порядок не меняется
+} ResumeTokenPayload;
+
+// CLIENT_CONN_RESUME - после перезапуска сервера из снимка клиент на новом соединении
+// забирает прежние звонки, стримы и подписки по connection_id из прошлого
+// SERVER_HANDSHAKE_START и токену из SERVER_RESUME_TOKEN (и только с того же IP). Без токена
+// сессию не вернуть: номера соединений - это fd, их легко перебрать. Ответ:
+// SERVER_CALL_CONN_JOINED по каждому звонку и SERVER_SUCCESS; участники звонков получают
+// SERVER_CALL_CONN_LEFT со старым и SERVER_CALL_CONN_NEW с новым id. Токен переходит
+// к новому соединению
+typedef struct {
+    uint32_t connection_id;
+    uint64_t token;
+} ConnResumePayload;
+
+// CLIENT_FRAMING / SERVER_FRAMING - формат TCP-сообщений (FRAMING_* из buffer_logic.h).
+// Клиент запрашивает версию, сервер отвечает той, что будет использовать (не выше своей
+// FRAMING_VERSION_MAX). Сообщения после CLIENT_FRAMING сервер читает, а после SERVER_FRAMING
+// пишет уже в новом формате; клиент, запросивший поддерживаемую версию, может сразу
+// за CLIENT_FRAMING слать сообщения в ней, не дожидаясь ответа
+typedef struct {
+    uint8_t version;
+} FramingPayload;
+
+// CLIENT_EVENT_BATCH - уведомления, накопленные за итерацию цикла сервера (см. notify.h),
+// приходят одним SERVER_EVENT_BATCH вместо отдельных сообщений. Ответ: SERVER_SUCCESS
+typedef struct {
+    uint8_t enabled;
+} EventBatchModePayload;
+
+// SERVER_EVENT_BATCH - события по порядку, отмененные за итерацию уже выброшены
+typedef struct {
+    uint8_t event_count;
+    // EventBatchEntry events[event_count]
+} EventBatchPayload;
+
+typedef struct {
+    uint8_t type;       // SERVER_CALL_CONN_NEW/LEFT, SERVER_CALL_STREAM_NEW/DELETED, SERVER_STREAM_START/END
+    uint32_t call_id;   // 0 для SERVER_STREAM_START/END
+    uint32_t id;        // connection_id для CONN_*, иначе stream_id
+} EventBatchEntry;
+
 // Базовые структуры с ID
 typedef struct {
     uint32_t id;
 } IDPayload;
 
 // Структуры для стримов
+// CLIENT_STREAM_CREATE - видеостримы (MEDIA_CLASS_VIDEO), формат прежних клиентов
 typedef struct {
     uint32_t call_id;  // 0 для публичного стрима
 } StreamCreatePayload;
 
+// CLIENT_STREAM_CREATE_MEDIA - стрим заданного класса. Отдельный тип, а не байт в конце
+// CLIENT_STREAM_CREATE: в FRAMING_LEGACY размер сообщения выводится из типа
+typedef struct {
+    uint32_t call_id;
+    uint8_t media_class;  // MEDIA_CLASS_*
+} StreamCreateMediaPayload;
+
 typedef struct {
     uint32_t stream_id;
 } StreamIDPayload;
 
+// CLIENT_STREAM_SET_LAYER - верхний слой simulcast, который клиент готов принимать
+typedef struct {
+    uint32_t stream_id;
+    uint8_t max_layer;
+} StreamLayerPayload;
+
+// CLIENT_RECEIVER_REPORT - периодический отчет клиента о приеме UDP по всем стримам
+typedef struct {
+    uint32_t packets_expected;  // по номерам пакетов (с учетом пропусков)
+    uint32_t packets_received;
+    uint32_t bytes_received;
+    uint32_t interval_ms;       // от первого до последнего прибытия за интервал отчета
+} ReceiverReportPayload;
+
+// SERVER_STREAM_STATS - периодический отчет владельцу о приеме его стрима сервером
+// (по всем слоям, счетчики за интервал с предыдущего отчета). Включается
+// --stream-stats-interval и уходит только клиентам с FRAMING_LENGTH_PREFIXED
+typedef struct {
+    uint32_t stream_id;
+    uint32_t packets_expected;
+    uint32_t packets_received;
+    uint32_t packets_lost;       // номера, выпавшие из окна приема без пакета
+    uint32_t packets_reordered;
+    uint32_t packets_duplicate;
+    uint32_t jitter_us;          // разброс интервалов прибытия, максимум по слоям
+    uint32_t interval_ms;
+} StreamStatsPayload;
+
+// CLIENT_STREAM_BATCH_JOIN / CLIENT_STREAM_BATCH_LEAVE - подписка на список стримов
+// (или отписка) одним сообщением. Ответ - один SERVER_STREAM_BATCH_RESULT со статусом
+// по каждому стриму в том же порядке
+typedef struct {
+    uint8_t stream_count;
+    // uint32_t streams[stream_count]
+} StreamBatchPayload;
+
+// SERVER_STREAM_BATCH_RESULT
+typedef struct {
+    uint8_t original_message_type;  // CLIENT_STREAM_BATCH_JOIN/LEAVE или CLIENT_CALL_SUBSCRIBE
+    uint8_t result_count;
+    // StreamBatchResult results[result_count]
+} StreamBatchResultPayload;
+
+typedef struct {
+    uint32_t stream_id;
+    uint8_t status;  // BATCH_STATUS_*
+} StreamBatchResult;
+
 // Структуры для звонков
 typedef struct {
     uint32_t call_id;
@@ -107,6 +267,72 @@ typedef struct {
     uint32_t stream_id;
 } CallStreamPayload;
 
+// SERVER_CALL_ACTIVE_SPEAKERS - аудиостримы, которые сейчас пересылаются участникам
+typedef struct {
+    uint32_t call_id;
+    uint8_t stream_count;
+    // uint32_t streams[stream_count] - от самого громкого
+} CallSpeakersPayload;
+
+// CLIENT_CALL_SET_MIXING - включить/выключить микширование аудио звонка на сервере.
+// В этом режиме аудиопакеты участников несут PCM (MIX_FRAME_BYTES после расширения),
+// а каждому участнику приходит один поток mix_stream_id - все, кроме него самого.
+typedef struct {
+    uint32_t call_id;
+    uint8_t enabled;
+} CallMixingPayload;
+
+// CLIENT_CALL_SUBSCRIBE - подписка участника на все чужие стримы звонка, включая созданные
+// позже. Ответ - SERVER_STREAM_BATCH_RESULT по уже существующим стримам; о каждом новом
+// стриме вслед за SERVER_CALL_STREAM_NEW приходит SERVER_STREAM_BATCH_RESULT с одной записью.
+// enabled = 0 прекращает подписку на будущие стримы, текущие остаются
+typedef struct {
+    uint32_t call_id;
+    uint8_t enabled;
+} CallSubscribePayload;
+
+// CLIENT_CALL_SYNC - вход в звонок (как CLIENT_CALL_CONN_JOIN) с версией состава, которую
+// клиент уже знает, например до обрыва соединения (0 - не знает ничего). Если журнал
+// звонка (CALL_CHANGE_LOG) покрывает эту версию, ответ - SERVER_CALL_DELTA только
+// с изменениями после нее; иначе SERVER_CALL_CONN_JOINED и SERVER_CALL_DELTA без изменений
+// с from_version = 0. Участник может повторять CLIENT_CALL_SYNC в любой момент, чтобы
+// узнать текущую версию: изменения после нее пришли ему уведомлениями
+typedef struct {
+    uint32_t call_id;
+    uint32_t version;
+} CallSyncPayload;
+
+// SERVER_CALL_DELTA - изменения состава от from_version до version (взаимно отмененные
+// выброшены); version - то, что клиент присылает в следующем CLIENT_CALL_SYNC
+typedef struct {
+    uint32_t call_id;
+    uint32_t from_version;
+    uint32_t version;
+    uint8_t change_count;
+    // CallDeltaEntry changes[change_count]
+} CallDeltaPayload;
+
+typedef struct {
+    uint8_t type;   // SERVER_CALL_CONN_NEW/LEFT, SERVER_CALL_STREAM_NEW/DELETED
+    uint32_t id;    // connection_id или stream_id
+} CallDeltaEntry;
+
+// SERVER_CALL_MIXING
+typedef struct {
+    uint32_t call_id;
+    uint32_t mix_stream_id;  // 0, если микширование выключено
+    uint8_t enabled;
+} CallMixingStatePayload;
+
+// SERVER_CALL_REDIRECT - звонок принадлежит другому узлу кластера:
+// клиент подключается к нему (TCP + UDP handshake) и повторяет CLIENT_CALL_CONN_JOIN
+typedef struct {
+    uint32_t call_id;
+    uint32_t node_addr;      // IPv4 узла-владельца, сетевой порядок
+    uint16_t tcp_port;
+    uint16_t udp_port;
+} CallRedirectPayload;
+
 // UDP пакеты
 typedef struct {
     uint64_t zero;           // UDP_HANDSHAKE_ZERO_BYTES нулевых байт
@@ -115,38 +341,71 @@ typedef struct {
 
 typedef struct {
     uint32_t call_id;
-    uint32_t stream_id;
+    uint32_t stream_id;      // | UDP_STREAM_EXT_BIT, если есть расширение
     uint32_t packet_number;
     uint8_t data[UDP_DATA_SIZE];
 } UDPStreamPacket;
 
+// Расширение заголовка (первые байты data при UDP_STREAM_EXT_BIT)
+typedef struct {
+    uint8_t flags;           // UDP_EXT_FLAG_*
+    uint8_t layer;           // слой simulcast (0 - нижний); номера пакетов ведутся в каждом слое отдельно
+    uint8_t audio_level;     // при UDP_EXT_FLAG_AUDIO: 0..127 -дБов (RFC 6464), 127 - тишина
+    uint8_t reserved;
+} UDPStreamExtHeader;
+
 #pragma pack(pop)
 
 // ==================== ОБРАБОТЧИКИ TCP СООБЩЕНИЙ ====================
 
-// Главный диспетчер сообщений
+// Главный диспетчер сообщений: обработчик по таблице из protocol_schema.h, нагрузка
+// короче, чем требует схема, отбрасывается
 void handle_client_message(Connection* conn, uint8_t message_type, const uint8_t* payload, size_t payload_len);
 
 // Обработчики базовых сообщений
-void handle_client_error(const ErrorSuccessPayload* payload);
-void handle_client_success(const ErrorSuccessPayload* payload);
+void handle_client_error(Connection* conn, const ErrorSuccessPayload* payload);
+void handle_client_success(Connection* conn, const ErrorSuccessPayload* payload);
+void handle_resume_token(Connection* conn);
+void handle_conn_resume(Connection* conn, const ConnResumePayload* payload);
+void handle_framing(Connection* conn, const FramingPayload* payload);
+void handle_event_batch(Connection* conn, const EventBatchModePayload* payload);
 
 // Обработчики стримов
 void handle_stream_create(Connection* conn, const StreamCreatePayload* payload);
+void handle_stream_create_media(Connection* conn, const StreamCreateMediaPayload* payload);
 void handle_stream_delete(Connection* conn, const StreamIDPayload* payload);
 void handle_stream_join(Connection* conn, const StreamIDPayload* payload);
 void handle_stream_leave(Connection* conn, const StreamIDPayload* payload);
+void handle_receiver_report(Connection* conn, const ReceiverReportPayload* payload);
+void handle_stream_set_layer(Connection* conn, const StreamLayerPayload* payload);
+void handle_stream_batch_join(Connection* conn, const StreamBatchPayload* payload);
+void handle_stream_batch_leave(Connection* conn, const StreamBatchPayload* payload);
 
 // Обработчики звонков
 void handle_call_create(Connection* conn);
 void handle_call_join(Connection* conn, const CallJoinPayload* payload);
 void handle_call_leave(Connection* conn, const CallJoinPayload* payload);
+void handle_call_set_mixing(Connection* conn, const CallMixingPayload* payload);
+void handle_call_subscribe(Connection* conn, const CallSubscribePayload* payload);
+void handle_call_sync(Connection* conn, const CallSyncPayload* payload);
 
 // ==================== ОБРАБОТЧИКИ UDP ПАКЕТОВ ====================
 
 void handle_udp_packet(const uint8_t* data, size_t len, const struct sockaddr_in* src_addr);
 void handle_udp_handshake(const UDPHandshakePacket* packet, const struct sockaddr_in* src_addr);
-void handle_udp_stream_packet(const UDPStreamPacket* packet, const struct sockaddr_in* src_addr);
+void handle_udp_stream_packet(const UDPStreamPacket* packet, size_t len, const struct sockaddr_in* src_addr);
+
+// Досылка кеша ключевого кадра новым зрителям (вызывается из главного цикла)
+#ifndef KEYFRAME_REPLAY_PACKETS_PER_MS
+#define KEYFRAME_REPLAY_PACKETS_PER_MS 4
+#endif
+void process_keyframe_replays(void);
+
+// Тик микшера звонков (вызывается из главного цикла, кадр каждые MIX_FRAME_MS)
+void process_call_mixing(void);
+
+// Отчеты SERVER_STREAM_STATS владельцам стримов раз в g_config.stream_stats_interval_ms
+void process_stream_stats(void);
 
 // ==================== ФУНКЦИИ ОТПРАВКИ СЕРВЕРА ====================
 
@@ -162,6 +421,9 @@ void send_stream_deleted(Stream* stream);
 void send_stream_joined(Connection* conn, Stream* stream);
 void send_stream_start(Stream* stream);
 void send_stream_end(Stream* stream);
+void send_stream_stats(Stream* stream, uint64_t now_ms);
+void send_stream_batch_result(Connection* conn, uint8_t original_message, const StreamBatchResult* results,
+                              uint8_t count);
 
 // Сообщения звонков
 void send_call_created(Connection* conn, Call* call);
@@ -170,9 +432,15 @@ void send_call_conn_new(Call* call, Connection* new_conn);
 void send_call_conn_left(Call* call, Connection* left_conn);
 void send_call_stream_new(Call* call, Stream* stream);
 void send_call_stream_deleted(Call* call, Stream* stream);
+void send_call_active_speakers(Call* call);
+void send_call_mixing(Call* call, Connection* conn);
+void send_call_redirect(Connection* conn, uint32_t call_id, uint32_t node);
+void send_call_delta(Connection* conn, Call* call, uint32_t known_version);
 
 // ==================== СЛУЖЕБНЫЕ ФУНКЦИИ ПРОТОКОЛА ====================
 
 void handle_connection_closed(Connection* conn);
 void broadcast_to_stream_recipients(Stream* stream, uint8_t message_type, const void* payload, size_t payload_len, Connection* exclude);
-void broadcast_to_call_participants(Call* call, uint8_t message_type, const void* payload, size_t payload_len, Connection* exclude);
\ No newline at end of file
+void broadcast_to_call_participants(Call* call, uint8_t message_type, const void* payload, size_t payload_len, Connection* exclude);
+
+#include "protocol_schema.h"  // размеры и обработчики сообщений
@@ -0,0 +1,142 @@
+#pragma once
+
+// Схема TCP-сообщений: одна строка на тип, включается в конце protocol.h. Из нее
+// препроцессор при сборке выводит размеры сообщений (protocol_payload_size - общий
+// для сервера, магистрали, прокси управления и утилит), проверку исходящих
+// (protocol_encode), проверку границ и таблицу обработчиков входящих (protocol.c)
+// и круговые тесты (test/test_schema.c). Поля нагрузок описаны структурами protocol.h.
+//
+//   BARE(тип, обработчик)                                 - только байт типа
+//   FIXED(тип, структура, обработчик)                     - нагрузка фиксированного размера
+//   VARIABLE(тип, заголовок, элемент, число, обработчик)  - заголовок и элементы, число
+//                                                           считается по заголовку h
+// У сообщений сервера обработчика нет. Новый тип достаточно описать здесь.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define PROTOCOL_CLIENT_MESSAGES(BARE, FIXED, VARIABLE) \
+    VARIABLE(CLIENT_ERROR,              ErrorSuccessPayload,   char,     h->message_length, handle_client_error) \
+    VARIABLE(CLIENT_SUCCESS,            ErrorSuccessPayload,   char,     h->message_length, handle_client_success) \
+    BARE(CLIENT_RESUME_TOKEN,                                  handle_resume_token) \
+    FIXED(CLIENT_CONN_RESUME,           ConnResumePayload,     handle_conn_resume) \
+    FIXED(CLIENT_FRAMING,               FramingPayload,        handle_framing) \
+    FIXED(CLIENT_EVENT_BATCH,           EventBatchModePayload, handle_event_batch) \
+    FIXED(CLIENT_STREAM_CREATE,         StreamCreatePayload,   handle_stream_create) \
+    FIXED(CLIENT_STREAM_CREATE_MEDIA,   StreamCreateMediaPayload, handle_stream_create_media) \
+    FIXED(CLIENT_STREAM_DELETE,         StreamIDPayload,       handle_stream_delete) \
+    FIXED(CLIENT_STREAM_CONN_JOIN,      StreamIDPayload,       handle_stream_join) \
+    FIXED(CLIENT_STREAM_CONN_LEAVE,     StreamIDPayload,       handle_stream_leave) \
+    FIXED(CLIENT_RECEIVER_REPORT,       ReceiverReportPayload, handle_receiver_report) \
+    FIXED(CLIENT_STREAM_SET_LAYER,      StreamLayerPayload,    handle_stream_set_layer) \
+    VARIABLE(CLIENT_STREAM_BATCH_JOIN,  StreamBatchPayload,    uint32_t, h->stream_count, handle_stream_batch_join) \
+    VARIABLE(CLIENT_STREAM_BATCH_LEAVE, StreamBatchPayload,    uint32_t, h->stream_count, handle_stream_batch_leave) \
+    BARE(CLIENT_CALL_CREATE,                                   handle_call_create) \
+    FIXED(CLIENT_CALL_CONN_JOIN,        CallJoinPayload,       handle_call_join) \
+    FIXED(CLIENT_CALL_CONN_LEAVE,       CallJoinPayload,       handle_call_leave) \
+    FIXED(CLIENT_CALL_SET_MIXING,       CallMixingPayload,     handle_call_set_mixing) \
+    FIXED(CLIENT_CALL_SUBSCRIBE,        CallSubscribePayload,  handle_call_subscribe) \
+    FIXED(CLIENT_CALL_SYNC,             CallSyncPayload,       handle_call_sync)
+
+#define PROTOCOL_SERVER_MESSAGES(BARE, FIXED, VARIABLE) \
+    VARIABLE(SERVER_ERROR,                ErrorSuccessPayload,      char,              h->message_length) \
+    VARIABLE(SERVER_SUCCESS,              ErrorSuccessPayload,      char,              h->message_length) \
+    FIXED(SERVER_HANDSHAKE_START,         HandshakeStartPayload) \
+    FIXED(SERVER_HANDSHAKE_END,           HandshakeStartPayload)  /* шлется структурой START */ \
+    FIXED(SERVER_FRAMING,                 FramingPayload) \
+    FIXED(SERVER_RESUME_TOKEN,            ResumeTokenPayload) \
+    VARIABLE(SERVER_EVENT_BATCH,          EventBatchPayload,        EventBatchEntry,   h->event_count) \
+    FIXED(SERVER_STREAM_CREATED,          StreamIDPayload) \
+    FIXED(SERVER_STREAM_DELETED,          StreamIDPayload) \
+    FIXED(SERVER_STREAM_CONN_JOINED,      StreamIDPayload) \
+    FIXED(SERVER_STREAM_START,            StreamIDPayload) \
+    FIXED(SERVER_STREAM_END,              StreamIDPayload) \
+    FIXED(SERVER_STREAM_STATS,            StreamStatsPayload) \
+    VARIABLE(SERVER_STREAM_BATCH_RESULT,  StreamBatchResultPayload, StreamBatchResult, h->result_count) \
+    FIXED(SERVER_CALL_CREATED,            IDPayload) \
+    VARIABLE(SERVER_CALL_CONN_JOINED,     CallJoinedPayload,        uint32_t,          h->participant_count + h->stream_count) \
+    FIXED(SERVER_CALL_CONN_NEW,           CallConnPayload) \
+    FIXED(SERVER_CALL_CONN_LEFT,          CallConnPayload) \
+    FIXED(SERVER_CALL_STREAM_NEW,         CallStreamPayload) \
+    FIXED(SERVER_CALL_STREAM_DELETED,     CallStreamPayload) \
+    VARIABLE(SERVER_CALL_ACTIVE_SPEAKERS, CallSpeakersPayload,      uint32_t,          h->stream_count) \
+    FIXED(SERVER_CALL_MIXING,             CallMixingStatePayload) \
+    FIXED(SERVER_CALL_REDIRECT,           CallRedirectPayload) \
+    VARIABLE(SERVER_CALL_DELTA,           CallDeltaPayload,         CallDeltaEntry,    h->change_count)
+
+// ==================== ВЫВЕДЕНО ИЗ СХЕМЫ ====================
+
+#define PROTOCOL_FROM_CLIENT 1
+#define PROTOCOL_FROM_SERVER 2
+
+typedef struct {
+    uint8_t direction;                          // PROTOCOL_FROM_*, 0 - тип не из схемы
+    uint16_t header_size;                       // фиксированная часть нагрузки
+    uint16_t entry_size;                        // 0 - сообщение фиксированного размера
+    uint32_t (*count)(const uint8_t* payload);  // число элементов по заголовку
+} ProtocolMessageInfo;
+
+#define PROTOCOL_SCHEMA_SKIP(...)
+#define PROTOCOL_SCHEMA_COUNT(type, Header, Entry, count, ...) \
+    static inline uint32_t protocol_count_##type(const uint8_t* payload) { \
+        const Header* h = (const Header*)payload; \
+        return (uint32_t)(count); \
+    }
+PROTOCOL_CLIENT_MESSAGES(PROTOCOL_SCHEMA_SKIP, PROTOCOL_SCHEMA_SKIP, PROTOCOL_SCHEMA_COUNT)
+PROTOCOL_SERVER_MESSAGES(PROTOCOL_SCHEMA_SKIP, PROTOCOL_SCHEMA_SKIP, PROTOCOL_SCHEMA_COUNT)
+
+#define PROTOCOL_SCHEMA_CLIENT_BARE(type, ...) \
+    [type] = { PROTOCOL_FROM_CLIENT, 0, 0, NULL },
+#define PROTOCOL_SCHEMA_CLIENT_FIXED(type, Payload, ...) \
+    [type] = { PROTOCOL_FROM_CLIENT, sizeof(Payload), 0, NULL },
+#define PROTOCOL_SCHEMA_CLIENT_VARIABLE(type, Header, Entry, count, ...) \
+    [type] = { PROTOCOL_FROM_CLIENT, sizeof(Header), sizeof(Entry), protocol_count_##type },
+#define PROTOCOL_SCHEMA_SERVER_BARE(type, ...) \
+    [type] = { PROTOCOL_FROM_SERVER, 0, 0, NULL },
+#define PROTOCOL_SCHEMA_SERVER_FIXED(type, Payload, ...) \
+    [type] = { PROTOCOL_FROM_SERVER, sizeof(Payload), 0, NULL },
+#define PROTOCOL_SCHEMA_SERVER_VARIABLE(type, Header, Entry, count, ...) \
+    [type] = { PROTOCOL_FROM_SERVER, sizeof(Header), sizeof(Entry), protocol_count_##type },
+
+// Описание типа по таблице на 256 байт типа; NULL - тип не из схемы
+static inline const ProtocolMessageInfo* protocol_message_info(uint8_t type) {
+    static const ProtocolMessageInfo schema[256] = {
+        PROTOCOL_CLIENT_MESSAGES(PROTOCOL_SCHEMA_CLIENT_BARE, PROTOCOL_SCHEMA_CLIENT_FIXED,
+                                 PROTOCOL_SCHEMA_CLIENT_VARIABLE)
+        PROTOCOL_SERVER_MESSAGES(PROTOCOL_SCHEMA_SERVER_BARE, PROTOCOL_SCHEMA_SERVER_FIXED,
+                                 PROTOCOL_SCHEMA_SERVER_VARIABLE)
+    };
+    return schema[type].direction ? &schema[type] : NULL;
+}
+
+// Точный размер нагрузки сообщения type по ее началу payload[0..avail).
+// 1 - размер известен, 0 - заголовок переменной части еще не пришел, -1 - тип не из схемы
+static inline int protocol_payload_size(uint8_t type, const uint8_t* payload, uint32_t avail,
+                                        uint32_t* out_size) {
+    const ProtocolMessageInfo* info = protocol_message_info(type);
+    if (!info) return -1;
+    if (!info->entry_size) {
+        *out_size = info->header_size;
+        return 1;
+    }
+    if (avail < info->header_size) return 0;
+    *out_size = info->header_size + info->entry_size * info->count(payload);
+    return 1;
+}
+
+// Пишет [type][payload] в out, если нагрузка ровно того размера, что требует схема.
+// Возвращает длину сообщения или -1 (тип не из схемы, размер не сходится, не влезает в out)
+static inline int protocol_encode(uint8_t* out, size_t out_len, uint8_t type, const void* payload,
+                                  size_t payload_len) {
+    uint32_t size = 0;
+    if (protocol_payload_size(type, payload, (uint32_t)payload_len, &size) != 1 || size != payload_len ||
+        1 + payload_len > out_len) {
+        return -1;
+    }
+    out[0] = type;
+    if (payload_len > 0) {
+        memcpy(out + 1, payload, payload_len);
+    }
+    return (int)(1 + payload_len);
+}
@@ -0,0 +1,97 @@
+#include "seq_stats.h"
+#include <string.h>
+
+void seq_stats_init(SeqStats* stats) {
+    if (!stats) return;
+    memset(stats, 0, sizeof(*stats));
+}
+
+static void seq_stats_restart(SeqStats* stats, uint32_t number) {
+    stats->base_number = number;
+    stats->highest = number;
+    // Номера до первого пакета не ожидались: считаем их принятыми, чтобы не попали в потери
+    stats->window = ~0ull;
+}
+
+static void seq_stats_update_jitter(SeqStats* stats, uint64_t now_us) {
+    int64_t interval_q4 = (int64_t)(now_us - stats->last_arrival_us) << 4;
+    if (stats->mean_interval_q4 == 0) {
+        stats->mean_interval_q4 = interval_q4;
+        return;
+    }
+
+    int64_t deviation = interval_q4 - stats->mean_interval_q4;
+    if (deviation < 0) deviation = -deviation;
+    stats->jitter_q4 += (deviation - stats->jitter_q4) / 16;
+    stats->mean_interval_q4 += (interval_q4 - stats->mean_interval_q4) / 16;
+}
+
+void seq_stats_update(SeqStats* stats, uint32_t number, uint64_t now_us) {
+    if (!stats) return;
+
+    if (!stats->started) {
+        stats->started = true;
+        seq_stats_restart(stats, number);
+        stats->received = 1;
+        stats->last_arrival_us = now_us;
+        return;
+    }
+
+    int32_t diff = (int32_t)(number - stats->highest);
+
+    if (diff > 0) {
+        if ((uint32_t)diff >= SEQ_STATS_RESET_GAP) {
+            stats->expected_before += (uint64_t)(stats->highest - stats->base_number) + 1;
+            stats->resets++;
+            seq_stats_restart(stats, number);
+        } else if (diff >= SEQ_STATS_WINDOW) {
+            // Все окно выпадает: непринятые в нем и весь пропуск за ним - потери
+            stats->lost += (uint64_t)(SEQ_STATS_WINDOW - __builtin_popcountll(stats->window));
+            stats->lost += (uint64_t)(diff - SEQ_STATS_WINDOW);
+            stats->window = 1;
+        } else {
+            uint64_t dropped = stats->window >> (SEQ_STATS_WINDOW - diff);
+            stats->lost += (uint64_t)(diff - __builtin_popcountll(dropped));
+            stats->window = (stats->window << diff) | 1;
+        }
+        stats->highest = number;
+        stats->received++;
+
+        // Разброс считаем только по соседним номерам: пропуск искажает интервал
+        if (diff == 1) {
+            seq_stats_update_jitter(stats, now_us);
+        }
+        stats->last_arrival_us = now_us;
+        return;
+    }
+
+    if (diff == 0) {
+        stats->duplicates++;
+        return;
+    }
+
+    uint32_t back = (uint32_t)(-(int64_t)diff);
+    if (back >= SEQ_STATS_WINDOW) {
+        stats->late++;
+        return;
+    }
+
+    uint64_t bit = 1ull << back;
+    if (stats->window & bit) {
+        stats->duplicates++;
+        return;
+    }
+    stats->window |= bit;
+    stats->received++;
+    stats->reordered++;
+}
+
+uint64_t seq_stats_expected(const SeqStats* stats) {
+    if (!stats || !stats->started) return 0;
+    return stats->expected_before + (uint64_t)(stats->highest - stats->base_number) + 1;
+}
+
+uint32_t seq_stats_jitter_us(const SeqStats* stats) {
+    if (!stats) return 0;
+    return (uint32_t)(stats->jitter_q4 >> 4);
+}
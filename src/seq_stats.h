@@ -0,0 +1,41 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+// Окно приема: последние SEQ_STATS_WINDOW номеров за highest (один uint64_t)
+#define SEQ_STATS_WINDOW 64
+
+// Скачок номера больше этого считается перезапуском издателя, а не потерями
+#ifndef SEQ_STATS_RESET_GAP
+#define SEQ_STATS_RESET_GAP 10000
+#endif
+
+// Качество приема одной последовательности packet_number, O(1) на пакет.
+// Потеря засчитывается, когда номер выпадает из окна, так и не придя;
+// пришедший позже, но еще в окне, считается переупорядоченным.
+typedef struct {
+    bool started;
+    uint32_t base_number;       // первый номер (после перезапуска - новый)
+    uint32_t highest;
+    uint64_t window;            // бит i - принят пакет highest - i
+    uint64_t expected_before;   // ожидалось до последнего перезапуска
+
+    uint64_t received;          // уникальных пакетов
+    uint64_t lost;
+    uint64_t reordered;
+    uint64_t duplicates;
+    uint64_t late;              // пришли, когда уже выпали из окна (и посчитаны потерянными)
+    uint64_t resets;
+
+    // Разброс интервалов между соседними пакетами (в пакетах нет временных меток,
+    // поэтому как J из RFC 3550, но относительно среднего интервала), Q4 мкс
+    uint64_t last_arrival_us;
+    int64_t mean_interval_q4;
+    int64_t jitter_q4;
+} SeqStats;
+
+void seq_stats_init(SeqStats* stats);
+void seq_stats_update(SeqStats* stats, uint32_t number, uint64_t now_us);
+
+uint64_t seq_stats_expected(const SeqStats* stats);
+uint32_t seq_stats_jitter_us(const SeqStats* stats);
@@ -0,0 +1,54 @@
+#include "simulcast.h"
+#include <string.h>
+
+void simulcast_state_init(SimulcastState* state, uint8_t initial_layer) {
+    if (!state) return;
+
+    memset(state, 0, sizeof(*state));
+    state->current_layer = initial_layer;
+    state->target_layer = initial_layer;
+    state->max_layer = SIMULCAST_MAX_LAYERS - 1;
+}
+
+bool simulcast_route(SimulcastState* state, uint8_t layer, bool is_keyframe,
+                     uint32_t in_number, uint32_t* out_number) {
+    if (!state || layer >= SIMULCAST_MAX_LAYERS) return false;
+
+    // Переключаемся только на ключевом кадре: декодер получателя не должен
+    // увидеть разностный кадр другого слоя
+    if (layer != state->current_layer && layer == state->target_layer && is_keyframe) {
+        if (state->has_output) {
+            state->number_offset = state->last_out_number + 1 - in_number;
+        }
+        state->current_layer = layer;
+        state->switches++;
+    }
+
+    if (layer != state->current_layer) return false;
+
+    uint32_t out = simulcast_rewrite(state, in_number);
+    if (out_number) *out_number = out;
+    return true;
+}
+
+uint32_t simulcast_rewrite(SimulcastState* state, uint32_t in_number) {
+    uint32_t out = in_number + state->number_offset;
+    state->last_out_number = out;
+    state->has_output = true;
+    return out;
+}
+
+uint8_t simulcast_pick_layer(const uint32_t layer_bps[SIMULCAST_MAX_LAYERS], uint8_t max_layer,
+                             uint32_t budget_bps) {
+    if (max_layer >= SIMULCAST_MAX_LAYERS) max_layer = SIMULCAST_MAX_LAYERS - 1;
+
+    int best = -1;
+    for (int layer = 0; layer <= max_layer; layer++) {
+        if (layer_bps[layer] == 0) continue;  // издатель этот слой сейчас не шлет
+
+        if (best < 0 || budget_bps == 0 || layer_bps[layer] <= budget_bps) {
+            best = layer;
+        }
+    }
+    return best < 0 ? 0 : (uint8_t)best;
+}
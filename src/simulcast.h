@@ -0,0 +1,38 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+// Число слоев качества в одном стриме (номер слоя - UDPStreamExtHeader.layer)
+#ifndef SIMULCAST_MAX_LAYERS
+#define SIMULCAST_MAX_LAYERS 4
+#endif
+
+// Выбор слоя для одного получателя стрима.
+// Номера пакетов издатель ведет отдельно в каждом слое; получателю уходит
+// packet_number + number_offset, и при переключении слоя смещение пересчитывается
+// так, чтобы последовательность у получателя продолжилась без разрыва.
+typedef struct {
+    uint8_t current_layer;    // слой, который получатель видит сейчас
+    uint8_t target_layer;     // слой, на который переключимся на ближайшем ключевом кадре
+    uint8_t max_layer;        // ограничение клиента (CLIENT_STREAM_SET_LAYER)
+    bool has_output;          // получателю уже что-то отправлено
+    uint32_t number_offset;
+    uint32_t last_out_number;
+    uint32_t switches;
+} SimulcastState;
+
+void simulcast_state_init(SimulcastState* state, uint8_t initial_layer);
+
+// Решает, отправлять ли пакет слоя layer получателю; при переключении слоя
+// (только на ключевом кадре целевого слоя) пересчитывает смещение номеров.
+// Возвращает true и номер пакета для получателя в *out_number.
+bool simulcast_route(SimulcastState* state, uint8_t layer, bool is_keyframe,
+                     uint32_t in_number, uint32_t* out_number);
+
+// Номер пакета для получателя без решения о слое (досылка кеша ключевого кадра)
+uint32_t simulcast_rewrite(SimulcastState* state, uint32_t in_number);
+
+// Самый высокий активный слой не выше max_layer, битрейт которого укладывается
+// в budget_bps (0 - бюджет неизвестен). Самый нижний активный слой доступен всегда.
+uint8_t simulcast_pick_layer(const uint32_t layer_bps[SIMULCAST_MAX_LAYERS], uint8_t max_layer,
+                             uint32_t budget_bps);
@@ -0,0 +1,490 @@
+#include "snapshot.h"
+#include "connection.h"
+#include "stream.h"
+#include "call.h"
+#include "buffer_logic.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "time_utils.h"
+
+#pragma pack(push, 1)
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t connections;
+    uint32_t calls;
+    uint32_t streams;
+} SnapshotHeader;
+
+// Следом read_len байт недочитанного сообщения и write_len неотправленных
+typedef struct {
+    int32_t fd;
+    struct sockaddr_in tcp_addr;
+    struct sockaddr_in udp_addr;
+    uint8_t udp_handshake_complete;
+    uint8_t framing;
+    uint8_t event_batch;
+    uint64_t resume_token;
+    uint32_t read_len;
+    uint32_t read_expected;
+    uint32_t write_len;
+    uint32_t write_expected;
+} SnapshotConnection;
+
+// Следом participants записей SnapshotMember
+typedef struct {
+    uint32_t call_id;
+    uint8_t mixing;
+    uint32_t mix_stream_id;
+    uint32_t mix_sequence;
+    uint32_t version;       // журнал изменений не сохраняется: клиенты получат состав целиком
+    uint8_t participants;
+} SnapshotCall;
+
+typedef struct {
+    int32_t fd;
+    uint8_t subscribed;  // CLIENT_CALL_SUBSCRIBE
+} SnapshotMember;
+
+// Следом recipients записей SnapshotRecipient
+typedef struct {
+    uint32_t stream_id;
+    int32_t owner_fd;
+    uint32_t call_id;      // 0 - публичный стрим
+    uint8_t media_class;
+    uint8_t is_audio;
+    uint8_t recipients;
+} SnapshotStream;
+
+typedef struct {
+    int32_t fd;
+    SimulcastState simulcast;  // смещение номеров: у получателя последовательность не рвется
+} SnapshotRecipient;
+
+#pragma pack(pop)
+
+typedef struct {
+    const uint8_t* data;
+    size_t len;
+    size_t pos;
+    bool detach;  // сокетов нет: соединения восстанавливаются отсоединенными
+} SnapshotReader;
+
+static SnapshotStats stats;
+static pid_t writer_pid = -1;
+static uint64_t writer_started_ms = 0;
+static char writer_path[256];
+static uint64_t detached_deadline_ms = 0;
+
+// ==================== ЗАПИСЬ ====================
+
+static int snapshot_put(SnapshotBlob* blob, const void* data, size_t len) {
+    if (blob->len + len > blob->capacity) {
+        size_t capacity = blob->capacity ? blob->capacity : 4096;
+        while (capacity < blob->len + len) capacity *= 2;
+        uint8_t* grown = realloc(blob->data, capacity);
+        if (!grown) return -1;
+        blob->data = grown;
+        blob->capacity = capacity;
+    }
+    memcpy(blob->data + blob->len, data, len);
+    blob->len += len;
+    return 0;
+}
+
+static int snapshot_put_connection(SnapshotBlob* blob, const Connection* conn) {
+    SnapshotConnection record;
+    memset(&record, 0, sizeof(record));
+    record.fd = conn->fd;
+    record.tcp_addr = conn->tcp_addr;
+    record.udp_addr = conn->udp_addr;
+    record.udp_handshake_complete = conn->udp_handshake_complete;
+    record.framing = conn->framing;
+    record.event_batch = conn->event_batch;
+    record.resume_token = conn->resume_token;
+    record.read_len = conn->read_buffer.position;
+    record.read_expected = conn->read_buffer.expected_size;
+    record.write_len = conn->write_buffer.position;
+    record.write_expected = conn->write_buffer.expected_size;
+
+    if (snapshot_put(blob, &record, sizeof(record)) != 0) return -1;
+    if (snapshot_put(blob, conn->read_buffer.data, record.read_len) != 0) return -1;
+    return snapshot_put(blob, conn->write_buffer.data, record.write_len);
+}
+
+static int snapshot_put_call(SnapshotBlob* blob, const Call* call) {
+    SnapshotCall record;
+    memset(&record, 0, sizeof(record));
+    record.call_id = call->call_id;
+    record.mixing = call->mixing;
+    record.mix_stream_id = call->mix_stream_id;
+    record.mix_sequence = call->mix_sequence;
+    record.version = call->version;
+    record.participants = (uint8_t)call_get_participant_count(call);
+
+    if (snapshot_put(blob, &record, sizeof(record)) != 0) return -1;
+    for (int i = 0; i < MAX_CALL_PARTICIPANTS; i++) {
+        if (!call->participants[i]) continue;
+        SnapshotMember member = { .fd = call->participants[i]->fd, .subscribed = call->subscribed[i] };
+        if (snapshot_put(blob, &member, sizeof(member)) != 0) return -1;
+    }
+    return 0;
+}
+
+static int snapshot_put_stream(SnapshotBlob* blob, const Stream* stream) {
+    SnapshotStream record;
+    memset(&record, 0, sizeof(record));
+    record.stream_id = stream->stream_id;
+    record.owner_fd = stream->owner->fd;
+    record.call_id = stream->call ? stream->call->call_id : 0;
+    record.media_class = stream->media_class;
+    record.is_audio = stream->is_audio;
+    record.recipients = (uint8_t)stream_get_recipient_count(stream);
+
+    if (snapshot_put(blob, &record, sizeof(record)) != 0) return -1;
+    for (int i = 0; i < STREAM_MAX_RECIPIENTS; i++) {
+        if (!stream->recipients[i]) continue;
+        SnapshotRecipient recipient;
+        recipient.fd = stream->recipients[i]->fd;
+        recipient.simulcast = stream->recipient_state[i].simulcast;
+        if (snapshot_put(blob, &recipient, sizeof(recipient)) != 0) return -1;
+    }
+    return 0;
+}
+
+int snapshot_encode(SnapshotBlob* blob) {
+    if (!blob) return -1;
+    blob->len = 0;
+
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = SNAPSHOT_MAGIC;
+    header.version = SNAPSHOT_VERSION;
+    header.connections = HASH_COUNT(connections);
+    header.calls = HASH_COUNT(calls);
+
+    Stream* stream, *stream_tmp;
+    HASH_ITER(hh, streams, stream, stream_tmp) {
+        if (!stream->relayed && stream->owner) header.streams++;
+    }
+    if (snapshot_put(blob, &header, sizeof(header)) != 0) return -2;
+
+    // Порядок важен для восстановления: участники звонка нужны до его стримов
+    Connection* conn, *conn_tmp;
+    HASH_ITER(hh, connections, conn, conn_tmp) {
+        if (snapshot_put_connection(blob, conn) != 0) return -2;
+    }
+
+    Call* call, *call_tmp;
+    HASH_ITER(hh, calls, call, call_tmp) {
+        if (snapshot_put_call(blob, call) != 0) return -2;
+    }
+
+    HASH_ITER(hh, streams, stream, stream_tmp) {
+        if (stream->relayed || !stream->owner) continue;
+        if (snapshot_put_stream(blob, stream) != 0) return -2;
+    }
+
+    return 0;
+}
+
+void snapshot_blob_free(SnapshotBlob* blob) {
+    if (!blob) return;
+    free(blob->data);
+    blob->data = NULL;
+    blob->len = blob->capacity = 0;
+}
+
+// ==================== ВОССТАНОВЛЕНИЕ ====================
+
+static const void* snapshot_take(SnapshotReader* reader, size_t len) {
+    if (reader->len - reader->pos < len) return NULL;
+    const void* data = reader->data + reader->pos;
+    reader->pos += len;
+    return data;
+}
+
+static bool snapshot_restore_buffer(Buffer* buffer, const void* data, uint32_t len, uint32_t expected) {
+    if (len > BUFFER_SIZE || expected > BUFFER_SIZE) return false;
+    memcpy(buffer->data, data, len);
+    buffer->position = len;
+    buffer->expected_size = expected;
+    return true;
+}
+
+// Ключ соединения в этом процессе по номеру из снимка
+static int snapshot_key(const SnapshotReader* reader, int32_t fd) {
+    return reader->detach && fd >= 0 ? SNAPSHOT_DETACHED_FD(fd) : fd;
+}
+
+static int snapshot_restore_connection(SnapshotReader* reader, SnapshotCounts* counts) {
+    const SnapshotConnection* record = snapshot_take(reader, sizeof(SnapshotConnection));
+    if (!record) return -1;
+    const uint8_t* read_data = snapshot_take(reader, record->read_len);
+    const uint8_t* write_data = snapshot_take(reader, record->write_len);
+    if (!read_data || !write_data) return -1;
+
+    // Сокет не дошел до нового процесса - клиент переподключится сам
+    int fd = snapshot_key(reader, record->fd);
+    bool detached = SNAPSHOT_IS_DETACHED(fd);
+    if ((!detached && (fd < 0 || fcntl(fd, F_GETFD) < 0)) || connection_find(fd)) {
+        counts->skipped++;
+        return 0;
+    }
+
+    struct sockaddr_in tcp_addr = record->tcp_addr;
+    struct sockaddr_in udp_addr = record->udp_addr;
+    Connection* conn = connection_new(fd, &tcp_addr);
+    if (!conn) return -2;
+    connection_set_udp_addr(conn, &udp_addr);
+    conn->udp_handshake_complete = record->udp_handshake_complete != 0;
+    conn->resume_token = record->resume_token;
+
+    // Байты TCP без сокета смысла не имеют: клиент начнет с CLIENT_CONN_RESUME
+    // в исходном формате сообщений
+    if (detached) {
+        counts->detached++;
+    } else if (record->framing > FRAMING_VERSION_MAX ||
+               !snapshot_restore_buffer(&conn->read_buffer, read_data, record->read_len, record->read_expected) ||
+               !snapshot_restore_buffer(&conn->write_buffer, write_data, record->write_len, record->write_expected)) {
+        return -1;
+    } else {
+        conn->framing = record->framing;
+        conn->event_batch = record->event_batch != 0;
+    }
+
+    counts->connections++;
+    return 0;
+}
+
+static int snapshot_restore_call(SnapshotReader* reader, SnapshotCounts* counts) {
+    const SnapshotCall* record = snapshot_take(reader, sizeof(SnapshotCall));
+    if (!record) return -1;
+    const SnapshotMember* members = snapshot_take(reader, record->participants * sizeof(SnapshotMember));
+    if (!members) return -1;
+
+    Call* call = call_new(record->call_id);
+    if (!call) {
+        counts->skipped++;
+        return 0;
+    }
+
+    for (uint8_t i = 0; i < record->participants; i++) {
+        SnapshotMember member;
+        memcpy(&member, &members[i], sizeof(member));
+        Connection* participant = connection_find(snapshot_key(reader, member.fd));
+        if (participant && call_add_participant(call, participant) == 0) {
+            call_set_subscribed(call, participant, member.subscribed != 0);
+            counts->memberships++;
+        } else {
+            counts->skipped++;
+        }
+    }
+
+    // Микс продолжает прежний stream_id и нумерацию
+    if (record->mixing) {
+        call_set_mixing(call, true);
+        call->mix_stream_id = record->mix_stream_id;
+        call->mix_sequence = record->mix_sequence;
+    }
+    call_reset_changes(call, record->version);
+
+    counts->calls++;
+    return 0;
+}
+
+static int snapshot_restore_stream(SnapshotReader* reader, SnapshotCounts* counts) {
+    const SnapshotStream* record = snapshot_take(reader, sizeof(SnapshotStream));
+    if (!record) return -1;
+    const SnapshotRecipient* recipients = snapshot_take(reader, record->recipients * sizeof(SnapshotRecipient));
+    if (!recipients) return -1;
+
+    Connection* owner = connection_find(snapshot_key(reader, record->owner_fd));
+    Call* call = record->call_id ? call_find_by_id(record->call_id) : NULL;
+    if (!owner || (record->call_id && !call)) {
+        counts->skipped++;
+        return 0;
+    }
+
+    Stream* stream = stream_new(record->stream_id, owner, call);
+    if (!stream) {
+        counts->skipped++;
+        return 0;
+    }
+    stream->media_class = record->media_class;
+    stream->is_audio = record->is_audio != 0;
+
+    for (uint8_t i = 0; i < record->recipients; i++) {
+        SnapshotRecipient recipient;
+        memcpy(&recipient, &recipients[i], sizeof(recipient));
+
+        Connection* conn = connection_find(snapshot_key(reader, recipient.fd));
+        if (!conn || stream_add_recipient(stream, conn) != 0) {
+            counts->skipped++;
+            continue;
+        }
+        int index = DENSE_ARRAY_INDEX_OF(stream->recipients, STREAM_MAX_RECIPIENTS, conn);
+        stream->recipient_state[index].simulcast = recipient.simulcast;
+        counts->memberships++;
+    }
+
+    counts->streams++;
+    return 0;
+}
+
+int snapshot_restore(const uint8_t* data, size_t len, bool detach, SnapshotCounts* counts) {
+    if (!data || !counts) return -1;
+    memset(counts, 0, sizeof(*counts));
+
+    SnapshotReader reader = { .data = data, .len = len, .pos = 0, .detach = detach };
+    const SnapshotHeader* header = snapshot_take(&reader, sizeof(SnapshotHeader));
+    if (!header || header->magic != SNAPSHOT_MAGIC) return -2;
+    if (header->version != SNAPSHOT_VERSION) return -3;
+
+    for (uint32_t i = 0; i < header->connections; i++) {
+        if (snapshot_restore_connection(&reader, counts) != 0) return -4;
+    }
+    for (uint32_t i = 0; i < header->calls; i++) {
+        if (snapshot_restore_call(&reader, counts) != 0) return -4;
+    }
+    for (uint32_t i = 0; i < header->streams; i++) {
+        if (snapshot_restore_stream(&reader, counts) != 0) return -4;
+    }
+    // Восстановление само записало изменения в журналы: версия после него не ниже сохраненной,
+    // а журнал пуст - клиент с прежней версией получит состав целиком
+    Call* call, *tmp;
+    HASH_ITER(hh, calls, call, tmp) {
+        call_reset_changes(call, call->version);
+    }
+
+    if (counts->detached > 0) {
+        detached_deadline_ms = monotonic_ms() + SNAPSHOT_RESUME_GRACE_MS;
+    }
+    return reader.pos == reader.len ? 0 : -4;
+}
+
+void snapshot_expire_detached(uint64_t now_ms) {
+    if (detached_deadline_ms == 0 || now_ms < detached_deadline_ms) return;
+    detached_deadline_ms = 0;
+
+    uint32_t expired = 0;
+    Connection* conn, *tmp;
+    HASH_ITER(hh, connections, conn, tmp) {
+        if (SNAPSHOT_IS_DETACHED(conn->fd)) {
+            connection_delete(conn);
+            expired++;
+        }
+    }
+    if (expired > 0) {
+        printf("Snapshot: %u restored connections did not resume, removed\n", expired);
+    }
+}
+
+// ==================== ФАЙЛ СНИМКА ====================
+
+int snapshot_save(const char* path) {
+    char tmp_path[sizeof(writer_path) + 8];
+    if (!path || snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path) >= (int)sizeof(tmp_path)) return -1;
+
+    SnapshotBlob blob = {0};
+    if (snapshot_encode(&blob) != 0) {
+        snapshot_blob_free(&blob);
+        return -2;
+    }
+
+    // Временный файл и rename: после падения посреди записи остается прежний снимок
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    size_t written = 0;
+    while (fd >= 0 && written < blob.len) {
+        ssize_t n = write(fd, blob.data + written, blob.len - written);
+        if (n <= 0) break;
+        written += (size_t)n;
+    }
+    int result = fd >= 0 && written == blob.len && fsync(fd) == 0 ? 0 : -3;
+    if (fd >= 0) close(fd);
+    if (result == 0 && rename(tmp_path, path) != 0) result = -4;
+    if (result != 0) unlink(tmp_path);
+
+    size_t len = blob.len;
+    snapshot_blob_free(&blob);
+    return result == 0 ? (int)len : result;
+}
+
+int snapshot_save_async(const char* path) {
+    if (!path || strlen(path) >= sizeof(writer_path)) return -1;
+    if (writer_pid > 0) return -2;  // предыдущая запись еще идет
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("snapshot fork");
+        stats.failed++;
+        return -3;
+    }
+    if (pid == 0) {
+        // Копия реестров на момент fork: основной процесс тем временем продолжает работать
+        _exit(snapshot_save(path) >= 0 ? 0 : 1);
+    }
+
+    writer_pid = pid;
+    writer_started_ms = monotonic_ms();
+    strcpy(writer_path, path);
+    return 0;
+}
+
+void snapshot_reap(bool wait) {
+    if (writer_pid <= 0) return;
+
+    int status = 0;
+    if (waitpid(writer_pid, &status, wait ? 0 : WNOHANG) != writer_pid) return;
+    writer_pid = -1;
+
+    struct stat st;
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0 && stat(writer_path, &st) == 0) {
+        stats.written++;
+        stats.last_bytes = (uint64_t)st.st_size;
+        stats.last_ms = monotonic_ms() - writer_started_ms;
+    } else {
+        stats.failed++;
+        fprintf(stderr, "Snapshot: writing %s failed\n", writer_path);
+    }
+}
+
+int snapshot_load(const char* path, SnapshotCounts* counts) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return 1;  // снимка нет - восстанавливать нечего
+
+    struct stat st;
+    uint8_t* data = NULL;
+    size_t len = 0;
+    if (fstat(fd, &st) == 0 && st.st_size > 0 && (data = malloc((size_t)st.st_size)) != NULL) {
+        while (len < (size_t)st.st_size) {
+            ssize_t n = read(fd, data + len, (size_t)st.st_size - len);
+            if (n <= 0) break;
+            len += (size_t)n;
+        }
+    }
+    close(fd);
+
+    int result = data && len == (size_t)st.st_size ? snapshot_restore(data, len, true, counts) : -1;
+    free(data);
+    return result;
+}
+
+SnapshotStats snapshot_stats(void) {
+    SnapshotStats result = stats;
+    result.detached = 0;
+
+    Connection* conn, *tmp;
+    HASH_ITER(hh, connections, conn, tmp) {
+        if (SNAPSHOT_IS_DETACHED(conn->fd)) result.detached++;
+    }
+    return result;
+}
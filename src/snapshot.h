@@ -0,0 +1,75 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Снимок таблиц маршрутизации: соединения (номер сокета, адреса, недочитанные
+// и неотправленные байты TCP), звонки с участниками, стримы с получателями и их
+// выбором слоя. Формат двоичный и привязан к сборке (версия в заголовке):
+// его читает процесс того же сервера, поэтому поля пишутся в порядке байтов хоста.
+// Кеши ключевых кадров, очереди пейсинга и оценки канала не сохраняются -
+// они восстанавливаются сами за доли секунды. Зеркала магистрали тоже не входят:
+// новый процесс подписывается на них заново.
+//
+// Снимок в файле (после падения) восстанавливается без сокетов: соединения
+// становятся "отсоединенными" - у них отрицательный ключ вместо fd, но звонки,
+// стримы и UDP-адреса на месте, и медиа идет получателям сразу. Клиент,
+// переподключившись, забирает свое состояние одним CLIENT_CONN_RESUME с прежним
+// connection_id и выданным ему токеном; кто не вернулся за SNAPSHOT_RESUME_GRACE_MS, удаляется.
+
+#define SNAPSHOT_MAGIC 0x53465553u  // "SFUS"
+#define SNAPSHOT_VERSION 6  // 2: формат TCP-сообщений соединения, 3: подписка на весь звонок,
+                            // 4: SERVER_EVENT_BATCH соединения, 5: версия состава звонка,
+                            // 6: токен CLIENT_CONN_RESUME
+
+#ifndef SNAPSHOT_RESUME_GRACE_MS
+#define SNAPSHOT_RESUME_GRACE_MS 30000
+#endif
+
+// Ключ отсоединенного соединения в connections по прежнему connection_id и обратно
+#define SNAPSHOT_DETACHED_FD(id) (-2 - (int)(id))
+#define SNAPSHOT_IS_DETACHED(fd) ((fd) <= -2)
+#define SNAPSHOT_DETACHED_ID(fd) ((uint32_t)(-2 - (fd)))
+
+typedef struct {
+    uint8_t* data;
+    size_t len;
+    size_t capacity;
+} SnapshotBlob;
+
+typedef struct {
+    uint32_t connections;
+    uint32_t calls;
+    uint32_t streams;
+    uint32_t memberships;  // участия в звонках и подписки на стримы
+    uint32_t skipped;      // записи, которые не удалось восстановить
+    uint32_t detached;     // соединений без сокета, ждут CLIENT_CONN_RESUME
+} SnapshotCounts;
+
+int snapshot_encode(SnapshotBlob* blob);
+void snapshot_blob_free(SnapshotBlob* blob);
+
+typedef struct {
+    uint64_t written;
+    uint64_t failed;
+    uint64_t last_bytes;
+    uint64_t last_ms;       // от fork до завершения записи
+    uint32_t detached;      // соединений ждут CLIENT_CONN_RESUME
+} SnapshotStats;
+
+// Восстанавливает реестры из снимка. С detach = false сокеты соединений уже открыты
+// под теми же номерами (горячий перезапуск), с true - соединения отсоединены.
+// Возвращает 0 или отрицательный код ошибки формата.
+int snapshot_restore(const uint8_t* data, size_t len, bool detach, SnapshotCounts* counts);
+
+/* Файл снимка */
+// Запись в фоне: дочерний процесс (fork, копия при записи) кодирует реестры и пишет
+// файл через временный и rename; основной цикл платит только за fork
+int snapshot_save_async(const char* path);
+void snapshot_reap(bool wait);  // забирает завершившуюся запись (wait - дождаться идущей)
+int snapshot_save(const char* path);
+int snapshot_load(const char* path, SnapshotCounts* counts);
+
+// Отсоединенные соединения, не вернувшиеся за SNAPSHOT_RESUME_GRACE_MS, удаляются
+void snapshot_expire_detached(uint64_t now_ms);
+SnapshotStats snapshot_stats(void);
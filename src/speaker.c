@@ -0,0 +1,56 @@
+#include "speaker.h"
+
+void audio_level_update(AudioLevelFilter* filter, uint8_t level_dbov, uint64_t now_ms) {
+    if (!filter) return;
+
+    if (level_dbov > AUDIO_LEVEL_SILENCE) level_dbov = AUDIO_LEVEL_SILENCE;
+
+    // После паузы фильтр начинает с нуля, а не со старой громкости
+    if (now_ms - filter->last_packet_ms > SPEAKER_SILENCE_TIMEOUT_MS) {
+        filter->level_q8 = 0;
+    }
+
+    int32_t sample = (int32_t)(AUDIO_LEVEL_SILENCE - level_dbov) << 8;
+    int32_t level = filter->level_q8;
+    int shift = sample > level ? SPEAKER_ATTACK_SHIFT : SPEAKER_RELEASE_SHIFT;
+    level += (sample - level) / (1 << shift);
+
+    filter->level_q8 = (uint16_t)level;
+    filter->last_packet_ms = now_ms;
+}
+
+uint16_t audio_level_current(const AudioLevelFilter* filter, uint64_t now_ms) {
+    if (!filter || filter->last_packet_ms == 0) return 0;
+    if (now_ms - filter->last_packet_ms > SPEAKER_SILENCE_TIMEOUT_MS) return 0;
+    return filter->level_q8;
+}
+
+void speaker_rank(const uint16_t* levels, const uint8_t* prev_rank, int count,
+                  int active_count, uint8_t* out_rank) {
+    int order[256];
+    int32_t score[256];
+    if (count > 256) count = 256;
+
+    // Сортировка вставками: стримов в звонке единицы-десятки
+    for (int i = 0; i < count; i++) {
+        bool was_active = prev_rank[i] != 0 && prev_rank[i] <= active_count;
+        score[i] = levels[i] + (was_active ? SPEAKER_HYSTERESIS_Q8 : 0);
+
+        int j = i;
+        while (j > 0) {
+            int other = order[j - 1];
+            // При равной громкости сохраняется прежний порядок
+            bool louder = score[i] > score[other] ||
+                          (score[i] == score[other] && prev_rank[i] != 0 &&
+                           (prev_rank[other] == 0 || prev_rank[i] < prev_rank[other]));
+            if (!louder) break;
+            order[j] = other;
+            j--;
+        }
+        order[j] = i;
+    }
+
+    for (int r = 0; r < count; r++) {
+        out_rank[order[r]] = (uint8_t)(r + 1);
+    }
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+// Сколько самых громких аудиостримов звонка пересылается каждому участнику
+#ifndef CALL_ACTIVE_SPEAKERS
+#define CALL_ACTIVE_SPEAKERS 3
+#endif
+
+// Как часто пересчитывается набор активных говорящих звонка
+#ifndef SPEAKER_UPDATE_INTERVAL_MS
+#define SPEAKER_UPDATE_INTERVAL_MS 100
+#endif
+
+// Аудиострим без пакетов дольше этого времени считается молчащим (DTX)
+#ifndef SPEAKER_SILENCE_TIMEOUT_MS
+#define SPEAKER_SILENCE_TIMEOUT_MS 500
+#endif
+
+// Фильтр громкости: быстрая атака, медленный спад (вес 1/2^shift)
+#define SPEAKER_ATTACK_SHIFT  2
+#define SPEAKER_RELEASE_SHIFT 4
+
+// Преимущество уже активного говорящего (Q8, ~4 дБ), чтобы набор не дергался
+#define SPEAKER_HYSTERESIS_Q8 (4 << 8)
+
+// Уровень из заголовка - как в RFC 6464: 0..127 -дБов, 127 - тишина
+#define AUDIO_LEVEL_SILENCE 127
+
+// Сглаженная громкость аудиострима в фиксированной точке Q8 (0 - тишина)
+typedef struct {
+    uint16_t level_q8;
+    uint64_t last_packet_ms;
+} AudioLevelFilter;
+
+void audio_level_update(AudioLevelFilter* filter, uint8_t level_dbov, uint64_t now_ms);
+uint16_t audio_level_current(const AudioLevelFilter* filter, uint64_t now_ms);
+
+// Ранжирует count аудиостримов по громкости (1 - самый громкий).
+// prev_rank - ранги прошлого пересчета (0 - не было); первые active_count
+// из них получают надбавку SPEAKER_HYSTERESIS_Q8.
+void speaker_rank(const uint16_t* levels, const uint8_t* prev_rank, int count,
+                  int active_count, uint8_t* out_rank);
@@ -0,0 +1,55 @@
+#include "spsc.h"
+#include <stdlib.h>
+
+int spsc_init(SpscQueue* queue, uint32_t capacity) {
+    if (!queue || capacity < 2 || (capacity & (capacity - 1)) != 0) return -1;
+
+    queue->slots = calloc(capacity, sizeof(void*));
+    if (!queue->slots) return -2;
+
+    queue->mask = capacity - 1;
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+    queue->cached_tail = 0;
+    queue->cached_head = 0;
+    return 0;
+}
+
+void spsc_destroy(SpscQueue* queue) {
+    if (!queue) return;
+    free(queue->slots);
+    queue->slots = NULL;
+}
+
+bool spsc_push(SpscQueue* queue, void* item) {
+    uint32_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+
+    if (tail - queue->cached_head > queue->mask) {
+        queue->cached_head = atomic_load_explicit(&queue->head, memory_order_acquire);
+        if (tail - queue->cached_head > queue->mask) return false;
+    }
+
+    queue->slots[tail & queue->mask] = item;
+    // release: читатель увидит слот не раньше нового tail
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+void* spsc_pop(SpscQueue* queue) {
+    uint32_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+
+    if (head == queue->cached_tail) {
+        queue->cached_tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+        if (head == queue->cached_tail) return NULL;
+    }
+
+    void* item = queue->slots[head & queue->mask];
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+    return item;
+}
+
+uint32_t spsc_count(SpscQueue* queue) {
+    uint32_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    uint32_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    return tail - head;
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+// Очередь указателей без блокировок: ровно один писатель и один читатель.
+// Писатель двигает tail, читатель head; каждый держит копию чужого индекса
+// и перечитывает атомик, только когда копия говорит "полно" / "пусто".
+typedef struct {
+    void** slots;
+    uint32_t mask;              // емкость - 1 (емкость - степень двойки)
+
+    _Alignas(64) _Atomic uint32_t head;
+    uint32_t cached_tail;       // копия tail у читателя
+
+    _Alignas(64) _Atomic uint32_t tail;
+    uint32_t cached_head;       // копия head у писателя
+} SpscQueue;
+
+int spsc_init(SpscQueue* queue, uint32_t capacity);
+void spsc_destroy(SpscQueue* queue);
+
+/* Писатель */
+bool spsc_push(SpscQueue* queue, void* item);
+
+/* Читатель */
+void* spsc_pop(SpscQueue* queue);
+
+// Примерная глубина (точна только из потока писателя или читателя)
+uint32_t spsc_count(SpscQueue* queue);
@@ -2,11 +2,16 @@
 #include "id_utils.h"
 #include "connection.h"
 #include "call.h"
+#include "keyframe_cache.h"
+#include "mixer.h"
+#include "time_utils.h"
+#include "fanout.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 
 Stream* streams = NULL;
+int stream_active_replays = 0;
 
 /* Внутренние функции */
 static Stream* stream_alloc(uint32_t stream_id, Connection* owner, Call* call) {
@@ -18,12 +23,32 @@ static Stream* stream_alloc(uint32_t stream_id, Connection* owner, Call* call) {
     s->owner = owner;
     s->call = call;
     DENSE_ARRAY_INIT(s->recipients, STREAM_MAX_RECIPIENTS);
+    memset(s->recipient_state, 0, sizeof(s->recipient_state));
+    memset(s->keyframe_cache, 0, sizeof(s->keyframe_cache));
+    s->active_replays = 0;
+    memset(s->layer_rate, 0, sizeof(s->layer_rate));
+    s->media_class = 0;  // MEDIA_CLASS_VIDEO
+    s->is_audio = false;
+    memset(&s->audio_level, 0, sizeof(s->audio_level));
+    s->speaker_rank = 0;
+    s->mix_queue = NULL;
+    for (int layer = 0; layer < SIMULCAST_MAX_LAYERS; layer++) {
+        seq_stats_init(&s->ingress[layer]);
+    }
+    memset(&s->ingress_reported, 0, sizeof(s->ingress_reported));
+    s->ingress_reported_ms = 0;
+    s->relayed = false;
     
     return s;
 }
 
 static void stream_free(Stream* stream) {
     if (!stream) return;
+    stream_cancel_replays(stream);
+    for (int layer = 0; layer < SIMULCAST_MAX_LAYERS; layer++) {
+        keyframe_cache_delete(stream->keyframe_cache[layer]);
+    }
+    free(stream->mix_queue);
     free(stream);
 }
 
@@ -48,12 +73,29 @@ static void stream_remove_from_registry(Stream* stream) {
 
 static int stream_add_recipient_to_array(Stream* stream, Connection* recipient) {
     if (!stream || !recipient) return -1;
-    return DENSE_ARRAY_ADD(stream->recipients, STREAM_MAX_RECIPIENTS, recipient);
+    int index = DENSE_ARRAY_ADD(stream->recipients, STREAM_MAX_RECIPIENTS, recipient);
+    if (index < 0) return index;
+
+    // Новый зритель сразу получает лучший из идущих слоев
+    uint32_t rates[SIMULCAST_MAX_LAYERS];
+    stream_layer_rates(stream, monotonic_ms(), rates);
+    memset(&stream->recipient_state[index], 0, sizeof(StreamRecipientState));
+    simulcast_state_init(&stream->recipient_state[index].simulcast,
+                         simulcast_pick_layer(rates, SIMULCAST_MAX_LAYERS - 1, 0));
+    stream->recipient_state[index].fanout_thread = FANOUT_UNASSIGNED;
+    fanout_rebalance_stream(stream);
+    return index;
 }
 
 static int stream_remove_recipient_from_array(Stream* stream, Connection* recipient) {
     if (!stream || !recipient) return -1;
-    return DENSE_ARRAY_REMOVE(stream->recipients, STREAM_MAX_RECIPIENTS, recipient);
+    int index = DENSE_ARRAY_INDEX_OF(stream->recipients, STREAM_MAX_RECIPIENTS, recipient);
+    if (index < 0) return -1;
+    stream_stop_replay(stream, index);
+    memset(&stream->recipient_state[index], 0, sizeof(StreamRecipientState));
+    stream->recipients[index] = NULL;
+    fanout_rebalance_stream(stream);
+    return 0;
 }
 
 static bool stream_is_recipient_in_array(const Stream* stream, const Connection* recipient) {
@@ -115,7 +157,7 @@ Stream* stream_new(uint32_t stream_id, Connection* owner, Call* call) {
     }
     
     // Добавляем к владельцу
-    if (connection_add_own_stream(owner, stream) != 0) {
+    if (connection_add_own_stream(owner, stream) < 0) {
         fprintf(stderr, "Failed to add stream %u to owner %d\n", stream_id, owner->fd);
         stream_remove_from_registry(stream);
         stream_free(stream);
@@ -140,6 +182,28 @@ Stream* stream_new(uint32_t stream_id, Connection* owner, Call* call) {
     return stream;
 }
 
+// Зеркало публичного стрима другого узла: пакеты приходят по магистрали,
+// владельца на этом узле нет, ID совпадает с ID на узле-источнике
+Stream* stream_new_relayed(uint32_t stream_id) {
+    if (stream_id == 0) return NULL;
+
+    Stream* stream = stream_alloc(stream_id, NULL, NULL);
+    if (!stream) {
+        fprintf(stderr, "Failed to allocate stream\n");
+        return NULL;
+    }
+    stream->relayed = true;
+
+    if (stream_add_to_registry(stream) != 0) {
+        fprintf(stderr, "Stream ID %u is already in use\n", stream_id);
+        stream_free(stream);
+        return NULL;
+    }
+
+    printf("Created relayed stream %u\n", stream_id);
+    return stream;
+}
+
 void stream_delete(Stream* stream) {
     if (!stream) return;
     
@@ -195,12 +259,12 @@ int stream_add_recipient(Stream* stream, Connection* recipient) {
     }
     
     // Добавляем в массив получателей стрима
-    if (stream_add_recipient_to_array(stream, recipient) != 0) {
+    if (stream_add_recipient_to_array(stream, recipient) < 0) {
         return -4;
     }
     
     // Добавляем стрим в watch_streams получателя
-    if (connection_add_watch_stream(recipient, stream) != 0) {
+    if (connection_add_watch_stream(recipient, stream) < 0) {
         // Откатываем добавление в массив получателей
         stream_remove_recipient_from_array(stream, recipient);
         return -5;
@@ -290,4 +354,157 @@ bool stream_can_add_recipient(const Stream* stream) {
         }
     }
     return false;
-}
\ No newline at end of file
+}
+
+void stream_cache_packet(Stream* stream, uint8_t layer, const void* data, size_t len, bool is_keyframe) {
+    if (!stream || layer >= SIMULCAST_MAX_LAYERS) return;
+
+    KeyframeCache** cache = &stream->keyframe_cache[layer];
+    if (!*cache) {
+        // Кеш нужен только слоям, которые размечают ключевые кадры
+        if (!is_keyframe) return;
+        *cache = keyframe_cache_new();
+        if (!*cache) return;
+    }
+
+    if (is_keyframe && stream->active_replays > 0) {
+        // Новый ключевой кадр слоя дойдет живым потоком - догонять его кеш больше нечего
+        for (int i = 0; i < STREAM_MAX_RECIPIENTS; i++) {
+            if (stream->recipient_state[i].replay_active && stream->recipient_state[i].replay_layer == layer) {
+                stream_stop_replay(stream, i);
+            }
+        }
+    }
+
+    keyframe_cache_push(*cache, data, len, is_keyframe);
+}
+
+int stream_start_replay(Stream* stream, Connection* recipient) {
+    if (!stream || !recipient) return -1;
+
+    int index = DENSE_ARRAY_INDEX_OF(stream->recipients, STREAM_MAX_RECIPIENTS, recipient);
+    if (index < 0) return -2;
+
+    StreamRecipientState* state = &stream->recipient_state[index];
+    uint8_t layer = state->simulcast.current_layer;
+    KeyframeCache* cache = stream->keyframe_cache[layer];
+    if (!keyframe_cache_is_valid(cache)) return -3;
+
+    if (state->replay_active) return -4;
+
+    state->replay_active = true;
+    state->replay_layer = layer;
+    state->replay_cursor = 0;
+    state->replay_generation = cache->generation;
+    stream->active_replays++;
+    stream_active_replays++;
+
+    return 0;
+}
+
+void stream_stop_replay(Stream* stream, int index) {
+    if (!stream || index < 0 || index >= STREAM_MAX_RECIPIENTS) return;
+
+    StreamRecipientState* state = &stream->recipient_state[index];
+    if (state->replay_active) {
+        stream->active_replays--;
+        stream_active_replays--;
+    }
+    state->replay_active = false;
+    state->replay_cursor = 0;
+    state->replay_generation = 0;
+}
+
+void stream_cancel_replays(Stream* stream) {
+    if (!stream || stream->active_replays == 0) return;
+
+    for (int i = 0; i < STREAM_MAX_RECIPIENTS; i++) {
+        stream_stop_replay(stream, i);
+    }
+}
+
+bool stream_is_replaying_to(const Stream* stream, int index) {
+    if (!stream || index < 0 || index >= STREAM_MAX_RECIPIENTS) return false;
+    return stream->recipient_state[index].replay_active;
+}
+
+void stream_layer_rates(const Stream* stream, uint64_t now_ms, uint32_t out_bps[SIMULCAST_MAX_LAYERS]) {
+    for (int layer = 0; layer < SIMULCAST_MAX_LAYERS; layer++) {
+        out_bps[layer] = stream ? rate_meter_bps(&stream->layer_rate[layer], now_ms) : 0;
+    }
+}
+
+int stream_set_max_layer(Stream* stream, Connection* recipient, uint8_t max_layer) {
+    if (!stream || !recipient) return -1;
+    if (max_layer >= SIMULCAST_MAX_LAYERS) return -3;
+
+    int index = DENSE_ARRAY_INDEX_OF(stream->recipients, STREAM_MAX_RECIPIENTS, recipient);
+    if (index < 0) return -2;
+
+    stream->recipient_state[index].simulcast.max_layer = max_layer;
+
+    // Бюджет берем из последней оценки канала, поделенной между стримами зрителя
+    uint32_t budget = 0;
+    int watched = (int)DENSE_ARRAY_COUNT(recipient->watch_streams, MAX_INPUT);
+    if (recipient->bwe.reports > 0 && watched > 0) {
+        budget = recipient->bwe.estimate_bps / (uint32_t)watched;
+    }
+    stream_select_layer(stream, index, budget, monotonic_ms());
+    return 0;
+}
+
+void stream_select_layer(Stream* stream, int index, uint32_t budget_bps, uint64_t now_ms) {
+    if (!stream || index < 0 || index >= STREAM_MAX_RECIPIENTS || !stream->recipients[index]) return;
+
+    SimulcastState* state = &stream->recipient_state[index].simulcast;
+    uint32_t rates[SIMULCAST_MAX_LAYERS];
+    stream_layer_rates(stream, now_ms, rates);
+
+    uint8_t target = simulcast_pick_layer(rates, state->max_layer, budget_bps);
+    if (target != state->target_layer) {
+        printf("Stream %u: connection %d switches to layer %u at next keyframe (current %u)\n",
+               stream->stream_id, stream->recipients[index]->fd, target, state->current_layer);
+        state->target_layer = target;
+    }
+}
+
+uint32_t stream_recipient_bitrate(const Stream* stream, const Connection* recipient, uint64_t now_ms) {
+    if (!stream || !recipient) return 0;
+
+    int index = DENSE_ARRAY_INDEX_OF(stream->recipients, STREAM_MAX_RECIPIENTS, recipient);
+    if (index < 0) return 0;
+
+    uint8_t layer = stream->recipient_state[index].simulcast.current_layer;
+    return rate_meter_bps(&stream->layer_rate[layer], now_ms);
+}
+int stream_push_audio_frame(Stream* stream, const void* pcm) {
+    if (!stream || !pcm) return -1;
+
+    if (!stream->mix_queue) {
+        stream->mix_queue = malloc(sizeof(AudioJitterQueue));
+        if (!stream->mix_queue) return -2;
+        audio_jitter_init(stream->mix_queue);
+    }
+
+    audio_jitter_push(stream->mix_queue, pcm);
+    return 0;
+}
+
+void stream_ingress_totals(const Stream* stream, StreamIngressTotals* out) {
+    if (!out) return;
+    memset(out, 0, sizeof(*out));
+    if (!stream) return;
+
+    for (int layer = 0; layer < SIMULCAST_MAX_LAYERS; layer++) {
+        const SeqStats* stats = &stream->ingress[layer];
+        if (!stats->started) continue;
+
+        out->received += stats->received;
+        out->expected += seq_stats_expected(stats);
+        out->lost += stats->lost;
+        out->reordered += stats->reordered;
+        out->duplicates += stats->duplicates;
+        uint32_t jitter = seq_stats_jitter_us(stats);
+        if (jitter > out->jitter_us) out->jitter_us = jitter;
+    }
+}
@@ -6,23 +6,65 @@
 #include "dense_array.h"
 #include "connection.h"
 #include "call.h"
+#include "bwe.h"
+#include "simulcast.h"
+#include "speaker.h"
+#include "seq_stats.h"
 
 #ifndef STREAM_MAX_RECIPIENTS
-#define STREAM_MAX_RECIPIENTS 4
+#define STREAM_MAX_RECIPIENTS 16
 #endif
 
+typedef struct KeyframeCache KeyframeCache;
+typedef struct AudioJitterQueue AudioJitterQueue;
+
+// Состояние получателя внутри стрима (индекс совпадает с recipients[])
+typedef struct {
+    bool replay_active;          // догоняет серию из кеша ключевого кадра
+    uint8_t replay_layer;        // слой, кеш которого досылается
+    uint32_t replay_cursor;      // следующий пакет кеша для отправки
+    uint32_t replay_generation;  // поколение кеша, с которого начат replay
+    SimulcastState simulcast;    // выбранный слой и перенумерация пакетов
+    uint8_t fanout_thread;       // поток рассылки, чьей части принадлежит получатель
+} StreamRecipientState;
+
+// Качество приема стрима, сложенное по всем слоям
+typedef struct {
+    uint64_t received;
+    uint64_t expected;
+    uint64_t lost;
+    uint64_t reordered;
+    uint64_t duplicates;
+    uint32_t jitter_us;  // максимум по слоям
+} StreamIngressTotals;
+
 typedef struct Stream {
     uint32_t stream_id;                          
     Call* call;
     Connection* owner;
     Connection* recipients[STREAM_MAX_RECIPIENTS];               
+    StreamRecipientState recipient_state[STREAM_MAX_RECIPIENTS];
+    KeyframeCache* keyframe_cache[SIMULCAST_MAX_LAYERS];  // по слою, создается при первом ключевом кадре
+    int active_replays;
+    RateMeter layer_rate[SIMULCAST_MAX_LAYERS];  // входящий битрейт каждого слоя
+    uint8_t media_class;                         // MEDIA_CLASS_* из CLIENT_STREAM_CREATE_MEDIA
+    bool is_audio;                               // пакеты несут UDP_EXT_FLAG_AUDIO
+    AudioLevelFilter audio_level;
+    uint8_t speaker_rank;                        // место по громкости в звонке (0 - не считалось)
+    AudioJitterQueue* mix_queue;                 // кадры PCM для микшера звонка, создается по первому кадру
+    SeqStats ingress[SIMULCAST_MAX_LAYERS];      // потери/порядок/джиттер входящих пакетов по слою
+    StreamIngressTotals ingress_reported;        // итоги на момент последнего SERVER_STREAM_STATS
+    uint64_t ingress_reported_ms;
+    bool relayed;                                // зеркало стрима другого узла (магистраль), без владельца
     UT_hash_handle hh;                           
 } Stream;
 
 extern Stream* streams;
+extern int stream_active_replays;  // суммарно по всем стримам
 
 /* Основные операции жизненного цикла */
 Stream* stream_new(uint32_t stream_id, Connection* owner, Call* call);
+Stream* stream_new_relayed(uint32_t stream_id);
 void stream_delete(Stream* stream);
 
 /* Управление получателями */
@@ -40,4 +82,23 @@ int stream_find_by_recipient(const Connection* recipient, Stream** result, int m
 Call* stream_get_call(const Stream* stream);
 bool stream_is_private(const Stream* stream);
 
-bool stream_can_add_recipient(const Stream* stream);
\ No newline at end of file
+bool stream_can_add_recipient(const Stream* stream);
+
+/* Быстрый старт: отправка новому зрителю серии с последнего ключевого кадра */
+void stream_cache_packet(Stream* stream, uint8_t layer, const void* data, size_t len, bool is_keyframe);
+int stream_start_replay(Stream* stream, Connection* recipient);
+void stream_stop_replay(Stream* stream, int index);
+void stream_cancel_replays(Stream* stream);
+bool stream_is_replaying_to(const Stream* stream, int index);
+
+/* Simulcast: слой для каждого получателя */
+void stream_layer_rates(const Stream* stream, uint64_t now_ms, uint32_t out_bps[SIMULCAST_MAX_LAYERS]);
+int stream_set_max_layer(Stream* stream, Connection* recipient, uint8_t max_layer);
+void stream_select_layer(Stream* stream, int index, uint32_t budget_bps, uint64_t now_ms);
+uint32_t stream_recipient_bitrate(const Stream* stream, const Connection* recipient, uint64_t now_ms);
+
+/* Микширование звонка: кадр PCM ждет тика микшера */
+int stream_push_audio_frame(Stream* stream, const void* pcm);
+
+/* Качество входящего потока издателя */
+void stream_ingress_totals(const Stream* stream, StreamIngressTotals* out);
\ No newline at end of file
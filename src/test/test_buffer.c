@@ -1,9 +1,13 @@
 #include <assert.h>
 #include <string.h>
 #include <stdio.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
 #include "../buffer.h"
 #include "../buffer_logic.h"
 #include "../protocol.h"
+#include "../connection.h"
 #include "../test_common.h"
 
 // Объявление функции, которая определена в buffer_logic.c но не в header'е
@@ -238,6 +242,7 @@ bool test_buffer_logic_simple_message() {
     TEST_ASSERT(&ctx, buffer_protocol_set_expected(&b) == 0, "Should set expected size successfully");
     TEST_ASSERT(&ctx, b.expected_size == 1 + sizeof(StreamCreatePayload), "Expected size should match StreamCreatePayload size");
 
+    buffer_logic_set_expected_size_resolver(buffer_protocol_expected_size);
     TEST_REPORT(&ctx, "test_buffer_logic_simple_message");
 }
 
@@ -273,8 +278,122 @@ bool test_buffer_logic_incomplete_message() {
     TEST_ASSERT(&ctx, b.position == expected_size, "Position should match expected size");
     TEST_ASSERT(&ctx, buffer_protocol_state(&b) == BUFFER_IS_COMPLETE, "Protocol state should be complete");
 
+    buffer_logic_set_expected_size_resolver(buffer_protocol_expected_size);
     TEST_REPORT(&ctx, "test_buffer_logic_incomplete_message");
 }
+bool test_buffer_protocol_pipelined_legacy() {
+    TestContext ctx;
+    TEST_INIT(&ctx, "test_buffer_protocol_pipelined_legacy");
+
+    // Три сообщения подряд, первое - переменной длины, последнее пришло не целиком
+    uint8_t stream[64];
+    uint32_t len = 0;
+    stream[len++] = CLIENT_ERROR;
+    stream[len++] = SERVER_CALL_CREATED;
+    stream[len++] = 4;
+    memcpy(stream + len, "oops", 4);
+    len += 4;
+    stream[len++] = CLIENT_STREAM_DELETE;
+    uint32_t id = htonl(300);
+    memcpy(stream + len, &id, sizeof(id));
+    len += sizeof(id);
+    stream[len++] = CLIENT_CALL_CONN_JOIN;
+    stream[len++] = 0;
+
+    ProtocolFrame frame;
+    uint32_t offset = 0;
+    TEST_ASSERT(&ctx, buffer_protocol_next_frame(stream, len, FRAMING_LEGACY, &frame) == 1 &&
+                frame.type == CLIENT_ERROR && frame.payload_len == 6 && frame.frame_len == 7,
+                "Error message length should come from its header");
+    offset += frame.frame_len;
+    TEST_ASSERT(&ctx, buffer_protocol_next_frame(stream + offset, len - offset, FRAMING_LEGACY, &frame) == 1 &&
+                frame.type == CLIENT_STREAM_DELETE && frame.payload_len == sizeof(StreamIDPayload),
+                "Fixed-size message should follow");
+    offset += frame.frame_len;
+    TEST_ASSERT(&ctx, buffer_protocol_next_frame(stream + offset, len - offset, FRAMING_LEGACY, &frame) == 0,
+                "Partial message should wait for more data");
+
+    uint8_t unknown = 0x7F;
+    TEST_ASSERT(&ctx, buffer_protocol_next_frame(&unknown, 1, FRAMING_LEGACY, &frame) < 0,
+                "Unknown type cannot be framed without a length");
+
+    Buffer b;
+    buffer_init(&b);
+    memcpy(b.data, stream, len);
+    b.position = len;
+    buffer_protocol_discard(&b, offset);
+    TEST_ASSERT(&ctx, b.position == 2 && b.data[0] == CLIENT_CALL_CONN_JOIN, "Only the partial message should remain");
+
+    TEST_REPORT(&ctx, "test_buffer_protocol_pipelined_legacy");
+}
+
+bool test_buffer_protocol_length_prefixed() {
+    TestContext ctx;
+    TEST_INIT(&ctx, "test_buffer_protocol_length_prefixed");
+
+    // Любой тип, даже неизвестный, пропускается по длине
+    uint8_t stream[] = {
+        0, 3, 0x7F, 0xAA, 0xBB,
+        0, 1, CLIENT_CALL_CREATE,
+        0, 5, CLIENT_STREAM_DELETE, 0, 0,
+    };
+    ProtocolFrame frame;
+    uint32_t offset = 0;
+    TEST_ASSERT(&ctx, buffer_protocol_next_frame(stream, sizeof(stream), FRAMING_LENGTH_PREFIXED, &frame) == 1 &&
+                frame.type == 0x7F && frame.payload_len == 2 && frame.payload[1] == 0xBB && frame.frame_len == 5,
+                "Unknown message should be framed by its length");
+    offset += frame.frame_len;
+    TEST_ASSERT(&ctx, buffer_protocol_next_frame(stream + offset, sizeof(stream) - offset, FRAMING_LENGTH_PREFIXED,
+                                                 &frame) == 1 && frame.type == CLIENT_CALL_CREATE && frame.payload_len == 0,
+                "Type-only message expected");
+    offset += frame.frame_len;
+    TEST_ASSERT(&ctx, buffer_protocol_next_frame(stream + offset, sizeof(stream) - offset, FRAMING_LENGTH_PREFIXED,
+                                                 &frame) == 0, "Truncated frame should wait");
+    TEST_ASSERT(&ctx, buffer_protocol_next_frame(stream, 1, FRAMING_LENGTH_PREFIXED, &frame) == 0,
+                "Half a length should wait");
+
+    uint8_t empty[] = { 0, 0 };
+    uint8_t huge[] = { 0xFF, 0xFF };
+    TEST_ASSERT(&ctx, buffer_protocol_next_frame(empty, sizeof(empty), FRAMING_LENGTH_PREFIXED, &frame) < 0 &&
+                buffer_protocol_next_frame(huge, sizeof(huge), FRAMING_LENGTH_PREFIXED, &frame) < 0,
+                "Empty and oversized frames should be rejected");
+    TEST_ASSERT(&ctx, buffer_protocol_framing_negotiate(200) == FRAMING_VERSION_MAX &&
+                buffer_protocol_framing_negotiate(FRAMING_LEGACY) == FRAMING_LEGACY,
+                "Server should settle on a version it knows");
+
+    TEST_REPORT(&ctx, "test_buffer_protocol_length_prefixed");
+}
+
+bool test_buffer_protocol_framing_switch() {
+    TestContext ctx;
+    TEST_INIT(&ctx, "test_buffer_protocol_framing_switch");
+
+    int pair[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, pair);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    Connection* conn = connection_new(pair[0], &addr);
+
+    FramingPayload request = { .version = FRAMING_LENGTH_PREFIXED };
+    handle_client_message(conn, CLIENT_FRAMING, (const uint8_t*)&request, sizeof(request));
+    TEST_ASSERT(&ctx, conn->framing == FRAMING_LENGTH_PREFIXED, "Connection should switch framing");
+
+    // Ответ еще в старом формате, следующее сообщение - уже с длиной
+    send_server_handshake_end(conn);
+    uint8_t reply[2 + FRAMING_HEADER_SIZE + 1 + sizeof(HandshakeStartPayload)];
+    TEST_ASSERT(&ctx, recv(pair[1], reply, sizeof(reply), MSG_WAITALL) == (ssize_t)sizeof(reply),
+                "Both messages should arrive");
+    TEST_ASSERT(&ctx, reply[0] == SERVER_FRAMING && reply[1] == FRAMING_LENGTH_PREFIXED,
+                "SERVER_FRAMING should be sent in the old format");
+    TEST_ASSERT(&ctx, reply[2] == 0 && reply[3] == 1 + sizeof(HandshakeStartPayload) && reply[4] == SERVER_HANDSHAKE_END,
+                "Next message should carry its length");
+
+    connection_delete(conn);
+    close(pair[1]);
+
+    TEST_REPORT(&ctx, "test_buffer_protocol_framing_switch");
+}
+
 // Функция для запуска всех тестов буфера
 bool run_all_buffer_tests() {
     printf("Running buffer tests...\n");
@@ -290,6 +409,9 @@ bool run_all_buffer_tests() {
     all_passed = test_buffer_state() && all_passed;
     all_passed = test_buffer_logic_simple_message() && all_passed;
     all_passed = test_buffer_logic_incomplete_message() && all_passed;
+    all_passed = test_buffer_protocol_pipelined_legacy() && all_passed;
+    all_passed = test_buffer_protocol_length_prefixed() && all_passed;
+    all_passed = test_buffer_protocol_framing_switch() && all_passed;
     
     if (all_passed) {
         printf("All buffer tests completed successfully! ✓\n\n");
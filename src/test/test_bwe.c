@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <string.h>
+#include "../bwe.h"
+#include "../test_common.h"
+
+bool test_rate_meter_measures_bitrate() {
+    TestContext ctx;
+    TEST_INIT(&ctx, "test_rate_meter_measures_bitrate");
+
+    RateMeter meter;
+    memset(&meter, 0, sizeof(meter));
+
+    // 1250 байт каждые 10 мс = 1 Мбит/с
+    uint64_t now = 10000;
+    for (int i = 0; i <= 100; i++) {
+        rate_meter_update(&meter, 1250, now);
+        now += 10;
+    }
+    uint32_t bps = rate_meter_bps(&meter, now);
+    TEST_ASSERT(&ctx, bps > 950000 && bps < 1050000, "Bitrate should be about 1 Mbps, got %u", bps);
+
+    // Поток остановился - битрейт обнуляется
+    TEST_ASSERT(&ctx, rate_meter_bps(&meter, now + 10 * RATE_METER_WINDOW_MS) == 0,
+                "Stale meter should report zero");
+
+    TEST_REPORT(&ctx, "test_rate_meter_measures_bitrate");
+}
+
+bool test_bwe_reacts_to_loss() {
+    TestContext ctx;
+    TEST_INIT(&ctx, "test_bwe_reacts_to_loss");
+
+    BandwidthEstimator bwe;
+    bwe_init(&bwe);
+
+    // Без потерь: 125000 байт за секунду = 1 Мбит/с, оценка не ниже скорости приема
+    bwe_on_report(&bwe, 100, 100, 125000, 1000, 1000);
+    TEST_ASSERT(&ctx, bwe.estimate_bps >= 1000000, "Estimate should cover receive rate, got %u", bwe.estimate_bps);
+    uint32_t before = bwe.estimate_bps;
+
+    bwe_on_report(&bwe, 100, 100, 125000, 1000, 2000);
+    TEST_ASSERT(&ctx, bwe.estimate_bps > before, "Loss-free report should grow the estimate");
+
+    // 30% потерь: оценка падает ниже фактического приема
+    bwe_on_report(&bwe, 100, 70, 87500, 1000, 3000);
+    TEST_ASSERT(&ctx, bwe.loss_permille == 300, "Loss should be 30%%, got %u", bwe.loss_permille);
+    TEST_ASSERT(&ctx, bwe.estimate_bps < 700000, "Estimate should drop below receive rate, got %u", bwe.estimate_bps);
+
+    TEST_REPORT(&ctx, "test_bwe_reacts_to_loss");
+}
+
+bool test_bwe_congestion_and_timeout() {
+    TestContext ctx;
+    TEST_INIT(&ctx, "test_bwe_congestion_and_timeout");
+
+    BandwidthEstimator bwe;
+    bwe_init(&bwe);
+
+    TEST_ASSERT(&ctx, !bwe_update_congestion(&bwe, 2000000), "No reports - never congested");
+    TEST_ASSERT(&ctx, !bwe_should_drop(&bwe, 0), "No reports - nothing dropped");
+
+    // Принимает 500 кбит/с с потерями при потребности 2 Мбит/с
+    bwe_on_report(&bwe, 100, 50, 62500, 1000, 5000);
+    TEST_ASSERT(&ctx, bwe_update_congestion(&bwe, 2000000), "State should switch to congested");
+    TEST_ASSERT(&ctx, bwe_should_drop(&bwe, 5100), "Droppable packets should be dropped");
+
+    // Пропуски от собственных отбрасываний сервера не считаются потерями канала
+    for (int i = 0; i < 20; i++) bwe_count_drop(&bwe);
+    bwe_on_report(&bwe, 100, 80, 100000, 1000, 5200);
+    TEST_ASSERT(&ctx, bwe.loss_permille == 0, "Server drops are not loss, got %u", bwe.loss_permille);
+    TEST_ASSERT(&ctx, bwe.dropped_packets == 20 && bwe.dropped_since_report == 0, "Drop counters");
+
+    // Отчеты перестали приходить - перестаем резать
+    TEST_ASSERT(&ctx, !bwe_should_drop(&bwe, 5200 + BWE_REPORT_TIMEOUT_MS + 1),
+                "Stale estimate should not drop packets");
+
+    // Потребность упала ниже оценки - перегрузка снята
+    TEST_ASSERT(&ctx, bwe_update_congestion(&bwe, 100000), "State should switch back");
+    TEST_ASSERT(&ctx, !bwe.congested, "Should not be congested");
+
+    TEST_REPORT(&ctx, "test_bwe_congestion_and_timeout");
+}
+
+bool run_all_bwe_tests() {
+    printf("Running bandwidth estimation tests...\n\n");
+
+    bool all_passed = true;
+    all_passed = test_rate_meter_measures_bitrate() && all_passed;
+    all_passed = test_bwe_reacts_to_loss() && all_passed;
+    all_passed = test_bwe_congestion_and_timeout() && all_passed;
+
+    if (all_passed) {
+        printf("All bandwidth estimation tests passed! ✓\n\n");
+    } else {
+        printf("Some bandwidth estimation tests failed! ✗\n\n");
+    }
+
+    return all_passed;
+}
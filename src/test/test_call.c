@@ -8,6 +8,8 @@
 #include "../call.h"
 #include "../connection.h"
 #include "../stream.h"
+#include "../protocol.h"
+#include "../buffer_logic.h"
 #include "../test_common.h"
 #include "../integrity_check.h"
 
@@ -248,6 +250,196 @@ TEST_ASSERT(&ctx, integrity_ok, "System integrity check failed after test");
     TEST_REPORT(&ctx, "test_call_delete_cleanup");
 }
 
+// Участник на socketpair с UDP-адресом: его ответы читаются со второго конца
+static Connection* make_peer(int pair[2], uint16_t udp_port) {
+    socketpair(AF_UNIX, SOCK_STREAM, 0, pair);
+    Connection* conn = make_conn(pair[0]);
+    struct sockaddr_in udp = conn->tcp_addr;
+    udp.sin_port = htons(udp_port);
+    connection_set_udp_addr(conn, &udp);
+    return conn;
+}
+
+// Последний SERVER_STREAM_BATCH_RESULT среди того, что сервер успел отправить
+static int read_batch_result(int fd, uint8_t* original, StreamBatchResult* results) {
+    uint8_t data[4096];
+    ssize_t len = recv(fd, data, sizeof(data), MSG_DONTWAIT);
+    int count = -1;
+    ProtocolFrame frame;
+    for (uint32_t offset = 0; len > 0 && buffer_protocol_next_frame(data + offset, (uint32_t)len - offset,
+                                                                       FRAMING_LEGACY, &frame) == 1;
+         offset += frame.frame_len) {
+        if (frame.type != SERVER_STREAM_BATCH_RESULT) continue;
+        const StreamBatchResultPayload* header = (const StreamBatchResultPayload*)frame.payload;
+        *original = header->original_message_type;
+        count = header->result_count;
+        memcpy(results, header + 1, count * sizeof(StreamBatchResult));
+    }
+    return count;
+}
+
+bool test_call_batch_subscribe() {
+    TestContext ctx;
+    TEST_INIT(&ctx, "test_call_batch_subscribe");
+
+    int pairs[3][2];
+    Connection* owner = make_peer(pairs[0], 9100);
+    Connection* viewer = make_peer(pairs[1], 9101);
+    Connection* follower = make_peer(pairs[2], 9102);
+    Call* call = call_new(710);
+    call_add_participant(call, owner);
+    call_add_participant(call, viewer);
+    call_add_participant(call, follower);
+    Stream* first = stream_new(810, owner, call);
+    Stream* second = stream_new(811, owner, call);
+
+    // Список стримов одним сообщением - один ответ со статусом по каждому
+    uint8_t request[sizeof(StreamBatchPayload) + 3 * sizeof(uint32_t)];
+    uint32_t ids[3] = { htonl(810), htonl(811), htonl(999999) };
+    request[0] = 3;
+    memcpy(request + 1, ids, sizeof(ids));
+    handle_client_message(viewer, CLIENT_STREAM_BATCH_JOIN, request, sizeof(request));
+
+    uint8_t original = 0;
+    StreamBatchResult results[8];
+    TEST_ASSERT(&ctx, read_batch_result(pairs[1][1], &original, results) == 3 && original == CLIENT_STREAM_BATCH_JOIN,
+                "One combined result expected");
+    TEST_ASSERT(&ctx, results[0].status == BATCH_STATUS_OK && results[1].status == BATCH_STATUS_OK &&
+                results[2].status == BATCH_STATUS_NOT_FOUND && ntohl(results[2].stream_id) == 999999,
+                "Statuses should follow the request order");
+    TEST_ASSERT(&ctx, stream_has_recipient(first, viewer) && stream_has_recipient(second, viewer),
+                "Viewer should watch both streams");
+
+    // Подписка на весь звонок: текущие стримы сразу, новые - по мере создания
+    CallSubscribePayload subscribe = { .call_id = htonl(710), .enabled = 1 };
+    handle_call_subscribe(follower, &subscribe);
+    TEST_ASSERT(&ctx, read_batch_result(pairs[2][1], &original, results) == 2 && original == CLIENT_CALL_SUBSCRIBE &&
+                call_is_subscribed(call, follower), "Follower should get existing streams in one result");
+
+    StreamCreatePayload create = { .call_id = htonl(710) };
+    handle_stream_create(owner, &create);
+    Stream* later = NULL;
+    for (int i = 0; i < MAX_CALL_STREAMS; i++) {
+        Stream* stream = call->streams[i];
+        if (stream && stream != first && stream != second) later = stream;
+    }
+    TEST_ASSERT(&ctx, later && stream_has_recipient(later, follower) && !stream_has_recipient(later, viewer),
+                "Only the subscribed participant should join a new stream");
+    TEST_ASSERT(&ctx, read_batch_result(pairs[2][1], &original, results) == 1 &&
+                ntohl(results[0].stream_id) == later->stream_id, "New stream should be reported to the follower");
+
+    // Отписка списком; повтор - не ошибка протокола, а статус
+    ids[1] = htonl(810);
+    request[0] = 2;
+    memcpy(request + 1, ids, 2 * sizeof(uint32_t));
+    handle_client_message(viewer, CLIENT_STREAM_BATCH_LEAVE, request, 1 + 2 * sizeof(uint32_t));
+    TEST_ASSERT(&ctx, read_batch_result(pairs[1][1], &original, results) == 2 && original == CLIENT_STREAM_BATCH_LEAVE &&
+                results[0].status == BATCH_STATUS_OK && results[1].status == BATCH_STATUS_ALREADY,
+                "Leave results expected");
+    TEST_ASSERT(&ctx, !stream_has_recipient(first, viewer), "Viewer should leave the stream");
+
+    // Место участника переходит к другому без подписки
+    call_remove_participant(call, follower);
+    call_add_participant(call, follower);
+    TEST_ASSERT(&ctx, !call_is_subscribed(call, follower), "Rejoining should start unsubscribed");
+
+    connection_delete(owner);
+    connection_delete(viewer);
+    connection_delete(follower);
+    call_delete(call);
+    for (int i = 0; i < 3; i++) close(pairs[i][1]);
+
+    TEST_REPORT(&ctx, "test_call_batch_subscribe");
+}
+
+// SERVER_CALL_DELTA из того, что сервер успел отправить; joined - был ли перед ним полный состав
+static int read_call_delta(int fd, CallDeltaPayload* header, CallDeltaEntry* entries, bool* joined) {
+    uint8_t data[4096];
+    ssize_t len = recv(fd, data, sizeof(data), MSG_DONTWAIT);
+    int count = -1;
+    *joined = false;
+    ProtocolFrame frame;
+    for (uint32_t offset = 0; len > 0 && buffer_protocol_next_frame(data + offset, (uint32_t)len - offset,
+                                                                       FRAMING_LEGACY, &frame) == 1;
+         offset += frame.frame_len) {
+        if (frame.type == SERVER_CALL_CONN_JOINED) *joined = true;
+        if (frame.type != SERVER_CALL_DELTA) continue;
+        memcpy(header, frame.payload, sizeof(*header));
+        count = header->change_count;
+        memcpy(entries, frame.payload + sizeof(*header), count * sizeof(CallDeltaEntry));
+    }
+    return count;
+}
+
+bool test_call_delta_sync() {
+    TestContext ctx;
+    TEST_INIT(&ctx, "test_call_delta_sync");
+
+    int pairs[3][2];
+    Connection* host = make_peer(pairs[0], 9110);
+    Connection* guest = make_peer(pairs[1], 9111);
+    Connection* visitor = make_peer(pairs[2], 9112);
+    Call* call = call_new(730);
+    CallDeltaPayload header;
+    CallDeltaEntry entries[CALL_CHANGE_LOG];
+    CallChange changes[CALL_CHANGE_LOG];
+    uint8_t drain[512];
+    bool joined = false;
+
+    // Без известной версии - полный состав и версия, с которой синхронизироваться дальше
+    CallSyncPayload sync = { .call_id = htonl(730), .version = 0 };
+    handle_call_sync(host, &sync);
+    TEST_ASSERT(&ctx, read_call_delta(pairs[0][1], &header, entries, &joined) == 0 && joined &&
+                header.from_version == 0 && ntohl(header.version) == call->version && call_has_participant(call, host),
+                "First sync should join with the full state");
+    uint32_t known = call->version;
+
+    // Гость вошел и создал стрим, посетитель зашел и вышел - в дельте только первое
+    CallJoinPayload join = { .call_id = htonl(730) };
+    handle_call_join(guest, &join);
+    call_add_participant(call, visitor);
+    call_remove_participant(call, visitor);
+    Stream* stream = stream_new(830, guest, call);
+    recv(pairs[0][1], drain, sizeof(drain), MSG_DONTWAIT);  // уведомления о госте
+
+    sync.version = htonl(known);
+    handle_call_sync(host, &sync);
+    TEST_ASSERT(&ctx, read_call_delta(pairs[0][1], &header, entries, &joined) == 2 && !joined,
+                "Delta should carry two changes");
+    TEST_ASSERT(&ctx, ntohl(header.from_version) == known && ntohl(header.version) == call->version,
+                "Delta should span the known and current versions");
+    TEST_ASSERT(&ctx, entries[0].type == SERVER_CALL_CONN_NEW && ntohl(entries[0].id) == (uint32_t)guest->fd &&
+                entries[1].type == SERVER_CALL_STREAM_NEW && ntohl(entries[1].id) == 830,
+                "Cancelled visit should be dropped from the delta");
+
+    // Текущая версия - пустая дельта
+    known = call->version;
+    sync.version = htonl(known);
+    handle_call_sync(host, &sync);
+    TEST_ASSERT(&ctx, read_call_delta(pairs[0][1], &header, entries, &joined) == 0 && !joined &&
+                ntohl(header.version) == known, "Up-to-date client should get an empty delta");
+
+    // Журнал переполнен - снова полный состав
+    for (int i = 0; i < CALL_CHANGE_LOG; i++) {
+        call_add_participant(call, visitor);
+        call_remove_participant(call, visitor);
+    }
+    TEST_ASSERT(&ctx, call_changes_since(call, known, changes, CALL_CHANGE_LOG) == -1,
+                "Truncated log should not cover the version");
+    handle_call_sync(host, &sync);
+    TEST_ASSERT(&ctx, read_call_delta(pairs[0][1], &header, entries, &joined) == 0 && joined && header.from_version == 0,
+                "Truncated log should fall back to the full state");
+
+    stream_delete(stream);
+    connection_delete(host);
+    connection_delete(guest);
+    connection_delete(visitor);
+    call_delete(call);
+    for (int i = 0; i < 3; i++) close(pairs[i][1]);
+
+    TEST_REPORT(&ctx, "test_call_delta_sync");
+}
+
 bool run_all_call_tests() {
     printf("Running call tests...\n\n");
     
@@ -257,6 +449,8 @@ bool run_all_call_tests() {
     all_passed = test_call_stream_management() && all_passed;
     all_passed = test_call_find_functions() && all_passed;
     all_passed = test_call_delete_cleanup() && all_passed;
+    all_passed = test_call_batch_subscribe() && all_passed;
+    all_passed = test_call_delta_sync() && all_passed;
     
     if (all_passed) {
         printf("All call tests passed! ✓\n\n");
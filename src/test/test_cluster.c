@@ -0,0 +1,125 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#include "../cluster.h"
+#include "../call.h"
+#include "../connection.h"
+#include "../protocol.h"
+#include "../test_common.h"
+
+static void make_nodes(ClusterNode* nodes, int count) {
+    char text[64];
+    for (int n = 0; n < count; n++) {
+        snprintf(text, sizeof(text), "127.0.0.1:%d:%d", 24300 + 2 * n, 24301 + 2 * n);
+        cluster_parse_node(text, &nodes[n]);
+    }
+}
+
+bool test_cluster_ring_balance() {
+    TestContext ctx;
+    TEST_INIT(&ctx, "test_cluster_ring_balance");
+
+    ClusterNode nodes[4];
+    TEST_ASSERT(&ctx, cluster_parse_node("10.0.0.7:5000:5001:2", &nodes[0]) == 0, "Node with weight should parse");
+    TEST_ASSERT(&ctx, nodes[0].weight == 2 && ntohs(nodes[0].tcp_addr.sin_port) == 5000 && nodes[0].udp_port == 5001,
+                "Parsed node fields mismatch");
+    TEST_ASSERT(&ctx, cluster_parse_node("10.0.0.7:5000", &nodes[0]) != 0, "UDP port is required");
+    TEST_ASSERT(&ctx, cluster_parse_node("nohost:5000:5001", &nodes[0]) != 0, "Host must be an IPv4 address");
+
+    make_nodes(nodes, 3);
+    TEST_ASSERT(&ctx, cluster_init(nodes, 3, 0) == 0 && cluster_enabled(), "Three-node cluster should start");
+
+    uint32_t owned[4] = {0};
+    uint32_t owner_before[3000];
+    for (uint32_t id = 1; id <= 3000; id++) {
+        owner_before[id - 1] = cluster_owner_of(id * 7919);
+        owned[owner_before[id - 1]]++;
+    }
+    uint32_t shares = 0;
+    for (int n = 0; n < 3; n++) {
+        TEST_ASSERT(&ctx, owned[n] > 800 && owned[n] < 1200, "Node %d owns %u of 3000 calls", n, owned[n]);
+        shares += cluster_ring_share((uint32_t)n);
+    }
+    TEST_ASSERT(&ctx, shares >= 995 && shares <= 1000, "Ring shares should add up to 100%%, got %u", shares);
+
+    // Четвертый узел забирает примерно четверть звонков и только себе
+    make_nodes(nodes, 4);
+    cluster_init(nodes, 4, 0);
+    uint32_t moved = 0;
+    for (uint32_t id = 1; id <= 3000; id++) {
+        uint32_t owner = cluster_owner_of(id * 7919);
+        if (owner != owner_before[id - 1]) {
+            TEST_ASSERT(&ctx, owner == 3, "Call %u moved between old nodes", id * 7919);
+            moved++;
+        }
+    }
+    TEST_ASSERT(&ctx, moved > 550 && moved < 950, "About a quarter of calls should move, got %u", moved);
+
+    cluster_shutdown();
+    TEST_ASSERT(&ctx, !cluster_enabled() && cluster_owns_call(12345), "Without cluster every call is local");
+    TEST_REPORT(&ctx, "test_cluster_ring_balance");
+}
+
+bool test_cluster_redirects_foreign_join() {
+    TestContext ctx;
+    TEST_INIT(&ctx, "test_cluster_redirects_foreign_join");
+
+    ClusterNode nodes[2];
+    make_nodes(nodes, 2);
+    cluster_init(nodes, 2, 0);
+
+    // Новые звонки этого узла берут ID из его части кольца
+    for (int i = 0; i < 20; i++) {
+        Call* call = call_new(0);
+        TEST_ASSERT(&ctx, call && cluster_owns_call(call->call_id), "Created call should be owned by this node");
+        call_delete(call);
+    }
+
+    uint32_t foreign = 1;
+    while (cluster_owns_call(foreign)) foreign++;
+
+    int fds[2];
+    TEST_ASSERT(&ctx, socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0, "socketpair failed");
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    Connection* conn = connection_new(fds[0], &addr);
+
+    CallJoinPayload join = { .call_id = htonl(foreign) };
+    handle_call_join(conn, &join);
+
+    uint8_t message[1 + sizeof(CallRedirectPayload)];
+    TEST_ASSERT(&ctx, recv(fds[1], message, sizeof(message), MSG_DONTWAIT) == (ssize_t)sizeof(message),
+                "Redirect message expected");
+    CallRedirectPayload redirect;
+    memcpy(&redirect, message + 1, sizeof(redirect));
+    TEST_ASSERT(&ctx, message[0] == SERVER_CALL_REDIRECT, "Wrong message type 0x%02x", message[0]);
+    TEST_ASSERT(&ctx, ntohl(redirect.call_id) == foreign, "Redirect should carry the call id");
+    TEST_ASSERT(&ctx, ntohs(redirect.tcp_port) == 24302 && ntohs(redirect.udp_port) == 24303 &&
+                redirect.node_addr == htonl(INADDR_LOOPBACK), "Redirect should point at node 1");
+    TEST_ASSERT(&ctx, cluster_redirects() == 1, "Redirect should be counted");
+    TEST_ASSERT(&ctx, conn->calls[0] == NULL, "Redirected connection should not join anything");
+
+    cluster_shutdown();
+    close(fds[1]);
+    TEST_REPORT(&ctx, "test_cluster_redirects_foreign_join");
+}
+
+bool run_all_cluster_tests() {
+    printf("Running cluster tests...\n\n");
+
+    bool all_passed = true;
+    all_passed = test_cluster_ring_balance() && all_passed;
+    all_passed = test_cluster_redirects_foreign_join() && all_passed;
+
+    if (all_passed) {
+        printf("All cluster tests passed! ✓\n\n");
+    } else {
+        printf("Some cluster tests failed! ✗\n\n");
+    }
+
+    return all_passed;
+}
@@ -316,6 +316,35 @@ TEST_ASSERT(&ctx, integrity_ok, "System integrity check failed after test");
     TEST_REPORT(&ctx, "test_connection_close_all");
 }
 
+bool test_connection_write_overflow() {
+    TestContext ctx;
+    TEST_INIT(&ctx, "test_connection_write_overflow");
+
+    int pair[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, pair);
+    Connection* conn = make_conn(pair[0]);
+    uint8_t message[5] = { 0x90, 0, 0, 0, 1 };
+
+    TEST_ASSERT(&ctx, connection_send_message(conn, message, sizeof(message)) > 0 &&
+                recv(pair[1], message, sizeof(message), MSG_DONTWAIT) == sizeof(message), "Message should be sent");
+
+    // Клиент не читает: буфер записи почти полон, следующее сообщение не влезает
+    conn->write_buffer.position = BUFFER_SIZE - 2;
+    TEST_ASSERT(&ctx, connection_queue_message(conn, message, sizeof(message)) == -1, "Overflow should fail");
+    TEST_ASSERT(&ctx, conn->write_overflow, "Connection should be marked as overflowed");
+    TEST_ASSERT(&ctx, recv(pair[1], message, sizeof(message), MSG_DONTWAIT) == 0, "Client should see the close");
+
+    // Дальше ничего не ставится, даже когда место появилось
+    conn->write_buffer.position = 0;
+    TEST_ASSERT(&ctx, connection_queue_message(conn, message, sizeof(message)) == -1,
+                "Overflowed connection should not take messages");
+
+    connection_delete(conn);
+    close(pair[1]);
+
+    TEST_REPORT(&ctx, "test_connection_write_overflow");
+}
+
 bool run_all_connection_tests() {
     printf("Running connection tests...\n\n");
     
@@ -326,6 +355,7 @@ bool run_all_connection_tests() {
     all_passed = test_connection_udp_management() && all_passed;
     all_passed = test_connection_delete_cleanup() && all_passed;
     all_passed = test_connection_close_all() && all_passed;
+    all_passed = test_connection_write_overflow() && all_passed;
     
     if (all_passed) {
         printf("All connection tests passed! ✓\n\n");
@@ -0,0 +1,161 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "../control.h"
+#include "../network.h"
+#include "../protocol.h"
+#include "../test_common.h"
+
+extern int g_epoll_fd;
+
+// Поток управления работает асинхронно: ждем нужной глубины очереди команд
+static bool wait_backlog(uint32_t count) {
+    for (int i = 0; i < 2000; i++) {
+        if (control_plane_backlog() >= count) return true;
+        usleep(1000);
+    }
+    return false;
+}
+
+bool test_control_plane_applies_commands() {
+    TestContext ctx;
+    TEST_INIT(&ctx, "test_control_plane_applies_commands");
+
+    int listen_fd = create_tcp_server(0);
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    getsockname(listen_fd, (struct sockaddr*)&addr, &addr_len);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    int saved_epoll_fd = g_epoll_fd;
+    g_epoll_fd = create_epoll_fd();
+    TEST_ASSERT(&ctx, control_plane_start(listen_fd) == 0, "Control plane should start");
+
+    // Соединение и одно сообщение: в очереди ACCEPT и MESSAGE, объекты еще не тронуты
+    int client = socket(AF_INET, SOCK_STREAM, 0);
+    TEST_ASSERT(&ctx, connect(client, (struct sockaddr*)&addr, sizeof(addr)) == 0, "Client should connect");
+    uint8_t message = CLIENT_CALL_CREATE;
+    TEST_ASSERT(&ctx, write(client, &message, 1) == 1, "Client should send a message");
+    TEST_ASSERT(&ctx, wait_backlog(2), "Accept and message should be queued");
+    TEST_ASSERT(&ctx, HASH_COUNT(connections) == 0, "Main loop state should not change before apply");
+
+    // Бюджет ограничивает число команд за итерацию
+    TEST_ASSERT(&ctx, control_plane_apply(1) == 1, "Budget of one should apply one command");
+    TEST_ASSERT(&ctx, HASH_COUNT(connections) == 1, "Connection should exist after accept");
+    TEST_ASSERT(&ctx, control_plane_apply(CONTROL_COMMANDS_PER_TICK) == 1, "Message should be applied");
+    TEST_ASSERT(&ctx, HASH_COUNT(calls) == 1, "Call should be created by the message");
+
+    // Ответы основной цикл пишет в сокет сам
+    uint8_t reply[64];
+    usleep(10000);
+    ssize_t n = read(client, reply, sizeof(reply));
+    TEST_ASSERT(&ctx, n > 0 && reply[0] == SERVER_HANDSHAKE_START, "Client should receive handshake start");
+
+    // Закрытие клиентом: соединение удаляется, сокет освобождает поток управления
+    close(client);
+    TEST_ASSERT(&ctx, wait_backlog(1), "Close should be queued");
+    control_plane_apply(CONTROL_COMMANDS_PER_TICK);
+    TEST_ASSERT(&ctx, HASH_COUNT(connections) == 0, "Connection should be deleted after close");
+
+    ControlStats stats = control_plane_stats();
+    TEST_ASSERT(&ctx, stats.accepted == 1 && stats.messages == 1 && stats.closed == 1 && stats.applied == 3,
+                "Stats should count one accept, message and close");
+
+    control_plane_stop();
+    TEST_ASSERT(&ctx, !control_plane_running(), "Control plane should stop");
+    close(listen_fd);
+    close(g_epoll_fd);
+    g_epoll_fd = saved_epoll_fd;
+    TEST_REPORT(&ctx, "test_control_plane_applies_commands");
+}
+
+// Маска событий fd в epoll_fd по /proc/self/fdinfo (0 - fd не зарегистрирован)
+static uint32_t epoll_interest(int epoll_fd, int fd) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/self/fdinfo/%d", epoll_fd);
+    FILE* info = fopen(path, "r");
+    if (!info) return 0;
+
+    char line[256];
+    uint32_t events = 0;
+    while (fgets(line, sizeof(line), info)) {
+        int tfd;
+        unsigned int mask;
+        if (sscanf(line, "tfd: %d events: %x", &tfd, &mask) == 2 && tfd == fd) {
+            events = mask;
+            break;
+        }
+    }
+    fclose(info);
+    return events;
+}
+
+// С потоком управления досылка после EAGAIN не взводит EPOLLIN в основном epoll:
+// входящие данные там никто не читает, и каждое пробуждение было бы впустую
+bool test_control_flush_keeps_reads_off_main_loop() {
+    TestContext ctx;
+    TEST_INIT(&ctx, "test_control_flush_keeps_reads_off_main_loop");
+
+    int listen_fd = create_tcp_server(0);
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    getsockname(listen_fd, (struct sockaddr*)&addr, &addr_len);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    int saved_epoll_fd = g_epoll_fd;
+    g_epoll_fd = create_epoll_fd();
+    TEST_ASSERT(&ctx, control_plane_start(listen_fd) == 0, "Control plane should start");
+
+    int client = socket(AF_INET, SOCK_STREAM, 0);
+    int small = 4096;
+    setsockopt(client, SOL_SOCKET, SO_RCVBUF, &small, sizeof(small));
+    TEST_ASSERT(&ctx, connect(client, (struct sockaddr*)&addr, sizeof(addr)) == 0, "Client should connect");
+    TEST_ASSERT(&ctx, wait_backlog(1), "Accept should be queued");
+    control_plane_apply(CONTROL_COMMANDS_PER_TICK);
+    Connection* conn = connections;
+    TEST_ASSERT(&ctx, conn != NULL, "Connection should exist after accept");
+
+    // Клиент не читает: сокет заполняется, досылка ждет EPOLLOUT
+    setsockopt(conn->fd, SOL_SOCKET, SO_SNDBUF, &small, sizeof(small));
+    uint8_t chunk[512] = { 0 };
+    int result = 0;
+    for (int i = 0; i < 1000 && result != -2; i++) {
+        connection_queue_message(conn, chunk, sizeof(chunk));
+        result = connection_flush(conn);
+    }
+    TEST_ASSERT(&ctx, result == -2, "Socket should fill up");
+
+    uint32_t events = epoll_interest(g_epoll_fd, conn->fd);
+    TEST_ASSERT(&ctx, (events & EPOLLOUT) && !(events & EPOLLIN),
+                "Main epoll should wait for EPOLLOUT only, got 0x%x", events);
+
+    close(client);
+    TEST_ASSERT(&ctx, wait_backlog(1), "Close should be queued");
+    control_plane_apply(CONTROL_COMMANDS_PER_TICK);
+    TEST_ASSERT(&ctx, HASH_COUNT(connections) == 0, "Connection should be deleted after close");
+
+    control_plane_stop();
+    close(listen_fd);
+    close(g_epoll_fd);
+    g_epoll_fd = saved_epoll_fd;
+    TEST_REPORT(&ctx, "test_control_flush_keeps_reads_off_main_loop");
+}
+
+bool run_all_control_tests() {
+    printf("Running control plane tests...\n\n");
+
+    bool all_passed = true;
+    all_passed = test_control_plane_applies_commands() && all_passed;
+    all_passed = test_control_flush_keeps_reads_off_main_loop() && all_passed;
+
+    if (all_passed) {
+        printf("All control plane tests passed! ✓\n\n");
+    } else {
+        printf("Some control plane tests failed! ✗\n\n");
+    }
+
+    return all_passed;
+}
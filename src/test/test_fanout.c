@@ -0,0 +1,240 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <arpa/inet.h>
+
+#include "../fanout.h"
+#include "../stream.h"
+#include "../connection.h"
+#include "../packet_pool.h"
+#include "../pacer.h"
+#include "../time_utils.h"
+#include "../test_common.h"
+
+// Зритель с UDP-адресом: сокет получателя, если он нужен, иначе фиктивный порт
+static Connection* make_viewer(int udp_fd, uint16_t port) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+
+    if (udp_fd >= 0) {
+        socklen_t addr_len = sizeof(addr);
+        getsockname(udp_fd, (struct sockaddr*)&addr, &addr_len);
+    } else {
+        addr.sin_port = htons(port);
+    }
+
+    Connection* conn = connection_new(socket(AF_INET, SOCK_STREAM, 0), &addr);
+    if (conn) connection_set_udp_addr(conn, &addr);
+    return conn;
+}
+
+static int bound_udp_socket(void) {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    bind(fd, (struct sockaddr*)&addr, sizeof(addr));
+
+    struct timeval timeout = {1, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    return fd;
+}
+
+static void part_sizes(const Stream* stream, uint32_t* sizes) {
+    memset(sizes, 0, sizeof(uint32_t) * FANOUT_MAX_THREADS);
+    for (int i = 0; i < STREAM_MAX_RECIPIENTS; i++) {
+        if (stream->recipients[i]) sizes[stream->recipient_state[i].fanout_thread]++;
+    }
+}
+
+bool test_fanout_partitions_balance() {
+    TestContext ctx;
+    TEST_INIT(&ctx, "test_fanout_partitions_balance");
+
+    int send_fd = bound_udp_socket();
+    TEST_ASSERT(&ctx, fanout_start(3, send_fd) == 0, "Fan-out threads should start");
+    TEST_ASSERT(&ctx, fanout_thread_count() == 3, "Three threads expected");
+
+    Connection* owner = make_viewer(-1, 9000);
+    Stream* stream = stream_new(500, owner, NULL);
+    Connection* viewers[9];
+    for (int i = 0; i < 9; i++) {
+        viewers[i] = make_viewer(-1, (uint16_t)(9001 + i));
+        TEST_ASSERT(&ctx, stream_add_recipient(stream, viewers[i]) == 0, "Viewer %d should be added", i);
+    }
+    TEST_ASSERT(&ctx, fanout_stream_eligible(stream), "Nine viewers are enough for fan-out");
+
+    uint32_t sizes[FANOUT_MAX_THREADS];
+    part_sizes(stream, sizes);
+    TEST_ASSERT(&ctx, sizes[0] == 3 && sizes[1] == 3 && sizes[2] == 3,
+                "Parts should be 3/3/3, got %u/%u/%u", sizes[0], sizes[1], sizes[2]);
+
+    // Уходят все зрители одной части - остальные перераспределяются
+    Connection* leaving[STREAM_MAX_RECIPIENTS];
+    int leaving_count = 0;
+    for (int i = 0; i < STREAM_MAX_RECIPIENTS; i++) {
+        if (stream->recipients[i] && stream->recipient_state[i].fanout_thread == 0) {
+            leaving[leaving_count++] = stream->recipients[i];
+        }
+    }
+    for (int i = 0; i < leaving_count; i++) {
+        stream_remove_recipient(stream, leaving[i]);
+    }
+    part_sizes(stream, sizes);
+    TEST_ASSERT(&ctx, sizes[0] + sizes[1] + sizes[2] == 6, "Six viewers should remain");
+    TEST_ASSERT(&ctx, sizes[0] == 2 && sizes[1] == 2 && sizes[2] == 2,
+                "Parts should be rebalanced to 2/2/2, got %u/%u/%u", sizes[0], sizes[1], sizes[2]);
+    TEST_ASSERT(&ctx, !fanout_stream_eligible(stream), "Six viewers are below the fan-out threshold");
+
+    stream_delete(stream);
+    fanout_stop();
+    TEST_ASSERT(&ctx, !fanout_enabled(), "Fan-out should be off after stop");
+    close(send_fd);
+    TEST_REPORT(&ctx, "test_fanout_partitions_balance");
+}
+
+bool test_fanout_submit_delivers() {
+    TestContext ctx;
+    TEST_INIT(&ctx, "test_fanout_submit_delivers");
+
+    int send_fd = bound_udp_socket();
+    TEST_ASSERT(&ctx, fanout_start(2, send_fd) == 0, "Fan-out threads should start");
+
+    int receivers[4];
+    Connection* viewers[4];
+    FanoutBatch batch;
+    fanout_batch_init(&batch);
+    for (int i = 0; i < 4; i++) {
+        receivers[i] = bound_udp_socket();
+        viewers[i] = make_viewer(receivers[i], 0);
+        fanout_batch_add(&batch, (uint8_t)(i % 2), viewers[i]);
+    }
+    TEST_ASSERT(&ctx, !fanout_batch_empty(&batch), "Batch should hold recipients");
+
+    const char payload[] = "fan-out payload";
+    PacketBuf* buf = packet_buf_from(payload, sizeof(payload));
+    fanout_submit(&batch, buf);
+    TEST_ASSERT(&ctx, buf->refcount == 3, "Each thread job should hold a reference, got %u", buf->refcount);
+    fanout_flush();
+
+    for (int i = 0; i < 4; i++) {
+        char data[64];
+        ssize_t received = recv(receivers[i], data, sizeof(data), 0);
+        TEST_ASSERT(&ctx, received == (ssize_t)sizeof(payload) && memcmp(data, payload, sizeof(payload)) == 0,
+                    "Receiver %d should get the packet", i);
+    }
+
+    // Задания возвращаются потоку приема после отправки
+    for (int attempt = 0; attempt < 100 && buf->refcount > 1; attempt++) {
+        fanout_collect();
+        usleep(1000);
+    }
+    TEST_ASSERT(&ctx, buf->refcount == 1, "Job references should be released, got %u", buf->refcount);
+
+    FanoutStats stats = fanout_thread_stats(0);
+    TEST_ASSERT(&ctx, stats.jobs == 1 && stats.sends == 2, "Thread 0 should send one job to two recipients");
+    TEST_ASSERT(&ctx, stats.syscalls == 1, "Two recipients should take one sendmmsg, got %lu",
+                (unsigned long)stats.syscalls);
+
+    packet_buf_release(buf);
+    fanout_stop();
+    for (int i = 0; i < 4; i++) {
+        close(receivers[i]);
+    }
+    close(send_fd);
+    TEST_REPORT(&ctx, "test_fanout_submit_delivers");
+}
+
+static int order_sends = 0;
+
+static int order_mock_send(const void* data, size_t len, const struct sockaddr_in* dest_addr, uint8_t media_class) {
+    (void)data; (void)dest_addr; (void)media_class;
+    order_sends++;
+    return (int)len;
+}
+
+bool test_fanout_keeps_recipient_order() {
+    TestContext ctx;
+    TEST_INIT(&ctx, "test_fanout_keeps_recipient_order");
+
+    int send_fd = bound_udp_socket();
+    TEST_ASSERT(&ctx, fanout_start(1, send_fd) == 0, "Fan-out thread should start");
+    usleep(10000);  // поток засыпает до fanout_flush
+    pacer_set_send_fn(order_mock_send);
+    order_sends = 0;
+
+    int receiver = bound_udp_socket();
+    Connection* viewer = make_viewer(receiver, 0);
+    connection_set_udp_handshake_complete(viewer);
+
+    const char payload[] = "fan-out first";
+    PacketBuf* first = packet_buf_from(payload, sizeof(payload));
+    PacketBuf* second = packet_buf_from(payload, sizeof(payload));
+    uint64_t now_us = monotonic_us();
+
+    FanoutBatch batch;
+    fanout_batch_init(&batch);
+    TEST_ASSERT(&ctx, fanout_recipient_ready(viewer, 0, first->len, now_us),
+                "Empty pacer queue should let the packet go to the thread");
+    fanout_batch_add(&batch, 0, viewer);
+    fanout_submit(&batch, first);
+
+    // Следующий пакет того же получателя идет через пейсинг и ждет задания потока
+    connection_send_udp(viewer, second);
+    pacer_flush(now_us);
+    TEST_ASSERT(&ctx, order_sends == 0 && pacer_queue_depth(viewer->pacer) == 1,
+                "Pacer should hold the packet behind the fan-out job");
+
+    fanout_flush();
+    char data[64];
+    TEST_ASSERT(&ctx, recv(receiver, data, sizeof(data), 0) == (ssize_t)sizeof(payload),
+                "Thread should send the first packet");
+    for (int attempt = 0; attempt < 100 && order_sends == 0; attempt++) {
+        usleep(1000);
+        pacer_run(monotonic_us());
+    }
+    TEST_ASSERT(&ctx, order_sends == 1 && pacer_queue_depth(viewer->pacer) == 0,
+                "Held packet should follow once the job is sent");
+
+    // Пакеты потоков оплачивает тот же token bucket: корзины хватает на один
+    pacer_queue_set_rate(viewer->pacer, 1000, 0);
+    now_us = monotonic_us();
+    TEST_ASSERT(&ctx, fanout_recipient_ready(viewer, 0, 1000, now_us), "Full bucket should pay for one packet");
+    TEST_ASSERT(&ctx, !fanout_recipient_ready(viewer, 0, 1000, now_us), "Next packet should wait for tokens");
+    TEST_ASSERT(&ctx, viewer->pacer->stats.sent_direct == 2, "Two packets should be charged, got %lu",
+                (unsigned long)viewer->pacer->stats.sent_direct);
+
+    for (int attempt = 0; attempt < 100 && first->refcount > 1; attempt++) {
+        fanout_collect();
+        usleep(1000);
+    }
+    packet_buf_release(first);
+    packet_buf_release(second);
+    pacer_set_send_fn(NULL);
+    fanout_stop();
+    close(receiver);
+    close(send_fd);
+    TEST_REPORT(&ctx, "test_fanout_keeps_recipient_order");
+}
+
+bool run_all_fanout_tests() {
+    printf("Running fan-out tests...\n\n");
+
+    bool all_passed = true;
+    all_passed = test_fanout_partitions_balance() && all_passed;
+    all_passed = test_fanout_submit_delivers() && all_passed;
+    all_passed = test_fanout_keeps_recipient_order() && all_passed;
+
+    if (all_passed) {
+        printf("All fan-out tests passed! ✓\n\n");
+    } else {
+        printf("Some fan-out tests failed! ✗\n\n");
+    }
+
+    return all_passed;
+}
@@ -0,0 +1,302 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <arpa/inet.h>
+
+#include "../handoff.h"
+#include "../snapshot.h"
+#include "../network.h"
+#include "../protocol.h"
+#include "../call.h"
+#include "../stream.h"
+#include "../connection.h"
+#include "../time_utils.h"
+#include "../test_common.h"
+
+static Connection* handoff_client(int fd, uint16_t udp_port) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(udp_port);
+
+    Connection* conn = connection_new(fd, &addr);
+    connection_set_udp_addr(conn, &addr);
+    connection_set_udp_handshake_complete(conn);
+    return conn;
+}
+
+bool test_snapshot_restores_registries() {
+    TestContext ctx;
+    TEST_INIT(&ctx, "test_snapshot_restores_registries");
+
+    int pairs[3][2];
+    for (int i = 0; i < 3; i++) {
+        socketpair(AF_UNIX, SOCK_STREAM, 0, pairs[i]);
+    }
+    Connection* owner = handoff_client(pairs[0][0], 41000);
+    Connection* viewer = handoff_client(pairs[1][0], 41001);
+    Connection* lurker = handoff_client(pairs[2][0], 41002);
+
+    Call* call = call_new(777);
+    call_add_participant(call, owner);
+    call_add_participant(call, viewer);
+    call_set_mixing(call, true);
+    call->mix_stream_id = 4242;
+    call->mix_sequence = 99;
+
+    Stream* stream = stream_new(555, owner, call);
+    stream->media_class = MEDIA_CLASS_AUDIO;
+    stream_add_recipient(stream, viewer);
+    stream->recipient_state[0].simulcast.number_offset = 1234;
+    stream->recipient_state[0].simulcast.has_output = true;
+    Stream* open_stream = stream_new(556, lurker, NULL);
+    stream_add_recipient(open_stream, viewer);
+
+    // Половина сообщения в чтении и неотправленный хвост в записи
+    viewer->read_buffer.data[0] = 0x42;
+    viewer->read_buffer.position = 1;
+    memcpy(lurker->write_buffer.data, "tail", 4);
+    lurker->write_buffer.position = 4;
+
+    SnapshotBlob blob = {0};
+    TEST_ASSERT(&ctx, snapshot_encode(&blob) == 0 && blob.len > 0, "Snapshot should encode");
+
+    // "Новый процесс": реестры пусты, сокеты открыты под теми же номерами
+    int saved[3];
+    for (int i = 0; i < 3; i++) saved[i] = fcntl(pairs[i][0], F_DUPFD, 100);
+    connection_close_all();
+    call_delete(call_find_by_id(777));
+    for (int i = 0; i < 3; i++) {
+        dup2(saved[i], pairs[i][0]);
+        close(saved[i]);
+    }
+    TEST_ASSERT(&ctx, HASH_COUNT(connections) == 0 && HASH_COUNT(streams) == 0 && HASH_COUNT(calls) == 0,
+                "Registries should be empty before restore");
+
+    SnapshotCounts counts;
+    int result = snapshot_restore(blob.data, blob.len, false, &counts);
+    snapshot_blob_free(&blob);
+    TEST_ASSERT(&ctx, result == 0, "Restore failed: %d", result);
+    TEST_ASSERT(&ctx, counts.connections == 3 && counts.calls == 1 && counts.streams == 2 && counts.memberships == 4 &&
+                counts.skipped == 0, "Counts mismatch: %u conns, %u calls, %u streams, %u memberships, %u skipped",
+                counts.connections, counts.calls, counts.streams, counts.memberships, counts.skipped);
+
+    owner = connection_find(pairs[0][0]);
+    viewer = connection_find(pairs[1][0]);
+    lurker = connection_find(pairs[2][0]);
+    call = call_find_by_id(777);
+    stream = stream_find_by_id(555);
+    open_stream = stream_find_by_id(556);
+    TEST_ASSERT(&ctx, owner && viewer && lurker && call && stream && open_stream, "Objects should be restored");
+    TEST_ASSERT(&ctx, ntohs(viewer->udp_addr.sin_port) == 41001 && viewer->udp_handshake_complete,
+                "UDP address and handshake should survive");
+    TEST_ASSERT(&ctx, call_has_participant(call, owner) && call_has_participant(call, viewer) &&
+                connection_is_in_call(viewer, call), "Call membership should be restored on both sides");
+    TEST_ASSERT(&ctx, call->mixing && call->mix_stream_id == 4242 && call->mix_sequence == 99,
+                "Mix should continue with the same stream id and numbering");
+    TEST_ASSERT(&ctx, stream->owner == owner && stream->call == call && call_has_stream(call, stream) &&
+                stream->media_class == MEDIA_CLASS_AUDIO, "Private stream should be restored");
+    int index = DENSE_ARRAY_INDEX_OF(stream->recipients, STREAM_MAX_RECIPIENTS, viewer);
+    TEST_ASSERT(&ctx, index >= 0 && stream->recipient_state[index].simulcast.number_offset == 1234,
+                "Recipient numbering offset should survive");
+    TEST_ASSERT(&ctx, open_stream->call == NULL && stream_has_recipient(open_stream, viewer) &&
+                connection_is_watching_stream(viewer, open_stream), "Public stream subscription should be restored");
+    TEST_ASSERT(&ctx, viewer->read_buffer.position == 1 && viewer->read_buffer.data[0] == 0x42,
+                "Partial message should be kept");
+    TEST_ASSERT(&ctx, lurker->write_buffer.position == 4 && memcmp(lurker->write_buffer.data, "tail", 4) == 0,
+                "Unsent bytes should be kept");
+
+    // Испорченный снимок не принимается
+    uint8_t junk[16] = {0};
+    TEST_ASSERT(&ctx, snapshot_restore(junk, sizeof(junk), false, &counts) < 0, "Bad magic should be rejected");
+
+    connection_close_all();
+    call_delete(call_find_by_id(777));
+    for (int i = 0; i < 3; i++) close(pairs[i][1]);
+
+    TEST_REPORT(&ctx, "test_snapshot_restores_registries");
+}
+
+bool test_snapshot_file_resume() {
+    TestContext ctx;
+    TEST_INIT(&ctx, "test_snapshot_file_resume");
+
+    const char* path = "/tmp/lab3server_test_snapshot.bin";
+    unlink(path);
+    SnapshotCounts counts;
+    TEST_ASSERT(&ctx, snapshot_load(path, &counts) == 1, "Missing file should mean nothing to restore");
+
+    int pairs[3][2];
+    for (int i = 0; i < 3; i++) {
+        socketpair(AF_UNIX, SOCK_STREAM, 0, pairs[i]);
+    }
+    Connection* owner = handoff_client(pairs[0][0], 42000);
+    Connection* viewer = handoff_client(pairs[1][0], 42001);
+    int owner_id = owner->fd;
+    int viewer_id = viewer->fd;
+
+    // Токен для возобновления клиент запрашивает заранее
+    uint8_t reply[1 + sizeof(ResumeTokenPayload)];
+    handle_resume_token(owner);
+    TEST_ASSERT(&ctx, recv(pairs[0][1], reply, sizeof(reply), MSG_DONTWAIT) == sizeof(reply) &&
+                reply[0] == SERVER_RESUME_TOKEN && owner->resume_token != 0, "Owner should get a resume token");
+    ResumeTokenPayload token;
+    memcpy(&token, reply + 1, sizeof(token));
+    TEST_ASSERT(&ctx, ntohl(token.connection_id) == (uint32_t)owner_id && token.token == owner->resume_token,
+                "Token reply should carry the connection id and token");
+
+    Call* call = call_new(888);
+    call_add_participant(call, owner);
+    call_add_participant(call, viewer);
+    Stream* stream = stream_new(600, owner, call);
+    stream_add_recipient(stream, viewer);
+
+    TEST_ASSERT(&ctx, snapshot_save(path) > 0, "Snapshot file should be written");
+
+    // "Падение": процесс и сокеты пропали, остался файл
+    connection_close_all();
+    call_delete(call_find_by_id(888));
+    TEST_ASSERT(&ctx, snapshot_load(path, &counts) == 0, "Snapshot file should load");
+    TEST_ASSERT(&ctx, counts.connections == 2 && counts.detached == 2 && counts.calls == 1 && counts.streams == 1,
+                "Counts mismatch: %u conns (%u detached), %u calls, %u streams",
+                counts.connections, counts.detached, counts.calls, counts.streams);
+    call = call_find_by_id(888);
+    stream = stream_find_by_id(600);
+    Connection* old_owner = connection_find(SNAPSHOT_DETACHED_FD(owner_id));
+    Connection* old_viewer = connection_find(SNAPSHOT_DETACHED_FD(viewer_id));
+    TEST_ASSERT(&ctx, call && stream && old_owner && old_viewer && stream->owner == old_owner &&
+                stream_has_recipient(stream, old_viewer), "Detached state should be restored");
+    TEST_ASSERT(&ctx, ntohs(old_viewer->udp_addr.sin_port) == 42001, "Media should keep going to the saved address");
+
+    // Клиент переподключился и забирает прежнее состояние одним сообщением
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    Connection* resumed = connection_new(pairs[2][0], &addr);
+    // Номер соединения угадать легко, токен - нет; без токена не отдается и зритель
+    ConnResumePayload payload = { .connection_id = htonl((uint32_t)owner_id), .token = token.token + 1 };
+    handle_conn_resume(resumed, &payload);
+    ConnResumePayload viewer_payload = { .connection_id = htonl((uint32_t)viewer_id), .token = 0 };
+    handle_conn_resume(resumed, &viewer_payload);
+    TEST_ASSERT(&ctx, stream->owner == old_owner && stream_has_recipient(stream, old_viewer) &&
+                !connection_is_in_call(resumed, call), "Resume without the right token should be refused");
+
+    payload.token = token.token;
+    handle_conn_resume(resumed, &payload);
+    TEST_ASSERT(&ctx, connection_find(SNAPSHOT_DETACHED_FD(owner_id)) == NULL, "Detached owner should be gone");
+    TEST_ASSERT(&ctx, call_has_participant(call, resumed) && connection_is_in_call(resumed, call) &&
+                stream->owner == resumed && resumed->udp_handshake_complete,
+                "Call, stream and UDP address should move to the new connection");
+    TEST_ASSERT(&ctx, resumed->resume_token == token.token, "Token should move to the new connection");
+
+    // Второй раз то же состояние не отдается
+    handle_conn_resume(resumed, &payload);
+    TEST_ASSERT(&ctx, stream->owner == resumed, "Repeated resume should change nothing");
+
+    // Не вернувшийся зритель удаляется после окна ожидания
+    snapshot_expire_detached(monotonic_ms() + SNAPSHOT_RESUME_GRACE_MS + 1);
+    TEST_ASSERT(&ctx, connection_find(SNAPSHOT_DETACHED_FD(viewer_id)) == NULL && !stream_has_recipient(stream, old_viewer) &&
+                !call_has_participant(call, old_viewer), "Expired connection should leave call and stream");
+    TEST_ASSERT(&ctx, snapshot_stats().detached == 0, "Nobody should be awaiting resume");
+
+    connection_close_all();
+    call_delete(call_find_by_id(888));
+    for (int i = 0; i < 3; i++) close(pairs[i][1]);
+    unlink(path);
+
+    TEST_REPORT(&ctx, "test_snapshot_file_resume");
+}
+
+// Преемник в дочернем процессе: сокеты должны прийти под прежними номерами
+static int handoff_successor(const char* path, const int* fds, int count, const char* expected) {
+    for (int i = 0; i < count; i++) close(fds[i]);
+
+    HandoffTakeover takeover;
+    if (handoff_receive(path, &takeover) != 0) return 1;
+    if (takeover.tcp_fd != fds[0] || takeover.udp_fd != fds[1]) return 2;
+    if (takeover.snapshot_len != strlen(expected) || memcmp(takeover.snapshot, expected, takeover.snapshot_len) != 0) {
+        return 3;
+    }
+    for (int i = 0; i < count; i++) {
+        if (write(fds[i], "x", 1) != 1) return 4;
+    }
+    return handoff_confirm(&takeover) == 0 ? 0 : 5;
+}
+
+bool test_handoff_passes_sockets() {
+    TestContext ctx;
+    TEST_INIT(&ctx, "test_handoff_passes_sockets");
+
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/sfu_handoff_test_%d.sock", (int)getpid());
+    int epoll_fd = create_epoll_fd();
+    TEST_ASSERT(&ctx, handoff_listen(path, epoll_fd) == 0, "Handoff socket should listen");
+
+    // Больше сокетов, чем помещается в одно сообщение SCM_RIGHTS
+    enum { COUNT = HANDOFF_FDS_PER_MESSAGE + 6 };
+    int ours[COUNT], peers[COUNT];
+    for (int i = 0; i < COUNT; i++) {
+        int pair[2];
+        socketpair(AF_UNIX, SOCK_STREAM, 0, pair);
+        ours[i] = pair[0];
+        peers[i] = pair[1];
+    }
+
+    const char* snapshot = "registries";
+    pid_t child = fork();
+    if (child == 0) {
+        for (int i = 0; i < COUNT; i++) close(peers[i]);
+        _exit(handoff_successor(path, ours, COUNT, snapshot));
+    }
+
+    struct pollfd pfd = { .fd = handoff_fd(), .events = POLLIN };
+    TEST_ASSERT(&ctx, poll(&pfd, 1, 2000) == 1, "Successor should connect");
+    int channel = handoff_accept();
+    TEST_ASSERT(&ctx, channel >= 0, "Successor should be accepted");
+    int result = handoff_send(channel, ours, COUNT, (const uint8_t*)snapshot, strlen(snapshot));
+    close(channel);
+
+    int status = 0;
+    waitpid(child, &status, 0);
+    TEST_ASSERT(&ctx, result == 0 && handoff_completed(), "Handoff should be confirmed: %d", result);
+    TEST_ASSERT(&ctx, WIFEXITED(status) && WEXITSTATUS(status) == 0, "Successor failed with %d", WEXITSTATUS(status));
+
+    // Каждый сокет дошел до преемника живым
+    int delivered = 0;
+    for (int i = 0; i < COUNT; i++) {
+        char byte = 0;
+        if (read(peers[i], &byte, 1) == 1 && byte == 'x') delivered++;
+        close(peers[i]);
+        close(ours[i]);
+    }
+    TEST_ASSERT(&ctx, delivered == COUNT, "Only %d of %d sockets reached the successor", delivered, COUNT);
+
+    handoff_stop();
+    unlink(path);
+    close(epoll_fd);
+
+    TEST_REPORT(&ctx, "test_handoff_passes_sockets");
+}
+
+bool run_all_handoff_tests() {
+    printf("Running handoff tests...\n\n");
+
+    bool all_passed = true;
+    all_passed = test_snapshot_restores_registries() && all_passed;
+    all_passed = test_snapshot_file_resume() && all_passed;
+    all_passed = test_handoff_passes_sockets() && all_passed;
+
+    if (all_passed) {
+        printf("All handoff tests passed! ✓\n\n");
+    } else {
+        printf("Some handoff tests failed! ✗\n\n");
+    }
+
+    return all_passed;
+}
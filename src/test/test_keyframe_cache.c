@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <string.h>
+#include "../keyframe_cache.h"
+#include "../test_common.h"
+
+static void make_packet(uint8_t* buf, uint32_t number) {
+    memset(buf, 0, UDP_PACKET_SIZE);
+    memcpy(buf, &number, sizeof(number));
+}
+
+bool test_keyframe_cache_waits_for_keyframe() {
+    TestContext ctx;
+    TEST_INIT(&ctx, "test_keyframe_cache_waits_for_keyframe");
+
+    KeyframeCache* cache = keyframe_cache_new();
+    TEST_ASSERT(&ctx, cache != NULL, "Cache should be allocated");
+
+    uint8_t packet[UDP_PACKET_SIZE];
+    make_packet(packet, 1);
+    keyframe_cache_push(cache, packet, 100, false);
+    TEST_ASSERT(&ctx, !keyframe_cache_is_valid(cache), "Cache should be empty before keyframe");
+    TEST_ASSERT(&ctx, keyframe_cache_count(cache) == 0, "Count should be 0 before keyframe");
+
+    make_packet(packet, 2);
+    keyframe_cache_push(cache, packet, 100, true);
+    make_packet(packet, 3);
+    keyframe_cache_push(cache, packet, 50, false);
+    TEST_ASSERT(&ctx, keyframe_cache_is_valid(cache), "Cache should be valid after keyframe");
+    TEST_ASSERT(&ctx, keyframe_cache_count(cache) == 2, "Should hold keyframe and delta");
+
+    const CachedPacket* first = keyframe_cache_get(cache, 0);
+    const CachedPacket* second = keyframe_cache_get(cache, 1);
+    uint32_t number = 0;
+    memcpy(&number, first->data, sizeof(number));
+    TEST_ASSERT(&ctx, number == 2 && first->len == 100, "First packet should be the keyframe");
+    memcpy(&number, second->data, sizeof(number));
+    TEST_ASSERT(&ctx, number == 3 && second->len == 50, "Second packet should keep its length");
+    TEST_ASSERT(&ctx, keyframe_cache_get(cache, 2) == NULL, "Out of range index should return NULL");
+
+    keyframe_cache_delete(cache);
+    TEST_REPORT(&ctx, "test_keyframe_cache_waits_for_keyframe");
+}
+
+bool test_keyframe_cache_new_keyframe_restarts() {
+    TestContext ctx;
+    TEST_INIT(&ctx, "test_keyframe_cache_new_keyframe_restarts");
+
+    KeyframeCache* cache = keyframe_cache_new();
+    uint8_t packet[UDP_PACKET_SIZE];
+
+    make_packet(packet, 1);
+    keyframe_cache_push(cache, packet, 100, true);
+    keyframe_cache_push(cache, packet, 100, false);
+    uint32_t generation = cache->generation;
+
+    make_packet(packet, 10);
+    keyframe_cache_push(cache, packet, 100, true);
+    TEST_ASSERT(&ctx, keyframe_cache_count(cache) == 1, "New keyframe should drop the old run");
+    TEST_ASSERT(&ctx, cache->generation != generation, "Generation should change on keyframe");
+
+    uint32_t number = 0;
+    memcpy(&number, keyframe_cache_get(cache, 0)->data, sizeof(number));
+    TEST_ASSERT(&ctx, number == 10, "Cache should start with the new keyframe");
+
+    keyframe_cache_delete(cache);
+    TEST_REPORT(&ctx, "test_keyframe_cache_new_keyframe_restarts");
+}
+
+bool test_keyframe_cache_overflow_invalidates() {
+    TestContext ctx;
+    TEST_INIT(&ctx, "test_keyframe_cache_overflow_invalidates");
+
+    KeyframeCache* cache = keyframe_cache_new();
+    uint8_t packet[UDP_PACKET_SIZE];
+    make_packet(packet, 1);
+
+    keyframe_cache_push(cache, packet, 64, true);
+    for (int i = 1; i < KEYFRAME_CACHE_MAX_PACKETS; i++) {
+        keyframe_cache_push(cache, packet, 64, false);
+    }
+    TEST_ASSERT(&ctx, keyframe_cache_count(cache) == KEYFRAME_CACHE_MAX_PACKETS, "Cache should be full");
+
+    keyframe_cache_push(cache, packet, 64, false);
+    TEST_ASSERT(&ctx, !keyframe_cache_is_valid(cache), "Overflowed run should be invalidated");
+
+    keyframe_cache_push(cache, packet, 64, false);
+    TEST_ASSERT(&ctx, keyframe_cache_count(cache) == 0, "Deltas after overflow should be ignored");
+
+    keyframe_cache_push(cache, packet, 64, true);
+    TEST_ASSERT(&ctx, keyframe_cache_count(cache) == 1, "Next keyframe should restart caching");
+
+    keyframe_cache_delete(cache);
+    TEST_REPORT(&ctx, "test_keyframe_cache_overflow_invalidates");
+}
+
+bool run_all_keyframe_cache_tests() {
+    printf("Running keyframe cache tests...\n\n");
+
+    bool all_passed = true;
+    all_passed = test_keyframe_cache_waits_for_keyframe() && all_passed;
+    all_passed = test_keyframe_cache_new_keyframe_restarts() && all_passed;
+    all_passed = test_keyframe_cache_overflow_invalidates() && all_passed;
+
+    if (all_passed) {
+        printf("All keyframe cache tests passed! ✓\n\n");
+    } else {
+        printf("Some keyframe cache tests failed! ✗\n\n");
+    }
+
+    return all_passed;
+}
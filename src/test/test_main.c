@@ -14,6 +14,21 @@ bool run_all_connection_tests();
 bool run_all_stream_tests();
 bool run_all_call_tests();
 bool run_all_integrity_tests();
+bool run_all_keyframe_cache_tests();
+bool run_all_pacer_tests();
+bool run_all_bwe_tests();
+bool run_all_simulcast_tests();
+bool run_all_speaker_tests();
+bool run_all_mixer_tests();
+bool run_all_seq_stats_tests();
+bool run_all_spsc_tests();
+bool run_all_control_tests();
+bool run_all_fanout_tests();
+bool run_all_trunk_tests();
+bool run_all_cluster_tests();
+bool run_all_handoff_tests();
+bool run_all_notify_tests();
+bool run_all_schema_tests();
 
 void handle_signal(int sig) {
     printf("\nReceived signal %d, stopping tests...\n", sig);
@@ -48,6 +63,51 @@ int main() {
     all_passed = run_all_call_tests() && all_passed;
     cleanup_globals();
     
+    all_passed = run_all_keyframe_cache_tests() && all_passed;
+    cleanup_globals();
+    
+    all_passed = run_all_pacer_tests() && all_passed;
+    cleanup_globals();
+    
+    all_passed = run_all_bwe_tests() && all_passed;
+    cleanup_globals();
+    
+    all_passed = run_all_simulcast_tests() && all_passed;
+    cleanup_globals();
+    
+    all_passed = run_all_speaker_tests() && all_passed;
+    cleanup_globals();
+    
+    all_passed = run_all_mixer_tests() && all_passed;
+    cleanup_globals();
+    
+    all_passed = run_all_seq_stats_tests() && all_passed;
+    cleanup_globals();
+    
+    all_passed = run_all_spsc_tests() && all_passed;
+    cleanup_globals();
+    
+    all_passed = run_all_control_tests() && all_passed;
+    cleanup_globals();
+    
+    all_passed = run_all_fanout_tests() && all_passed;
+    cleanup_globals();
+    
+    all_passed = run_all_trunk_tests() && all_passed;
+    cleanup_globals();
+    
+    all_passed = run_all_cluster_tests() && all_passed;
+    cleanup_globals();
+    
+    all_passed = run_all_handoff_tests() && all_passed;
+    cleanup_globals();
+    
+    all_passed = run_all_notify_tests() && all_passed;
+    cleanup_globals();
+
+    all_passed = run_all_schema_tests() && all_passed;
+    cleanup_globals();
+    
     // Integrity tests требуют особой осторожности
     //all_passed = run_all_integrity_tests() && all_passed;
     //cleanup_globals();
@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../mixer.h"
+#include "../test_common.h"
+
+static void fill_random(int16_t* samples, size_t count, int amplitude) {
+    for (size_t i = 0; i < count; i++) {
+        samples[i] = (int16_t)(rand() % (2 * amplitude + 1) - amplitude);
+    }
+}
+
+static bool kernel_matches_scalar(MixAddFn kernel, size_t count) {
+    int16_t acc[1000], src[1000], expected[1000];
+    fill_random(acc, count, 32767);
+    fill_random(src, count, 32767);
+    memcpy(expected, acc, sizeof(acc));
+
+    mix_add_s16_scalar(expected, src, count);
+    kernel(acc, src, count);
+    return memcmp(acc, expected, count * sizeof(int16_t)) == 0;
+}
+
+bool test_mix_kernels_match_scalar() {
+    TestContext ctx;
+    TEST_INIT(&ctx, "test_mix_kernels_match_scalar");
+
+    // Насыщение вместо переполнения
+    int16_t acc[2] = {30000, -30000};
+    int16_t src[2] = {10000, -10000};
+    mix_add_s16_scalar(acc, src, 2);
+    TEST_ASSERT(&ctx, acc[0] == INT16_MAX && acc[1] == INT16_MIN, "Scalar kernel should saturate");
+
+    srand(42);
+    size_t lengths[] = {MIX_FRAME_SAMPLES, 1, 7, 15, 17, 33, 1000};
+    for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+#if defined(__x86_64__) || defined(__i386__)
+        TEST_ASSERT(&ctx, kernel_matches_scalar(mix_add_s16_sse2, lengths[l]), "SSE2 differs at length %zu", lengths[l]);
+        if (__builtin_cpu_supports("avx2")) {
+            TEST_ASSERT(&ctx, kernel_matches_scalar(mix_add_s16_avx2, lengths[l]), "AVX2 differs at length %zu", lengths[l]);
+        }
+#endif
+        mixer_init();
+        TEST_ASSERT(&ctx, kernel_matches_scalar(mix_add_s16, lengths[l]), "Selected kernel %s differs at length %zu",
+                    mixer_kernel_name(), lengths[l]);
+    }
+
+    TEST_REPORT(&ctx, "test_mix_kernels_match_scalar");
+}
+
+bool test_mix_minus_self() {
+    TestContext ctx;
+    TEST_INIT(&ctx, "test_mix_minus_self");
+
+    enum { SOURCES = 4 };
+    static AudioFrame frames[SOURCES];
+    static AudioFrame everyone;
+    static AudioFrame minus[SOURCES];
+    const AudioFrame* sources[SOURCES];
+
+    // Без клиппинга микс точно равен сумме остальных
+    srand(7);
+    for (int s = 0; s < SOURCES; s++) {
+        fill_random(frames[s].samples, MIX_FRAME_SAMPLES, 8000);
+        sources[s] = &frames[s];
+    }
+    mixer_init();
+    mixer_mix_minus(sources, SOURCES, &everyone, minus);
+
+    for (int n = 0; n < MIX_FRAME_SAMPLES; n++) {
+        int32_t total = 0;
+        for (int s = 0; s < SOURCES; s++) total += frames[s].samples[n];
+        TEST_ASSERT(&ctx, everyone.samples[n] == total, "Full mix wrong at sample %d", n);
+        for (int s = 0; s < SOURCES; s++) {
+            TEST_ASSERT(&ctx, minus[s].samples[n] == total - frames[s].samples[n],
+                        "Mix minus %d wrong at sample %d", s, n);
+        }
+    }
+
+    // Один источник: себя он не слышит
+    mixer_mix_minus(sources, 1, &everyone, minus);
+    TEST_ASSERT(&ctx, minus[0].samples[0] == 0 && minus[0].samples[MIX_FRAME_SAMPLES - 1] == 0,
+                "Single source should get silence");
+    TEST_ASSERT(&ctx, memcmp(everyone.samples, frames[0].samples, MIX_FRAME_BYTES) == 0,
+                "Listeners should get the single source");
+
+    // Громкие источники клиппируются, а не заворачиваются
+    for (int n = 0; n < MIX_FRAME_SAMPLES; n++) {
+        frames[0].samples[n] = 25000;
+        frames[1].samples[n] = 25000;
+    }
+    mixer_mix_minus(sources, 2, &everyone, minus);
+    TEST_ASSERT(&ctx, everyone.samples[0] == INT16_MAX, "Loud mix should saturate, got %d", everyone.samples[0]);
+
+    TEST_REPORT(&ctx, "test_mix_minus_self");
+}
+
+bool test_audio_jitter_queue() {
+    TestContext ctx;
+    TEST_INIT(&ctx, "test_audio_jitter_queue");
+
+    AudioJitterQueue queue;
+    audio_jitter_init(&queue);
+    TEST_ASSERT(&ctx, audio_jitter_pop(&queue) == NULL && queue.underruns == 1, "Empty queue should underrun");
+
+    int16_t pcm[MIX_FRAME_SAMPLES];
+    for (int f = 0; f < MIX_JITTER_FRAMES + 2; f++) {
+        pcm[0] = (int16_t)f;
+        audio_jitter_push(&queue, pcm);
+    }
+    TEST_ASSERT(&ctx, queue.count == MIX_JITTER_FRAMES && queue.overruns == 2, "Overflow should drop oldest frames");
+
+    const AudioFrame* frame = audio_jitter_pop(&queue);
+    TEST_ASSERT(&ctx, frame && frame->samples[0] == 2, "Oldest kept frame should be 2, got %d",
+                frame ? frame->samples[0] : -1);
+
+    TEST_REPORT(&ctx, "test_audio_jitter_queue");
+}
+
+bool run_all_mixer_tests() {
+    printf("Running audio mixer tests...\n\n");
+
+    bool all_passed = true;
+    all_passed = test_mix_kernels_match_scalar() && all_passed;
+    all_passed = test_mix_minus_self() && all_passed;
+    all_passed = test_audio_jitter_queue() && all_passed;
+
+    if (all_passed) {
+        printf("All audio mixer tests passed! ✓\n\n");
+    } else {
+        printf("Some audio mixer tests failed! ✗\n\n");
+    }
+
+    return all_passed;
+}
@@ -231,6 +231,114 @@ void test_async_io() {
     printf("✓ async I/O works correctly\n");
 }
 
+void test_udp_gso_gro_roundtrip() {
+    printf("=== Testing UDP GSO send / GRO receive ===\n");
+    
+    int server_fd = create_udp_server(23237);
+    assert(server_fd >= 0);
+    int client_fd = create_udp_server(23238);
+    assert(client_fd >= 0);
+    
+    if (!udp_gso_supported(client_fd) || udp_enable_gro(server_fd) != 0) {
+        close(server_fd);
+        close(client_fd);
+        printf("✓ UDP GSO/GRO not supported by the kernel, skipped\n");
+        return;
+    }
+    
+    struct sockaddr_in server_addr;
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(23237);
+    inet_pton(AF_INET, "127.0.0.1", &server_addr.sin_addr);
+    
+    // Три сегмента по 100 байт и короткий хвост
+    uint8_t segments[4][100];
+    struct iovec iov[4];
+    for (int i = 0; i < 4; i++) {
+        memset(segments[i], 'a' + i, sizeof(segments[i]));
+        iov[i].iov_base = segments[i];
+        iov[i].iov_len = i < 3 ? 100 : 40;
+    }
+    int send_result = udp_send_segments(client_fd, iov, 4, 100, &server_addr, NULL);
+    if (send_result == -3) {
+        close(server_fd);
+        close(client_fd);
+        printf("✓ UDP GSO rejected by the route, skipped\n");
+        return;
+    }
+    assert(send_result == 340);
+    
+    // Склеенный буфер или отдельные датаграммы - в сумме те же 4 сегмента по порядку
+    static uint8_t buffer[UDP_GRO_BUFFER_SIZE];
+    struct sockaddr_in src_addr;
+    int total = 0, segment_index = 0;
+    while (total < 340) {
+        uint16_t segment_size = 0;
+        int received = udp_receive_gro(server_fd, buffer, sizeof(buffer), &src_addr, &segment_size);
+        assert(received > 0);
+        for (int offset = 0; offset < received; offset += segment_size) {
+            int len = received - offset < segment_size ? received - offset : segment_size;
+            assert(len == (segment_index < 3 ? 100 : 40));
+            assert(buffer[offset] == 'a' + segment_index);
+            segment_index++;
+        }
+        total += received;
+    }
+    assert(segment_index == 4);
+    
+    close(server_fd);
+    close(client_fd);
+    printf("✓ UDP GSO/GRO roundtrip works correctly\n");
+}
+
+void test_udp_kernel_drop_accounting() {
+    printf("=== Testing SO_RXQ_OVFL kernel drop accounting ===\n");
+    
+    int server_fd = create_udp_server(23239);
+    assert(server_fd >= 0);
+    int client_fd = create_udp_server(23240);
+    assert(client_fd >= 0);
+    
+    // Крошечный буфер приема: ядро отбросит большую часть серии
+    int rcvbuf = socket_set_buffer(server_fd, true, 1024);
+    assert(rcvbuf > 0);
+    assert(socket_get_buffer(server_fd, true) == rcvbuf);
+    if (udp_enable_rxq_ovfl(server_fd) != 0) {
+        close(server_fd);
+        close(client_fd);
+        printf("✓ SO_RXQ_OVFL not supported by the kernel, skipped\n");
+        return;
+    }
+    
+    struct sockaddr_in server_addr;
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(23239);
+    inet_pton(AF_INET, "127.0.0.1", &server_addr.sin_addr);
+    
+    uint8_t payload[1000];
+    memset(payload, 'x', sizeof(payload));
+    for (int i = 0; i < 200; i++) {
+        udp_send_packet(client_fd, payload, sizeof(payload), &server_addr);
+    }
+    
+    // Счетчик приходит с датаграммами, поставленными в очередь после потерь
+    uint8_t buffer[2048];
+    struct sockaddr_in src_addr;
+    while (udp_receive_packet(server_fd, buffer, sizeof(buffer), &src_addr) > 0) {}
+    g_udp_rx_stats.kernel_drops = 0;
+    udp_send_packet(client_fd, payload, sizeof(payload), &server_addr);
+    while (udp_receive_packet(server_fd, buffer, sizeof(buffer), &src_addr) > 0) {}
+    assert(g_udp_rx_stats.kernel_drops > 0);
+    printf("  kernel dropped %lu datagrams with rcvbuf %d\n", (unsigned long)g_udp_rx_stats.kernel_drops, rcvbuf);
+    g_udp_rx_stats.kernel_drops = 0;
+    
+    close(server_fd);
+    close(client_fd);
+    printf("✓ kernel drop accounting works correctly\n");
+}
+
 void run_all_network_tests() {
     printf("Running network tests...\n\n");
     
@@ -242,6 +350,8 @@ void run_all_network_tests() {
     test_udp_send_receive();
     test_sockaddr_utils();
     test_async_io();
+    test_udp_gso_gro_roundtrip();
+    test_udp_kernel_drop_accounting();
     
     printf("\nAll network tests passed! ✓\n\n");
 }
@@ -0,0 +1,148 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#include "../notify.h"
+#include "../call.h"
+#include "../connection.h"
+#include "../protocol.h"
+#include "../buffer_logic.h"
+#include "../test_common.h"
+
+static Connection* make_peer(int pair[2]) {
+    socketpair(AF_UNIX, SOCK_STREAM, 0, pair);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    return connection_new(pair[0], &addr);
+}
+
+// Разбирает то, что сервер записал в сокет, на сообщения (не больше max)
+static int read_frames(int fd, uint8_t* data, size_t size, ProtocolFrame* frames, int max) {
+    ssize_t len = recv(fd, data, size, MSG_DONTWAIT);
+    int count = 0;
+    uint32_t offset = 0;
+    while (len > 0 && count < max &&
+           buffer_protocol_next_frame(data + offset, (uint32_t)len - offset, FRAMING_LEGACY, &frames[count]) == 1) {
+        offset += frames[count++].frame_len;
+    }
+    return len > 0 && offset == (uint32_t)len ? count : -1;
+}
+
+bool test_notify_coalesces_per_tick() {
+    TestContext ctx;
+    TEST_INIT(&ctx, "test_notify_coalesces_per_tick");
+
+    int pairs[2][2];
+    Connection* owner = make_peer(pairs[0]);
+    Connection* viewer = make_peer(pairs[1]);
+    Call* call = call_new(720);
+    call_add_participant(call, owner);
+    call_add_participant(call, viewer);
+    NotifyStats before = notify_stats();
+
+    // Участник вошел и вышел за итерацию, START повторился - клиенты этого не видят
+    notify_begin();
+    notify_call_event(call, SERVER_CALL_CONN_NEW, 5000, NULL);
+    notify_call_event(call, SERVER_CALL_STREAM_NEW, 820, NULL);
+    notify_call_event(call, SERVER_CALL_CONN_LEFT, 5000, NULL);
+    notify_event(owner, SERVER_STREAM_START, 0, 820);
+    notify_event(owner, SERVER_STREAM_START, 0, 820);
+
+    uint8_t data[1024];
+    ProtocolFrame frames[8];
+    TEST_ASSERT(&ctx, recv(pairs[1][1], data, sizeof(data), MSG_DONTWAIT) < 0, "Nothing should be written mid-tick");
+    TEST_ASSERT(&ctx, notify_active() && owner->notify && viewer->notify, "Both recipients should have queues");
+
+    notify_flush();
+    TEST_ASSERT(&ctx, !notify_active() && !owner->notify && !viewer->notify, "Flush should empty every queue");
+    TEST_ASSERT(&ctx, read_frames(pairs[1][1], data, sizeof(data), frames, 8) == 1 &&
+                frames[0].type == SERVER_CALL_STREAM_NEW, "Viewer should get only STREAM_NEW");
+    TEST_ASSERT(&ctx, read_frames(pairs[0][1], data, sizeof(data), frames, 8) == 2 &&
+                frames[0].type == SERVER_CALL_STREAM_NEW && frames[1].type == SERVER_STREAM_START,
+                "Owner should get STREAM_NEW and one STREAM_START in one write");
+
+    NotifyStats after = notify_stats();
+    TEST_ASSERT(&ctx, after.events - before.events == 8 && after.superseded - before.superseded == 5 &&
+                after.writes - before.writes == 2 && after.batches == before.batches,
+                "Stats mismatch: %lu events, %lu superseded", (unsigned long)(after.events - before.events),
+                (unsigned long)(after.superseded - before.superseded));
+
+    // Вне итерации - сразу
+    notify_event(viewer, SERVER_CALL_STREAM_DELETED, 720, 820);
+    TEST_ASSERT(&ctx, read_frames(pairs[1][1], data, sizeof(data), frames, 8) == 1 &&
+                frames[0].type == SERVER_CALL_STREAM_DELETED, "Event outside a tick should go at once");
+
+    connection_delete(owner);
+    connection_delete(viewer);
+    call_delete(call);
+    for (int i = 0; i < 2; i++) close(pairs[i][1]);
+
+    TEST_REPORT(&ctx, "test_notify_coalesces_per_tick");
+}
+
+bool test_notify_event_batch() {
+    TestContext ctx;
+    TEST_INIT(&ctx, "test_notify_event_batch");
+
+    int pairs[2][2];
+    Connection* conn = make_peer(pairs[0]);
+    Connection* gone = make_peer(pairs[1]);
+    uint8_t data[1024];
+    ProtocolFrame frames[8];
+
+    EventBatchModePayload mode = { .enabled = 1 };
+    handle_client_message(conn, CLIENT_EVENT_BATCH, (const uint8_t*)&mode, sizeof(mode));
+    TEST_ASSERT(&ctx, conn->event_batch && read_frames(pairs[0][1], data, sizeof(data), frames, 8) == 1 &&
+                frames[0].type == SERVER_SUCCESS, "CLIENT_EVENT_BATCH should be confirmed");
+
+    // Выход и повторный вход остаются оба; прямой ответ выталкивает накопленное раньше себя
+    notify_begin();
+    notify_event(conn, SERVER_CALL_CONN_LEFT, 720, 6000);
+    notify_event(conn, SERVER_CALL_CONN_NEW, 720, 6000);
+    notify_event(conn, SERVER_CALL_STREAM_DELETED, 720, 821);
+    Call* call = call_new(721);
+    send_call_created(conn, call);
+    notify_event(conn, SERVER_STREAM_END, 0, 822);
+    notify_event(gone, SERVER_CALL_CONN_NEW, 720, 6000);
+    connection_delete(gone);
+    notify_flush();
+
+    TEST_ASSERT(&ctx, read_frames(pairs[0][1], data, sizeof(data), frames, 8) == 3, "Three messages expected");
+    TEST_ASSERT(&ctx, frames[0].type == SERVER_EVENT_BATCH && frames[1].type == SERVER_CALL_CREATED &&
+                frames[2].type == SERVER_STREAM_END, "Batch should precede the direct reply");
+
+    const EventBatchPayload* header = (const EventBatchPayload*)frames[0].payload;
+    EventBatchEntry entries[3];
+    memcpy(entries, header + 1, sizeof(entries));
+    TEST_ASSERT(&ctx, header->event_count == 3 && frames[0].payload_len == sizeof(*header) + sizeof(entries),
+                "Batch should carry three events");
+    TEST_ASSERT(&ctx, entries[0].type == SERVER_CALL_CONN_LEFT && entries[1].type == SERVER_CALL_CONN_NEW &&
+                ntohl(entries[1].id) == 6000 && ntohl(entries[1].call_id) == 720 &&
+                entries[2].type == SERVER_CALL_STREAM_DELETED && ntohl(entries[2].id) == 821,
+                "Events should keep their order");
+
+    connection_delete(conn);
+    call_delete(call);
+    for (int i = 0; i < 2; i++) close(pairs[i][1]);
+
+    TEST_REPORT(&ctx, "test_notify_event_batch");
+}
+
+bool run_all_notify_tests() {
+    printf("Running notify tests...\n\n");
+
+    bool all_passed = true;
+    all_passed = test_notify_coalesces_per_tick() && all_passed;
+    all_passed = test_notify_event_batch() && all_passed;
+
+    if (all_passed) {
+        printf("All notify tests passed! ✓\n\n");
+    } else {
+        printf("Some notify tests failed! ✗\n\n");
+    }
+
+    return all_passed;
+}
@@ -0,0 +1,406 @@
+#include <stdio.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include "../pacer.h"
+#include "../packet_pool.h"
+#include "../test_common.h"
+
+static int mock_sent = 0;
+static int mock_result = 0;
+static int mock_batches = 0;
+static int mock_batch_packets = 0;
+static int mock_batch_result = 0;
+static uint8_t mock_last[UDP_PACKET_SIZE];
+static size_t mock_last_len = 0;
+static uint8_t mock_classes[64];  // классы отправок по порядку
+
+static int mock_send(const void* data, size_t len, const struct sockaddr_in* dest_addr, uint8_t media_class) {
+    (void)dest_addr;
+    if (mock_sent < (int)sizeof(mock_classes)) mock_classes[mock_sent] = media_class;
+    mock_sent++;
+    mock_last_len = len <= sizeof(mock_last) ? len : 0;
+    memcpy(mock_last, data, mock_last_len);
+    return mock_result == 0 ? (int)len : mock_result;
+}
+
+static int mock_batch_send(const struct iovec* iov, int count, uint16_t segment_size,
+                           const struct sockaddr_in* dest_addr, uint8_t media_class) {
+    (void)dest_addr;
+    (void)media_class;
+    if (mock_batch_result != 0) return mock_batch_result;
+
+    // Все сегменты, кроме последнего, ровно segment_size
+    size_t total = 0;
+    for (int i = 0; i < count; i++) {
+        if (i < count - 1 && iov[i].iov_len != segment_size) return -1;
+        if (iov[i].iov_len > segment_size) return -1;
+        total += iov[i].iov_len;
+    }
+    mock_batches++;
+    mock_batch_packets += count;
+    return (int)total;
+}
+
+static void mock_reset(void) {
+    mock_sent = 0;
+    mock_result = 0;
+    mock_batches = 0;
+    mock_batch_packets = 0;
+    mock_batch_result = 0;
+    pacer_init(-1);
+    pacer_set_send_fn(mock_send);
+}
+
+static struct sockaddr_in make_addr(void) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(40000);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    return addr;
+}
+
+static PacketBuf* make_buf(size_t len) {
+    uint8_t data[UDP_PACKET_SIZE];
+    memset(data, 0xAB, sizeof(data));
+    return packet_buf_from(data, len);
+}
+
+bool test_pacer_unlimited_sends_immediately() {
+    TestContext ctx;
+    TEST_INIT(&ctx, "test_pacer_unlimited_sends_immediately");
+    mock_reset();
+
+    struct sockaddr_in addr = make_addr();
+    PacerQueue* queue = pacer_queue_new(&addr, 0, 0);
+    PacketBuf* buf = make_buf(1000);
+
+    for (int i = 0; i < 10; i++) {
+        TEST_ASSERT(&ctx, pacer_enqueue(queue, buf) == 0, "Enqueue should succeed");
+    }
+    TEST_ASSERT(&ctx, mock_sent == 0, "Sending waits for flush");
+    pacer_flush(1000);
+    TEST_ASSERT(&ctx, mock_sent == 10, "All packets should be sent on flush, sent %d", mock_sent);
+    TEST_ASSERT(&ctx, pacer_queue_depth(queue) == 0, "Queue should stay empty");
+    TEST_ASSERT(&ctx, pacer_scheduled_count() == 0, "Nothing should be scheduled");
+    TEST_ASSERT(&ctx, buf->refcount == 1, "Queue should release sent buffers");
+
+    packet_buf_release(buf);
+    pacer_queue_delete(queue);
+    pacer_set_send_fn(NULL);
+    TEST_REPORT(&ctx, "test_pacer_unlimited_sends_immediately");
+}
+
+bool test_pacer_token_bucket_spreads_burst() {
+    TestContext ctx;
+    TEST_INIT(&ctx, "test_pacer_token_bucket_spreads_burst");
+    mock_reset();
+
+    // 1 200 000 байт/с = один пакет за миллисекунду, корзина на один пакет
+    struct sockaddr_in addr = make_addr();
+    PacerQueue* queue = pacer_queue_new(&addr, 1200000, UDP_PACKET_SIZE);
+    PacketBuf* buf = make_buf(UDP_PACKET_SIZE);
+
+    uint64_t now = 5000000;
+    for (int i = 0; i < 10; i++) {
+        pacer_enqueue(queue, buf);
+    }
+    pacer_flush(now);
+    TEST_ASSERT(&ctx, mock_sent == 1, "Only the burst should go out at once, sent %d", mock_sent);
+    TEST_ASSERT(&ctx, pacer_queue_depth(queue) == 9, "Rest should wait in the queue");
+    TEST_ASSERT(&ctx, pacer_scheduled_count() == 1, "Queue should be scheduled on the wheel");
+
+    // Каждую миллисекунду уходит по одному пакету
+    for (int ms = 1; ms <= 4; ms++) {
+        pacer_run(now + (uint64_t)ms * 1000 + 10);
+    }
+    TEST_ASSERT(&ctx, mock_sent >= 4 && mock_sent <= 6, "About one packet per ms expected, sent %d", mock_sent);
+
+    // Долгая пауза не дает всплеска больше корзины - досылаем тик за тиком
+    for (int ms = 5; ms <= 20; ms++) {
+        pacer_run(now + (uint64_t)ms * 1000 + 10);
+    }
+    TEST_ASSERT(&ctx, mock_sent == 10, "Everything should drain eventually, sent %d", mock_sent);
+    TEST_ASSERT(&ctx, pacer_scheduled_count() == 0, "Wheel should be empty after drain");
+    TEST_ASSERT(&ctx, queue->stats.sent == 10, "Stats should count sent packets");
+
+    packet_buf_release(buf);
+    pacer_queue_delete(queue);
+    pacer_set_send_fn(NULL);
+    TEST_REPORT(&ctx, "test_pacer_token_bucket_spreads_burst");
+}
+
+bool test_pacer_tail_drop_and_eagain() {
+    TestContext ctx;
+    TEST_INIT(&ctx, "test_pacer_tail_drop_and_eagain");
+    mock_reset();
+
+    struct sockaddr_in addr = make_addr();
+    PacerQueue* queue = pacer_queue_new(&addr, 1000, UDP_PACKET_SIZE);
+    PacketBuf* buf = make_buf(UDP_PACKET_SIZE);
+
+    for (int i = 0; i < PACER_QUEUE_PACKETS + 6; i++) {
+        pacer_enqueue(queue, buf);
+    }
+    // До flush ничего не уходит - очередь заполняется, лишнее отбрасывается
+    TEST_ASSERT(&ctx, pacer_queue_depth(queue) == PACER_QUEUE_PACKETS, "Queue should be full");
+    TEST_ASSERT(&ctx, queue->stats.dropped_full == 6, "Overflow should be counted, got %lu",
+                (unsigned long)queue->stats.dropped_full);
+
+    pacer_queue_delete(queue);
+    TEST_ASSERT(&ctx, buf->refcount == 1, "Deleting queue should release buffers");
+    TEST_ASSERT(&ctx, pacer_scheduled_count() == 0, "Deleted queue should leave the wheel");
+
+    // EAGAIN не теряет пакет: очередь ждет EPOLLOUT, остальные встают за ней
+    mock_result = -2;
+    queue = pacer_queue_new(&addr, 0, 0);
+    PacerQueue* other = pacer_queue_new(&addr, 0, 0);
+    pacer_enqueue(queue, buf);
+    pacer_flush(1000);
+    TEST_ASSERT(&ctx, queue->stats.eagain_stalls == 1, "EAGAIN should be counted");
+    TEST_ASSERT(&ctx, pacer_queue_depth(queue) == 1, "Packet should stay queued after EAGAIN");
+
+    mock_sent = 0;
+    pacer_enqueue(other, buf);
+    pacer_flush(1000);
+    TEST_ASSERT(&ctx, mock_sent == 0 && pacer_blocked_count() == 2, "Blocked socket should not be retried");
+
+    mock_result = 0;
+    pacer_on_writable();
+    TEST_ASSERT(&ctx, queue->stats.sent == 1 && other->stats.sent == 1, "EPOLLOUT should flush waiting queues");
+    TEST_ASSERT(&ctx, pacer_blocked_count() == 0, "No queue should wait after flush");
+    pacer_queue_delete(other);
+
+    packet_buf_release(buf);
+    pacer_queue_delete(queue);
+    pacer_set_send_fn(NULL);
+    TEST_REPORT(&ctx, "test_pacer_tail_drop_and_eagain");
+}
+
+bool test_pacer_gso_batches_equal_sizes() {
+    TestContext ctx;
+    TEST_INIT(&ctx, "test_pacer_gso_batches_equal_sizes");
+    mock_reset();
+    pacer_set_batch_send_fn(mock_batch_send);
+
+    struct sockaddr_in addr = make_addr();
+    PacerQueue* queue = pacer_queue_new(&addr, 0, 0);
+    PacketBuf* full = make_buf(UDP_PACKET_SIZE);
+    PacketBuf* small = make_buf(800);
+
+    // 5 полных + 2 коротких + 1 полный: серия из 6 (короткий замыкает), затем два по одному
+    for (int i = 0; i < 5; i++) pacer_enqueue(queue, full);
+    pacer_enqueue(queue, small);
+    pacer_enqueue(queue, small);
+    pacer_enqueue(queue, full);
+    pacer_flush(1000);
+
+    TEST_ASSERT(&ctx, mock_batches == 1, "One GSO batch expected, got %d", mock_batches);
+    TEST_ASSERT(&ctx, mock_batch_packets == 6, "Batch should carry 6 packets, got %d", mock_batch_packets);
+    TEST_ASSERT(&ctx, mock_sent == 2, "Size change should fall back to single sends, got %d", mock_sent);
+    TEST_ASSERT(&ctx, queue->stats.sent == 8, "All packets should be counted as sent");
+    TEST_ASSERT(&ctx, queue->stats.gso_batches == 1 && queue->stats.gso_packets == 6,
+                "GSO stats should be counted");
+
+    // Ядро без GSO: серия откатывается на поштучную отправку, GSO выключается
+    mock_batch_result = -3;
+    for (int i = 0; i < 4; i++) pacer_enqueue(queue, full);
+    pacer_flush(2000);
+    TEST_ASSERT(&ctx, mock_sent == 6, "Fallback should send packets one by one, got %d", mock_sent);
+    TEST_ASSERT(&ctx, !pacer_gso_enabled(), "GSO should be disabled after failure");
+    TEST_ASSERT(&ctx, queue->stats.sent == 12, "Fallback packets should be counted as sent");
+
+    packet_buf_release(full);
+    packet_buf_release(small);
+    pacer_queue_delete(queue);
+    pacer_set_batch_send_fn(NULL);
+    pacer_set_send_fn(NULL);
+    TEST_REPORT(&ctx, "test_pacer_gso_batches_equal_sizes");
+}
+
+bool test_pacer_bundles_small_packets() {
+    TestContext ctx;
+    TEST_INIT(&ctx, "test_pacer_bundles_small_packets");
+    mock_reset();
+    pacer_set_bundle_window(2000);
+
+    struct sockaddr_in addr = make_addr();
+    PacerQueue* queue = pacer_queue_new(&addr, 0, 0);
+    PacketBuf* a = make_buf(100);
+    PacketBuf* b = make_buf(200);
+
+    // Мелкие пакеты ждут окно, пришедшие за это время попадают в ту же связку
+    pacer_enqueue(queue, a);
+    pacer_enqueue(queue, b);
+    pacer_flush(10000);
+    TEST_ASSERT(&ctx, mock_sent == 0 && pacer_scheduled_count() == 1, "Small packets should wait for the window");
+    pacer_enqueue(queue, a);
+    pacer_flush(10500);
+    TEST_ASSERT(&ctx, mock_sent == 0, "Packet arriving within the window should wait too");
+
+    pacer_run(12500);
+    TEST_ASSERT(&ctx, mock_sent == 1, "One bundle datagram expected, got %d", mock_sent);
+    TEST_ASSERT(&ctx, mock_last_len == UDP_BUNDLE_HEADER_SIZE + 3 * UDP_BUNDLE_ENTRY_HEADER + 400,
+                "Bundle length mismatch: %zu", mock_last_len);
+
+    uint32_t marker;
+    memcpy(&marker, mock_last, sizeof(marker));
+    TEST_ASSERT(&ctx, ntohl(marker) == UDP_BUNDLE_MARKER, "Bundle should start with the marker");
+    size_t offset = UDP_BUNDLE_HEADER_SIZE;
+    uint16_t expected[3] = {100, 200, 100};
+    for (int i = 0; i < 3; i++) {
+        uint16_t len;
+        memcpy(&len, mock_last + offset, sizeof(len));
+        TEST_ASSERT(&ctx, ntohs(len) == expected[i], "Entry %d length %u", i, ntohs(len));
+        TEST_ASSERT(&ctx, mock_last[offset + UDP_BUNDLE_ENTRY_HEADER] == 0xAB, "Entry %d payload", i);
+        offset += UDP_BUNDLE_ENTRY_HEADER + ntohs(len);
+    }
+    TEST_ASSERT(&ctx, queue->stats.bundles == 1 && queue->stats.bundled_packets == 3 && queue->stats.sent == 3,
+                "Bundle stats should be counted");
+
+    // Крупный пакет не задерживается и уходит как есть
+    PacketBuf* big = make_buf(1000);
+    pacer_enqueue(queue, big);
+    pacer_flush(20000);
+    TEST_ASSERT(&ctx, mock_sent == 2 && mock_last_len == 1000, "Large packet should go out unbundled");
+
+    // Больше, чем влезает в датаграмму: сразу несколько связок без ожидания
+    for (int i = 0; i < 8; i++) pacer_enqueue(queue, b);
+    pacer_flush(30000);
+    TEST_ASSERT(&ctx, mock_sent == 4, "Overfull queue should go out as 2 bundles, got %d sends", mock_sent - 2);
+    TEST_ASSERT(&ctx, queue->stats.bundled_packets == 11, "All small packets should be bundled");
+
+    packet_buf_release(a);
+    packet_buf_release(b);
+    packet_buf_release(big);
+    pacer_queue_delete(queue);
+    pacer_set_bundle_window(0);
+    pacer_set_send_fn(NULL);
+    TEST_REPORT(&ctx, "test_pacer_bundles_small_packets");
+}
+
+static PacketBuf* make_media_buf(bool audio) {
+    uint8_t data[UDP_PACKET_SIZE];
+    memset(data, 0, sizeof(data));
+
+    UDPStreamPacket* packet = (UDPStreamPacket*)data;
+    packet->stream_id = htonl(7 | UDP_STREAM_EXT_BIT);
+    UDPStreamExtHeader* ext = (UDPStreamExtHeader*)packet->data;
+    ext->flags = audio ? UDP_EXT_FLAG_AUDIO : 0;
+    PacketBuf* buf = packet_buf_from(data, UDP_HEADER_SIZE + sizeof(UDPStreamExtHeader) + 100);
+    buf->media_class = audio ? MEDIA_CLASS_AUDIO : MEDIA_CLASS_VIDEO;
+    return buf;
+}
+
+bool test_pacer_drop_policies() {
+    TestContext ctx;
+    TEST_INIT(&ctx, "test_pacer_drop_policies");
+    mock_reset();
+
+    struct sockaddr_in addr = make_addr();
+    PacketBuf* audio = make_media_buf(true);
+    PacketBuf* video = make_media_buf(false);
+    pacer_set_queue_limit(4);
+
+    // oldest: новому пакету уступает самый старый пакет его класса
+    pacer_set_drop_policy(PACER_DROP_OLDEST);
+    PacerQueue* queue = pacer_queue_new(&addr, 0, 0);
+    pacer_enqueue(queue, video);
+    for (int i = 0; i < 4; i++) pacer_enqueue(queue, audio);
+    TEST_ASSERT(&ctx, pacer_queue_depth(queue) == 4 && queue->stats.dropped_oldest == 1,
+                "Oldest packet should be evicted");
+    TEST_ASSERT(&ctx, video->refcount == 2 && audio->refcount == 4,
+                "Oldest audio should be evicted and released, video kept");
+    pacer_queue_delete(queue);
+
+    // audio: видео вытесняется первым, пока оно есть; потом новое видео отбрасывается
+    pacer_set_drop_policy(PACER_DROP_VIDEO_FIRST);
+    queue = pacer_queue_new(&addr, 0, 0);
+    pacer_enqueue(queue, audio);
+    pacer_enqueue(queue, video);
+    pacer_enqueue(queue, audio);
+    pacer_enqueue(queue, video);
+    pacer_enqueue(queue, audio);
+    pacer_enqueue(queue, audio);
+    TEST_ASSERT(&ctx, queue->stats.dropped_video == 2 && video->refcount == 1, "Both video packets should go first");
+    pacer_enqueue(queue, video);
+    TEST_ASSERT(&ctx, queue->stats.dropped_full == 1, "Video should not evict audio");
+    pacer_enqueue(queue, audio);
+    TEST_ASSERT(&ctx, queue->stats.dropped_oldest == 1 && pacer_queue_depth(queue) == 4,
+                "Audio should evict the oldest audio");
+    pacer_queue_delete(queue);
+
+    // tail: новый пакет отбрасывается
+    pacer_set_drop_policy(PACER_DROP_TAIL);
+    queue = pacer_queue_new(&addr, 0, 0);
+    for (int i = 0; i < 5; i++) pacer_enqueue(queue, audio);
+    TEST_ASSERT(&ctx, queue->stats.dropped_full == 1 && pacer_queue_depth(queue) == 4, "Tail drop should keep queue");
+    pacer_queue_delete(queue);
+
+    TEST_ASSERT(&ctx, audio->refcount == 1, "All queued references should be released");
+    packet_buf_release(audio);
+    packet_buf_release(video);
+    pacer_set_queue_limit(PACER_QUEUE_PACKETS);
+    pacer_set_send_fn(NULL);
+    TEST_REPORT(&ctx, "test_pacer_drop_policies");
+}
+
+bool test_pacer_audio_priority() {
+    TestContext ctx;
+    TEST_INIT(&ctx, "test_pacer_audio_priority");
+    mock_reset();
+
+    struct sockaddr_in addr = make_addr();
+    PacketBuf* audio = make_media_buf(true);
+    PacketBuf* video = make_media_buf(false);
+
+    // Серия ключевого кадра в очереди, за ней аудио: аудио уходит первым
+    PacerQueue* queue = pacer_queue_new(&addr, 0, 0);
+    for (int i = 0; i < 4; i++) pacer_enqueue(queue, video);
+    pacer_enqueue(queue, audio);
+    pacer_enqueue(queue, audio);
+    pacer_flush(1000);
+    TEST_ASSERT(&ctx, mock_sent == 6, "All packets should be sent, got %d", mock_sent);
+    TEST_ASSERT(&ctx, mock_classes[0] == MEDIA_CLASS_AUDIO && mock_classes[1] == MEDIA_CLASS_AUDIO &&
+                mock_classes[2] == MEDIA_CLASS_VIDEO, "Audio should go before queued video");
+    TEST_ASSERT(&ctx, queue->stats.sent_class[MEDIA_CLASS_AUDIO] == 2 &&
+                queue->stats.sent_class[MEDIA_CLASS_VIDEO] == 4, "Per-class counters should match");
+    pacer_queue_delete(queue);
+
+    // Поток аудио не морит видео голодом: после PACER_STARVATION_LIMIT отправок - ход видео
+    mock_sent = 0;
+    queue = pacer_queue_new(&addr, 0, 0);
+    pacer_enqueue(queue, video);
+    for (int i = 0; i < PACER_STARVATION_LIMIT + 4; i++) pacer_enqueue(queue, audio);
+    pacer_flush(2000);
+    TEST_ASSERT(&ctx, mock_classes[PACER_STARVATION_LIMIT] == MEDIA_CLASS_VIDEO,
+                "Video should get a turn after %d audio sends", PACER_STARVATION_LIMIT);
+    TEST_ASSERT(&ctx, queue->stats.starvation_turns == 1, "Starvation turn should be counted");
+    pacer_queue_delete(queue);
+
+    packet_buf_release(audio);
+    packet_buf_release(video);
+    pacer_set_send_fn(NULL);
+    TEST_REPORT(&ctx, "test_pacer_audio_priority");
+}
+
+bool run_all_pacer_tests() {
+    printf("Running pacer tests...\n\n");
+
+    bool all_passed = true;
+    all_passed = test_pacer_unlimited_sends_immediately() && all_passed;
+    all_passed = test_pacer_token_bucket_spreads_burst() && all_passed;
+    all_passed = test_pacer_tail_drop_and_eagain() && all_passed;
+    all_passed = test_pacer_gso_batches_equal_sizes() && all_passed;
+    all_passed = test_pacer_bundles_small_packets() && all_passed;
+    all_passed = test_pacer_drop_policies() && all_passed;
+    all_passed = test_pacer_audio_priority() && all_passed;
+
+    if (all_passed) {
+        printf("All pacer tests passed! ✓\n\n");
+    } else {
+        printf("Some pacer tests failed! ✗\n\n");
+    }
+
+    return all_passed;
+}
@@ -0,0 +1,173 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#include "../protocol.h"
+#include "../connection.h"
+#include "../call.h"
+#include "../buffer_logic.h"
+#include "../test_common.h"
+
+typedef struct {
+    uint8_t type;
+    const char* name;
+} SchemaMessage;
+
+#define SCHEMA_ROW(type, ...) { type, #type },
+static const SchemaMessage schema_messages[] = {
+    PROTOCOL_CLIENT_MESSAGES(SCHEMA_ROW, SCHEMA_ROW, SCHEMA_ROW)
+    PROTOCOL_SERVER_MESSAGES(SCHEMA_ROW, SCHEMA_ROW, SCHEMA_ROW)
+};
+#define SCHEMA_MESSAGE_COUNT (sizeof(schema_messages) / sizeof(schema_messages[0]))
+
+// Образец нагрузки: байты заголовка равны 1 (у списков - по 1-2 элемента), элементы - по номеру байта
+static uint32_t schema_sample(const ProtocolMessageInfo* info, uint8_t* payload) {
+    memset(payload, 1, info->header_size);
+    uint32_t len = info->header_size;
+    if (info->entry_size) {
+        len += info->entry_size * info->count(payload);
+    }
+    for (uint32_t i = info->header_size; i < len; i++) {
+        payload[i] = (uint8_t)(0xA0 + i);
+    }
+    return len;
+}
+
+bool test_schema_round_trip() {
+    TestContext ctx;
+    TEST_INIT(&ctx, "test_schema_round_trip");
+
+    uint8_t payload[512];
+    uint8_t message[2 + 1 + sizeof(payload)];
+    ProtocolFrame frame;
+
+    for (size_t m = 0; m < SCHEMA_MESSAGE_COUNT; m++) {
+        uint8_t type = schema_messages[m].type;
+        const char* name = schema_messages[m].name;
+        const ProtocolMessageInfo* info = protocol_message_info(type);
+        TEST_ASSERT(&ctx, info != NULL, "%s should be in the schema table", name);
+        if (!info) continue;
+
+        uint32_t len = schema_sample(info, payload);
+        uint32_t size = 0;
+        TEST_ASSERT(&ctx, protocol_payload_size(type, payload, len, &size) == 1 && size == len,
+                    "%s: exact size %u expected, got %u", name, len, size);
+        TEST_ASSERT(&ctx, buffer_protocol_expected_size(type, &size) == 0 && size == 1u + info->header_size,
+                    "%s: expected size should be the fixed part", name);
+
+        // Кодирование принимает только точный размер
+        TEST_ASSERT(&ctx, protocol_encode(message + 2, sizeof(message) - 2, type, payload, len + 1) < 0,
+                    "%s: longer payload should be rejected", name);
+        if (len > 0) {
+            TEST_ASSERT(&ctx, protocol_encode(message + 2, sizeof(message) - 2, type, payload, len - 1) < 0,
+                        "%s: shorter payload should be rejected", name);
+        }
+        TEST_ASSERT(&ctx, protocol_encode(message + 2, len, type, payload, len) < 0,
+                    "%s: output buffer overrun should be rejected", name);
+        int encoded = protocol_encode(message + 2, sizeof(message) - 2, type, payload, len);
+        TEST_ASSERT(&ctx, encoded == (int)(1 + len), "%s: encoded length mismatch", name);
+
+        // FRAMING_LEGACY: граница по схеме, неполное сообщение ждет остатка
+        TEST_ASSERT(&ctx, buffer_protocol_next_frame(message + 2, (uint32_t)encoded, FRAMING_LEGACY, &frame) == 1 &&
+                    frame.type == type && frame.payload_len == len && frame.frame_len == (uint32_t)encoded &&
+                    memcmp(frame.payload, payload, len) == 0, "%s: legacy round trip failed", name);
+        for (int avail = 1; avail < encoded; avail++) {
+            TEST_ASSERT(&ctx, buffer_protocol_next_frame(message + 2, (uint32_t)avail, FRAMING_LEGACY, &frame) == 0,
+                        "%s: %d of %d bytes should not make a frame", name, avail, encoded);
+        }
+
+        // FRAMING_LENGTH_PREFIXED
+        message[0] = (uint8_t)(encoded >> 8);
+        message[1] = (uint8_t)encoded;
+        TEST_ASSERT(&ctx, buffer_protocol_next_frame(message, (uint32_t)encoded + 2, FRAMING_LENGTH_PREFIXED, &frame) == 1 &&
+                    frame.type == type && frame.payload_len == len && memcmp(frame.payload, payload, len) == 0,
+                    "%s: length-prefixed round trip failed", name);
+    }
+
+    uint32_t size = 0;
+    TEST_ASSERT(&ctx, protocol_message_info(0xFF) == NULL && protocol_payload_size(0xFF, payload, 0, &size) == -1,
+                "Unknown type should not be in the schema");
+    TEST_ASSERT(&ctx, protocol_encode(message, sizeof(message), 0xFF, NULL, 0) < 0, "Unknown type should not encode");
+
+    TEST_REPORT(&ctx, "test_schema_round_trip");
+}
+
+// Ответ сервера в сокете: число байт или 0, если ничего не пришло
+static ssize_t schema_reply(int fd, uint8_t* data, size_t size) {
+    ssize_t len = recv(fd, data, size, MSG_DONTWAIT);
+    return len > 0 ? len : 0;
+}
+
+bool test_schema_dispatch_bounds() {
+    TestContext ctx;
+    TEST_INIT(&ctx, "test_schema_dispatch_bounds");
+
+    int pair[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, pair);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    Connection* conn = connection_new(pair[0], &addr);
+    uint8_t data[256];
+    ProtocolFrame frame;
+
+    // Направление в таблице совпадает с именем; сообщения сервера от клиента не принимаются
+    for (size_t m = 0; m < SCHEMA_MESSAGE_COUNT; m++) {
+        const ProtocolMessageInfo* info = protocol_message_info(schema_messages[m].type);
+        TEST_ASSERT(&ctx, info->direction == (schema_messages[m].name[0] == 'C' ? PROTOCOL_FROM_CLIENT
+                                                                                : PROTOCOL_FROM_SERVER),
+                    "%s: wrong direction", schema_messages[m].name);
+    }
+    StreamIDPayload stream = { .stream_id = htonl(1234) };
+    handle_client_message(conn, SERVER_STREAM_CREATED, (const uint8_t*)&stream, sizeof(stream));
+    handle_client_message(conn, 0xFF, (const uint8_t*)&stream, sizeof(stream));
+    TEST_ASSERT(&ctx, schema_reply(pair[1], data, sizeof(data)) == 0, "Server and unknown types should be ignored");
+
+    // Заявлено три стрима, пришел один - сообщение отбрасывается целиком
+    uint8_t batch[sizeof(StreamBatchPayload) + 3 * sizeof(uint32_t)] = { 3 };
+    memcpy(batch + 1, &stream.stream_id, sizeof(uint32_t));
+    handle_client_message(conn, CLIENT_STREAM_BATCH_JOIN, batch, sizeof(StreamBatchPayload) + sizeof(uint32_t));
+    handle_client_message(conn, CLIENT_CALL_CONN_JOIN, batch, sizeof(CallJoinPayload) - 1);
+    TEST_ASSERT(&ctx, schema_reply(pair[1], data, sizeof(data)) == 0, "Truncated messages should be dropped");
+
+    batch[0] = 1;
+    handle_client_message(conn, CLIENT_STREAM_BATCH_JOIN, batch, sizeof(StreamBatchPayload) + sizeof(uint32_t));
+    ssize_t len = schema_reply(pair[1], data, sizeof(data));
+    TEST_ASSERT(&ctx, buffer_protocol_next_frame(data, (uint32_t)len, FRAMING_LEGACY, &frame) == 1 &&
+                frame.type == SERVER_STREAM_BATCH_RESULT && frame.frame_len == (uint32_t)len &&
+                ((const StreamBatchResultPayload*)frame.payload)->result_count == 1,
+                "Complete batch should be answered");
+
+    // Исходящее не по схеме не уходит
+    Call* call = call_new(730);
+    call_add_participant(call, conn);
+    CallMixingStatePayload mixing = { 0 };
+    broadcast_to_call_participants(call, SERVER_CALL_MIXING, &mixing, sizeof(mixing) - 1, NULL);
+    TEST_ASSERT(&ctx, schema_reply(pair[1], data, sizeof(data)) == 0, "Malformed broadcast should not be sent");
+    broadcast_to_call_participants(call, SERVER_CALL_MIXING, &mixing, sizeof(mixing), NULL);
+    TEST_ASSERT(&ctx, schema_reply(pair[1], data, sizeof(data)) == 1 + sizeof(mixing), "Broadcast should be sent");
+
+    connection_delete(conn);
+    call_delete(call);
+    close(pair[1]);
+
+    TEST_REPORT(&ctx, "test_schema_dispatch_bounds");
+}
+
+bool run_all_schema_tests() {
+    printf("Running schema tests...\n\n");
+
+    bool all_passed = true;
+    all_passed = test_schema_round_trip() && all_passed;
+    all_passed = test_schema_dispatch_bounds() && all_passed;
+
+    if (all_passed) {
+        printf("All schema tests passed! ✓\n\n");
+    } else {
+        printf("Some schema tests failed! ✗\n\n");
+    }
+
+    return all_passed;
+}
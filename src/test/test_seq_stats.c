@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <string.h>
+#include "../seq_stats.h"
+#include "../test_common.h"
+
+bool test_seq_stats_loss_and_reorder() {
+    TestContext ctx;
+    TEST_INIT(&ctx, "test_seq_stats_loss_and_reorder");
+
+    SeqStats stats;
+    seq_stats_init(&stats);
+
+    // 100..109, потом 111 и 113 раньше 110; 112 не придет вовсе
+    uint64_t now = 0;
+    for (uint32_t n = 100; n < 110; n++, now += 1000) seq_stats_update(&stats, n, now);
+    seq_stats_update(&stats, 111, now);
+    seq_stats_update(&stats, 113, now);
+    seq_stats_update(&stats, 110, now);
+
+    TEST_ASSERT(&ctx, stats.highest == 113, "Highest should be 113, got %u", stats.highest);
+    TEST_ASSERT(&ctx, seq_stats_expected(&stats) == 14, "Expected 14 packets, got %lu",
+                (unsigned long)seq_stats_expected(&stats));
+    TEST_ASSERT(&ctx, stats.received == 13, "Received should be 13, got %lu", (unsigned long)stats.received);
+    TEST_ASSERT(&ctx, stats.reordered == 1, "One reordered packet, got %lu", (unsigned long)stats.reordered);
+    TEST_ASSERT(&ctx, stats.lost == 0, "Loss is confirmed only when 112 leaves the window");
+
+    // Окно уходит вперед - 112 засчитывается потерянным, пропуск за ним пока в окне
+    seq_stats_update(&stats, 113 + SEQ_STATS_WINDOW, now);
+    TEST_ASSERT(&ctx, stats.lost == 1, "Only 112 should be lost so far, got %lu", (unsigned long)stats.lost);
+    seq_stats_update(&stats, 113 + 2 * SEQ_STATS_WINDOW, now);
+    TEST_ASSERT(&ctx, stats.lost == 1 + (SEQ_STATS_WINDOW - 1), "Lost should be 112 plus the gap, got %lu",
+                (unsigned long)stats.lost);
+
+    // Очень старый пакет - опоздавший, не дубликат
+    seq_stats_update(&stats, 112, now);
+    TEST_ASSERT(&ctx, stats.late == 1 && stats.duplicates == 0, "112 should be counted as late");
+
+    TEST_REPORT(&ctx, "test_seq_stats_loss_and_reorder");
+}
+
+bool test_seq_stats_duplicates_and_wrap() {
+    TestContext ctx;
+    TEST_INIT(&ctx, "test_seq_stats_duplicates_and_wrap");
+
+    SeqStats stats;
+    seq_stats_init(&stats);
+
+    // Переход номера через 2^32
+    uint32_t start = 0xFFFFFFF0u;
+    for (uint32_t i = 0; i < 32; i++) seq_stats_update(&stats, start + i, i * 1000);
+    TEST_ASSERT(&ctx, stats.highest == start + 31, "Highest should wrap to %u, got %u", start + 31, stats.highest);
+    TEST_ASSERT(&ctx, seq_stats_expected(&stats) == 32 && stats.lost == 0, "No loss across wrap");
+
+    seq_stats_update(&stats, start + 31, 40000);
+    seq_stats_update(&stats, start + 20, 40000);
+    TEST_ASSERT(&ctx, stats.duplicates == 2 && stats.received == 32, "Both repeats should be duplicates, got %lu",
+                (unsigned long)stats.duplicates);
+
+    // Скачок номера - перезапуск издателя, а не тысячи потерь
+    seq_stats_update(&stats, 1000000, 50000);
+    seq_stats_update(&stats, 1000001, 51000);
+    TEST_ASSERT(&ctx, stats.resets == 1 && stats.lost == 0, "Jump should restart the sequence");
+    TEST_ASSERT(&ctx, seq_stats_expected(&stats) == 34, "Expected should continue after restart, got %lu",
+                (unsigned long)seq_stats_expected(&stats));
+
+    TEST_REPORT(&ctx, "test_seq_stats_duplicates_and_wrap");
+}
+
+bool test_seq_stats_jitter() {
+    TestContext ctx;
+    TEST_INIT(&ctx, "test_seq_stats_jitter");
+
+    SeqStats steady, uneven;
+    seq_stats_init(&steady);
+    seq_stats_init(&uneven);
+
+    // Ровно каждые 10 мс против 5/15 мс с тем же средним
+    uint64_t t1 = 0, t2 = 0;
+    for (uint32_t n = 0; n < 200; n++) {
+        seq_stats_update(&steady, n, t1);
+        seq_stats_update(&uneven, n, t2);
+        t1 += 10000;
+        t2 += (n % 2) ? 15000 : 5000;
+    }
+
+    uint32_t steady_us = seq_stats_jitter_us(&steady);
+    uint32_t uneven_us = seq_stats_jitter_us(&uneven);
+    TEST_ASSERT(&ctx, steady_us == 0, "Steady stream should have no jitter, got %u", steady_us);
+    TEST_ASSERT(&ctx, uneven_us > 3000 && uneven_us <= 6000, "Uneven stream jitter should be ~5 ms, got %u",
+                uneven_us);
+
+    TEST_REPORT(&ctx, "test_seq_stats_jitter");
+}
+
+bool run_all_seq_stats_tests() {
+    printf("Running ingress sequence stats tests...\n\n");
+
+    bool all_passed = true;
+    all_passed = test_seq_stats_loss_and_reorder() && all_passed;
+    all_passed = test_seq_stats_duplicates_and_wrap() && all_passed;
+    all_passed = test_seq_stats_jitter() && all_passed;
+
+    if (all_passed) {
+        printf("All ingress sequence stats tests passed! ✓\n\n");
+    } else {
+        printf("Some ingress sequence stats tests failed! ✗\n\n");
+    }
+
+    return all_passed;
+}
@@ -0,0 +1,90 @@
+#include <stdio.h>
+#include <string.h>
+#include "../simulcast.h"
+#include "../test_common.h"
+
+bool test_simulcast_filters_other_layers() {
+    TestContext ctx;
+    TEST_INIT(&ctx, "test_simulcast_filters_other_layers");
+
+    SimulcastState state;
+    simulcast_state_init(&state, 1);
+
+    uint32_t out = 0;
+    TEST_ASSERT(&ctx, !simulcast_route(&state, 0, false, 10, &out), "Lower layer should be filtered");
+    TEST_ASSERT(&ctx, !simulcast_route(&state, 2, true, 10, &out), "Non-target keyframe should not switch");
+    TEST_ASSERT(&ctx, simulcast_route(&state, 1, false, 10, &out) && out == 10,
+                "Current layer should pass with original number");
+    TEST_ASSERT(&ctx, !simulcast_route(&state, SIMULCAST_MAX_LAYERS, true, 11, &out), "Invalid layer rejected");
+
+    TEST_REPORT(&ctx, "test_simulcast_filters_other_layers");
+}
+
+bool test_simulcast_switch_keeps_sequence() {
+    TestContext ctx;
+    TEST_INIT(&ctx, "test_simulcast_switch_keeps_sequence");
+
+    SimulcastState state;
+    simulcast_state_init(&state, 2);
+
+    uint32_t out = 0;
+    for (uint32_t n = 100; n < 105; n++) {
+        simulcast_route(&state, 2, n == 100, n, &out);
+    }
+    TEST_ASSERT(&ctx, out == 104, "Last forwarded number should be 104, got %u", out);
+
+    // Целевой слой ниже, но пока нет ключевого кадра - остаемся на текущем
+    state.target_layer = 0;
+    TEST_ASSERT(&ctx, !simulcast_route(&state, 0, false, 7000, &out), "Switch must wait for keyframe");
+    TEST_ASSERT(&ctx, simulcast_route(&state, 2, false, 105, &out) && out == 105, "Old layer continues");
+
+    // Ключевой кадр нижнего слоя: переключение, номера продолжаются
+    TEST_ASSERT(&ctx, simulcast_route(&state, 0, true, 7001, &out), "Keyframe of target should switch");
+    TEST_ASSERT(&ctx, out == 106, "Sequence should continue after switch, got %u", out);
+    TEST_ASSERT(&ctx, state.current_layer == 0 && state.switches == 1, "State should record switch");
+    TEST_ASSERT(&ctx, !simulcast_route(&state, 2, false, 106, &out), "Old layer should now be filtered");
+
+    // Пропуск номера у издателя остается пропуском у получателя
+    simulcast_route(&state, 0, false, 7003, &out);
+    TEST_ASSERT(&ctx, out == 108, "Upstream gap should be preserved, got %u", out);
+
+    TEST_REPORT(&ctx, "test_simulcast_switch_keeps_sequence");
+}
+
+bool test_simulcast_pick_layer() {
+    TestContext ctx;
+    TEST_INIT(&ctx, "test_simulcast_pick_layer");
+
+    uint32_t rates[SIMULCAST_MAX_LAYERS] = {300000, 1000000, 2500000, 0};
+
+    TEST_ASSERT(&ctx, simulcast_pick_layer(rates, SIMULCAST_MAX_LAYERS - 1, 0) == 2,
+                "Unknown budget should pick highest active layer");
+    TEST_ASSERT(&ctx, simulcast_pick_layer(rates, SIMULCAST_MAX_LAYERS - 1, 1500000) == 1,
+                "Budget should cap the layer");
+    TEST_ASSERT(&ctx, simulcast_pick_layer(rates, SIMULCAST_MAX_LAYERS - 1, 100000) == 0,
+                "Lowest active layer is always allowed");
+    TEST_ASSERT(&ctx, simulcast_pick_layer(rates, 0, 0) == 0, "Client cap should be respected");
+
+    uint32_t single[SIMULCAST_MAX_LAYERS] = {0, 0, 0, 0};
+    TEST_ASSERT(&ctx, simulcast_pick_layer(single, SIMULCAST_MAX_LAYERS - 1, 0) == 0,
+                "No active layers should fall back to layer 0");
+
+    TEST_REPORT(&ctx, "test_simulcast_pick_layer");
+}
+
+bool run_all_simulcast_tests() {
+    printf("Running simulcast tests...\n\n");
+
+    bool all_passed = true;
+    all_passed = test_simulcast_filters_other_layers() && all_passed;
+    all_passed = test_simulcast_switch_keeps_sequence() && all_passed;
+    all_passed = test_simulcast_pick_layer() && all_passed;
+
+    if (all_passed) {
+        printf("All simulcast tests passed! ✓\n\n");
+    } else {
+        printf("Some simulcast tests failed! ✗\n\n");
+    }
+
+    return all_passed;
+}
@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include "../speaker.h"
+#include "../call.h"
+#include "../connection.h"
+#include "../stream.h"
+#include "../test_common.h"
+
+static Connection* make_conn(int fd) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port   = htons(9090);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+
+    return connection_new(fd, &addr);
+}
+
+bool test_audio_level_filter() {
+    TestContext ctx;
+    TEST_INIT(&ctx, "test_audio_level_filter");
+
+    AudioLevelFilter filter;
+    memset(&filter, 0, sizeof(filter));
+    TEST_ASSERT(&ctx, audio_level_current(&filter, 1000) == 0, "Empty filter should be silent");
+
+    // Громкая речь (-20 дБов): быстрая атака
+    uint64_t now = 1000;
+    for (int i = 0; i < 10; i++, now += 20) audio_level_update(&filter, 20, now);
+    uint16_t loud = audio_level_current(&filter, now);
+    TEST_ASSERT(&ctx, loud > (100 << 8) && loud <= (107 << 8), "Level should approach 107, got %u", loud >> 8);
+
+    // Одна тихая пачка не обрушивает уровень: спад медленный
+    audio_level_update(&filter, AUDIO_LEVEL_SILENCE, now);
+    uint16_t after = audio_level_current(&filter, now);
+    TEST_ASSERT(&ctx, after < loud && after > loud * 3 / 4, "Release should be slow, got %u", after >> 8);
+
+    // Пакеты перестали приходить - тишина
+    TEST_ASSERT(&ctx, audio_level_current(&filter, now + SPEAKER_SILENCE_TIMEOUT_MS + 1) == 0,
+                "Stale filter should be silent");
+
+    TEST_REPORT(&ctx, "test_audio_level_filter");
+}
+
+bool test_speaker_rank_hysteresis() {
+    TestContext ctx;
+    TEST_INIT(&ctx, "test_speaker_rank_hysteresis");
+
+    uint16_t levels[4] = {50 << 8, 90 << 8, 70 << 8, 10 << 8};
+    uint8_t prev[4] = {0, 0, 0, 0};
+    uint8_t rank[4];
+
+    speaker_rank(levels, prev, 4, 2, rank);
+    TEST_ASSERT(&ctx, rank[1] == 1 && rank[2] == 2 && rank[0] == 3 && rank[3] == 4,
+                "Ranks should follow loudness: %u %u %u %u", rank[0], rank[1], rank[2], rank[3]);
+
+    // Чуть громче активного - не вытесняет его
+    memcpy(prev, rank, sizeof(prev));
+    levels[0] = (70 << 8) + (2 << 8);
+    speaker_rank(levels, prev, 4, 2, rank);
+    TEST_ASSERT(&ctx, rank[2] == 2 && rank[0] == 3, "Small margin should not switch speaker");
+
+    // Заметно громче - вытесняет
+    memcpy(prev, rank, sizeof(prev));
+    levels[0] = 80 << 8;
+    speaker_rank(levels, prev, 4, 2, rank);
+    TEST_ASSERT(&ctx, rank[0] == 2 && rank[2] == 3, "Louder stream should take the slot");
+
+    TEST_REPORT(&ctx, "test_speaker_rank_hysteresis");
+}
+
+bool test_call_forwards_top_speakers() {
+    TestContext ctx;
+    TEST_INIT(&ctx, "test_call_forwards_top_speakers");
+
+    enum { PARTICIPANTS = CALL_ACTIVE_SPEAKERS + 2 };
+    Call* call = call_new(700);
+    Connection* conns[PARTICIPANTS];
+    Stream* audio[PARTICIPANTS];
+
+    uint64_t now = 10000;
+    for (int i = 0; i < PARTICIPANTS; i++) {
+        conns[i] = make_conn(socket(AF_INET, SOCK_STREAM, 0));
+        TEST_ASSERT(&ctx, call_add_participant(call, conns[i]) == 0, "Should add participant %d", i);
+        audio[i] = stream_new(0, conns[i], call);
+        TEST_ASSERT(&ctx, audio[i] != NULL, "Should create audio stream %d", i);
+        audio[i]->is_audio = true;
+    }
+
+    // Чем больше индекс, тем громче участник
+    for (int i = 0; i < PARTICIPANTS; i++) {
+        for (int p = 0; p < 10; p++) {
+            audio_level_update(&audio[i]->audio_level, (uint8_t)(100 - i * 15), now + p * 20);
+        }
+    }
+    now += 200;
+
+    TEST_ASSERT(&ctx, call_update_active_speakers(call, now), "First update should report a new set");
+    TEST_ASSERT(&ctx, call->active_speakers[0] == audio[PARTICIPANTS - 1], "Loudest should lead the set");
+    TEST_ASSERT(&ctx, !call_update_active_speakers(call, now + SPEAKER_UPDATE_INTERVAL_MS),
+                "Same levels should not change the set");
+
+    // Самый тихий не нужен никому
+    Connection* loudest = conns[PARTICIPANTS - 1];
+    Connection* quiet = conns[0];
+    TEST_ASSERT(&ctx, !call_should_forward_audio(audio[0], loudest), "Quietest stream should be filtered");
+
+    // Первый за набором нужен только тем, кто сам в наборе
+    Stream* next = audio[1];
+    TEST_ASSERT(&ctx, next->speaker_rank == CALL_ACTIVE_SPEAKERS + 1, "Rank should be K+1, got %u", next->speaker_rank);
+    TEST_ASSERT(&ctx, call_should_forward_audio(next, loudest), "Active speaker should hear K other streams");
+    TEST_ASSERT(&ctx, !call_should_forward_audio(next, quiet), "Listener already has K streams");
+    TEST_ASSERT(&ctx, call_should_forward_audio(audio[PARTICIPANTS - 1], quiet), "Top speaker goes to everyone");
+
+    // Самый громкий замолчал (DTX) - набор меняется
+    uint64_t later = now + SPEAKER_SILENCE_TIMEOUT_MS + 1;
+    for (int i = 0; i < PARTICIPANTS - 1; i++) {
+        audio_level_update(&audio[i]->audio_level, (uint8_t)(100 - i * 15), later);
+    }
+    TEST_ASSERT(&ctx, call_update_active_speakers(call, later), "Silent speaker should leave the set");
+    TEST_ASSERT(&ctx, !DENSE_ARRAY_CONTAINS(call->active_speakers, CALL_ACTIVE_SPEAKERS, audio[PARTICIPANTS - 1]),
+                "Silent stream should not be active");
+
+    // Удаленный стрим убирается из набора
+    Stream* leader = call->active_speakers[0];
+    stream_delete(leader);
+    TEST_ASSERT(&ctx, !DENSE_ARRAY_CONTAINS(call->active_speakers, CALL_ACTIVE_SPEAKERS, leader),
+                "Deleted stream should leave the set");
+
+    cleanup_globals();
+    TEST_REPORT(&ctx, "test_call_forwards_top_speakers");
+}
+
+bool run_all_speaker_tests() {
+    printf("Running active speaker tests...\n\n");
+
+    bool all_passed = true;
+    all_passed = test_audio_level_filter() && all_passed;
+    all_passed = test_speaker_rank_hysteresis() && all_passed;
+    all_passed = test_call_forwards_top_speakers() && all_passed;
+
+    if (all_passed) {
+        printf("All active speaker tests passed! ✓\n\n");
+    } else {
+        printf("Some active speaker tests failed! ✗\n\n");
+    }
+
+    return all_passed;
+}
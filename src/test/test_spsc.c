@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "../spsc.h"
+#include "../test_common.h"
+
+bool test_spsc_order_and_capacity() {
+    TestContext ctx;
+    TEST_INIT(&ctx, "test_spsc_order_and_capacity");
+
+    SpscQueue queue;
+    TEST_ASSERT(&ctx, spsc_init(&queue, 6) != 0, "Capacity must be a power of two");
+    TEST_ASSERT(&ctx, spsc_init(&queue, 4) == 0, "Init should succeed");
+    TEST_ASSERT(&ctx, spsc_pop(&queue) == NULL, "New queue should be empty");
+
+    // Несколько оборотов кольца: порядок FIFO и предел емкости
+    uintptr_t next_in = 1, next_out = 1;
+    for (int round = 0; round < 10; round++) {
+        for (int i = 0; i < 4; i++) {
+            TEST_ASSERT(&ctx, spsc_push(&queue, (void*)next_in++), "Push %d should fit", i);
+        }
+        TEST_ASSERT(&ctx, !spsc_push(&queue, (void*)next_in), "Full queue should reject push");
+        TEST_ASSERT(&ctx, spsc_count(&queue) == 4, "Count should be 4, got %u", spsc_count(&queue));
+
+        for (int i = 0; i < 3; i++) {
+            uintptr_t item = (uintptr_t)spsc_pop(&queue);
+            TEST_ASSERT(&ctx, item == next_out, "Expected %lu, got %lu", (unsigned long)next_out, (unsigned long)item);
+            next_out++;
+        }
+        TEST_ASSERT(&ctx, spsc_push(&queue, (void*)next_in++), "Freed slot should be reusable");
+        while (spsc_pop(&queue) != NULL) next_out++;
+        TEST_ASSERT(&ctx, next_out == next_in, "All pushed items should be popped");
+    }
+
+    spsc_destroy(&queue);
+    TEST_REPORT(&ctx, "test_spsc_order_and_capacity");
+}
+
+#define SPSC_TEST_ITEMS 200000
+
+static void* spsc_producer(void* arg) {
+    SpscQueue* queue = arg;
+    for (uintptr_t i = 1; i <= SPSC_TEST_ITEMS; i++) {
+        while (!spsc_push(queue, (void*)i)) {}
+    }
+    return NULL;
+}
+
+bool test_spsc_two_threads() {
+    TestContext ctx;
+    TEST_INIT(&ctx, "test_spsc_two_threads");
+
+    SpscQueue queue;
+    TEST_ASSERT(&ctx, spsc_init(&queue, 64) == 0, "Init should succeed");
+
+    pthread_t producer;
+    TEST_ASSERT(&ctx, pthread_create(&producer, NULL, spsc_producer, &queue) == 0, "Producer should start");
+
+    // Маленькое кольцо: писатель постоянно упирается в читателя
+    uintptr_t expected = 1;
+    bool in_order = true;
+    while (expected <= SPSC_TEST_ITEMS) {
+        void* item = spsc_pop(&queue);
+        if (!item) continue;
+        if ((uintptr_t)item != expected) in_order = false;
+        expected++;
+    }
+    pthread_join(producer, NULL);
+
+    TEST_ASSERT(&ctx, in_order, "Items should arrive in order without loss");
+    TEST_ASSERT(&ctx, spsc_pop(&queue) == NULL, "Queue should be empty at the end");
+
+    spsc_destroy(&queue);
+    TEST_REPORT(&ctx, "test_spsc_two_threads");
+}
+
+bool run_all_spsc_tests() {
+    printf("Running SPSC queue tests...\n\n");
+
+    bool all_passed = true;
+    all_passed = test_spsc_order_and_capacity() && all_passed;
+    all_passed = test_spsc_two_threads() && all_passed;
+
+    if (all_passed) {
+        printf("All SPSC queue tests passed! ✓\n\n");
+    } else {
+        printf("Some SPSC queue tests failed! ✗\n\n");
+    }
+
+    return all_passed;
+}
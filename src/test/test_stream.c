@@ -10,6 +10,9 @@
 #include "../call.h"
 #include "../test_common.h"
 #include "../integrity_check.h"
+#include "../protocol.h"
+#include "../buffer_logic.h"
+#include "../config.h"
 
 static Connection* make_conn(int fd) {
     struct sockaddr_in addr;
@@ -286,6 +289,108 @@ bool test_stream_delete_cleanup() {
     TEST_REPORT(&ctx, "test_stream_delete_cleanup");
 }
 
+// Созданный по сообщению стрим владельца (последний) и тип ответа сервера
+static Stream* created_stream(Connection* owner, int peer, uint8_t* reply_type) {
+    uint8_t data[64];
+    ProtocolFrame frame;
+    ssize_t len = recv(peer, data, sizeof(data), MSG_DONTWAIT);
+    *reply_type = len > 0 && buffer_protocol_next_frame(data, (uint32_t)len, FRAMING_LEGACY, &frame) == 1 ? frame.type : 0;
+    Stream* stream = NULL;
+    for (int i = 0; i < MAX_OUTPUT && owner->own_streams[i]; i++) stream = owner->own_streams[i];
+    return stream;
+}
+
+bool test_stream_create_media_class() {
+    TestContext ctx;
+    TEST_INIT(&ctx, "test_stream_create_media_class");
+
+    int pair[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, pair);
+    Connection* owner = make_conn(pair[0]);
+    uint8_t reply = 0;
+
+    // Прежний 4-байтный CLIENT_STREAM_CREATE по-прежнему кадрируется и создает видео
+    uint8_t legacy[1 + sizeof(StreamCreatePayload)] = { CLIENT_STREAM_CREATE, 0, 0, 0, 0 };
+    ProtocolFrame frame;
+    TEST_ASSERT(&ctx, sizeof(StreamCreatePayload) == 4 &&
+                buffer_protocol_next_frame(legacy, sizeof(legacy), FRAMING_LEGACY, &frame) == 1 &&
+                frame.frame_len == sizeof(legacy), "Legacy create should keep its 5-byte frame");
+    handle_client_message(owner, frame.type, frame.payload, frame.payload_len);
+    Stream* video = created_stream(owner, pair[1], &reply);
+    TEST_ASSERT(&ctx, reply == SERVER_STREAM_CREATED && video && video->media_class == MEDIA_CLASS_VIDEO,
+                "Legacy create should make a video stream");
+
+    StreamCreateMediaPayload audio_request = { .call_id = 0, .media_class = MEDIA_CLASS_AUDIO };
+    handle_client_message(owner, CLIENT_STREAM_CREATE_MEDIA, (const uint8_t*)&audio_request, sizeof(audio_request));
+    Stream* audio = created_stream(owner, pair[1], &reply);
+    TEST_ASSERT(&ctx, reply == SERVER_STREAM_CREATED && audio && audio != video &&
+                audio->media_class == MEDIA_CLASS_AUDIO, "CLIENT_STREAM_CREATE_MEDIA should set the class");
+
+    audio_request.media_class = MEDIA_CLASS_COUNT;
+    handle_client_message(owner, CLIENT_STREAM_CREATE_MEDIA, (const uint8_t*)&audio_request, sizeof(audio_request));
+    TEST_ASSERT(&ctx, created_stream(owner, pair[1], &reply) == audio && reply == SERVER_ERROR,
+                "Unknown class should be rejected");
+
+    connection_delete(owner);
+    close(pair[1]);
+
+    TEST_REPORT(&ctx, "test_stream_create_media_class");
+}
+
+// Пришел ли владельцу SERVER_STREAM_STATS в заданном фрейминге
+static bool got_stream_stats(int peer, uint8_t framing) {
+    uint8_t data[128];
+    ProtocolFrame frame;
+    ssize_t len = recv(peer, data, sizeof(data), MSG_DONTWAIT);
+    return len > 0 && buffer_protocol_next_frame(data, (uint32_t)len, framing, &frame) == 1 &&
+           frame.type == SERVER_STREAM_STATS;
+}
+
+bool test_stream_stats_opt_in() {
+    TestContext ctx;
+    TEST_INIT(&ctx, "test_stream_stats_opt_in");
+
+    int legacy_pair[2], framed_pair[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, legacy_pair);
+    socketpair(AF_UNIX, SOCK_STREAM, 0, framed_pair);
+    Connection* legacy = make_conn(legacy_pair[0]);
+    Connection* framed = make_conn(framed_pair[0]);
+    uint8_t reply = 0;
+
+    StreamCreatePayload request = { .call_id = 0 };
+    handle_client_message(legacy, CLIENT_STREAM_CREATE, (const uint8_t*)&request, sizeof(request));
+    Stream* legacy_stream = created_stream(legacy, legacy_pair[1], &reply);
+    handle_client_message(framed, CLIENT_STREAM_CREATE, (const uint8_t*)&request, sizeof(request));
+    Stream* framed_stream = created_stream(framed, framed_pair[1], &reply);
+    framed->framing = FRAMING_LENGTH_PREFIXED;
+    TEST_ASSERT(&ctx, legacy_stream && framed_stream, "Both owners should get a stream");
+
+    TEST_ASSERT(&ctx, g_config.stream_stats_interval_ms == 0, "Stream stats should be off by default");
+
+    // Включены явно: первый обход открывает интервал, второй отчитывается о пакетах
+    uint32_t saved_interval = g_config.stream_stats_interval_ms;
+    g_config.stream_stats_interval_ms = 1;
+    process_stream_stats();
+    seq_stats_update(&legacy_stream->ingress[0], 1, 1000);
+    seq_stats_update(&framed_stream->ingress[0], 1, 1000);
+    usleep(5000);
+    process_stream_stats();
+    g_config.stream_stats_interval_ms = saved_interval;
+
+    TEST_ASSERT(&ctx, got_stream_stats(framed_pair[1], FRAMING_LENGTH_PREFIXED),
+                "Length-prefixed owner should get SERVER_STREAM_STATS");
+    uint8_t data[128];
+    TEST_ASSERT(&ctx, recv(legacy_pair[1], data, sizeof(data), MSG_DONTWAIT) < 0,
+                "Legacy owner should never get SERVER_STREAM_STATS");
+
+    connection_delete(legacy);
+    connection_delete(framed);
+    close(legacy_pair[1]);
+    close(framed_pair[1]);
+
+    TEST_REPORT(&ctx, "test_stream_stats_opt_in");
+}
+
 bool run_all_stream_tests() {
     printf("Running stream tests...\n\n");
     
@@ -295,6 +400,8 @@ bool run_all_stream_tests() {
     all_passed = test_stream_recipient_management() && all_passed;
     all_passed = test_stream_find_functions() && all_passed;
     all_passed = test_stream_delete_cleanup() && all_passed;
+    all_passed = test_stream_create_media_class() && all_passed;
+    all_passed = test_stream_stats_opt_in() && all_passed;
     
     if (all_passed) {
         printf("All stream tests passed! ✓\n\n");
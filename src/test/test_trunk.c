@@ -0,0 +1,220 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/epoll.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+
+#include "../trunk.h"
+#include "../protocol.h"
+#include "../buffer_logic.h"
+#include "../stream.h"
+#include "../test_common.h"
+#include "../time_utils.h"
+
+// Сокет узла-источника на loopback с эфемерным портом
+static int origin_socket(int type, struct sockaddr_in* addr) {
+    int fd = socket(AF_INET, type, 0);
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    inet_pton(AF_INET, "127.0.0.1", &addr->sin_addr);
+    bind(fd, (struct sockaddr*)addr, sizeof(*addr));
+    socklen_t addr_len = sizeof(*addr);
+    getsockname(fd, (struct sockaddr*)addr, &addr_len);
+
+    struct timeval timeout = {1, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if (type == SOCK_STREAM) listen(fd, 1);
+    return fd;
+}
+
+// Формат, в котором источник пишет магистрали (после SERVER_FRAMING - с длиной)
+static uint8_t origin_framing = FRAMING_LEGACY;
+
+static void origin_write(int fd, const uint8_t* message, size_t len) {
+    uint8_t framed[FRAMING_HEADER_SIZE + 64];
+    size_t header = origin_framing == FRAMING_LENGTH_PREFIXED ? FRAMING_HEADER_SIZE : 0;
+    framed[0] = (uint8_t)(len >> 8);
+    framed[1] = (uint8_t)len;
+    memcpy(framed + FRAMING_HEADER_SIZE, message, len);
+    if (write(fd, framed + FRAMING_HEADER_SIZE - header, header + len) != (ssize_t)(header + len)) perror("origin_write");
+}
+
+static void origin_send(int fd, uint8_t type, uint32_t value) {
+    uint8_t message[5];
+    uint32_t net = htonl(value);
+    message[0] = type;
+    memcpy(message + 1, &net, sizeof(net));
+    origin_write(fd, message, sizeof(message));
+}
+
+static void origin_send_error(int fd, uint8_t original, const char* text) {
+    uint8_t message[64];
+    message[0] = SERVER_ERROR;
+    message[1] = original;
+    message[2] = (uint8_t)strlen(text);
+    memcpy(message + 3, text, strlen(text));
+    origin_write(fd, message, 3 + strlen(text));
+}
+
+// Следующая команда магистрали (после CLIENT_FRAMING - с длиной): тип и stream_id
+static bool origin_recv(int fd, uint8_t* type, uint32_t* value) {
+    uint8_t message[FRAMING_HEADER_SIZE + 5];
+    if (recv(fd, message, sizeof(message), MSG_WAITALL) != (ssize_t)sizeof(message)) return false;
+    if (message[0] != 0 || message[1] != 5) return false;
+    *type = message[2];
+    memcpy(value, message + 3, sizeof(*value));
+    *value = ntohl(*value);
+    return true;
+}
+
+bool test_trunk_subscription_lifecycle() {
+    TestContext ctx;
+    TEST_INIT(&ctx, "test_trunk_subscription_lifecycle");
+
+    struct sockaddr_in origin_tcp, origin_udp, local_udp;
+    int listen_fd = origin_socket(SOCK_STREAM, &origin_tcp);
+    int origin_udp_fd = origin_socket(SOCK_DGRAM, &origin_udp);
+    int udp_fd = origin_socket(SOCK_DGRAM, &local_udp);
+
+    // Основной цикл не нужен: события сокета магистрали подаем вручную
+    TEST_ASSERT(&ctx, trunk_start(&origin_tcp, &origin_udp, -1, udp_fd) == 0, "Trunk should start");
+    int peer = accept(listen_fd, NULL, NULL);
+    TEST_ASSERT(&ctx, peer >= 0, "Origin should accept the trunk");
+    int yes = 1;
+    setsockopt(peer, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+    trunk_on_event(EPOLLOUT);
+    TEST_ASSERT(&ctx, trunk_stats().state == TRUNK_HANDSHAKE, "Trunk should wait for handshake");
+
+    // Первым делом магистраль просит сообщения с длиной
+    uint8_t request[1 + sizeof(FramingPayload)];
+    TEST_ASSERT(&ctx, recv(peer, request, sizeof(request), MSG_WAITALL) == (ssize_t)sizeof(request) &&
+                request[0] == CLIENT_FRAMING && request[1] == FRAMING_LENGTH_PREFIXED,
+                "Trunk should ask for length-prefixed framing");
+
+    // UDP handshake уходит с сокета узла, на него же потом пойдут пакеты
+    origin_framing = FRAMING_LEGACY;
+    origin_send(peer, SERVER_HANDSHAKE_START, 77);
+    uint8_t reply[1 + sizeof(FramingPayload)] = { SERVER_FRAMING, FRAMING_LENGTH_PREFIXED };
+    origin_write(peer, reply, sizeof(reply));
+    origin_framing = FRAMING_LENGTH_PREFIXED;
+    trunk_on_event(EPOLLIN);
+    UDPHandshakePacket hs;
+    TEST_ASSERT(&ctx, recv(origin_udp_fd, &hs, sizeof(hs), 0) == (ssize_t)sizeof(hs) &&
+                hs.zero == 0 && ntohl(hs.connection_id) == 77, "Origin should get UDP handshake for connection 77");
+
+    // Подписка до конца handshake ждет, зеркало уже есть
+    Stream* mirror = trunk_subscribe(4242);
+    TEST_ASSERT(&ctx, mirror && mirror->relayed && !mirror->owner, "Relayed mirror should be created");
+    TEST_ASSERT(&ctx, stream_find_by_id(4242) == mirror, "Mirror should be registered under the origin id");
+    TEST_ASSERT(&ctx, trunk_subscribe(4242) == mirror, "Second subscribe should reuse the mirror");
+
+    origin_send(peer, SERVER_HANDSHAKE_END, 77);
+    trunk_on_event(EPOLLIN);
+    TEST_ASSERT(&ctx, trunk_stats().state == TRUNK_UP, "Trunk should be up");
+
+    uint8_t type = 0;
+    uint32_t value = 0;
+    TEST_ASSERT(&ctx, origin_recv(peer, &type, &value) && type == CLIENT_STREAM_CONN_JOIN && value == 4242,
+                "Waiting subscription should be joined after handshake");
+
+    // Вторая подписка отклонена источником: зеркало удаляется
+    trunk_subscribe(5353);
+    TEST_ASSERT(&ctx, origin_recv(peer, &type, &value) && type == CLIENT_STREAM_CONN_JOIN && value == 5353,
+                "Second join expected");
+    origin_send(peer, SERVER_STREAM_CONN_JOINED, 4242);
+    // Усеченный SERVER_ERROR без длины текста отказом не считается
+    uint8_t truncated[] = { SERVER_ERROR, CLIENT_STREAM_CONN_JOIN };
+    origin_write(peer, truncated, sizeof(truncated));
+    trunk_on_event(EPOLLIN);
+    TEST_ASSERT(&ctx, trunk_stats().join_failures == 0 && stream_find_by_id(5353) != NULL,
+                "Truncated error should not refuse the pending join");
+    origin_send_error(peer, CLIENT_STREAM_CONN_JOIN, "ERROR: COULDN'T FIND STREAM");
+    trunk_on_event(EPOLLIN);
+
+    TrunkStats stats = trunk_stats();
+    TEST_ASSERT(&ctx, stats.subscriptions == 1 && stats.active == 1, "One active subscription should remain");
+    TEST_ASSERT(&ctx, stats.join_failures == 1, "Refused join should be counted");
+    TEST_ASSERT(&ctx, stream_find_by_id(5353) == NULL, "Refused mirror should be deleted");
+
+    // Без зрителей подписка снимается после паузы
+    uint64_t now = monotonic_ms();
+    trunk_tick(now);
+    trunk_tick(now + TRUNK_LINGER_MS - 1);
+    TEST_ASSERT(&ctx, stream_find_by_id(4242) == mirror, "Mirror should linger");
+    trunk_tick(now + TRUNK_LINGER_MS);
+    TEST_ASSERT(&ctx, origin_recv(peer, &type, &value) && type == CLIENT_STREAM_CONN_LEAVE && value == 4242,
+                "Idle subscription should leave the origin stream");
+    TEST_ASSERT(&ctx, stream_find_by_id(4242) == NULL && trunk_stats().subscriptions == 0,
+                "Idle mirror should be deleted");
+
+    // Обрыв: магистраль уходит в переподключение
+    close(peer);
+    trunk_on_event(EPOLLIN);
+    TEST_ASSERT(&ctx, trunk_stats().state == TRUNK_DOWN && trunk_stats().disconnects == 1,
+                "Closed origin should take the trunk down");
+
+    trunk_stop();
+    TEST_ASSERT(&ctx, !trunk_enabled(), "Trunk should be off after stop");
+    close(listen_fd);
+    close(origin_udp_fd);
+    close(udp_fd);
+    TEST_REPORT(&ctx, "test_trunk_subscription_lifecycle");
+}
+
+// Запись связки: длина и пакет без данных
+static size_t bundle_entry(uint8_t* out, uint32_t stream_id, uint32_t number) {
+    UDPStreamPacket packet = { .stream_id = htonl(stream_id), .packet_number = htonl(number) };
+    uint16_t len = htons(UDP_HEADER_SIZE);
+    memcpy(out, &len, sizeof(len));
+    memcpy(out + UDP_BUNDLE_ENTRY_HEADER, &packet, UDP_HEADER_SIZE);
+    return UDP_BUNDLE_ENTRY_HEADER + UDP_HEADER_SIZE;
+}
+
+bool test_trunk_bundle_ingress() {
+    TestContext ctx;
+    TEST_INIT(&ctx, "test_trunk_bundle_ingress");
+
+    // Источник с --bundle-window шлет узлу связки вместо отдельных пакетов
+    Stream* mirror = stream_new_relayed(6161);
+    uint8_t bundle[UDP_BUNDLE_HEADER_SIZE + 3 * (UDP_BUNDLE_ENTRY_HEADER + UDP_HEADER_SIZE)];
+    uint32_t marker = htonl(UDP_BUNDLE_MARKER);
+    memcpy(bundle, &marker, sizeof(marker));
+    size_t len = UDP_BUNDLE_HEADER_SIZE;
+    len += bundle_entry(bundle + len, 6161, 1);
+    len += bundle_entry(bundle + len, 6161, 2);
+    struct sockaddr_in origin = { .sin_family = AF_INET };
+    handle_udp_packet(bundle, len, &origin);
+    TEST_ASSERT(&ctx, mirror->ingress[0].received == 2 && mirror->ingress[0].highest == 2,
+                "Both bundled packets should reach the mirror, got %lu",
+                (unsigned long)mirror->ingress[0].received);
+
+    // Обрезанная запись: предыдущие приняты, остаток отброшен
+    len = UDP_BUNDLE_HEADER_SIZE;
+    len += bundle_entry(bundle + len, 6161, 3);
+    len += bundle_entry(bundle + len, 6161, 4);
+    handle_udp_packet(bundle, len - 1, &origin);
+    TEST_ASSERT(&ctx, mirror->ingress[0].received == 3 && mirror->ingress[0].highest == 3,
+                "Truncated entry should be dropped, got %lu", (unsigned long)mirror->ingress[0].received);
+
+    stream_delete(mirror);
+    TEST_REPORT(&ctx, "test_trunk_bundle_ingress");
+}
+
+bool run_all_trunk_tests() {
+    printf("Running trunk tests...\n\n");
+
+    bool all_passed = true;
+    all_passed = test_trunk_subscription_lifecycle() && all_passed;
+    all_passed = test_trunk_bundle_ingress() && all_passed;
+
+    if (all_passed) {
+        printf("All trunk tests passed! ✓\n\n");
+    } else {
+        printf("Some trunk tests failed! ✗\n\n");
+    }
+
+    return all_passed;
+}
@@ -0,0 +1,14 @@
+#pragma once
+#include <stdint.h>
+#include <time.h>
+
+// Монотонное время в микросекундах (не зависит от перевода системных часов)
+static inline uint64_t monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ull + (uint64_t)ts.tv_nsec / 1000ull;
+}
+
+static inline uint64_t monotonic_ms(void) {
+    return monotonic_us() / 1000ull;
+}
@@ -0,0 +1,207 @@
+// Проверка кластера из нескольких локальных серверов (--cluster, --cluster-self):
+// создатели звонков подключаются к узлам по кругу, затем к каждому звонку входит
+// клиент случайного узла. Вход на чужом узле должен вернуть SERVER_CALL_REDIRECT
+// на узел-создатель, повторный вход там - SERVER_CALL_CONN_JOINED.
+// Кольцо берется прямо из исходника кластера: утилиты с сервером не линкуются.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "protocol.h"
+#include "time_utils.h"
+#include "cluster.c"
+
+#define PROBE_MAX_CALLS 512
+
+typedef struct {
+    int fd;
+    uint8_t rx[BUFFER_SIZE];
+    size_t rx_len;
+} Client;
+
+// Размер полного сообщения сервера по схеме протокола или 0, если данных пока не хватает
+static size_t server_message_size(const uint8_t* data, size_t avail) {
+    uint32_t size = 0;
+    if (avail < 1 || protocol_payload_size(data[0], data + 1, (uint32_t)(avail - 1), &size) != 1) return 0;
+    return 1 + size;
+}
+
+// Ждет сообщение одного из типов; копирует его в out, возвращает тип или -1
+static int client_wait(Client* c, uint8_t a, uint8_t b, uint8_t* out, size_t out_len, int timeout_ms) {
+    uint64_t deadline = monotonic_ms() + (uint64_t)timeout_ms;
+    for (;;) {
+        size_t size = server_message_size(c->rx, c->rx_len);
+        if (size > 0 && c->rx_len >= size) {
+            uint8_t type = c->rx[0];
+            if (out) memcpy(out, c->rx, size < out_len ? size : out_len);
+            memmove(c->rx, c->rx + size, c->rx_len - size);
+            c->rx_len -= size;
+            if (type == a || type == b || type == SERVER_ERROR) return type;
+            continue;
+        }
+
+        uint64_t now = monotonic_ms();
+        if (now >= deadline) return -1;
+        struct pollfd pfd = { .fd = c->fd, .events = POLLIN };
+        if (poll(&pfd, 1, (int)(deadline - now)) <= 0) return -1;
+        ssize_t n = read(c->fd, c->rx + c->rx_len, sizeof(c->rx) - c->rx_len);
+        if (n <= 0) return -1;
+        c->rx_len += (size_t)n;
+    }
+}
+
+static int client_connect(Client* c, const ClusterNode* node) {
+    memset(c, 0, sizeof(*c));
+    c->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (c->fd < 0 || connect(c->fd, (const struct sockaddr*)&node->tcp_addr, sizeof(node->tcp_addr)) != 0) {
+        perror("connect");
+        return -1;
+    }
+    int yes = 1;
+    setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+    return client_wait(c, SERVER_HANDSHAKE_START, SERVER_HANDSHAKE_START, NULL, 0, 2000) == SERVER_HANDSHAKE_START
+           ? 0 : -1;
+}
+
+static int client_send(Client* c, uint8_t type, uint32_t value, bool with_value) {
+    uint8_t message[1 + sizeof(uint32_t)];
+    uint32_t net = htonl(value);
+    message[0] = type;
+    memcpy(message + 1, &net, sizeof(net));
+    size_t len = with_value ? sizeof(message) : 1;
+    return write(c->fd, message, len) == (ssize_t)len ? 0 : -1;
+}
+
+static int node_by_port(uint16_t tcp_port) {
+    for (uint32_t n = 0; n < cluster_node_count(); n++) {
+        if (ntohs(cluster_node(n)->tcp_addr.sin_port) == tcp_port) return (int)n;
+    }
+    return -1;
+}
+
+static void usage(const char* prog) {
+    printf("Usage: %s --nodes HOST:TCP:UDP[:WEIGHT],... [options]\n", prog);
+    printf("  --nodes LIST   cluster nodes, same list as the servers' --cluster\n");
+    printf("  --calls N      calls to create, up to %d (60)\n", PROBE_MAX_CALLS);
+}
+
+int main(int argc, char** argv) {
+    const char* list = NULL;
+    int call_count = 60;
+
+    static struct option long_options[] = {
+        {"nodes", required_argument, 0, 'n'},
+        {"calls", required_argument, 0, 'c'},
+        {"help", no_argument, 0, 'h'},
+        {0, 0, 0, 0}
+    };
+
+    int ch;
+    while ((ch = getopt_long(argc, argv, "", long_options, NULL)) != -1) {
+        switch (ch) {
+            case 'n': list = optarg; break;
+            case 'c': call_count = atoi(optarg); break;
+            case 'h': usage(argv[0]); return 0;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (!list || call_count <= 0 || call_count > PROBE_MAX_CALLS) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    ClusterNode nodes[CLUSTER_MAX_NODES];
+    uint32_t node_count = 0;
+    char buffer[1024];
+    snprintf(buffer, sizeof(buffer), "%s", list);
+    for (char* item = strtok(buffer, ","); item; item = strtok(NULL, ",")) {
+        if (node_count >= CLUSTER_MAX_NODES || cluster_parse_node(item, &nodes[node_count]) != 0) {
+            fprintf(stderr, "Bad node: %s\n", item);
+            return 1;
+        }
+        node_count++;
+    }
+    if (node_count < 2 || cluster_init(nodes, node_count, 0) != 0) {
+        fprintf(stderr, "Need at least two nodes\n");
+        return 1;
+    }
+
+    // Создатели звонков - по кругу по узлам
+    static Client creators[PROBE_MAX_CALLS];
+    uint32_t call_ids[PROBE_MAX_CALLS];
+    uint32_t created[CLUSTER_MAX_NODES] = {0};
+    for (int i = 0; i < call_count; i++) {
+        uint32_t node = (uint32_t)i % node_count;
+        uint8_t reply[16];
+        if (client_connect(&creators[i], &nodes[node]) != 0 ||
+            client_send(&creators[i], CLIENT_CALL_CREATE, 0, false) != 0 ||
+            client_wait(&creators[i], SERVER_CALL_CREATED, SERVER_CALL_CREATED, reply, sizeof(reply), 2000) !=
+                SERVER_CALL_CREATED) {
+            fprintf(stderr, "Call create on node %u failed\n", node);
+            return 1;
+        }
+        memcpy(&call_ids[i], reply + 1, sizeof(uint32_t));
+        call_ids[i] = ntohl(call_ids[i]);
+        if (cluster_owner_of(call_ids[i]) != node) {
+            fprintf(stderr, "Call %u created on node %u hashes to node %u\n", call_ids[i], node,
+                    cluster_owner_of(call_ids[i]));
+            return 1;
+        }
+        created[node]++;
+    }
+
+    // Вход с любого узла, по редиректу - на владельца
+    uint32_t redirected = 0, joined = 0;
+    double redirect_ms = 0;
+    srand(1);
+    for (int i = 0; i < call_count; i++) {
+        uint32_t node = (uint32_t)rand() % node_count;
+        Client joiner;
+        uint8_t reply[64];
+        uint64_t start = monotonic_us();
+        if (client_connect(&joiner, &nodes[node]) != 0) return 1;
+        client_send(&joiner, CLIENT_CALL_CONN_JOIN, call_ids[i], true);
+        int type = client_wait(&joiner, SERVER_CALL_CONN_JOINED, SERVER_CALL_REDIRECT, reply, sizeof(reply), 2000);
+
+        if (type == SERVER_CALL_REDIRECT) {
+            CallRedirectPayload redirect;
+            memcpy(&redirect, reply + 1, sizeof(redirect));
+            int owner = node_by_port(ntohs(redirect.tcp_port));
+            if (owner < 0 || (uint32_t)owner != cluster_owner_of(call_ids[i])) {
+                fprintf(stderr, "Call %u redirected to unknown node port %u\n", call_ids[i], ntohs(redirect.tcp_port));
+                return 1;
+            }
+            close(joiner.fd);
+            if (client_connect(&joiner, &nodes[owner]) != 0) return 1;
+            client_send(&joiner, CLIENT_CALL_CONN_JOIN, call_ids[i], true);
+            type = client_wait(&joiner, SERVER_CALL_CONN_JOINED, SERVER_CALL_CONN_JOINED, NULL, 0, 2000);
+            redirected++;
+            redirect_ms += (monotonic_us() - start) / 1000.0;
+        }
+        if (type != SERVER_CALL_CONN_JOINED) {
+            fprintf(stderr, "Join of call %u failed\n", call_ids[i]);
+            return 1;
+        }
+        joined++;
+        close(joiner.fd);
+    }
+
+    printf("node  ring_share  calls\n");
+    for (uint32_t n = 0; n < node_count; n++) {
+        uint32_t share = cluster_ring_share(n);
+        printf("%4u  %8u.%u%%  %5u\n", n, share / 10, share % 10, created[n]);
+    }
+    printf("\n%u/%d joins succeeded, %u via redirect (avg %.2f ms incl. reconnect)\n", joined, call_count,
+           redirected, redirected ? redirect_ms / redirected : 0.0);
+
+    for (int i = 0; i < call_count; i++) close(creators[i].fd);
+    return joined == (uint32_t)call_count ? 0 : 1;
+}
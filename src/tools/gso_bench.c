@@ -0,0 +1,259 @@
+// Бенчмарк отправки UDP: поштучный sendto против серий UDP_SEGMENT (GSO).
+// Отправитель шлет пачки датаграмм одного размера одному получателю (как пейсер
+// сервера шлет серию ключевого кадра одному зрителю), приемник в отдельном потоке
+// считает доставленное. Сравнивается процессорное время отправляющего потока.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <getopt.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/udp.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "network.h"
+#include "protocol.h"
+
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+
+typedef struct {
+    const char* host;
+    int packets;
+    int burst;
+    int size;
+} Options;
+
+typedef struct {
+    int fd;
+    volatile bool done;
+    uint64_t received;
+} Receiver;
+
+typedef struct {
+    uint64_t sent;
+    uint64_t syscalls;
+    uint64_t errors;
+    uint64_t wall_ns;
+    uint64_t cpu_ns;
+    uint64_t received;
+} BenchResult;
+
+static uint64_t clock_ns(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void* receiver_main(void* arg) {
+    Receiver* rx = arg;
+    uint8_t buffer[UDP_PACKET_SIZE];
+
+    // Дочитываем очередь и после завершения отправки, пока она не опустеет
+    for (;;) {
+        struct pollfd pfd = {.fd = rx->fd, .events = POLLIN};
+        int ready = poll(&pfd, 1, 100);
+        if (ready <= 0) {
+            if (rx->done) break;
+            continue;
+        }
+        while (recv(rx->fd, buffer, sizeof(buffer), MSG_DONTWAIT) > 0) {
+            rx->received++;
+        }
+    }
+    return NULL;
+}
+
+static int send_burst_plain(int fd, const uint8_t* data, int count, int size,
+                            const struct sockaddr_in* dest, BenchResult* result) {
+    for (int i = 0; i < count; i++) {
+        result->syscalls++;
+        if (sendto(fd, data, (size_t)size, 0, (const struct sockaddr*)dest, sizeof(*dest)) != size) {
+            result->errors++;
+            continue;
+        }
+        result->sent++;
+    }
+    return 0;
+}
+
+static int send_burst_gso(int fd, const uint8_t* data, int count, int size,
+                          const struct sockaddr_in* dest, BenchResult* result) {
+    int max_segments = UDP_GSO_MAX_BYTES / size;
+    if (max_segments > UDP_GSO_MAX_SEGMENTS) max_segments = UDP_GSO_MAX_SEGMENTS;
+
+    while (count > 0) {
+        int segments = count < max_segments ? count : max_segments;
+
+        struct iovec iov[UDP_GSO_MAX_SEGMENTS];
+        for (int i = 0; i < segments; i++) {
+            iov[i].iov_base = (void*)data;
+            iov[i].iov_len = (size_t)size;
+        }
+
+        union {
+            char buf[CMSG_SPACE(sizeof(uint16_t))];
+            struct cmsghdr align;
+        } control;
+        memset(&control, 0, sizeof(control));
+
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_name = (void*)dest;
+        msg.msg_namelen = sizeof(*dest);
+        msg.msg_iov = iov;
+        msg.msg_iovlen = (size_t)segments;
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+
+        uint16_t segment_size = (uint16_t)size;
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_UDP;
+        cmsg->cmsg_type = UDP_SEGMENT;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+        memcpy(CMSG_DATA(cmsg), &segment_size, sizeof(uint16_t));
+
+        result->syscalls++;
+        if (sendmsg(fd, &msg, 0) < 0) {
+            if (errno == EIO || errno == EINVAL || errno == EOPNOTSUPP) {
+                fprintf(stderr, "UDP GSO is not available: %s\n", strerror(errno));
+                return -1;
+            }
+            result->errors += (uint64_t)segments;
+        } else {
+            result->sent += (uint64_t)segments;
+        }
+        count -= segments;
+    }
+    return 0;
+}
+
+static int run_bench(const Options* opt, bool gso, BenchResult* result) {
+    memset(result, 0, sizeof(*result));
+
+    Receiver rx = {.fd = socket(AF_INET, SOCK_DGRAM, 0)};
+    int tx_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (rx.fd < 0 || tx_fd < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    int rcvbuf = 32 * 1024 * 1024;
+    setsockopt(rx.fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    struct sockaddr_in dest;
+    memset(&dest, 0, sizeof(dest));
+    dest.sin_family = AF_INET;
+    inet_pton(AF_INET, opt->host, &dest.sin_addr);
+    if (bind(rx.fd, (struct sockaddr*)&dest, sizeof(dest)) != 0) {
+        perror("bind");
+        return -1;
+    }
+    socklen_t dest_len = sizeof(dest);
+    getsockname(rx.fd, (struct sockaddr*)&dest, &dest_len);
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, receiver_main, &rx);
+
+    uint8_t data[UDP_PACKET_SIZE];
+    memset(data, 0x5A, sizeof(data));
+
+    uint64_t wall_start = clock_ns(CLOCK_MONOTONIC);
+    uint64_t cpu_start = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+
+    int status = 0;
+    for (int left = opt->packets; left > 0 && status == 0; left -= opt->burst) {
+        int count = left < opt->burst ? left : opt->burst;
+        status = gso ? send_burst_gso(tx_fd, data, count, opt->size, &dest, result)
+                     : send_burst_plain(tx_fd, data, count, opt->size, &dest, result);
+    }
+
+    result->cpu_ns = clock_ns(CLOCK_THREAD_CPUTIME_ID) - cpu_start;
+    result->wall_ns = clock_ns(CLOCK_MONOTONIC) - wall_start;
+
+    rx.done = true;
+    pthread_join(thread, NULL);
+    result->received = rx.received;
+
+    close(tx_fd);
+    close(rx.fd);
+    return status;
+}
+
+static void print_result(const char* name, const BenchResult* r) {
+    double cpu_ms = (double)r->cpu_ns / 1e6;
+    double wall_ms = (double)r->wall_ns / 1e6;
+    printf("%-8s %10lu %10lu %10.1f %10.1f %10.0f %10.2f %9.1f%%\n",
+           name, (unsigned long)r->sent, (unsigned long)r->syscalls, wall_ms, cpu_ms,
+           r->sent ? (double)r->cpu_ns / (double)r->sent : 0.0,
+           r->cpu_ns ? (double)r->sent * 1000.0 / (double)r->cpu_ns : 0.0,
+           r->sent ? 100.0 * (double)r->received / (double)r->sent : 0.0);
+}
+
+static void usage(const char* name) {
+    printf("Usage: %s [options]\n", name);
+    printf("  --host ADDR     receiver address (127.0.0.1)\n");
+    printf("  --packets N     datagrams per run (200000)\n");
+    printf("  --burst N       datagrams per burst to one recipient (32)\n");
+    printf("  --size N        datagram size in bytes (%d)\n", UDP_PACKET_SIZE);
+}
+
+int main(int argc, char* argv[]) {
+    Options opt = {.host = "127.0.0.1", .packets = 200000, .burst = 32, .size = UDP_PACKET_SIZE};
+
+    static const struct option long_options[] = {
+        {"host", required_argument, 0, 'h'},
+        {"packets", required_argument, 0, 'n'},
+        {"burst", required_argument, 0, 'b'},
+        {"size", required_argument, 0, 's'},
+        {"help", no_argument, 0, '?'},
+        {0, 0, 0, 0}
+    };
+
+    int ch;
+    while ((ch = getopt_long(argc, argv, "", long_options, NULL)) != -1) {
+        switch (ch) {
+            case 'h': opt.host = optarg; break;
+            case 'n': opt.packets = atoi(optarg); break;
+            case 'b': opt.burst = atoi(optarg); break;
+            case 's': opt.size = atoi(optarg); break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+
+    if (opt.packets < 1 || opt.burst < 1 || opt.size < 1 || opt.size > UDP_PACKET_SIZE) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    printf("%d datagrams of %d bytes, bursts of %d to one recipient on %s\n\n",
+           opt.packets, opt.size, opt.burst, opt.host);
+    printf("%-8s %10s %10s %10s %10s %10s %10s %10s\n",
+           "mode", "sent", "syscalls", "wall ms", "cpu ms", "ns/pkt", "Mpps/cpu", "delivered");
+
+    BenchResult plain, gso;
+    if (run_bench(&opt, false, &plain) != 0) return 1;
+    print_result("sendto", &plain);
+
+    if (run_bench(&opt, true, &gso) != 0) return 1;
+    print_result("gso", &gso);
+
+    if (gso.cpu_ns > 0 && gso.sent > 0 && plain.sent > 0) {
+        double per_plain = (double)plain.cpu_ns / (double)plain.sent;
+        double per_gso = (double)gso.cpu_ns / (double)gso.sent;
+        printf("\nGSO sender CPU per packet: %.2fx of sendto\n", per_gso / per_plain);
+    }
+    return 0;
+}
@@ -0,0 +1,505 @@
+// Генератор нагрузки: один издатель и несколько зрителей одного стрима.
+// Издатель шлет пакеты с заданной частотой и размечает ключевые кадры,
+// зрители подключаются по очереди, для каждого измеряется time-to-first-frame:
+// время от CLIENT_STREAM_CONN_JOIN до первого пакета ключевого кадра.
+// С --viewer-tcp-port/--viewer-udp-port зрители подключаются к другому узлу,
+// который получает стрим по магистрали (server --trunk).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <getopt.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <netinet/udp.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "protocol.h"
+#include "time_utils.h"
+
+#define LOADGEN_MAX_VIEWERS 64
+#define LOADGEN_MAX_BURST 64
+
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+
+typedef struct {
+    int tcp_fd;
+    int udp_fd;
+    uint32_t connection_id;
+    uint8_t rx[BUFFER_SIZE];
+    size_t rx_len;
+
+    uint64_t join_sent_us;
+    uint64_t first_frame_us;
+    uint64_t packets_received;
+    uint64_t bundles_received;   // датаграмм-связок (сервер с --bundle-window)
+    bool joined;
+
+    // Отчет о приеме за текущий интервал (CLIENT_RECEIVER_REPORT)
+    int loss_percent;            // имитация потерь на канале до этого зрителя
+    uint32_t report_first_number;
+    uint32_t report_highest_number;
+    uint32_t report_packets;
+    uint32_t report_bytes;
+    uint64_t report_first_us;
+    uint64_t report_last_us;
+    uint64_t next_report_us;
+} Client;
+
+typedef struct {
+    const char* host;
+    int tcp_port;
+    int udp_port;
+    int viewer_tcp_port;   // узел зрителей (по умолчанию тот же, что у издателя)
+    int viewer_udp_port;
+    int viewers;
+    int rate;              // пакетов в секунду
+    int gop;               // пакетов между ключевыми кадрами
+    int payload;           // байт данных в пакете
+    int join_interval_ms;
+    int duration_ms;
+    int burst;             // пакетов издателя в одном UDP_SEGMENT (1 - по одному sendto)
+    int report_interval_ms; // период CLIENT_RECEIVER_REPORT, 0 - не отправлять
+    int slow_loss;         // % потерь у последнего зрителя
+    bool droppable;        // помечать каждый второй не ключевой пакет как droppable
+} Options;
+
+static struct sockaddr_in g_server_udp;
+static struct sockaddr_in g_viewer_udp;
+
+// ==================== РАЗБОР СООБЩЕНИЙ СЕРВЕРА ====================
+
+// Размер полного сообщения сервера по схеме протокола или 0, если данных пока не хватает
+static size_t server_message_size(const uint8_t* data, size_t avail) {
+    uint32_t size = 0;
+    if (avail < 1 || protocol_payload_size(data[0], data + 1, (uint32_t)(avail - 1), &size) != 1) return 0;
+    return 1 + size;
+}
+
+// Читает одно сообщение; возвращает 1 - есть сообщение, 0 - нет данных, -1 - ошибка
+static int client_poll_message(Client* c, uint8_t* type, uint32_t* value, int timeout_ms) {
+    for (;;) {
+        size_t size = server_message_size(c->rx, c->rx_len);
+        if (size > 0 && c->rx_len >= size) {
+            *type = c->rx[0];
+            uint32_t v = 0;
+            if (size >= 5) memcpy(&v, c->rx + 1, sizeof(v));
+            *value = ntohl(v);
+            memmove(c->rx, c->rx + size, c->rx_len - size);
+            c->rx_len -= size;
+            return 1;
+        }
+
+        struct pollfd pfd = { .fd = c->tcp_fd, .events = POLLIN };
+        int ready = poll(&pfd, 1, timeout_ms);
+        if (ready <= 0) return ready;
+
+        ssize_t n = read(c->tcp_fd, c->rx + c->rx_len, sizeof(c->rx) - c->rx_len);
+        if (n <= 0) return -1;
+        c->rx_len += (size_t)n;
+    }
+}
+
+static int client_wait_message(Client* c, uint8_t wanted, uint32_t* value, int timeout_ms) {
+    uint64_t deadline = monotonic_ms() + (uint64_t)timeout_ms;
+    while (monotonic_ms() < deadline) {
+        uint8_t type;
+        int result = client_poll_message(c, &type, value, 50);
+        if (result < 0) return -1;
+        if (result == 1 && type == wanted) return 0;
+        if (result == 1 && type == SERVER_ERROR) return -1;
+    }
+    return -1;
+}
+
+static int client_send(Client* c, uint8_t type, uint32_t value) {
+    uint8_t message[1 + sizeof(uint32_t)];
+    uint32_t net = htonl(value);
+    message[0] = type;
+    memcpy(message + 1, &net, sizeof(net));
+    return write(c->tcp_fd, message, sizeof(message)) == (ssize_t)sizeof(message) ? 0 : -1;
+}
+
+// ==================== ПОДКЛЮЧЕНИЕ ====================
+
+static int client_connect(Client* c, const Options* opt, int tcp_port, const struct sockaddr_in* server_udp) {
+    memset(c, 0, sizeof(*c));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(tcp_port);
+    inet_pton(AF_INET, opt->host, &addr.sin_addr);
+
+    c->tcp_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (c->tcp_fd < 0 || connect(c->tcp_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        perror("connect");
+        return -1;
+    }
+    int yes = 1;
+    setsockopt(c->tcp_fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
+    c->udp_fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    if (c->udp_fd < 0) {
+        perror("socket udp");
+        return -1;
+    }
+
+    if (client_wait_message(c, SERVER_HANDSHAKE_START, &c->connection_id, 2000) != 0) {
+        fprintf(stderr, "No SERVER_HANDSHAKE_START\n");
+        return -1;
+    }
+
+    // UDP handshake повторяем, пока не придет SERVER_HANDSHAKE_END
+    UDPHandshakePacket hs;
+    memset(&hs, 0, sizeof(hs));
+    hs.connection_id = htonl(c->connection_id);
+    for (int attempt = 0; attempt < 20; attempt++) {
+        sendto(c->udp_fd, &hs, sizeof(hs), 0, (const struct sockaddr*)server_udp, sizeof(*server_udp));
+        uint32_t value;
+        if (client_wait_message(c, SERVER_HANDSHAKE_END, &value, 100) == 0) return 0;
+    }
+
+    fprintf(stderr, "UDP handshake failed for connection %u\n", c->connection_id);
+    return -1;
+}
+
+static void client_close(Client* c) {
+    if (c->tcp_fd >= 0) close(c->tcp_fd);
+    if (c->udp_fd >= 0) close(c->udp_fd);
+}
+
+// Отчет о приеме за интервал; пропуски номеров считаются потерями
+static void client_send_report(Client* c) {
+    if (c->report_packets < 2 || c->report_last_us <= c->report_first_us) return;
+
+    uint8_t message[1 + sizeof(ReceiverReportPayload)];
+    ReceiverReportPayload report = {
+        .packets_expected = htonl(c->report_highest_number - c->report_first_number + 1),
+        .packets_received = htonl(c->report_packets),
+        .bytes_received = htonl(c->report_bytes),
+        .interval_ms = htonl((uint32_t)((c->report_last_us - c->report_first_us) / 1000 + 1)),
+    };
+    message[0] = CLIENT_RECEIVER_REPORT;
+    memcpy(message + 1, &report, sizeof(report));
+    if (write(c->tcp_fd, message, sizeof(message)) != (ssize_t)sizeof(message)) {
+        perror("write report");
+    }
+    c->report_packets = 0;
+    c->report_bytes = 0;
+}
+
+// Серия одинаковых датаграмм одним sendmsg с UDP_SEGMENT - на приеме сервер видит ее
+// одним буфером UDP GRO
+static int publisher_send_burst(int fd, struct iovec* iov, int count, uint16_t segment_size) {
+    union {
+        char buf[CMSG_SPACE(sizeof(uint16_t))];
+        struct cmsghdr align;
+    } control;
+    memset(&control, 0, sizeof(control));
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = &g_server_udp;
+    msg.msg_namelen = sizeof(g_server_udp);
+    msg.msg_iov = iov;
+    msg.msg_iovlen = (size_t)count;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_UDP;
+    cmsg->cmsg_type = UDP_SEGMENT;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+    memcpy(CMSG_DATA(cmsg), &segment_size, sizeof(uint16_t));
+
+    return sendmsg(fd, &msg, 0) < 0 ? -1 : 0;
+}
+
+// ==================== ИЗМЕРЕНИЕ ====================
+
+static void client_handle_packet(Client* c, uint32_t stream_id, const uint8_t* buffer, ssize_t n) {
+    if (n < (ssize_t)UDP_HEADER_SIZE) return;
+
+    const UDPStreamPacket* packet = (const UDPStreamPacket*)buffer;
+    uint32_t raw_id = ntohl(packet->stream_id);
+    if ((raw_id & UDP_STREAM_ID_MASK) != stream_id) return;
+    uint32_t number = ntohl(packet->packet_number);
+
+    // Потерянный "в сети" пакет до зрителя не доходит
+    if (c->loss_percent > 0 && rand() % 100 < c->loss_percent) return;
+
+    c->packets_received++;
+
+    uint64_t now = monotonic_us();
+    if (c->report_packets == 0) {
+        c->report_first_number = number;
+        c->report_highest_number = number;
+        c->report_first_us = now;
+    }
+    if (number > c->report_highest_number) c->report_highest_number = number;
+    c->report_packets++;
+    c->report_bytes += (uint32_t)n;
+    c->report_last_us = now;
+
+    bool keyframe = (raw_id & UDP_STREAM_EXT_BIT) &&
+                    n >= (ssize_t)(UDP_HEADER_SIZE + sizeof(UDPStreamExtHeader)) &&
+                    (((const UDPStreamExtHeader*)packet->data)->flags & UDP_EXT_FLAG_KEYFRAME);
+    if (keyframe && c->joined && c->first_frame_us == 0) {
+        c->first_frame_us = monotonic_us();
+    }
+}
+
+// Связка от сервера (--bundle-window): записи {длина; пакет} подряд
+static void client_drain_udp(Client* c, uint32_t stream_id) {
+    uint8_t buffer[UDP_PACKET_SIZE];
+    for (;;) {
+        ssize_t n = recv(c->udp_fd, buffer, sizeof(buffer), 0);
+        if (n < (ssize_t)UDP_BUNDLE_HEADER_SIZE) return;
+
+        uint32_t marker;
+        memcpy(&marker, buffer, sizeof(marker));
+        if (ntohl(marker) != UDP_BUNDLE_MARKER) {
+            client_handle_packet(c, stream_id, buffer, n);
+            continue;
+        }
+
+        c->bundles_received++;
+        ssize_t offset = UDP_BUNDLE_HEADER_SIZE;
+        while (offset + (ssize_t)UDP_BUNDLE_ENTRY_HEADER <= n) {
+            uint16_t len;
+            memcpy(&len, buffer + offset, sizeof(len));
+            offset += UDP_BUNDLE_ENTRY_HEADER;
+            if (offset + ntohs(len) > n) break;
+            client_handle_packet(c, stream_id, buffer + offset, ntohs(len));
+            offset += ntohs(len);
+        }
+    }
+}
+
+static int compare_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static void usage(const char* name) {
+    printf("Usage: %s [options]\n", name);
+    printf("  --host ADDR          server address (127.0.0.1)\n");
+    printf("  --tcp-port N         server TCP port (23230)\n");
+    printf("  --udp-port N         server UDP port (23231)\n");
+    printf("  --viewer-tcp-port N  viewers join another node, e.g. one with --trunk (same as --tcp-port)\n");
+    printf("  --viewer-udp-port N  UDP port of the viewers' node (same as --udp-port)\n");
+    printf("  --viewers N          number of viewers (3)\n");
+    printf("  --rate N             publisher packets per second (500)\n");
+    printf("  --gop N              packets between keyframes (250)\n");
+    printf("  --payload N          payload bytes per packet (1000)\n");
+    printf("  --join-interval MS   delay between viewer joins (700)\n");
+    printf("  --duration MS        total run time (5000)\n");
+    printf("  --burst N            publisher packets per UDP GSO send, 1 = plain sendto (1)\n");
+    printf("  --report-interval MS viewers send receiver reports, 0 = off (0)\n");
+    printf("  --slow-loss PCT      simulated downlink loss of the last viewer (0)\n");
+    printf("  --droppable          mark every other non-keyframe packet droppable\n");
+}
+
+int main(int argc, char* argv[]) {
+    Options opt = {
+        .host = "127.0.0.1", .tcp_port = 23230, .udp_port = 23231,
+        .viewers = 3, .rate = 500, .gop = 250, .payload = 1000,
+        .join_interval_ms = 700, .duration_ms = 5000, .burst = 1,
+        .report_interval_ms = 0, .slow_loss = 0, .droppable = false,
+    };
+
+    static const struct option long_options[] = {
+        {"host", required_argument, 0, 'h'},
+        {"tcp-port", required_argument, 0, 't'},
+        {"udp-port", required_argument, 0, 'u'},
+        {"viewer-tcp-port", required_argument, 0, 'T'},
+        {"viewer-udp-port", required_argument, 0, 'U'},
+        {"viewers", required_argument, 0, 'v'},
+        {"rate", required_argument, 0, 'r'},
+        {"gop", required_argument, 0, 'g'},
+        {"payload", required_argument, 0, 'p'},
+        {"join-interval", required_argument, 0, 'j'},
+        {"duration", required_argument, 0, 'd'},
+        {"burst", required_argument, 0, 'b'},
+        {"report-interval", required_argument, 0, 'R'},
+        {"slow-loss", required_argument, 0, 'L'},
+        {"droppable", no_argument, 0, 'D'},
+        {"help", no_argument, 0, '?'},
+        {0, 0, 0, 0}
+    };
+
+    int ch;
+    while ((ch = getopt_long(argc, argv, "", long_options, NULL)) != -1) {
+        switch (ch) {
+            case 'h': opt.host = optarg; break;
+            case 't': opt.tcp_port = atoi(optarg); break;
+            case 'u': opt.udp_port = atoi(optarg); break;
+            case 'T': opt.viewer_tcp_port = atoi(optarg); break;
+            case 'U': opt.viewer_udp_port = atoi(optarg); break;
+            case 'v': opt.viewers = atoi(optarg); break;
+            case 'r': opt.rate = atoi(optarg); break;
+            case 'g': opt.gop = atoi(optarg); break;
+            case 'p': opt.payload = atoi(optarg); break;
+            case 'j': opt.join_interval_ms = atoi(optarg); break;
+            case 'd': opt.duration_ms = atoi(optarg); break;
+            case 'b': opt.burst = atoi(optarg); break;
+            case 'R': opt.report_interval_ms = atoi(optarg); break;
+            case 'L': opt.slow_loss = atoi(optarg); break;
+            case 'D': opt.droppable = true; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+
+    if (opt.viewers < 1 || opt.viewers > LOADGEN_MAX_VIEWERS || opt.rate < 1 || opt.gop < 1 ||
+        opt.payload < (int)sizeof(UDPStreamExtHeader) || opt.payload > (int)UDP_DATA_SIZE ||
+        opt.burst < 1 || opt.burst > LOADGEN_MAX_BURST || opt.report_interval_ms < 0 ||
+        opt.slow_loss < 0 || opt.slow_loss > 100) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    memset(&g_server_udp, 0, sizeof(g_server_udp));
+    g_server_udp.sin_family = AF_INET;
+    g_server_udp.sin_port = htons(opt.udp_port);
+    inet_pton(AF_INET, opt.host, &g_server_udp.sin_addr);
+    if (opt.viewer_tcp_port == 0) opt.viewer_tcp_port = opt.tcp_port;
+    g_viewer_udp = g_server_udp;
+    if (opt.viewer_udp_port != 0) g_viewer_udp.sin_port = htons(opt.viewer_udp_port);
+
+    // Издатель
+    Client publisher;
+    if (client_connect(&publisher, &opt, opt.tcp_port, &g_server_udp) != 0) return 1;
+
+    uint32_t stream_id = 0;
+    uint8_t create[1 + sizeof(StreamCreatePayload)];
+    memset(create, 0, sizeof(create));
+    create[0] = CLIENT_STREAM_CREATE;
+    if (write(publisher.tcp_fd, create, sizeof(create)) != (ssize_t)sizeof(create)) {
+        fprintf(stderr, "Failed to send stream create\n");
+        return 1;
+    }
+    if (client_wait_message(&publisher, SERVER_STREAM_CREATED, &stream_id, 2000) != 0) {
+        fprintf(stderr, "Failed to create stream\n");
+        return 1;
+    }
+    printf("Publisher %u created stream %u\n", publisher.connection_id, stream_id);
+
+    static Client viewers[LOADGEN_MAX_VIEWERS];
+    for (int i = 0; i < opt.viewers; i++) {
+        if (client_connect(&viewers[i], &opt, opt.viewer_tcp_port, &g_viewer_udp) != 0) return 1;
+    }
+    viewers[opt.viewers - 1].loss_percent = opt.slow_loss;
+
+    static UDPStreamPacket packets[LOADGEN_MAX_BURST];
+    memset(packets, 0, sizeof(packets));
+    struct iovec burst_iov[LOADGEN_MAX_BURST];
+    int burst_count = 0;
+    size_t packet_len = UDP_HEADER_SIZE + (size_t)opt.payload;
+
+    uint64_t start_us = monotonic_us();
+    uint64_t interval_us = 1000000ull / (uint64_t)opt.rate;
+    uint64_t next_send_us = start_us;
+    uint32_t sequence = 0;
+    int next_viewer = 0;
+    uint64_t next_join_us = start_us + 200000ull;  // даем издателю разогнаться
+
+    while (monotonic_us() - start_us < (uint64_t)opt.duration_ms * 1000ull) {
+        uint64_t now = monotonic_us();
+
+        // Пакеты издателя по расписанию; при --burst копятся и уходят одной серией
+        while (next_send_us <= now) {
+            bool keyframe = sequence % (uint32_t)opt.gop == 0;
+            UDPStreamExtHeader ext = { .flags = keyframe ? UDP_EXT_FLAG_KEYFRAME : 0 };
+            if (!keyframe && opt.droppable && (sequence & 1)) ext.flags |= UDP_EXT_FLAG_DROPPABLE;
+            UDPStreamPacket* packet = &packets[burst_count];
+            packet->call_id = htonl(0);
+            packet->stream_id = htonl(stream_id | UDP_STREAM_EXT_BIT);
+            packet->packet_number = htonl(sequence++);
+            memcpy(packet->data, &ext, sizeof(ext));
+            burst_iov[burst_count].iov_base = packet;
+            burst_iov[burst_count].iov_len = packet_len;
+            burst_count++;
+            next_send_us += interval_us;
+
+            if (burst_count == opt.burst) {
+                if (burst_count == 1) {
+                    sendto(publisher.udp_fd, packet, packet_len, 0,
+                           (struct sockaddr*)&g_server_udp, sizeof(g_server_udp));
+                } else if (publisher_send_burst(publisher.udp_fd, burst_iov, burst_count,
+                                                (uint16_t)packet_len) != 0) {
+                    perror("sendmsg UDP_SEGMENT");
+                }
+                burst_count = 0;
+            }
+        }
+
+        // Подключение очередного зрителя
+        if (next_viewer < opt.viewers && now >= next_join_us) {
+            Client* v = &viewers[next_viewer++];
+            v->join_sent_us = monotonic_us();
+            v->joined = true;
+            client_send(v, CLIENT_STREAM_CONN_JOIN, stream_id);
+            next_join_us = now + (uint64_t)opt.join_interval_ms * 1000ull;
+        }
+
+        // Прием у зрителей; TCP сообщения просто вычитываем
+        for (int i = 0; i < opt.viewers; i++) {
+            client_drain_udp(&viewers[i], stream_id);
+            if (opt.report_interval_ms > 0 && viewers[i].joined && now >= viewers[i].next_report_us) {
+                client_send_report(&viewers[i]);
+                viewers[i].next_report_us = now + (uint64_t)opt.report_interval_ms * 1000ull;
+            }
+            uint8_t type;
+            uint32_t value;
+            while (client_poll_message(&viewers[i], &type, &value, 0) == 1) {}
+        }
+        uint8_t type;
+        uint32_t value;
+        while (client_poll_message(&publisher, &type, &value, 0) == 1) {}
+
+        usleep(200);
+    }
+
+    // Отчет
+    uint64_t ttff[LOADGEN_MAX_VIEWERS];
+    int measured = 0;
+    printf("\nviewer  packets  bundles  ttff_ms\n");
+    for (int i = 0; i < opt.viewers; i++) {
+        Client* v = &viewers[i];
+        if (v->first_frame_us) {
+            ttff[measured++] = v->first_frame_us - v->join_sent_us;
+            printf("%6u  %7lu  %7lu  %7.2f\n", v->connection_id, (unsigned long)v->packets_received,
+                   (unsigned long)v->bundles_received, (v->first_frame_us - v->join_sent_us) / 1000.0);
+        } else {
+            printf("%6u  %7lu  %7lu  %7s\n", v->connection_id, (unsigned long)v->packets_received,
+                   (unsigned long)v->bundles_received, "-");
+        }
+    }
+
+    if (measured > 0) {
+        qsort(ttff, (size_t)measured, sizeof(ttff[0]), compare_u64);
+        uint64_t sum = 0;
+        for (int i = 0; i < measured; i++) sum += ttff[i];
+        printf("\nTTFF: min %.2f ms, median %.2f ms, avg %.2f ms, max %.2f ms (%d/%d viewers)\n",
+               ttff[0] / 1000.0, ttff[measured / 2] / 1000.0,
+               (double)sum / measured / 1000.0, ttff[measured - 1] / 1000.0,
+               measured, opt.viewers);
+    } else {
+        printf("\nTTFF: no viewer received a keyframe\n");
+    }
+
+    for (int i = 0; i < opt.viewers; i++) client_close(&viewers[i]);
+    client_close(&publisher);
+    return measured == opt.viewers ? 0 : 1;
+}
@@ -0,0 +1,122 @@
+// Бенчмарк ядер микшера звонков: скалярное сложение с насыщением против SSE2 и AVX2,
+// плюс полный кадр "все, кроме себя" для звонка из --sources источников.
+// Утилиты с сервером не линкуются, поэтому ядра берутся прямо из исходника микшера.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+
+#include "mixer.c"
+
+typedef struct {
+    int frames;
+    int sources;
+} Options;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void usage(const char* prog) {
+    printf("Usage: %s [options]\n", prog);
+    printf("  --frames N    frames per measurement (200000)\n");
+    printf("  --sources N   mixed sources per call frame, up to %d (%d)\n", MIX_MAX_SOURCES, 4);
+}
+
+static volatile int16_t sink;
+
+static void bench_kernel(const char* name, MixAddFn kernel, int frames) {
+    static AudioFrame acc, src;
+    for (int i = 0; i < MIX_FRAME_SAMPLES; i++) {
+        acc.samples[i] = (int16_t)(rand() % 2000 - 1000);
+        src.samples[i] = (int16_t)(rand() % 65536 - 32768);
+    }
+
+    double start = now_sec();
+    for (int f = 0; f < frames; f++) {
+        kernel(acc.samples, src.samples, MIX_FRAME_SAMPLES);
+        src.samples[f % MIX_FRAME_SAMPLES] ^= 1;  // не даем компилятору вынести цикл
+    }
+    double elapsed = now_sec() - start;
+    sink = acc.samples[0];
+
+    double ns_per_frame = elapsed * 1e9 / frames;
+    printf("%-8s %8.1f ns/frame %8.2f samples/ns\n", name, ns_per_frame, MIX_FRAME_SAMPLES / ns_per_frame);
+}
+
+static void bench_mix_minus(const char* name, MixAddFn kernel, int frames, int count) {
+    static AudioFrame inputs[MIX_MAX_SOURCES], everyone, minus[MIX_MAX_SOURCES];
+    const AudioFrame* sources[MIX_MAX_SOURCES];
+    for (int s = 0; s < count; s++) {
+        for (int i = 0; i < MIX_FRAME_SAMPLES; i++) {
+            inputs[s].samples[i] = (int16_t)(rand() % 16000 - 8000);
+        }
+        sources[s] = &inputs[s];
+    }
+
+    mix_add_s16 = kernel;
+    double start = now_sec();
+    for (int f = 0; f < frames; f++) {
+        mixer_mix_minus(sources, count, &everyone, minus);
+        inputs[0].samples[f % MIX_FRAME_SAMPLES] ^= 1;
+    }
+    double elapsed = now_sec() - start;
+    sink = everyone.samples[0];
+
+    // Один кадр микса на звонок каждые MIX_FRAME_MS: сколько звонков выдержит одно ядро
+    double us_per_frame = elapsed * 1e6 / frames;
+    printf("%-8s %8.2f us/call frame, ~%.0f calls per core\n", name, us_per_frame,
+           MIX_FRAME_MS * 1000.0 / us_per_frame);
+}
+
+int main(int argc, char** argv) {
+    Options opt = {200000, 4};
+
+    static struct option long_options[] = {
+        {"frames", required_argument, 0, 'f'},
+        {"sources", required_argument, 0, 's'},
+        {"help", no_argument, 0, 'h'},
+        {0, 0, 0, 0}
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "", long_options, NULL)) != -1) {
+        switch (c) {
+            case 'f': opt.frames = atoi(optarg); break;
+            case 's': opt.sources = atoi(optarg); break;
+            case 'h': usage(argv[0]); return 0;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (opt.frames <= 0 || opt.sources <= 0 || opt.sources > MIX_MAX_SOURCES) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    mixer_init();
+    printf("Frame: %d samples (%d ms at %d Hz), selected kernel: %s\n\n",
+           MIX_FRAME_SAMPLES, MIX_FRAME_MS, MIX_SAMPLE_RATE, mixer_kernel_name());
+
+    printf("Saturating add, one frame:\n");
+    bench_kernel("scalar", mix_add_s16_scalar, opt.frames);
+#if defined(__x86_64__) || defined(__i386__)
+    bench_kernel("sse2", mix_add_s16_sse2, opt.frames);
+    if (__builtin_cpu_supports("avx2")) {
+        bench_kernel("avx2", mix_add_s16_avx2, opt.frames);
+    }
+#endif
+
+    printf("\nMix-minus for %d sources (%d participant streams):\n", opt.sources, opt.sources + 1);
+    bench_mix_minus("scalar", mix_add_s16_scalar, opt.frames / 4, opt.sources);
+#if defined(__x86_64__) || defined(__i386__)
+    bench_mix_minus("sse2", mix_add_s16_sse2, opt.frames / 4, opt.sources);
+    if (__builtin_cpu_supports("avx2")) {
+        bench_mix_minus("avx2", mix_add_s16_avx2, opt.frames / 4, opt.sources);
+    }
+#endif
+    return 0;
+}
@@ -0,0 +1,443 @@
+#include "trunk.h"
+#include "protocol.h"
+#include "network.h"
+#include "buffer_logic.h"
+#include "time_utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+
+static bool enabled = false;
+static TrunkState state = TRUNK_DOWN;
+static struct sockaddr_in origin_tcp_addr;
+static struct sockaddr_in origin_udp_addr;
+static int trunk_epoll_fd = -1;
+static int trunk_udp_fd = -1;
+static int sock_fd = -1;
+
+static uint32_t connection_id = 0;    // из SERVER_HANDSHAKE_START источника
+static bool have_connection_id = false;
+static uint64_t next_connect_ms = 0;
+static uint64_t next_handshake_ms = 0;
+
+static uint8_t rx[TRUNK_RX_BUFFER];
+static size_t rx_len = 0;
+
+// Формат сообщений: свои пишем с длиной сразу после CLIENT_FRAMING, чужие читаем так после SERVER_FRAMING
+static uint8_t tx_framing = FRAMING_LEGACY;
+static uint8_t rx_framing = FRAMING_LEGACY;
+
+// Отправленные JOIN по порядку: источник отвечает JOINED или ERROR в том же порядке
+static uint32_t pending_joins[TRUNK_MAX_PENDING];
+static uint32_t pending_head = 0;
+static uint32_t pending_tail = 0;
+
+static TrunkSubscription* subscriptions = NULL;
+static TrunkStats stats;
+
+const char* trunk_state_name(TrunkState s) {
+    switch (s) {
+        case TRUNK_DOWN: return "down";
+        case TRUNK_CONNECTING: return "connecting";
+        case TRUNK_HANDSHAKE: return "handshake";
+        case TRUNK_UP: return "up";
+    }
+    return "unknown";
+}
+
+static TrunkSubscription* trunk_find(uint32_t stream_id) {
+    TrunkSubscription* sub = NULL;
+    HASH_FIND(hh, subscriptions, &stream_id, sizeof(stream_id), sub);
+    return sub;
+}
+
+// ==================== СОКЕТ МАГИСТРАЛИ ====================
+
+static void trunk_disconnect(uint64_t now_ms, const char* reason) {
+    if (sock_fd >= 0) {
+        if (trunk_epoll_fd >= 0) epoll_ctl(trunk_epoll_fd, EPOLL_CTL_DEL, sock_fd, NULL);
+        close(sock_fd);
+        sock_fd = -1;
+        stats.disconnects++;
+        printf("Trunk to origin %s:%d lost: %s\n", inet_ntoa(origin_tcp_addr.sin_addr),
+               ntohs(origin_tcp_addr.sin_port), reason);
+    }
+
+    state = TRUNK_DOWN;
+    have_connection_id = false;
+    rx_len = 0;
+    tx_framing = rx_framing = FRAMING_LEGACY;
+    pending_head = pending_tail = 0;
+    next_connect_ms = now_ms + TRUNK_RECONNECT_MS;
+
+    // Зеркала остаются: после переподключения подписки отправятся заново
+    TrunkSubscription* sub, *tmp;
+    HASH_ITER(hh, subscriptions, sub, tmp) {
+        sub->state = TRUNK_SUB_WAITING;
+    }
+}
+
+static int trunk_send_message(uint8_t message_type, const void* payload, size_t payload_len) {
+    if (sock_fd < 0) return -1;
+
+    uint8_t message[FRAMING_HEADER_SIZE + 1 + sizeof(StreamIDPayload)];
+    size_t len = 0;
+    if (tx_framing == FRAMING_LENGTH_PREFIXED) {
+        message[len++] = (uint8_t)((1 + payload_len) >> 8);
+        message[len++] = (uint8_t)(1 + payload_len);
+    }
+    message[len++] = message_type;
+    memcpy(message + len, payload, payload_len);
+    len += payload_len;
+
+    // Сообщения в несколько байт: буфер сокета не заполняется, неполная запись - обрыв
+    ssize_t sent = send(sock_fd, message, len, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (sent != (ssize_t)len) {
+        trunk_disconnect(monotonic_ms(), sent < 0 ? strerror(errno) : "partial write");
+        return -1;
+    }
+    return 0;
+}
+
+static int trunk_send(uint8_t message_type, uint32_t stream_id) {
+    StreamIDPayload payload = { .stream_id = htonl(stream_id) };
+    return trunk_send_message(message_type, &payload, sizeof(payload));
+}
+
+static void trunk_send_handshake(uint64_t now_ms) {
+    UDPHandshakePacket packet;
+    memset(&packet, 0, sizeof(packet));
+    packet.connection_id = htonl(connection_id);
+    udp_send_packet(trunk_udp_fd, &packet, sizeof(packet), &origin_udp_addr);
+    next_handshake_ms = now_ms + TRUNK_HANDSHAKE_RETRY_MS;
+}
+
+// Подписки, ждущие готовности магистрали (или места в очереди ответов)
+static void trunk_send_joins(void) {
+    TrunkSubscription* sub, *tmp;
+    HASH_ITER(hh, subscriptions, sub, tmp) {
+        if (state != TRUNK_UP) return;
+        if (sub->state != TRUNK_SUB_WAITING) continue;
+        if (pending_tail - pending_head >= TRUNK_MAX_PENDING) return;
+
+        if (trunk_send(CLIENT_STREAM_CONN_JOIN, sub->stream_id) != 0) return;
+        pending_joins[pending_tail++ & (TRUNK_MAX_PENDING - 1)] = sub->stream_id;
+        sub->state = TRUNK_SUB_PENDING;
+        stats.joins++;
+    }
+}
+
+static void trunk_on_connected(void) {
+    state = TRUNK_HANDSHAKE;
+    if (trunk_epoll_fd >= 0) {
+        epoll_modify(trunk_epoll_fd, sock_fd, EPOLLIN);
+    }
+    printf("Trunk connected to origin %s:%d, waiting for handshake\n",
+           inet_ntoa(origin_tcp_addr.sin_addr), ntohs(origin_tcp_addr.sin_port));
+
+    // Сообщения с длиной: источник, понимающий CLIENT_FRAMING, поддерживает эту версию,
+    // поэтому следующие сообщения сразу идут в ней
+    FramingPayload framing = { .version = FRAMING_LENGTH_PREFIXED };
+    if (trunk_send_message(CLIENT_FRAMING, &framing, sizeof(framing)) == 0) {
+        tx_framing = FRAMING_LENGTH_PREFIXED;
+    }
+}
+
+static void trunk_connect(uint64_t now_ms) {
+    sock_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sock_fd < 0) {
+        perror("trunk socket");
+        next_connect_ms = now_ms + TRUNK_RECONNECT_MS;
+        return;
+    }
+    int yes = 1;
+    setsockopt(sock_fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
+    if (connect(sock_fd, (const struct sockaddr*)&origin_tcp_addr, sizeof(origin_tcp_addr)) != 0 &&
+        errno != EINPROGRESS) {
+        close(sock_fd);
+        sock_fd = -1;
+        next_connect_ms = now_ms + TRUNK_RECONNECT_MS;
+        return;
+    }
+
+    // Завершение connect придет как EPOLLOUT
+    state = TRUNK_CONNECTING;
+    if (trunk_epoll_fd >= 0) {
+        epoll_add(trunk_epoll_fd, sock_fd, EPOLLOUT);
+    }
+}
+
+// ==================== СООБЩЕНИЯ ИСТОЧНИКА ====================
+
+// Подписка больше не нужна или невозможна: зрители узнают об этом как об удалении стрима
+static void trunk_drop(TrunkSubscription* sub) {
+    if (sub->stream) {
+        send_stream_deleted(sub->stream);
+        stream_delete(sub->stream);
+    }
+    HASH_DEL(subscriptions, sub);
+    free(sub);
+}
+
+static void trunk_handle_message(uint8_t message_type, const uint8_t* payload, size_t payload_len, uint64_t now_ms) {
+    uint32_t value = 0;
+    if (payload_len >= sizeof(uint32_t)) {
+        memcpy(&value, payload, sizeof(value));
+        value = ntohl(value);
+    }
+
+    switch (message_type) {
+        case SERVER_FRAMING:
+            if (payload_len >= sizeof(FramingPayload)) rx_framing = payload[0];
+            break;
+
+        case SERVER_HANDSHAKE_START:
+            connection_id = value;
+            have_connection_id = true;
+            trunk_send_handshake(now_ms);
+            break;
+
+        case SERVER_HANDSHAKE_END:
+            if (state != TRUNK_HANDSHAKE) break;
+            state = TRUNK_UP;
+            printf("Trunk to origin %s:%d is up (connection %u)\n",
+                   inet_ntoa(origin_tcp_addr.sin_addr), ntohs(origin_tcp_addr.sin_port), connection_id);
+            trunk_send_joins();
+            break;
+
+        case SERVER_STREAM_CONN_JOINED: {
+            if (pending_head != pending_tail) pending_head++;
+            TrunkSubscription* sub = trunk_find(value);
+            if (sub && sub->state == TRUNK_SUB_PENDING) {
+                sub->state = TRUNK_SUB_ACTIVE;
+                printf("Trunk subscribed to origin stream %u\n", value);
+            }
+            trunk_send_joins();
+            break;
+        }
+
+        case SERVER_ERROR: {
+            if (payload_len < sizeof(ErrorSuccessPayload)) break;
+            const ErrorSuccessPayload* error = (const ErrorSuccessPayload*)payload;
+            if (error->original_message_type != CLIENT_STREAM_CONN_JOIN || pending_head == pending_tail) break;
+
+            uint32_t stream_id = pending_joins[pending_head++ & (TRUNK_MAX_PENDING - 1)];
+            // Длине текста из заголовка не верим дальше границ кадра
+            size_t text_len = payload_len - sizeof(*error);
+            if (error->message_length < text_len) text_len = error->message_length;
+            printf("Trunk: origin refused stream %u: %.*s\n", stream_id, (int)text_len,
+                   (const char*)(error + 1));
+            TrunkSubscription* sub = trunk_find(stream_id);
+            if (sub && sub->state == TRUNK_SUB_PENDING) {
+                stats.join_failures++;
+                trunk_drop(sub);
+            }
+            trunk_send_joins();
+            break;
+        }
+
+        case SERVER_STREAM_DELETED: {
+            TrunkSubscription* sub = trunk_find(value);
+            if (sub) {
+                printf("Trunk: origin deleted stream %u\n", value);
+                trunk_drop(sub);
+            }
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+static void trunk_read(uint64_t now_ms) {
+    for (;;) {
+        ssize_t n = recv(sock_fd, rx + rx_len, sizeof(rx) - rx_len, MSG_DONTWAIT);
+        if (n == 0) {
+            trunk_disconnect(now_ms, "closed by origin");
+            return;
+        }
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) trunk_disconnect(now_ms, strerror(errno));
+            return;
+        }
+        rx_len += (size_t)n;
+
+        size_t offset = 0;
+        ProtocolFrame frame;
+        int result;
+        while ((result = buffer_protocol_next_frame(rx + offset, (uint32_t)(rx_len - offset), rx_framing, &frame)) == 1) {
+            trunk_handle_message(frame.type, frame.payload, frame.payload_len, now_ms);
+            if (sock_fd < 0) return;  // обработчик разорвал магистраль
+            offset += frame.frame_len;
+        }
+        if (result < 0) {
+            trunk_disconnect(now_ms, "unparsable message");
+            return;
+        }
+        memmove(rx, rx + offset, rx_len - offset);
+        rx_len -= offset;
+    }
+}
+
+// ==================== ПУБЛИЧНЫЕ ФУНКЦИИ ====================
+
+int trunk_start(const struct sockaddr_in* origin_tcp, const struct sockaddr_in* origin_udp,
+                int epoll_fd, int udp_fd) {
+    if (enabled || !origin_tcp || !origin_udp || udp_fd < 0) return -1;
+
+    origin_tcp_addr = *origin_tcp;
+    origin_udp_addr = *origin_udp;
+    trunk_epoll_fd = epoll_fd;
+    trunk_udp_fd = udp_fd;
+    memset(&stats, 0, sizeof(stats));
+    enabled = true;
+
+    trunk_connect(monotonic_ms());
+    return 0;
+}
+
+void trunk_stop(void) {
+    if (!enabled) return;
+
+    if (sock_fd >= 0) {
+        if (trunk_epoll_fd >= 0) epoll_ctl(trunk_epoll_fd, EPOLL_CTL_DEL, sock_fd, NULL);
+        close(sock_fd);
+        sock_fd = -1;
+    }
+
+    TrunkSubscription* sub, *tmp;
+    HASH_ITER(hh, subscriptions, sub, tmp) {
+        stream_delete(sub->stream);
+        HASH_DEL(subscriptions, sub);
+        free(sub);
+    }
+
+    state = TRUNK_DOWN;
+    have_connection_id = false;
+    rx_len = 0;
+    pending_head = pending_tail = 0;
+    trunk_epoll_fd = -1;
+    trunk_udp_fd = -1;
+    enabled = false;
+}
+
+bool trunk_enabled(void) {
+    return enabled;
+}
+
+int trunk_fd(void) {
+    return sock_fd;
+}
+
+void trunk_on_event(uint32_t events) {
+    if (sock_fd < 0) return;
+    uint64_t now_ms = monotonic_ms();
+
+    if (state == TRUNK_CONNECTING) {
+        if (!(events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) return;
+
+        int error = 0;
+        socklen_t error_len = sizeof(error);
+        if (getsockopt(sock_fd, SOL_SOCKET, SO_ERROR, &error, &error_len) != 0 || error != 0) {
+            if (trunk_epoll_fd >= 0) epoll_ctl(trunk_epoll_fd, EPOLL_CTL_DEL, sock_fd, NULL);
+            close(sock_fd);
+            sock_fd = -1;
+            state = TRUNK_DOWN;
+            next_connect_ms = now_ms + TRUNK_RECONNECT_MS;
+            return;
+        }
+        trunk_on_connected();
+        return;
+    }
+
+    if (events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+        trunk_read(now_ms);
+    }
+}
+
+void trunk_tick(uint64_t now_ms) {
+    if (!enabled) return;
+
+    if (state == TRUNK_DOWN && now_ms >= next_connect_ms) {
+        trunk_connect(now_ms);
+    }
+
+    // UDP handshake теряется - повторяем, пока не придет SERVER_HANDSHAKE_END
+    if (state == TRUNK_HANDSHAKE && have_connection_id && now_ms >= next_handshake_ms) {
+        trunk_send_handshake(now_ms);
+    }
+
+    // Зеркала без зрителей: подписка снимается после паузы (зритель может сразу вернуться)
+    TrunkSubscription* sub, *tmp;
+    HASH_ITER(hh, subscriptions, sub, tmp) {
+        if (stream_get_recipient_count(sub->stream) > 0) {
+            sub->idle_since_ms = 0;
+            continue;
+        }
+        if (sub->idle_since_ms == 0) {
+            sub->idle_since_ms = now_ms;
+            continue;
+        }
+        // Ответ на JOIN еще в пути - снимем после него
+        if (sub->state == TRUNK_SUB_PENDING || now_ms - sub->idle_since_ms < TRUNK_LINGER_MS) continue;
+
+        if (sub->state == TRUNK_SUB_ACTIVE && state == TRUNK_UP) {
+            trunk_send(CLIENT_STREAM_CONN_LEAVE, sub->stream_id);
+            stats.leaves++;
+        }
+        printf("Trunk: released idle stream %u\n", sub->stream_id);
+        stream_delete(sub->stream);
+        HASH_DEL(subscriptions, sub);
+        free(sub);
+    }
+}
+
+Stream* trunk_subscribe(uint32_t stream_id) {
+    if (!enabled) return NULL;
+
+    TrunkSubscription* sub = trunk_find(stream_id);
+    if (sub) return sub->stream;
+
+    Stream* stream = stream_new_relayed(stream_id);
+    if (!stream) return NULL;
+
+    sub = calloc(1, sizeof(TrunkSubscription));
+    if (!sub) {
+        stream_delete(stream);
+        return NULL;
+    }
+    sub->stream_id = stream_id;
+    sub->stream = stream;
+    sub->state = TRUNK_SUB_WAITING;
+    HASH_ADD(hh, subscriptions, stream_id, sizeof(sub->stream_id), sub);
+
+    trunk_send_joins();
+    return stream;
+}
+
+void trunk_account(Stream* stream, uint32_t sends) {
+    if (!stream || !stream->relayed) return;
+    stats.packets++;
+    stats.sends += sends;
+}
+
+TrunkStats trunk_stats(void) {
+    TrunkStats result = stats;
+    result.state = state;
+    result.subscriptions = HASH_COUNT(subscriptions);
+    result.active = 0;
+
+    TrunkSubscription* sub, *tmp;
+    HASH_ITER(hh, subscriptions, sub, tmp) {
+        if (sub->state == TRUNK_SUB_ACTIVE) result.active++;
+    }
+    return result;
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <netinet/in.h>
+#include "uthash.h"
+#include "stream.h"
+
+// Магистраль к узлу-источнику (каскад серверов): этот узел подключается к источнику
+// как обычный клиент (TCP + UDP handshake со своего UDP-сокета) и подписывается
+// на стрим один раз, когда его впервые запрашивает локальный зритель. Источник шлет
+// узлу одну копию пакета, узел раздает ее своим зрителям через зеркало стрима.
+// Зеркало без зрителей живет TRUNK_LINGER_MS, потом подписка снимается.
+
+#ifndef TRUNK_RECONNECT_MS
+#define TRUNK_RECONNECT_MS 1000
+#endif
+
+#ifndef TRUNK_HANDSHAKE_RETRY_MS
+#define TRUNK_HANDSHAKE_RETRY_MS 100
+#endif
+
+#ifndef TRUNK_LINGER_MS
+#define TRUNK_LINGER_MS 2000
+#endif
+
+// JOIN в ожидании ответа: источник отвечает на них по порядку (степень двойки)
+#ifndef TRUNK_MAX_PENDING
+#define TRUNK_MAX_PENDING 256
+#endif
+
+// Не меньше BUFFER_SIZE: в буфер должно влезать самое длинное сообщение
+#ifndef TRUNK_RX_BUFFER
+#define TRUNK_RX_BUFFER 8192
+#endif
+
+typedef enum {
+    TRUNK_DOWN = 0,       // ждет переподключения
+    TRUNK_CONNECTING,     // неблокирующий connect
+    TRUNK_HANDSHAKE,      // TCP есть, ждем SERVER_HANDSHAKE_END
+    TRUNK_UP,
+} TrunkState;
+
+typedef enum {
+    TRUNK_SUB_WAITING = 0,  // магистраль не готова, CLIENT_STREAM_CONN_JOIN не отправлен
+    TRUNK_SUB_PENDING,      // JOIN отправлен, ждем ответа
+    TRUNK_SUB_ACTIVE,
+} TrunkSubState;
+
+typedef struct {
+    uint32_t stream_id;
+    Stream* stream;            // зеркало
+    TrunkSubState state;
+    uint64_t idle_since_ms;    // без зрителей с этого момента (0 - зрители есть)
+    UT_hash_handle hh;
+} TrunkSubscription;
+
+typedef struct {
+    TrunkState state;
+    uint32_t subscriptions;
+    uint32_t active;
+    uint64_t joins;
+    uint64_t join_failures;
+    uint64_t leaves;
+    uint64_t disconnects;
+    uint64_t packets;          // пакетов пришло по магистрали
+    uint64_t sends;            // копий локальным зрителям
+} TrunkStats;
+
+/* Жизненный цикл (epoll_fd - основной цикл, udp_fd - сокет, с которого идет UDP handshake) */
+int trunk_start(const struct sockaddr_in* origin_tcp, const struct sockaddr_in* origin_udp,
+                int epoll_fd, int udp_fd);
+void trunk_stop(void);
+bool trunk_enabled(void);
+int trunk_fd(void);
+
+// События сокета магистрали из основного цикла
+void trunk_on_event(uint32_t events);
+
+// Переподключение, повтор UDP handshake, снятие подписок без зрителей
+void trunk_tick(uint64_t now_ms);
+
+/* Подписки */
+Stream* trunk_subscribe(uint32_t stream_id);
+void trunk_account(Stream* stream, uint32_t sends);
+
+TrunkStats trunk_stats(void);
+const char* trunk_state_name(TrunkState state);